@@ -0,0 +1,109 @@
+#include "fqadstats.h"
+#include "fqkernels.h"
+
+#define FQAD_TOP 20 //adapters listed in the summary
+
+static const char* endNames[FQAD_NUM_ENDS]={ "5'", "3'" };
+
+void FqAdStats::merge(FqAdStats& s) {
+	int n=(GMIN(numAdapters, s.numAdapters)+1)*FQAD_NUM_ENDS*2;
+	for (int i=0;i<n;i++) {
+		FqAdHits& h=hits[i];
+		FqAdHits& sh=s.hits[i];
+		h.calls+=sh.calls;
+		h.hits+=sh.hits;
+		h.strong+=sh.strong;
+		if (sh.posCap>h.posCap) h.grow(sh.posCap-1);
+		for (int p=0;p<sh.posCap;p++) h.pos[p]+=sh.pos[p];
+	}
+}
+
+//the ends an adapter is aligned to
+static bool adapterEnd(CASeqData& a, int end) {
+	if (a.trim_type==galn_TrimEither) return true;
+	return (end==FQAD_END5) ? (a.trim_type==galn_TrimLeft) : (a.trim_type==galn_TrimRight);
+}
+
+struct SAdRow {
+	int fidx, end, strand;
+	uint64 hits;
+};
+
+static int cmpAdRows(const void* a, const void* b) {
+	uint64 ha=((const SAdRow*)a)->hits, hb=((const SAdRow*)b)->hits;
+	if (ha!=hb) return (ha>hb) ? -1 : 1;
+	return ((const SAdRow*)a)->fidx-((const SAdRow*)b)->fidx;
+}
+
+void FqAdStats::printSummary() {
+	int numruns=revCompl ? 2 : 1;
+	GVec<SAdRow> rows;
+	int unused=0;
+	uint64 unusedCalls=0, allCalls=0;
+	for (int i=0;i<all_adapters.Count();i++) {
+		CASeqData& a=*all_adapters[i];
+		uint64 ahits=0, acalls=0;
+		for (int e=0;e<FQAD_NUM_ENDS;e++) {
+			if (!adapterEnd(a, e)) continue;
+			for (int r=0;r<numruns;r++) {
+				FqAdHits& h=get(a.fidx, e, r);
+				ahits+=h.hits;
+				acalls+=h.calls;
+				if (h.hits==0) continue;
+				SAdRow row;
+				row.fidx=a.fidx;
+				row.end=e;
+				row.strand=r;
+				row.hits=h.hits;
+				rows.Add(row);
+			}
+		}
+		allCalls+=acalls;
+		if (ahits==0) {
+			unused++;
+			unusedCalls+=acalls;
+		}
+	}
+	if (rows.Count()>1) qsort(&rows[0], rows.Count(), sizeof(SAdRow), cmpAdRows);
+	GMessage("\n-------------- Adapter hits: ---------------\n");
+	if (rows.Count()>0)
+		GMessage("adapter end strand      hits    strong       calls  sequence\n");
+	for (int i=0;i<rows.Count() && i<FQAD_TOP;i++) {
+		SAdRow& row=rows[i];
+		FqAdHits& h=get(row.fidx, row.end, row.strand);
+		CASeqData* a=NULL;
+		for (int j=0;j<all_adapters.Count();j++)
+			if (all_adapters[j]->fidx==row.fidx) { a=all_adapters[j]; break; }
+		GMessage("%7d %3s %6c %9llu %9llu %11llu  %s\n", row.fidx, endNames[row.end],
+		    row.strand ? '-' : '+', h.hits, h.strong, h.calls,
+		    a ? (row.strand ? a->seqr.chars() : a->seq.chars()) : "");
+	}
+	if (rows.Count()>FQAD_TOP)
+		GMessage("(%d more, see the --adstats file)\n", rows.Count()-FQAD_TOP);
+	GMessage("Adapters never matched: %d of %d", unused, all_adapters.Count());
+	if (unused>0 && allCalls>0)
+		GMessage(" (%.1f%% of the %llu alignment calls)", 100.0*unusedCalls/allCalls, allCalls);
+	GMessage("\n");
+}
+
+void FqAdStats::write(FILE* f) {
+	int numruns=revCompl ? 2 : 1;
+	fprintf(f, "#ADAPTER\tfidx\tend\tstrand\tcalls\thits\tstrong\tweak\tsequence\n");
+	fprintf(f, "#POS\tfidx\tend\tstrand\tpos\thits\n");
+	for (int i=0;i<all_adapters.Count();i++) {
+		CASeqData& a=*all_adapters[i];
+		for (int e=0;e<FQAD_NUM_ENDS;e++) {
+			if (!adapterEnd(a, e)) continue;
+			for (int r=0;r<numruns;r++) {
+				FqAdHits& h=get(a.fidx, e, r);
+				char strand=r ? '-' : '+';
+				fprintf(f, "ADAPTER\t%d\t%s\t%c\t%llu\t%llu\t%llu\t%llu\t%s\n", a.fidx, endNames[e],
+				    strand, h.calls, h.hits, h.strong, h.hits-h.strong,
+				    r ? a.seqr.chars() : a.seq.chars());
+				for (int p=0;p<h.posCap;p++)
+					if (h.pos[p])
+						fprintf(f, "POS\t%d\t%s\t%c\t%d\t%llu\n", a.fidx, endNames[e], strand, p, h.pos[p]);
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef FQ_ADSTATS_H
+#define FQ_ADSTATS_H
+#include "GBase.h"
+
+// Adapter hit statistics (--adstats): for each adapter (fidx), end and strand
+// (reverse complement with -R), the number of match_adapter() calls made,
+// the alignments used for trimming (strong and weak) and a histogram of the
+// trim positions (read coordinate of the first base removed at the 3' end,
+// or of the first base kept at the 5' end). Adapters never matching still
+// cost their calls for every read: they can be pruned from the -f file.
+// Each trimming thread keeps its own stats, merged by finishFile().
+
+enum { FQAD_END5=0, FQAD_END3, FQAD_NUM_ENDS };
+
+struct FqAdHits { //one adapter, end and strand
+	uint64 calls;
+	uint64 hits;
+	uint64 strong;
+	int posCap; //histogram size
+	uint64* pos; //hits by trim position
+	FqAdHits():calls(0), hits(0), strong(0), posCap(0), pos(NULL) { }
+	~FqAdHits() { GFREE(pos); }
+	void grow(int p) { //make room for position p
+		int newcap=(p/64+1)*64;
+		GREALLOC(pos, newcap*sizeof(uint64));
+		memset(pos+posCap, 0, (newcap-posCap)*sizeof(uint64));
+		posCap=newcap;
+	}
+	void addPos(int p) {
+		if (p<0) p=0;
+		if (p>=posCap) grow(p);
+		pos[p]++;
+	}
+};
+
+class FqAdStats {
+ protected:
+	int numAdapters; //fidx is 1..numAdapters
+	FqAdHits* hits;
+ public:
+	FqAdStats(int nadapters):numAdapters(nadapters), hits(NULL) {
+		hits=new FqAdHits[(numAdapters+1)*FQAD_NUM_ENDS*2];
+	}
+	~FqAdStats() { delete[] hits; }
+	FqAdHits& get(int fidx, int end, int strand) {
+		return hits[(fidx*FQAD_NUM_ENDS+end)*2+strand];
+	}
+	void addCall(int fidx, int end, int strand) { get(fidx, end, strand).calls++; }
+	void addHit(int fidx, int end, int strand, bool strong, int pos) {
+		FqAdHits& h=get(fidx, end, strand);
+		h.hits++;
+		if (strong) h.strong++;
+		h.addPos(pos);
+	}
+	void merge(FqAdStats& s);
+	void printSummary(); //adapters by hits, and those never used (stderr)
+	void write(FILE* f); //all the counts and histograms, as TSV
+};
+
+#endif
@@ -0,0 +1,314 @@
+#include "GArgs.h"
+#include "GStr.h"
+#include "GVec.hh"
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// End-to-end throughput benchmark of fqtrim (make bench): generates the
+// synthetic input with fqgen (once, kept in the work directory), runs
+// fqtrim with a standard set of options, measuring each run in a forked
+// child (wall time, CPU time and peak RSS from wait4()), and writes the
+// results as a TSV table that can be compared with the table of another
+// build (-c).
+
+#define USAGE "fqbench: fqtrim throughput benchmark. Usage:\n\
+fqbench [-b <fqtrim>] [-g <fqgen>] [-d <workdir>] [-n <num_reads>]\\\n\
+   [-l <read_len>] [-r <repeats>] [-p <max_cpus>] [-k <case>[,..]]\\\n\
+   [-o <results.tsv>] [-c <baseline.tsv>]\n\
+\n\
+Options:\n\
+-b fqtrim binary to benchmark (default: ./fqtrim)\n\
+-g fqgen binary generating the input (default: ./fqgen)\n\
+-d work directory for the input and output files (default: bench_data)\n\
+-n number of read pairs to generate (default: 1000000)\n\
+-l read length (default: 100)\n\
+-r runs of each case, the fastest is reported (default: 3)\n\
+-p largest number of threads for the -p cases (default: number of CPUs)\n\
+-k only run the cases with these names\n\
+-o write the results to this file (default: stdout)\n\
+-c compare the results with those of another build (a previous -o file)\n\
+"
+
+struct BenchCase {
+	GStr name;
+	GStr opts; //fqtrim options, @AD is replaced by the adapter file
+	bool paired;
+	int cpus;
+	BenchCase(const char* n="", const char* o="", bool p=false, int c=1):
+	    name(n), opts(o), paired(p), cpus(c) { }
+};
+
+struct BenchResult {
+	GStr name;
+	int cpus;
+	double wall, user, sys;
+	long maxrss; //KB
+	double readsps, mbps;
+	BenchResult():name(), cpus(0), wall(0), user(0), sys(0), maxrss(0), readsps(0), mbps(0) { }
+};
+
+static double wallTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static uint64 fileSize(const char* fname) {
+	struct stat st;
+	if (stat(fname, &st)!=0) return 0;
+	return st.st_size;
+}
+
+//split on spaces
+static void splitArgs(const char* s, GVec<GStr>& args) {
+	char* buf=Gstrdup(s);
+	for (char* p=strtok(buf, " ");p!=NULL;p=strtok(NULL, " ")) {
+		GStr a(p);
+		args.Add(a);
+	}
+	GFREE(buf);
+}
+
+//run a command, its stdout discarded and stderr saved to logfile;
+//returns the exit status, and the resources used in ru
+static int runCmd(GVec<GStr>& cmd, const char* logfile, double& wall, struct rusage& ru) {
+	char** argv=NULL;
+	GMALLOC(argv, (cmd.Count()+1)*sizeof(char*));
+	for (int i=0;i<cmd.Count();i++) argv[i]=(char*)cmd[i].chars();
+	argv[cmd.Count()]=NULL;
+	fflush(stdout);
+	fflush(stderr);
+	double t0=wallTime();
+	pid_t pid=fork();
+	if (pid<0) GError("Error: fork() failed\n");
+	if (pid==0) {
+		int fdn=open("/dev/null", O_WRONLY);
+		int fdl=open(logfile, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		if (fdn>=0) dup2(fdn, 1);
+		if (fdl>=0) dup2(fdl, 2);
+		execv(argv[0], argv);
+		fprintf(stderr, "Error: cannot run %s\n", argv[0]);
+		_exit(127);
+	}
+	int status=0;
+	memset(&ru, 0, sizeof(ru));
+	if (wait4(pid, &status, 0, &ru)<0) GError("Error: wait4() failed\n");
+	wall=wallTime()-t0;
+	GFREE(argv);
+	if (WIFEXITED(status)) return WEXITSTATUS(status);
+	return 128+(WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+
+static void genInput(GStr& fqgen, GStr& dir, int nreads, int rlen) {
+	GStr r1(dir), r2(dir), ad(dir), stamp(dir);
+	r1.append("/r1.fq");
+	r2.append("/r2.fq");
+	ad.append("/adapters.txt");
+	stamp.append("/params.txt");
+	char params[64];
+	sprintf(params, "%d %d", nreads, rlen);
+	FILE* f=fopen(stamp.chars(), "r");
+	if (f) { //same data already generated?
+		char buf[64];
+		bool same=(fgets(buf, sizeof(buf), f)!=NULL && strncmp(buf, params, strlen(params))==0
+		    && buf[strlen(params)]=='\n');
+		fclose(f);
+		if (same && fileExists(r1.chars())>1 && fileExists(r2.chars())>1) return;
+	}
+	GMessage("Generating %d read pairs of length %d into %s/ ..\n", nreads, rlen, dir.chars());
+	GVec<GStr> cmd;
+	char buf[64];
+	cmd.Add(fqgen);
+	cmd.Add(GStr("-n"));
+	sprintf(buf, "%d", nreads);
+	cmd.Add(GStr(buf));
+	cmd.Add(GStr("-l"));
+	sprintf(buf, "%d", rlen);
+	cmd.Add(GStr(buf));
+	cmd.Add(GStr("-o"));
+	cmd.Add(r1);
+	cmd.Add(GStr("-2"));
+	cmd.Add(r2);
+	cmd.Add(GStr("--adfile"));
+	cmd.Add(ad);
+	GStr log(dir);
+	log.append("/fqgen.log");
+	double wall=0;
+	struct rusage ru;
+	if (runCmd(cmd, log.chars(), wall, ru)!=0)
+		GError("Error: %s failed, see %s\n", fqgen.chars(), log.chars());
+	f=fopen(stamp.chars(), "w");
+	if (f==NULL) GError("Error creating file %s\n", stamp.chars());
+	fprintf(f, "%s\n", params);
+	fclose(f);
+}
+
+static void loadResults(const char* fname, GVec<BenchResult>& res) {
+	FILE* f=fopen(fname, "r");
+	if (f==NULL) GError("Error: cannot open %s\n", fname);
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0]=='#' || strncmp(line, "case\t", 5)==0) continue;
+		char name[256];
+		BenchResult r;
+		if (sscanf(line, "%255s %d %lf %lf %lf %lf %lf %ld", name, &r.cpus, &r.wall, &r.user,
+		    &r.sys, &r.readsps, &r.mbps, &r.maxrss)!=8) continue;
+		r.name=name;
+		res.Add(r);
+	}
+	fclose(f);
+}
+
+static void compareResults(GVec<BenchResult>& res, const char* basefile) {
+	GVec<BenchResult> base;
+	loadResults(basefile, base);
+	GMessage("\nComparison with %s:\n", basefile);
+	GMessage("%-14s %12s %12s %8s %10s %10s\n", "case", "reads/s", "base", "speedup",
+	    "maxRSS_KB", "base");
+	for (int i=0;i<res.Count();i++) {
+		BenchResult& r=res[i];
+		int b=-1;
+		for (int j=0;j<base.Count();j++)
+			if (base[j].name==r.name) { b=j; break; }
+		if (b<0) {
+			GMessage("%-14s %12.0f %12s %8s %10ld %10s\n", r.name.chars(), r.readsps, "-", "-",
+			    r.maxrss, "-");
+			continue;
+		}
+		GMessage("%-14s %12.0f %12.0f %7.2fx %10ld %10ld\n", r.name.chars(), r.readsps,
+		    base[b].readsps, base[b].readsps>0 ? r.readsps/base[b].readsps : 0.0, r.maxrss,
+		    base[b].maxrss);
+	}
+}
+
+static bool selected(GStr& only, GStr& name) {
+	if (only.is_empty()) return true;
+	GStr l(","), n(",");
+	l.append(only.chars());
+	l.append(",");
+	n.append(name.chars());
+	n.append(",");
+	return (strstr(l.chars(), n.chars())!=NULL);
+}
+
+int main(int argc, char* argv[]) {
+	GArgs args(argc, argv, "hb:g:d:n:l:r:p:k:o:c:");
+	int e;
+	if ((e=args.isError())>0 || args.getOpt('h')!=NULL) {
+		GMessage("%s\n", USAGE);
+		if (e>0) GMessage("Invalid argument: %s\n", argv[e]);
+		exit(1);
+	}
+	GStr fqtrim("./fqtrim"), fqgen("./fqgen"), dir("bench_data"), only, s;
+	int nreads=1000000, rlen=100, repeats=3;
+	int maxcpus=(int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxcpus<1) maxcpus=1;
+	if ((s=args.getOpt('b')).is_empty()==false) fqtrim=s;
+	if ((s=args.getOpt('g')).is_empty()==false) fqgen=s;
+	if ((s=args.getOpt('d')).is_empty()==false) dir=s;
+	if ((s=args.getOpt('n')).is_empty()==false) nreads=s.asInt();
+	if ((s=args.getOpt('l')).is_empty()==false) rlen=s.asInt();
+	if ((s=args.getOpt('r')).is_empty()==false) repeats=GMAX(1, s.asInt());
+	if ((s=args.getOpt('p')).is_empty()==false) maxcpus=GMAX(1, s.asInt());
+	if ((s=args.getOpt('k')).is_empty()==false) only=s;
+	dir.chomp("/");
+	if (fileExists(dir.chars())==0 && mkdir(dir.chars(), 0755)!=0)
+		GError("Error creating directory %s\n", dir.chars());
+	GStr outdir(dir);
+	outdir.append("/out");
+	if (fileExists(outdir.chars())==0 && mkdir(outdir.chars(), 0755)!=0)
+		GError("Error creating directory %s\n", outdir.chars());
+	genInput(fqgen, dir, nreads, rlen);
+
+	GVec<BenchCase> cases;
+	cases.Add(BenchCase("plain", ""));
+	cases.Add(BenchCase("qtrim", "-q 20"));
+	cases.Add(BenchCase("adapters", "-f @AD"));
+	cases.Add(BenchCase("dust", "-D"));
+	cases.Add(BenchCase("collapse", "-C"));
+	cases.Add(BenchCase("paired", "", true));
+	for (int c=1;c<=maxcpus;c<<=1) {
+		char name[32];
+		sprintf(name, "paired-p%d", c);
+		cases.Add(BenchCase(name, "-q 20 -f @AD", true, c));
+		if (c<maxcpus && (c<<1)>maxcpus) c=maxcpus>>1; //always end with maxcpus
+	}
+
+	GStr r1(dir), r2(dir), ad(dir);
+	r1.append("/r1.fq");
+	r2.append("/r2.fq");
+	ad.append("/adapters.txt");
+	uint64 sbytes=fileSize(r1.chars());
+	uint64 pbytes=sbytes+fileSize(r2.chars());
+	GVec<BenchResult> results;
+	for (int i=0;i<cases.Count();i++) {
+		BenchCase& bc=cases[i];
+		if (!selected(only, bc.name)) continue;
+		GVec<GStr> cmd;
+		cmd.Add(fqtrim);
+		GVec<GStr> opts;
+		splitArgs(bc.opts.chars(), opts);
+		for (int o=0;o<opts.Count();o++)
+			cmd.Add(opts[o]=="@AD" ? ad : opts[o]);
+		char buf[32];
+		sprintf(buf, "%d", bc.cpus);
+		cmd.Add(GStr("-p"));
+		cmd.Add(GStr(buf));
+		cmd.Add(GStr("-o"));
+		cmd.Add(GStr("bench.fq"));
+		cmd.Add(GStr("--outdir"));
+		cmd.Add(outdir);
+		GStr input(r1);
+		if (bc.paired) {
+			input.append(",");
+			input.append(r2.chars());
+		}
+		cmd.Add(input);
+		GStr log(outdir);
+		log.append("/");
+		log.append(bc.name.chars());
+		log.append(".log");
+		BenchResult br;
+		br.name=bc.name;
+		br.cpus=bc.cpus;
+		for (int r=0;r<repeats;r++) {
+			double wall=0;
+			struct rusage ru;
+			int st=runCmd(cmd, log.chars(), wall, ru);
+			if (st!=0) GError("Error: %s exited with status %d for case %s, see %s\n",
+			    fqtrim.chars(), st, bc.name.chars(), log.chars());
+			if (ru.ru_maxrss>br.maxrss) br.maxrss=ru.ru_maxrss;
+			if (r>0 && wall>=br.wall) continue;
+			br.wall=wall;
+			br.user=ru.ru_utime.tv_sec+ru.ru_utime.tv_usec/1e6;
+			br.sys=ru.ru_stime.tv_sec+ru.ru_stime.tv_usec/1e6;
+		}
+		br.readsps=(br.wall>0) ? nreads/br.wall : 0;
+		br.mbps=(br.wall>0) ? (bc.paired ? pbytes : sbytes)/br.wall/1048576.0 : 0;
+		GMessage("%-14s %8.3fs %12.0f reads/s %8.1f MB/s %8ld KB\n", br.name.chars(), br.wall,
+		    br.readsps, br.mbps, br.maxrss);
+		results.Add(br);
+	}
+
+	FILE* fout=stdout;
+	if ((s=args.getOpt('o')).is_empty()==false) {
+		fout=fopen(s.chars(), "w");
+		if (fout==NULL) GError("Error creating file %s\n", s.chars());
+	}
+	fprintf(fout, "#fqbench\tfqtrim=%s\treads=%d\tlength=%d\trepeats=%d\n", fqtrim.chars(),
+	    nreads, rlen, repeats);
+	fprintf(fout, "case\tcpus\twall_s\tuser_s\tsys_s\treads_per_s\tMB_per_s\tmaxrss_KB\n");
+	for (int i=0;i<results.Count();i++) {
+		BenchResult& r=results[i];
+		fprintf(fout, "%s\t%d\t%.3f\t%.3f\t%.3f\t%.0f\t%.2f\t%ld\n", r.name.chars(), r.cpus,
+		    r.wall, r.user, r.sys, r.readsps, r.mbps, r.maxrss);
+	}
+	if (fout!=stdout) fclose(fout);
+	if ((s=args.getOpt('c')).is_empty()==false)
+		compareResults(results, s.chars());
+	return 0;
+}
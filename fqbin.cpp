@@ -0,0 +1,79 @@
+#include "GArgs.h"
+#include "GStr.h"
+#include "fqbin.h"
+
+// Converts the binary output of fqtrim (--obin) back to FASTA/FASTQ, through
+// the reader of fqbin.h
+
+#define USAGE "fqbin: convert fqtrim binary output (--obin) to FASTA/FASTQ. Usage:\n\
+fqbin [-o <output.fq>] [-i] <reads.fqb>\n\
+\n\
+Options:\n\
+-o output file (default: stdout)\n\
+-i only show the block index: the offset, first read, number of reads and\n\
+   of bases of each block\n\
+"
+
+int main(int argc, char* argv[]) {
+	GArgs args(argc, argv, "hio:");
+	int e;
+	if ((e=args.isError())>0 || args.getOpt('h')!=NULL) {
+		GMessage("%s\n", USAGE);
+		if (e>0) GMessage("Invalid argument: %s\n", argv[e]);
+		exit(1);
+	}
+	if (args.startNonOpt()!=1) {
+		GMessage("%s\n", USAGE);
+		exit(1);
+	}
+	GStr fname(args.nextNonOpt());
+	FqBinReader rd;
+	if (!rd.open(fname.chars()))
+		GError("Error: cannot load %s (%s)\n", fname.chars(), rd.error());
+	FILE* fout=stdout;
+	GStr s=args.getOpt('o');
+	if (!s.is_empty() && s!="-") {
+		fout=fopen(s.chars(), "w");
+		if (fout==NULL) GError("Error creating file %s\n", s.chars());
+	}
+	if (args.getOpt('i')!=NULL) {
+		fprintf(fout, "#%llu reads in %llu blocks, Phred+%u%s\n",
+		    (unsigned long long)rd.numReads(), (unsigned long long)rd.numBlocks(),
+		    rd.phred(), rd.qbinned() ? ", binned qualities" : "");
+		fprintf(fout, "#block\toffset\tfirst_read\treads\tbases\tnon_ACGT\n");
+		for (uint64 b=0;b<rd.numBlocks();b++) {
+			const FqBinIndexEntry& ie=rd.indexEntry(b);
+			FqBinBlock blk=rd.block(b);
+			fprintf(fout, "%llu\t%llu\t%llu\t%u\t%llu\t%u\n", (unsigned long long)b,
+			    (unsigned long long)ie.offset, (unsigned long long)ie.firstRead, ie.nreads,
+			    (unsigned long long)blk.numBases(), blk.numExceptions());
+		}
+	}
+	else {
+		char* seq=NULL;
+		uint32 cap=0;
+		for (uint64 b=0;b<rd.numBlocks();b++) {
+			FqBinBlock blk=rd.block(b);
+			for (uint32 i=0;i<blk.count();i++) {
+				uint32 len=blk.length(i), nlen=0;
+				if (len+1>cap) {
+					cap=len+1;
+					GREALLOC(seq, cap);
+				}
+				blk.seq(i, seq);
+				seq[len]=0;
+				const char* name=blk.name(i, nlen);
+				if (blk.hasQual()) {
+					fprintf(fout, "@%.*s\n%s\n+\n%.*s\n", (int)nlen, name, seq, (int)len, blk.qual(i));
+				}
+				else {
+					fprintf(fout, ">%.*s\n", (int)nlen, name);
+					writeFasta(fout, NULL, NULL, seq, 100, len);
+				}
+			}
+		}
+		GFREE(seq);
+	}
+	if (fout!=stdout) fclose(fout);
+	return 0;
+}
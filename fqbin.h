@@ -0,0 +1,235 @@
+#ifndef FQ_BIN_H
+#define FQ_BIN_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Binary output of fqtrim (--obin), and a reader for it. This header has no
+// other dependency, so it can be copied into the programs reading the files.
+//
+// Layout (little-endian, each part starting at a multiple of 8 bytes):
+//   FqBinFileHdr
+//   blocks: an FqBinBlockHdr, then the sections of its reads, at the
+//     offsets (from the block start) given in the block header:
+//       seqOff   uint32[nreads+1] start of each read in the block's bases
+//       trim5    int32[nreads]    bases trimmed from the 5' end of the read
+//       trim3    int32[nreads]    bases trimmed from the 3' end
+//       nameOff  uint32[nreads+1] start of each name in names
+//       names    the read names, as the header lines of the FASTA/FASTQ
+//                output (without the '>' or '@')
+//       bases    2 bits per base (A,C,G,T=0..3, from the low bits of each
+//                byte), the reads one after another
+//       excPos   uint32[numExc]   bases that are not A,C,G,T (N..), sorted
+//       excChr   char[numExc]     and their actual letters (packed as A)
+//       quals    char[nbases]     quality chars as written, only in blocks
+//                                 with the FQBIN_BLK_QUAL flag
+//   index: an FqBinIndexEntry for each block
+//   FqBinTrailer (at the end of the file)
+// A whole file can be mapped and each block accessed through the index.
+
+#define FQBIN_MAGIC "FQTBIN1\n"
+#define FQBIN_END_MAGIC "FQTBEND\n"
+#define FQBIN_BLOCK_MAGIC 0x4B425146 //"FQBK"
+#define FQBIN_VERSION 1
+
+enum {
+	FQBIN_QBINNED=1 //file flag: the qualities were binned (--qbin)
+};
+enum {
+	FQBIN_BLK_QUAL=1 //block flag: the reads have qualities (FASTQ)
+};
+
+struct FqBinFileHdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags; //FQBIN_QBINNED
+	uint32_t phred; //Phred offset of the qualities (33 or 64)
+	uint32_t reserved;
+	uint64_t reserved2;
+};
+
+struct FqBinBlockHdr {
+	uint32_t magic; //FQBIN_BLOCK_MAGIC
+	uint32_t flags; //FQBIN_BLK_QUAL
+	uint32_t nreads;
+	uint32_t numExc;
+	uint64_t nbases;
+	uint64_t size; //of the whole block, with this header
+	uint64_t seqOff, trim5, trim3, nameOff, names, bases, excPos, excChr, quals; //sections
+};
+
+struct FqBinIndexEntry {
+	uint64_t offset; //of the block in the file
+	uint64_t firstRead; //number of reads in the blocks before it
+	uint32_t nreads;
+	uint32_t reserved;
+};
+
+struct FqBinTrailer {
+	uint64_t indexOffset;
+	uint64_t nblocks;
+	uint64_t nreads;
+	char magic[8]; //FQBIN_END_MAGIC
+};
+
+//a block of a mapped file
+class FqBinBlock {
+	const char* b;
+	const FqBinBlockHdr* h;
+	template<class T> const T* sec(uint64_t off) const { return (const T*)(b+off); }
+ public:
+	FqBinBlock(const char* data=NULL):b(data), h((const FqBinBlockHdr*)data) { }
+	uint32_t count() const { return h->nreads; }
+	uint64_t numBases() const { return h->nbases; }
+	uint32_t numExceptions() const { return h->numExc; } //bases not A,C,G,T
+	bool hasQual() const { return (h->flags & FQBIN_BLK_QUAL)!=0; }
+	uint32_t length(uint32_t i) const {
+		const uint32_t* so=sec<uint32_t>(h->seqOff);
+		return so[i+1]-so[i];
+	}
+	int trim5(uint32_t i) const { return sec<int32_t>(h->trim5)[i]; }
+	int trim3(uint32_t i) const { return sec<int32_t>(h->trim3)[i]; }
+	const char* name(uint32_t i, uint32_t& len) const {
+		const uint32_t* no=sec<uint32_t>(h->nameOff);
+		len=no[i+1]-no[i];
+		return sec<char>(h->names)+no[i];
+	}
+	//the quality chars of read i (length(i) of them), NULL if !hasQual()
+	const char* qual(uint32_t i) const {
+		if (!hasQual()) return NULL;
+		return sec<char>(h->quals)+sec<uint32_t>(h->seqOff)[i];
+	}
+	//decode the bases of read i into s (length(i) chars, not 0-terminated)
+	void seq(uint32_t i, char* s) const {
+		static const char acgt[4]={'A','C','G','T'};
+		const uint8_t* p=sec<uint8_t>(h->bases);
+		uint64_t start=sec<uint32_t>(h->seqOff)[i];
+		uint32_t len=length(i);
+		for (uint32_t j=0;j<len;j++) {
+			uint64_t k=start+j;
+			s[j]=acgt[(p[k>>2]>>((k&3)<<1))&3];
+		}
+		//exceptions in [start, start+len)
+		const uint32_t* ep=sec<uint32_t>(h->excPos);
+		const char* ec=sec<char>(h->excChr);
+		uint32_t lo=0, hi=h->numExc;
+		while (lo<hi) {
+			uint32_t m=(lo+hi)>>1;
+			if (ep[m]<start) lo=m+1;
+			else hi=m;
+		}
+		for (;lo<h->numExc && ep[lo]<start+len;lo++) s[ep[lo]-start]=ec[lo];
+	}
+};
+
+//a file written with --obin, mapped into memory (read whole on Windows)
+class FqBinReader {
+	char* data;
+	uint64_t size;
+	const FqBinFileHdr* hdr;
+	const FqBinTrailer* trl;
+	const FqBinIndexEntry* idx;
+	bool mapped;
+	const char* err;
+	bool fail(const char* msg) { err=msg; close(); return false; }
+ public:
+	FqBinReader():data(NULL), size(0), hdr(NULL), trl(NULL), idx(NULL), mapped(false),
+			err(NULL) { }
+	~FqBinReader() { close(); }
+	//false if the file cannot be read or is not valid (see error())
+	bool open(const char* fname) {
+		close();
+		err=NULL;
+#ifndef _WIN32
+		int fd=::open(fname, O_RDONLY);
+		if (fd<0) return fail("cannot open file");
+		struct stat st;
+		if (fstat(fd, &st)!=0 || !S_ISREG(st.st_mode)) {
+			::close(fd);
+			return fail("not a regular file");
+		}
+		size=st.st_size;
+		if (size>0) {
+			void* m=mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+			if (m!=MAP_FAILED) {
+				data=(char*)m;
+				mapped=true;
+			}
+		}
+		::close(fd);
+#endif
+		if (data==NULL) { //no mmap: read the whole file
+			FILE* f=fopen(fname, "rb");
+			if (f==NULL) return fail("cannot open file");
+			fseek(f, 0, SEEK_END);
+			size=ftell(f);
+			fseek(f, 0, SEEK_SET);
+			data=(char*)malloc(size ? size : 1);
+			bool ok=(data!=NULL && fread(data, 1, size, f)==size);
+			fclose(f);
+			if (!ok) return fail("cannot read file");
+		}
+		if (size<sizeof(FqBinFileHdr)+sizeof(FqBinTrailer)) return fail("file too short");
+		hdr=(const FqBinFileHdr*)data;
+		trl=(const FqBinTrailer*)(data+size-sizeof(FqBinTrailer));
+		if (memcmp(hdr->magic, FQBIN_MAGIC, 8)!=0) return fail("not an fqtrim binary file");
+		if (hdr->version!=FQBIN_VERSION) return fail("unsupported format version");
+		if (memcmp(trl->magic, FQBIN_END_MAGIC, 8)!=0) return fail("truncated file");
+		if (trl->indexOffset>size-sizeof(FqBinTrailer) ||
+		    trl->nblocks>(size-sizeof(FqBinTrailer)-trl->indexOffset)/sizeof(FqBinIndexEntry))
+			return fail("invalid block index");
+		idx=(const FqBinIndexEntry*)(data+trl->indexOffset);
+		for (uint64_t i=0;i<trl->nblocks;i++) {
+			if (idx[i].offset+sizeof(FqBinBlockHdr)>trl->indexOffset)
+				return fail("invalid block offset");
+			const FqBinBlockHdr* bh=(const FqBinBlockHdr*)(data+idx[i].offset);
+			if (bh->magic!=FQBIN_BLOCK_MAGIC || bh->size>trl->indexOffset-idx[i].offset)
+				return fail("invalid block");
+			const uint64_t* so=&(bh->seqOff);
+			for (int j=0;j<9;j++)
+				if (so[j]>bh->size) return fail("invalid block section");
+		}
+		return true;
+	}
+	void close() {
+		if (data!=NULL) {
+#ifndef _WIN32
+			if (mapped) munmap(data, size);
+			else
+#endif
+			free(data);
+		}
+		data=NULL;
+		size=0;
+		hdr=NULL;
+		trl=NULL;
+		idx=NULL;
+		mapped=false;
+	}
+	const char* error() const { return err; }
+	uint32_t phred() const { return hdr->phred; }
+	bool qbinned() const { return (hdr->flags & FQBIN_QBINNED)!=0; }
+	uint64_t numReads() const { return trl->nreads; }
+	uint64_t numBlocks() const { return trl->nblocks; }
+	const FqBinIndexEntry& indexEntry(uint64_t i) const { return idx[i]; }
+	FqBinBlock block(uint64_t i) const { return FqBinBlock(data+idx[i].offset); }
+	//the block having read number r (0-based, in the file)
+	uint64_t findBlock(uint64_t r) const {
+		uint64_t lo=0, hi=trl->nblocks;
+		while (hi-lo>1) {
+			uint64_t m=(lo+hi)>>1;
+			if (idx[m].firstRead<=r) lo=m;
+			else hi=m;
+		}
+		return lo;
+	}
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "fqbinout.h"
+
+static const char* zeros="\0\0\0\0\0\0\0";
+
+struct SBaseCodes { //2-bit codes of the bases, 4 for the others (exceptions)
+	byte code[256];
+	SBaseCodes() {
+		memset(code, 4, 256);
+		code['A']=0;
+		code['C']=1;
+		code['G']=2;
+		code['T']=3;
+	}
+};
+static SBaseCodes baseCodes;
+
+FqBinWriter::FqBinWriter(FILE* fout, bool binQuals):f(fout), qbin(binQuals), fpos(0),
+		nreads(0), index(), withQual(false), seqOff(), trim5(), trim3(), nameOff(), names(),
+		bases(), nbases(0), excPos(), excChr(), quals(), phred(0) { }
+
+void FqBinWriter::writeHeader() {
+	FqBinFileHdr h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, FQBIN_MAGIC, 8);
+	h.version=FQBIN_VERSION;
+	h.flags=qbin ? FQBIN_QBINNED : 0;
+	h.phred=phred;
+	put(&h, sizeof(h));
+}
+
+void FqBinWriter::put(const void* p, uint64 len) {
+	if (len>0 && fwrite(p, 1, len, f)!=len)
+		GError("Error writing the binary output!\n");
+	fpos+=len;
+}
+
+void FqBinWriter::pad() {
+	if (fpos & 7) put(zeros, 8-(fpos & 7));
+}
+
+void FqBinWriter::add(const char* name, int nlen, const char* seq, const char* qv, int len,
+		int t5, int t3) {
+	bool q=(qv!=NULL);
+	if (seqOff.Count()>0 && q!=withQual) flushBlock(); //FASTA and FASTQ reads are not mixed
+	if (seqOff.Count()==0) {
+		withQual=q;
+		seqOff.Add((uint32)0);
+		nameOff.Add((uint32)0);
+	}
+	trim5.Add(t5);
+	trim3.Add(t3);
+	names.add(name, nlen);
+	nameOff.Add((uint32)names.len);
+	//pack the bases, starting at nbases (which can be inside a byte)
+	bases.reserve((len>>2)+2);
+	for (int i=0;i<len;i++) {
+		uint64 k=nbases+i;
+		if ((k & 3)==0) bases.data[bases.len++]=0;
+		byte c=baseCodes.code[(byte)seq[i]];
+		if (c>3) {
+			excPos.Add((uint32)k);
+			excChr.add(seq[i]);
+			c=0;
+		}
+		bases.data[bases.len-1]|=(char)(c<<((k & 3)<<1));
+	}
+	nbases+=len;
+	seqOff.Add((uint32)nbases);
+	if (q) {
+		if (qbin) {
+			quals.reserve(len);
+			for (int i=0;i<len;i++)
+				quals.data[quals.len++]=(char)(phred+fqBinQual(qv[i]-phred));
+		}
+		else quals.add(qv, len);
+	}
+	if (trim5.Count()>=FQBIN_BLOCK_READS || nbases>=FQBIN_BLOCK_BASES) flushBlock();
+}
+
+void FqBinWriter::flushBlock() {
+	int n=trim5.Count();
+	if (n==0) return;
+	if (fpos==0) writeHeader();
+	FqBinIndexEntry ie;
+	ie.offset=fpos;
+	ie.firstRead=nreads;
+	ie.nreads=n;
+	ie.reserved=0;
+	index.Add(ie);
+	FqBinBlockHdr h;
+	memset(&h, 0, sizeof(h));
+	h.magic=FQBIN_BLOCK_MAGIC;
+	h.flags=withQual ? FQBIN_BLK_QUAL : 0;
+	h.nreads=n;
+	h.numExc=excPos.Count();
+	h.nbases=nbases;
+	//section offsets, each aligned to 8 bytes
+	uint64 o=sizeof(h);
+	#define FQBIN_SECTION(s, len) h.s=o; o=(o+(len)+7) & ~(uint64)7
+	FQBIN_SECTION(seqOff, (n+1)*sizeof(uint32));
+	FQBIN_SECTION(trim5, n*sizeof(int32));
+	FQBIN_SECTION(trim3, n*sizeof(int32));
+	FQBIN_SECTION(nameOff, (n+1)*sizeof(uint32));
+	FQBIN_SECTION(names, names.len);
+	FQBIN_SECTION(bases, bases.len);
+	FQBIN_SECTION(excPos, h.numExc*sizeof(uint32));
+	FQBIN_SECTION(excChr, excChr.len);
+	FQBIN_SECTION(quals, withQual ? nbases : 0);
+	#undef FQBIN_SECTION
+	h.size=o;
+	put(&h, sizeof(h));
+	put(&seqOff[0], (n+1)*sizeof(uint32)); pad();
+	put(&trim5[0], n*sizeof(int32)); pad();
+	put(&trim3[0], n*sizeof(int32)); pad();
+	put(&nameOff[0], (n+1)*sizeof(uint32)); pad();
+	put(names.data, names.len); pad();
+	put(bases.data, bases.len); pad();
+	if (h.numExc>0) put(&excPos[0], h.numExc*sizeof(uint32));
+	pad();
+	put(excChr.data, excChr.len); pad();
+	if (withQual) {
+		put(quals.data, quals.len);
+		pad();
+	}
+	nreads+=n;
+	seqOff.setCount(0);
+	trim5.setCount(0);
+	trim3.setCount(0);
+	nameOff.setCount(0);
+	names.clear();
+	bases.clear();
+	nbases=0;
+	excPos.setCount(0);
+	excChr.clear();
+	quals.clear();
+}
+
+void FqBinWriter::finish() {
+	flushBlock();
+	if (fpos==0) writeHeader(); //no reads
+	FqBinTrailer t;
+	t.indexOffset=fpos;
+	t.nblocks=index.Count();
+	t.nreads=nreads;
+	memcpy(t.magic, FQBIN_END_MAGIC, 8);
+	if (index.Count()>0) put(&index[0], index.Count()*sizeof(FqBinIndexEntry));
+	put(&t, sizeof(t));
+}
@@ -0,0 +1,57 @@
+#ifndef FQ_BINOUT_H
+#define FQ_BINOUT_H
+#include "GBase.h"
+#include "GVec.hh"
+#include "fqbin.h"
+#include "fqrep.h"
+
+// Writer of the binary output files (--obin), in the format of fqbin.h.
+// The reads of an output file are added in the output order (by the writer
+// thread) and written a block at a time (the file header with the first
+// one); finish() writes the last block, the block index and the trailer.
+
+#define FQBIN_BLOCK_READS 8192
+#define FQBIN_BLOCK_BASES (4<<20)
+
+//--qbin: Illumina's 8-level binning of the Phred scores
+static inline int fqBinQual(int q) {
+	if (q<2) return q;
+	if (q<10) return 6;
+	if (q<20) return 15;
+	if (q<25) return 22;
+	if (q<30) return 27;
+	if (q<35) return 33;
+	if (q<40) return 37;
+	return 40;
+}
+
+class FqBinWriter {
+	FILE* f;
+	bool qbin;
+	uint64 fpos; //bytes written so far
+	uint64 nreads;
+	GVec<FqBinIndexEntry> index;
+	//the block being filled
+	bool withQual;
+	GVec<uint32> seqOff;
+	GVec<int32> trim5, trim3;
+	GVec<uint32> nameOff;
+	FqRepBuf names;
+	FqRepBuf bases; //2-bit packed
+	uint64 nbases;
+	GVec<uint32> excPos;
+	FqRepBuf excChr;
+	FqRepBuf quals;
+	void writeHeader();
+	void put(const void* p, uint64 len);
+	void pad(); //to a multiple of 8 bytes
+	void flushBlock();
+ public:
+	int phred; //offset of the quality chars, set before the first read is added
+	FqBinWriter(FILE* fout, bool binQuals);
+	void add(const char* name, int nlen, const char* seq, const char* qv, int len,
+			int t5, int t3);
+	void finish();
+};
+
+#endif
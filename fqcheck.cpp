@@ -0,0 +1,839 @@
+#include "GArgs.h"
+#include "GStr.h"
+#include "fqkernels.h"
+#include "fqkref.h"
+#include "fqgen.h"
+#include "fqsimd.h"
+#include "fqlib.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Equivalence tests of the trimming kernels (make check): the kernels of
+// fqkernels.cpp and the per-read trimming built on them are run against the
+// frozen reference implementations of fqkref.cpp, over generated reads and
+// edge cases, with several sets of trimming options. Any difference in the
+// kernel results or in trim5/trim3/trashcode/trimhist of a read is reported.
+// The vector variants of the byte scanning kernels (fqsimd.cpp) are checked
+// against the scalar ones for every SIMD level the CPU supports, and the
+// kernels checked against the reference use the -S level (default: the best).
+// The in-memory trimming API (fqlib.h) is checked the same way, in batches.
+// With -b, fqtrim itself is also run with -p 1 and with more threads on the
+// same input, and the outputs must be identical.
+
+#define USAGE "fqcheck: fqtrim kernel equivalence tests. Usage:\n\
+fqcheck [-n <num_reads>] [-s <seed>] [-k <config>[,..]] [-m <max_diffs>]\\\n\
+   [-S <simd_level>]\\\n\
+   [-b <fqtrim> [-p <threads>[,..]] [-d <workdir>] [-N <num_pairs>]]\n\
+\n\
+Options:\n\
+-n reads checked with each set of trimming options (default: 200000)\n\
+-s random seed (default: 1)\n\
+-k only check with these sets of options (see the list printed)\n\
+-m stop after this many differences (default: 20)\n\
+-S SIMD level of the kernels checked against the reference (scalar, sse4.2,\n\
+   avx2 or avx512; default: the best the CPU supports)\n\
+-b also check that this fqtrim binary gives the same output with -p 1 and\n\
+   with the thread counts given by -p (default: 2,4)\n\
+-d work directory for the fqtrim runs (default: a new fqcheck_* directory in\n\
+   $TMPDIR or /tmp, removed afterwards unless the outputs differ)\n\
+-N read pairs in the input of the fqtrim runs (default: 100000)\n\
+"
+
+//5' adapter of the tests (Illumina 5' adapter)
+#define CHECK_ADAPTER5 "ACACTCTTTCCCTACACGACGCTCTTCCGATCT"
+
+static int maxDiffs=20;
+static int numDiffs=0;
+static GStr curConfig;
+
+static void resetParams() {
+	doPolyTrim=true;
+	polyBothEnds=false;
+	revCompl=false;
+	showAdapterIdx=false;
+	doDust=false;
+	dustMask=false;
+	doCollapse=false;
+	dust_cutoff=16;
+	min_read_len=16;
+	max_perc_N=5.0;
+	perc_lenN=12.0;
+	dist_lenN=0;
+	qvtrim_qmin=0;
+	qvtrim_max=0;
+	qvtrim_win=6;
+	qv_phredtype=33;
+	qv_cvtadd=0;
+	match_reward=1;
+	mismatch_penalty=3;
+	Xdrop=8;
+	minEndAdapter=6;
+	min_pid3=94.0;
+	min_pid5=96.0;
+	poly_minScore=12;
+	adapters5.Clear();
+	adapters3.Clear();
+	all_adapters.Clear();
+	adapter_idx=0;
+}
+
+static void setAdapters(bool either5=false) {
+	GStr a3(FQGEN_ADAPTER1), a3b(FQGEN_ADAPTER2), a5(CHECK_ADAPTER5);
+	addAdapter(adapters3, a3, galn_TrimRight);
+	addAdapter(adapters3, a3b, galn_TrimRight);
+	addAdapter(adapters5, a5, either5 ? galn_TrimEither : galn_TrimLeft);
+}
+
+//the sets of trimming options checked
+struct CheckConfig {
+	const char* name;
+	const char* desc; //fqtrim options
+	void (*setup)();
+};
+
+static void cfgDefault() { }
+static void cfgQ20() { qvtrim_qmin=20; }
+static void cfgQ30() { qvtrim_qmin=30; qvtrim_win=3; qvtrim_max=20; }
+static void cfgPhred64() { qvtrim_qmin=20; qv_phredtype=64; qv_cvtadd=-31; }
+static void cfgNstrict() { max_perc_N=1.0; dist_lenN=8; }
+static void cfgAdapters() { setAdapters(); showAdapterIdx=true; }
+static void cfgAdaptersRC() {
+	revCompl=true;
+	polyBothEnds=true;
+	min_pid3=90.0;
+	min_pid5=90.0;
+	minEndAdapter=4;
+	poly_minScore=4*poly_m_score;
+	setAdapters(true);
+}
+static void cfgScoring() {
+	match_reward=2;
+	mismatch_penalty=4;
+	Xdrop=10;
+	doPolyTrim=false;
+	setAdapters();
+}
+static void cfgDust() { doDust=true; min_read_len=25; }
+static void cfgAll() {
+	qvtrim_qmin=20;
+	polyBothEnds=true;
+	doDust=true;
+	dust_cutoff=10;
+	showAdapterIdx=true;
+	setAdapters();
+}
+
+static CheckConfig configs[]={
+	{ "default", "", cfgDefault },
+	{ "q20", "-q 20", cfgQ20 },
+	{ "q30", "-q 30 -w 3 -t 20", cfgQ30 },
+	{ "phred64", "-q 20 -P 64", cfgPhred64 },
+	{ "nstrict", "-m 1 --ntrimdist 8", cfgNstrict },
+	{ "adapters", "-f <adapters> --aidx", cfgAdapters },
+	{ "adapters_rc", "-f <adapters,5' either end> -R -B --pid3 90 --pid5 90 -a 4 -y 4", cfgAdaptersRC },
+	{ "scoring", "-f <adapters> -A --match 2 --mism 4 --XDROP 10", cfgScoring },
+	{ "dust", "-D -l 25", cfgDust },
+	{ "all", "-q 20 -B -D -f <adapters> --aidx (dust cutoff 10)", cfgAll },
+	{ NULL, NULL, NULL }
+};
+
+//------------ reads ------------
+
+static void randomBases(GenRand& rnd, char* s, int len, const char* alphabet="ACGT") {
+	int n=strlen(alphabet);
+	for (int i=0;i<len;i++) s[i]=alphabet[rnd.range(n)];
+	s[len]=0;
+}
+
+static void randomQuals(GenRand& rnd, char* q, int len, int qmin, int qmax) {
+	for (int i=0;i<len;i++) q[i]=(char)(33+qmin+rnd.range(qmax-qmin+1));
+	q[len]=0;
+}
+
+//an adapter in the read: a part of it (or of its reverse complement) with
+//a few errors, at either end or inside the read
+static void plantAdapter(GenRand& rnd, char* s, int len) {
+	const char* ad=FQGEN_ADAPTER1;
+	switch (rnd.range(4)) {
+		case 1: ad=FQGEN_ADAPTER2; break;
+		case 2: ad=CHECK_ADAPTER5; break;
+	}
+	char buf[64];
+	int alen=strlen(ad);
+	strcpy(buf, ad);
+	if (rnd.range(4)==0) {
+		for (int i=0;i<alen;i++) {
+			char c=ad[alen-1-i];
+			buf[i]=(c=='A') ? 'T' : (c=='C') ? 'G' : (c=='G') ? 'C' : 'A';
+		}
+	}
+	int from=0, n=1+rnd.range(alen);
+	if (rnd.range(2)) from=alen-n; //adapter end
+	if (n>len) n=len;
+	int pos=0;
+	switch (rnd.range(3)) {
+		case 0: pos=len-n; break; //3' end
+		case 1: pos=0; break; //5' end
+		default: pos=rnd.range(len-n+1);
+	}
+	memcpy(s+pos, buf+from, n);
+	int nerr=rnd.range(4);
+	for (int e=0;e<nerr;e++) s[pos+rnd.range(n)]="ACGTN"[rnd.range(5)];
+}
+
+//reads probing the corner cases of the kernels
+static void edgeRead(GenRand& rnd, char* s, char* q) {
+	int len=1+rnd.range(160);
+	if (rnd.range(3)==0) len=1+rnd.range(24); //around min_read_len and the qtrim window
+	randomBases(rnd, s, len);
+	randomQuals(rnd, q, len, 2, 41);
+	switch (rnd.range(12)) {
+		case 0: memset(s, 'N', len); break;
+		case 1: memset(s, rnd.range(2) ? 'A' : 'T', len); break;
+		case 2: { //poly-A/T tail or head with errors
+			int t=1+rnd.range(len);
+			bool at3=rnd.range(2);
+			char c=rnd.range(2) ? 'A' : 'T';
+			memset(at3 ? s+len-t : s, c, t);
+			int nerr=rnd.range(3);
+			for (int e=0;e<nerr;e++) s[(at3 ? len-t : 0)+rnd.range(t)]="ACGTN"[rnd.range(5)];
+			break;
+		}
+		case 3: plantAdapter(rnd, s, len); break;
+		case 4: { //tandem repeats (dust)
+			int ulen=1+rnd.range(4);
+			char unit[8];
+			randomBases(rnd, unit, ulen);
+			int from=rnd.range(len);
+			for (int i=from;i<len;i++) s[i]=unit[(i-from)%ulen];
+			break;
+		}
+		case 5: randomBases(rnd, s, len, "acgtACGTnN"); break;
+		case 6: memset(q, '!'+rnd.range(3), len); break;
+		case 7: memset(q, 'J', len); break;
+		case 8: { //N runs near the ends
+			int n5=rnd.range(GMIN(len, 12)+1), n3=rnd.range(GMIN(len, 12)+1);
+			for (int i=0;i<n5;i++) if (rnd.range(3)) s[i]='N';
+			for (int i=0;i<n3;i++) if (rnd.range(3)) s[len-1-i]='N';
+			break;
+		}
+		case 9: //low quality ends
+			for (int i=0;i<len;i++)
+				if (i<rnd.range(10) || i>=len-rnd.range(30)) q[i]=(char)(33+rnd.range(15));
+			break;
+		case 10: //alternating qualities around the threshold
+			for (int i=0;i<len;i++) q[i]=(char)(33+((i&1) ? 18+rnd.range(3) : 21+rnd.range(3)));
+			break;
+		default: //several problems at once
+			plantAdapter(rnd, s, len);
+			if (len>8) memset(s+len-8, 'A', 8);
+			for (int i=0;i<len && i<4;i++) q[i]='#';
+			break;
+	}
+}
+
+struct ReadSource {
+	GenRand rnd;
+	FqReadGen* gen;
+	int left; //reads from gen until its parameters are changed
+	char seq[512], qv[512];
+	ReadSource(uint64 seed):rnd(seed), gen(NULL), left(0) { }
+	~ReadSource() { delete gen; }
+	void next(RData& rd) {
+		if (rnd.range(10)==0) edgeRead(rnd, seq, qv);
+		else {
+			if (left==0) { //new generator parameters
+				delete gen;
+				GenParams gp;
+				gp.len=(rnd.range(4)==0) ? 10+rnd.range(30) : 30+rnd.range(220);
+				gp.q5=20+rnd.range(22);
+				gp.q3=2+rnd.range(40);
+				gp.nrate=rnd.range(3) ? rnd.unif()*0.01 : rnd.unif()*0.1;
+				gp.polya=rnd.unif()*0.3;
+				gp.adapter=rnd.unif()*0.6;
+				gp.admin=rnd.unif()*0.5;
+				gp.admax=gp.admin+rnd.unif()*(1.0-gp.admin);
+				gp.dups=0;
+				gen=new FqReadGen(gp, rnd.next(), false);
+				left=1000;
+			}
+			gen->next(seq, qv);
+			left--;
+		}
+		rd.clear();
+		rd.seq=seq;
+		rd.qv=qv;
+		if (qv_phredtype==64) convertPhred(rd.qv);
+	}
+};
+
+//------------ comparisons ------------
+
+static bool report(const char* what, RData& rd, const char* detail) {
+	numDiffs++;
+	GMessage("DIFF [%s] %s: %s\n  seq: %s\n  qv:  %s\n", curConfig.chars(), what, detail,
+	    rd.seq.chars(), rd.qv.chars());
+	if (numDiffs>=maxDiffs) GError("Error: too many differences, giving up.\n");
+	return false;
+}
+
+static void trimStr(RData& r, char trashcode, GStr& s) {
+	char buf[64];
+	sprintf(buf, "trashcode=%d trim5=%d trim3=%d hist=", trashcode, r.trim5, r.trim3);
+	s=buf;
+	for (int i=0;i<r.trimhist.Count();i++) {
+		sprintf(buf, "%s%d%c%d", i ? "," : "", r.trimhist[i].tend, r.trimhist[i].tcode, r.trimhist[i].tlen);
+		s.append(buf);
+	}
+}
+
+static void cmpTrim(const char* kernel, RData& rd, bool a, int l5, int l3, bool b, int r5, int r3) {
+	if (a==b && l5==r5 && l3==r3) return;
+	char d[128];
+	sprintf(d, "returned %d, l5=%d, l3=%d (reference: %d, %d, %d)", a, l5, l3, b, r5, r3);
+	report(kernel, rd, d);
+}
+
+//each kernel on the whole read, then the trimming of the read
+static void checkRead(CTrimKernels& k, fqref::CTrimKernels& ref, RData& rd) {
+	int len=rd.seq.length();
+	GStr seq(rd.seq.chars()), qv(rd.qv.chars());
+	const char* s=seq.chars();
+	int l5=0, l3=len-1, r5=0, r3=len-1;
+	bool a=k.qtrim(qv.chars(), qv.length(), l5, l3), b=ref.qtrim(qv, r5, r3);
+	cmpTrim("qtrim", rd, a, l5, l3, b, r5, r3);
+	{ int l5=0, l3=len-1, r5=0, r3=len-1;
+	  double pN=0, rpN=0;
+	  bool a=k.ntrim(s, len, l5, l3, pN), b=ref.ntrim(seq, r5, r3, rpN);
+	  if (a!=b || l5!=r5 || l3!=r3 || pN!=rpN) {
+		char d[160];
+		sprintf(d, "returned %d, l5=%d, l3=%d, pN=%g (reference: %d, %d, %d, %g)", a, l5, l3, pN, b, r5, r3, rpN);
+		report("ntrim", rd, d);
+	  }
+	}
+	l5=0; l3=len-1; r5=0; r3=len-1;
+	a=k.trim_poly3(s, len, l5, l3, polyA_seed);
+	b=ref.trim_poly3(seq, r5, r3, polyA_seed);
+	cmpTrim("trim_poly3 A", rd, a, l5, l3, b, r5, r3);
+	l5=0; l3=len-1; r5=0; r3=len-1;
+	a=k.trim_poly3(s, len, l5, l3, polyT_seed);
+	b=ref.trim_poly3(seq, r5, r3, polyT_seed);
+	cmpTrim("trim_poly3 T", rd, a, l5, l3, b, r5, r3);
+	l5=0; l3=len-1; r5=0; r3=len-1;
+	a=k.trim_poly5(s, len, l5, l3, polyT_seed);
+	b=ref.trim_poly5(seq, r5, r3, polyT_seed);
+	cmpTrim("trim_poly5 T", rd, a, l5, l3, b, r5, r3);
+	l5=0; l3=len-1; r5=0; r3=len-1;
+	a=k.trim_poly5(s, len, l5, l3, polyA_seed);
+	b=ref.trim_poly5(seq, r5, r3, polyA_seed);
+	cmpTrim("trim_poly5 A", rd, a, l5, l3, b, r5, r3);
+	if (adapters3.Count()>0 || adapters5.Count()>0) {
+		int a5=0, a3=len-1, b5=0, b3=len-1, ai=-1, bi=-1;
+		bool a=k.trim_adapter3(s, len, a5, a3, ai), b=ref.trim_adapter3(seq, b5, b3, bi);
+		if (a!=b || a5!=b5 || a3!=b3 || ai!=bi) {
+			char d[160];
+			sprintf(d, "returned %d, l5=%d, l3=%d, aidx=%d (reference: %d, %d, %d, %d)", a, a5, a3, ai, b, b5, b3, bi);
+			report("trim_adapter3", rd, d);
+		}
+		a5=0; a3=len-1; b5=0; b3=len-1; ai=-1; bi=-1;
+		a=k.trim_adapter5(s, len, a5, a3, ai);
+		b=ref.trim_adapter5(seq, b5, b3, bi);
+		if (a!=b || a5!=b5 || a3!=b3 || ai!=bi) {
+			char d[160];
+			sprintf(d, "returned %d, l5=%d, l3=%d, aidx=%d (reference: %d, %d, %d, %d)", a, a5, a3, ai, b, b5, b3, bi);
+			report("trim_adapter5", rd, d);
+		}
+	}
+	if (doDust) { //count and masking
+		bool dm=dustMask;
+		dustMask=true;
+		GStr ms(rd.seq.chars()), rs(rd.seq.chars());
+		int a=dust(ms), b=fqref::dust(rs);
+		dustMask=dm;
+		if (a!=b || ms!=rs || k.dust(s, len)!=b) {
+			char d[1200];
+			snprintf(d, sizeof(d), "masked %d: %s (reference: %d, %s)", a, ms.chars(), b, rs.chars());
+			report("dust", rd, d);
+		}
+	}
+	RData r1, r2;
+	r1.seq=rd.seq; r1.qv=rd.qv;
+	r2.seq=rd.seq; r2.qv=rd.qv;
+	char c1=k.process_read(r1), c2=ref.process_read(r2);
+	bool same=(c1==c2 && r1.trim5==r2.trim5 && r1.trim3==r2.trim3 &&
+	    r1.trimhist.Count()==r2.trimhist.Count());
+	for (int i=0;same && i<r1.trimhist.Count();i++) {
+		STrimOp& a=r1.trimhist[i];
+		STrimOp& b=r2.trimhist[i];
+		same=(a.tend==b.tend && a.tcode==b.tcode && a.tlen==b.tlen);
+	}
+	if (!same) {
+		GStr s1, s2;
+		trimStr(r1, c1, s1);
+		trimStr(r2, c2, s2);
+		s1.append(" (reference: ");
+		s1.append(s2.chars());
+		s1.append(")");
+		report("process_read", rd, s1.chars());
+	}
+}
+
+static bool sameCounts(STrimCounts& a, STrimCounts& b) {
+	return a.num_trimN==b.num_trimN && a.num_trimQ==b.num_trimQ && a.num_trimV==b.num_trimV &&
+	    a.num_trimA==b.num_trimA && a.num_trimT==b.num_trimT && a.b_totalIn==b.b_totalIn &&
+	    a.b_totalN==b.b_totalN && a.b_trimN==b.b_trimN && a.b_trimQ==b.b_trimQ &&
+	    a.b_trimV==b.b_trimV && a.b_trimA==b.b_trimA && a.b_trimT==b.b_trimT;
+}
+
+static bool selected(GStr& only, const char* name) {
+	if (only.is_empty()) return true;
+	GStr l(","), n(",");
+	l.append(only.chars());
+	l.append(",");
+	n.append(name);
+	n.append(",");
+	return (strstr(l.chars(), n.chars())!=NULL);
+}
+
+//------------ in-memory trimming API ------------
+
+//FqTrimmer::trim() in batches, with the options of the "all" set given
+//through fqTrimInit(), against the reference process_read()
+static void checkLib(int nreads, uint64 seed) {
+	FqTrimSetup setup;
+	setup.qmin=20;
+	setup.polyBothEnds=true;
+	setup.dust=true;
+	setup.dustCutoff=10;
+	setup.showAdapterIdx=true;
+	setup.adapter5=CHECK_ADAPTER5;
+	setup.adapter3=FQGEN_ADAPTER1;
+	setup.simd=fqSimdLevelName(fqsimd.level);
+	GStr err;
+	if (!fqTrimInit(setup, &err)) GError("Error: fqTrimInit() failed: %s\n", err.chars());
+	curConfig="lib";
+	int prevDiffs=numDiffs;
+	const int bsize=256;
+	FqTrimmer trimmer;
+	fqref::CTrimKernels ref;
+	ReadSource src(seed);
+	RData reads[bsize];
+	FqReadView views[bsize];
+	FqTrimResult res[bsize];
+	for (int done=0;done<nreads;) {
+		int n=GMIN(bsize, nreads-done);
+		for (int i=0;i<n;i++) {
+			src.next(reads[i]);
+			views[i].seq=reads[i].seq.chars();
+			views[i].qual=reads[i].qv.is_empty() ? NULL : reads[i].qv.chars();
+			views[i].len=reads[i].seq.length();
+		}
+		trimmer.trim(views, n, res);
+		for (int i=0;i<n;i++) {
+			RData r;
+			r.seq=reads[i].seq;
+			r.seq.upper();
+			r.qv=reads[i].qv;
+			char c=ref.process_read(r);
+			ref.incounter++;
+			ref.countTrashed(c);
+			if (c<=1) ref.outcounter++;
+			bool same=(c==res[i].trashcode && r.trim5==res[i].trim5 && r.trim3==res[i].trim3 &&
+			    r.trimhist.Count()==res[i].totalOps &&
+			    GMIN(res[i].totalOps, FQLIB_MAX_OPS)==res[i].numOps);
+			for (int j=0;same && j<res[i].numOps;j++) {
+				STrimOp& a=res[i].ops[j];
+				STrimOp& b=r.trimhist[j];
+				same=(a.tend==b.tend && a.tcode==b.tcode && a.tlen==b.tlen);
+			}
+			if (!same) {
+				char d[128];
+				sprintf(d, "trashcode=%d trim5=%d trim3=%d ops=%d/%d", res[i].trashcode, res[i].trim5,
+				    res[i].trim3, res[i].numOps, res[i].totalOps);
+				GStr s(d), s2;
+				trimStr(r, c, s2);
+				s.append(" (reference: ");
+				s.append(s2.chars());
+				s.append(")");
+				report("FqTrimmer::trim", reads[i], s.chars());
+			}
+		}
+		done+=n;
+	}
+	STrimCounts& lc=trimmer.counts();
+	if (!sameCounts(lc, ref) || lc.incounter!=ref.incounter || lc.outcounter!=ref.outcounter ||
+	    lc.trash_s!=ref.trash_s || lc.trash_poly!=ref.trash_poly || lc.trash_Q!=ref.trash_Q ||
+	    lc.trash_N!=ref.trash_N || lc.trash_D!=ref.trash_D || lc.trash_X!=ref.trash_X) {
+		numDiffs++;
+		GMessage("DIFF [lib] the trimming counts are different\n");
+	}
+	fqTrimDone();
+	GMessage("%-12s %-58s %s\n", "lib", "FqTrimmer::trim(), as \"all\" (one 3' adapter)",
+	    numDiffs>prevDiffs ? "DIFFERENT" : "ok");
+}
+
+//------------ SIMD variants vs scalar ------------
+
+static bool simdDiff(const char* level, const char* kernel, const char* buf, int len,
+		const char* detail) {
+	numDiffs++;
+	GMessage("DIFF [simd %s] %s (len=%d): %s\n  %.*s\n", level, kernel, len, detail, len, buf);
+	if (numDiffs>=maxDiffs) GError("Error: too many differences, giving up.\n");
+	return false;
+}
+
+//random buffers: bases, poly-A/T runs planted anywhere, quality chars and
+//any byte values, of all the lengths around the vector widths
+static int checkSimd(int nbufs, uint64 seed) {
+	FqSimd sc;
+	fqSimdGet(FQSIMD_SCALAR, sc);
+	GenRand rnd(seed);
+	char buf[320], b1[320], b2[320];
+	int prevDiffs=numDiffs, nlevels=0;
+	for (int l=FQSIMD_SCALAR+1;l<FQSIMD_NUM_LEVELS;l++) {
+		if (!fqSimdSupported(l)) continue;
+		nlevels++;
+		const char* lname=fqSimdLevelName(l);
+		FqSimd k;
+		fqSimdGet(l, k);
+		for (int n=0;n<nbufs;n++) {
+			int len=(n<300) ? n : rnd.range(300);
+			switch (rnd.range(4)) {
+				case 0: randomBases(rnd, buf, len, "ACGTNacgtn.-"); break;
+				case 1: randomQuals(rnd, buf, len, 0, 41); break;
+				case 2:
+					for (int i=0;i<len;i++) buf[i]=(char)(1+rnd.range(255));
+					buf[len]=0;
+					break;
+				default:
+					randomBases(rnd, buf, len, "AT");
+			}
+			if (len>4 && rnd.range(2)) { //poly run near one end
+				int t=4+rnd.range(GMIN(len, 20)-3);
+				if (t>len) t=len;
+				int at=rnd.range(2) ? len-t-rnd.range(3) : rnd.range(3);
+				at=GMAX(0, GMIN(at, len-t));
+				memset(buf+at, rnd.range(2) ? 'A' : 'T', t);
+			}
+			char d[128];
+			int a=k.countNonACGT(buf, len), b=sc.countNonACGT(buf, len);
+			if (a!=b) {
+				sprintf(d, "%d (scalar: %d)", a, b);
+				simdDiff(lname, "countNonACGT", buf, len, d);
+			}
+			int amin, amax, bmin, bmax;
+			k.qualRange(buf, len, amin, amax);
+			sc.qualRange(buf, len, bmin, bmax);
+			if (amin!=bmin || amax!=bmax) {
+				sprintf(d, "%d..%d (scalar: %d..%d)", amin, amax, bmin, bmax);
+				simdDiff(lname, "qualRange", buf, len, d);
+			}
+			for (int c=0;c<2;c++) {
+				char pc=c ? 'T' : 'A';
+				if ((a=k.polySeed3(buf, len, pc))!=(b=sc.polySeed3(buf, len, pc))) {
+					sprintf(d, "%c: %d (scalar: %d)", pc, a, b);
+					simdDiff(lname, "polySeed3", buf, len, d);
+				}
+				if ((a=k.polySeed5(buf, len, pc))!=(b=sc.polySeed5(buf, len, pc))) {
+					sprintf(d, "%c: %d (scalar: %d)", pc, a, b);
+					simdDiff(lname, "polySeed5", buf, len, d);
+				}
+			}
+			int v=rnd.range(2) ? 31 : -31;
+			memcpy(b1, buf, len+1);
+			memcpy(b2, buf, len+1);
+			k.addQual(b1, len, v);
+			sc.addQual(b2, len, v);
+			if (memcmp(b1, b2, len+1)!=0) {
+				sprintf(d, "adding %d", v);
+				simdDiff(lname, "addQual", buf, len, d);
+			}
+		}
+	}
+	GMessage("%-12s %-58s %s\n", "simd", nlevels ? "vector kernels vs scalar, each SIMD level of this CPU" :
+	    "no SIMD level supported, not checked", numDiffs>prevDiffs ? "DIFFERENT" : "ok");
+	return nlevels;
+}
+
+//------------ fqtrim -p N vs -p 1 ------------
+
+//run fqtrim, stdout and stderr saved to logfile; returns the exit status
+static int runCmd(GVec<GStr>& cmd, const char* logfile) {
+	char** argv=NULL;
+	GMALLOC(argv, (cmd.Count()+1)*sizeof(char*));
+	for (int i=0;i<cmd.Count();i++) argv[i]=(char*)cmd[i].chars();
+	argv[cmd.Count()]=NULL;
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid=fork();
+	if (pid<0) GError("Error: fork() failed\n");
+	if (pid==0) {
+		int fdl=open(logfile, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		if (fdl>=0) {
+			dup2(fdl, 1);
+			dup2(fdl, 2);
+		}
+		execv(argv[0], argv);
+		fprintf(stderr, "Error: cannot run %s\n", argv[0]);
+		_exit(127);
+	}
+	int status=0;
+	if (waitpid(pid, &status, 0)<0) GError("Error: waitpid() failed\n");
+	GFREE(argv);
+	if (WIFEXITED(status)) return WEXITSTATUS(status);
+	return 128+(WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+
+static void makeDir(GStr& dir) {
+	if (fileExists(dir.chars())==0 && mkdir(dir.chars(), 0755)!=0)
+		GError("Error creating directory %s\n", dir.chars());
+}
+
+static bool sameFiles(const char* f1, const char* f2) {
+	FILE* a=fopen(f1, "rb");
+	FILE* b=fopen(f2, "rb");
+	bool same=(a!=NULL && b!=NULL);
+	char ba[65536], bb[65536];
+	while (same) {
+		size_t na=fread(ba, 1, sizeof(ba), a), nb=fread(bb, 1, sizeof(bb), b);
+		if (na!=nb || memcmp(ba, bb, na)!=0) same=false;
+		if (na==0) break;
+	}
+	if (a) fclose(a);
+	if (b) fclose(b);
+	return same;
+}
+
+//a private work directory for the fqtrim runs
+static void makeTempDir(GStr& dir) {
+	const char* t=getenv("TMPDIR");
+	dir=(t==NULL || t[0]==0) ? "/tmp" : t;
+	dir.chomp('/');
+	dir.append("/fqcheck_XXXXXX");
+	char* d=Gstrdup(dir.chars());
+	if (mkdtemp(d)==NULL) GError("Error creating directory %s\n", dir.chars());
+	dir=d;
+	GFREE(d);
+}
+
+//remove a work directory and everything in it
+static void removeDir(GStr& dir) {
+	DIR* d=opendir(dir.chars());
+	if (d==NULL) return;
+	struct dirent* e;
+	while ((e=readdir(d))!=NULL) {
+		if (strcmp(e->d_name, ".")==0 || strcmp(e->d_name, "..")==0) continue;
+		GStr f(dir);
+		f.append("/");
+		f.append(e->d_name);
+		struct stat st;
+		if (lstat(f.chars(), &st)==0 && S_ISDIR(st.st_mode)) removeDir(f);
+		else unlink(f.chars());
+	}
+	closedir(d);
+	rmdir(dir.chars());
+}
+
+//all the output files of a -p 1 run must be in the -p N run, identical
+static int compareOutputs(GStr& dir1, GStr& dirN) {
+	DIR* d=opendir(dir1.chars());
+	if (d==NULL) GError("Error: cannot read directory %s\n", dir1.chars());
+	int diffs=0;
+	struct dirent* e;
+	while ((e=readdir(d))!=NULL) {
+		if (e->d_name[0]=='.' || strcmp(e->d_name, "fqtrim.log")==0) continue;
+		GStr f1(dir1), fN(dirN);
+		f1.append("/");
+		f1.append(e->d_name);
+		fN.append("/");
+		fN.append(e->d_name);
+		if (!sameFiles(f1.chars(), fN.chars())) {
+			GMessage("DIFF %s and %s differ\n", f1.chars(), fN.chars());
+			diffs++;
+		}
+	}
+	closedir(d);
+	return diffs;
+}
+
+static void writeInput(GStr& dir, int npairs) {
+	GStr r1(dir), r2(dir), ad(dir);
+	r1.append("/r1.fq");
+	r2.append("/r2.fq");
+	ad.append("/adapters.txt");
+	FILE* f1=fopen(r1.chars(), "w");
+	FILE* f2=fopen(r2.chars(), "w");
+	FILE* fa=fopen(ad.chars(), "w");
+	if (f1==NULL || f2==NULL || fa==NULL) GError("Error creating the input files in %s\n", dir.chars());
+	fprintf(fa, "%s,%s\n,%s\n", CHECK_ADAPTER5, FQGEN_ADAPTER1, FQGEN_ADAPTER2);
+	fclose(fa);
+	GenParams gp;
+	gp.nrate=0.01;
+	gp.polya=0.1;
+	gp.adapter=0.3;
+	FqReadGen gen(gp, 7, true);
+	char seq[128], qv[128], seq2[128], qv2[128];
+	for (int i=0;i<npairs;i++) {
+		gen.next(seq, qv, seq2, qv2);
+		fprintf(f1, "@chk.%d/1\n%s\n+\n%s\n", i, seq, qv);
+		fprintf(f2, "@chk.%d/2\n%s\n+\n%s\n", i, seq2, qv2);
+	}
+	fclose(f1);
+	fclose(f2);
+}
+
+struct PipeCase {
+	const char* name;
+	const char* opts; //@AD is replaced by the adapter file
+	bool paired;
+};
+
+static PipeCase pipeCases[]={
+	{ "single", "-q 20 -f @AD --aidx", false },
+	{ "paired", "-q 20 -f @AD -B -D", true },
+	{ "paired_s", "-f @AD -s 1 -l 30", true },
+	{ "collapse", "-C -q 20 -f @AD", false },
+	{ NULL, NULL, false }
+};
+
+static int checkThreads(GStr& fqtrim, GStr& dir, int npairs, GVec<int>& threads) {
+	makeDir(dir);
+	writeInput(dir, npairs);
+	int diffs=0;
+	for (int c=0;pipeCases[c].name!=NULL;c++) {
+		PipeCase& pc=pipeCases[c];
+		GStr dir1;
+		for (int t=-1;t<threads.Count();t++) {
+			int p=(t<0) ? 1 : threads[t];
+			char buf[32];
+			GStr odir(dir);
+			sprintf(buf, "/%s.p%d", pc.name, p);
+			odir.append(buf);
+			makeDir(odir);
+			GVec<GStr> cmd;
+			cmd.Add(fqtrim);
+			char* opts=Gstrdup(pc.opts);
+			for (char* o=strtok(opts, " ");o!=NULL;o=strtok(NULL, " ")) {
+				if (strcmp(o, "@AD")==0) {
+					GStr ad(dir);
+					ad.append("/adapters.txt");
+					cmd.Add(ad);
+				}
+				else cmd.Add(GStr(o));
+			}
+			GFREE(opts);
+			GStr rep(odir);
+			rep.append("/report.txt");
+			cmd.Add(GStr("-r"));
+			cmd.Add(rep);
+			sprintf(buf, "%d", p);
+			cmd.Add(GStr("-p"));
+			cmd.Add(GStr(buf));
+			cmd.Add(GStr("-o"));
+			cmd.Add(GStr("out.fq"));
+			cmd.Add(GStr("--outdir"));
+			cmd.Add(odir);
+			GStr input(dir);
+			input.append("/r1.fq");
+			if (pc.paired) {
+				input.append(",");
+				input.append(dir.chars());
+				input.append("/r2.fq");
+			}
+			cmd.Add(input);
+			GStr log(odir);
+			log.append("/fqtrim.log");
+			int st=runCmd(cmd, log.chars());
+			if (st!=0) GError("Error: %s exited with status %d, see %s\n", fqtrim.chars(), st, log.chars());
+			if (t<0) { dir1=odir; continue; }
+			int d=compareOutputs(dir1, odir);
+			GMessage("%-14s -p %-3d %s\n", pc.name, p, d ? "DIFFERENT" : "same as -p 1");
+			diffs+=d;
+		}
+	}
+	return diffs;
+}
+
+int main(int argc, char* argv[]) {
+	GArgs args(argc, argv, "hn:s:k:m:S:b:p:d:N:");
+	int e;
+	if ((e=args.isError())>0 || args.getOpt('h')!=NULL) {
+		GMessage("%s\n", USAGE);
+		if (e>0) GMessage("Invalid argument: %s\n", argv[e]);
+		exit(1);
+	}
+	int nreads=200000;
+	uint64 seed=1;
+	GStr only, s;
+	if ((s=args.getOpt('n')).is_empty()==false) nreads=s.asInt();
+	if ((s=args.getOpt('s')).is_empty()==false) seed=strtoull(s.chars(), NULL, 10);
+	if ((s=args.getOpt('k')).is_empty()==false) only=s;
+	if ((s=args.getOpt('m')).is_empty()==false) maxDiffs=GMAX(1, s.asInt());
+	initACGT();
+	s=args.getOpt('S');
+	if (!fqSimdInit(s.chars()))
+		GError("Error: SIMD level %s is not available here (CPU: %s)\n", s.chars(),
+		    fqSimdCpuFeatures().chars());
+	GMessage("Kernels checked with SIMD level %s (CPU: %s)\n", fqSimdLevelName(fqsimd.level),
+	    fqSimdCpuFeatures().chars());
+	if (selected(only, "simd")) checkSimd(GMAX(nreads/10, 1000), seed);
+	for (int c=0;configs[c].name!=NULL;c++) {
+		CheckConfig& cc=configs[c];
+		if (!selected(only, cc.name)) continue;
+		resetParams();
+		cc.setup();
+		curConfig=cc.name;
+		int prevDiffs=numDiffs;
+		FqTrimOptions opts; //from the globals set by cc.setup()
+		CTrimKernels k(opts);
+		fqref::CTrimKernels ref;
+		ReadSource src(seed+c);
+		RData rd;
+		for (int i=0;i<nreads;i++) {
+			src.next(rd);
+			checkRead(k, ref, rd);
+		}
+		if (!sameCounts(k, ref)) {
+			numDiffs++;
+			GMessage("DIFF [%s] the trimming counts are different\n", cc.name);
+		}
+		GMessage("%-12s %-58s %s\n", cc.name, cc.desc, numDiffs>prevDiffs ? "DIFFERENT" : "ok");
+	}
+	if (selected(only, "lib")) checkLib(nreads, seed+100);
+	resetParams();
+	if ((s=args.getOpt('b')).is_empty()==false) {
+		GStr fqtrim(s), dir;
+		int npairs=100000;
+		GVec<int> threads;
+		bool tmpDir=false;
+		if ((s=args.getOpt('d')).is_empty()==false) dir=s;
+		else {
+			makeTempDir(dir);
+			tmpDir=true;
+		}
+		if ((s=args.getOpt('N')).is_empty()==false) npairs=GMAX(1, s.asInt());
+		s=args.getOpt('p');
+		if (s.is_empty()) s="2,4";
+		char* buf=Gstrdup(s.chars());
+		for (char* p=strtok(buf, ",");p!=NULL;p=strtok(NULL, ",")) {
+			int n=atoi(p);
+			if (n>1) threads.Add(n);
+		}
+		GFREE(buf);
+		int d=checkThreads(fqtrim, dir, npairs, threads);
+		if (tmpDir) {
+			if (d==0) removeDir(dir);
+			else GMessage("The outputs of the fqtrim runs are kept in %s\n", dir.chars());
+		}
+		numDiffs+=d;
+	}
+	if (numDiffs>0) {
+		GMessage("%d differences found.\n", numDiffs);
+		return 1;
+	}
+	GMessage("All checks passed.\n");
+	return 0;
+}
@@ -0,0 +1,617 @@
+#include "fqdups.h"
+#include <fcntl.h>
+
+#define FQDUP_CHUNK_SIZE (1ULL<<20) //record pool allocation unit
+#define FQDUP_HDR_SIZE 9 //count(4), len(4), flags(1) [, mate 1 length(4) for pairs]
+                         //[, UMI length(1) and merge link(8) for UMI keys]
+
+enum {
+	fdup_Raw=0x01, //key is not 2-bit packed (exception path, e.g. it has Ns)
+	fdup_Qv=0x02, //record has quality values
+	fdup_Name=0x04, //record has the name of the first read
+	fdup_Pair=0x08, //key is a read pair (the mate 1 length follows the flags)
+	fdup_Umi=0x10 //key starts with a UMI (UMI length and merge link follow)
+};
+
+static inline int recHdrSize(byte flags) {
+	int hsize=FQDUP_HDR_SIZE;
+	if (flags & fdup_Pair) hsize+=4;
+	if (flags & fdup_Umi) hsize+=9;
+	return hsize;
+}
+
+static inline char* recUmiPtr(char* rec, byte flags) { //UMI length and link
+	return rec+FQDUP_HDR_SIZE+((flags & fdup_Pair) ? 4 : 0);
+}
+
+static byte dup_ntcode[256];
+
+static struct FqDupCodeInit {
+	FqDupCodeInit() {
+		memset(dup_ntcode, 4, 256);
+		dup_ntcode[(int)'A']=0; dup_ntcode[(int)'C']=1;
+		dup_ntcode[(int)'G']=2; dup_ntcode[(int)'T']=3;
+	}
+} dup_code_init;
+
+static inline uint64 dupMix(uint64 h) {
+	h^=h>>33;
+	h*=0xff51afd7ed558ccdULL;
+	h^=h>>33;
+	h*=0xc4ceb9fe1a85ec53ULL;
+	h^=h>>33;
+	return h;
+}
+
+static uint32 dupHash(const byte* key, int ksize, uint32 slen, bool raw, uint32 mlen,
+		uint32 ulen) {
+	uint64 h=(slen+1)*0x9E3779B97F4A7C15ULL;
+	if (raw) h^=0x5bd1e995ULL;
+	if (mlen || ulen) h=dupMix(h^mlen^(((uint64)ulen)<<32));
+	int i=0;
+	uint64 w;
+	for (;i+8<=ksize;i+=8) {
+		memcpy(&w, key+i, 8);
+		h=dupMix(h^w);
+	}
+	if (i<ksize) {
+		w=0;
+		memcpy(&w, key+i, ksize-i);
+		h=dupMix(h^w);
+	}
+	return (uint32)(h ^ (h>>32));
+}
+
+FqDupTable::FqDupTable(bool keep_names, int init_bits):slots(NULL), capacity(0),
+		initBits(init_bits), numKeys(0), chunks(NULL), chunk_used(NULL), chunk_size(NULL), numChunks(0),
+		allocChunks(0), poolSize(0), keepNames(keep_names), kbuf(NULL), kbufCap(0),
+		sbuf(NULL), sbufCap(0), iterChunk(0), iterPos(0) {
+	if (initBits<4) initBits=4;
+	capacity=(1ULL<<initBits);
+	GCALLOC(slots, capacity*sizeof(FqDupSlot));
+}
+
+FqDupTable::~FqDupTable() {
+	Clear();
+	GFREE(slots);
+	GFREE(chunks);
+	GFREE(chunk_used);
+	GFREE(chunk_size);
+	GFREE(kbuf);
+	GFREE(sbuf);
+}
+
+void FqDupTable::Clear(bool shrink) {
+	for (int i=0;i<numChunks;i++) GFREE(chunks[i]);
+	numChunks=0;
+	poolSize=0;
+	numKeys=0;
+	if (shrink && capacity>(1ULL<<initBits)) {
+		GFREE(slots);
+		capacity=(1ULL<<initBits);
+		GCALLOC(slots, capacity*sizeof(FqDupSlot));
+	}
+	else if (slots!=NULL) memset((void*)slots, 0, capacity*sizeof(FqDupSlot));
+	startIterate();
+}
+
+int FqDupTable::packKey(const char* seq, int slen) {
+	int ksize=(slen+3)>>2;
+	if (ksize>kbufCap) {
+		kbufCap=ksize+64;
+		GREALLOC(kbuf, kbufCap);
+	}
+	memset(kbuf, 0, ksize);
+	for (int i=0;i<slen;i++) {
+		byte c=dup_ntcode[(byte)seq[i]];
+		if (c>3) return -1;
+		kbuf[i>>2]|=(c<<((i&3)<<1));
+	}
+	return ksize;
+}
+
+uint64 FqDupTable::newRecord(uint64 rsize, char* & rec) {
+	if (numChunks==0 || chunk_used[numChunks-1]+rsize>chunk_size[numChunks-1]) {
+		if (numChunks==allocChunks) {
+			allocChunks+=64;
+			GREALLOC(chunks, allocChunks*sizeof(char*));
+			GREALLOC(chunk_used, allocChunks*sizeof(uint64));
+			GREALLOC(chunk_size, allocChunks*sizeof(uint64));
+		}
+		uint64 csize=GMAX(FQDUP_CHUNK_SIZE, rsize);
+		GMALLOC(chunks[numChunks], csize);
+		chunk_size[numChunks]=csize;
+		chunk_used[numChunks]=0;
+		poolSize+=csize;
+		numChunks++;
+	}
+	int c=numChunks-1;
+	uint64 rofs=(((uint64)(c+1))<<32) | chunk_used[c];
+	rec=chunks[c]+chunk_used[c];
+	chunk_used[c]+=rsize;
+	return rofs;
+}
+
+void FqDupTable::grow() {
+	uint64 newcap=capacity<<1;
+	FqDupSlot* newslots=NULL;
+	GCALLOC(newslots, newcap*sizeof(FqDupSlot));
+	uint64 mask=newcap-1;
+	for (uint64 i=0;i<capacity;i++) {
+		if (slots[i].rofs==0) continue;
+		uint64 j=slots[i].hcode & mask;
+		while (newslots[j].rofs) j=(j+1) & mask;
+		newslots[j]=slots[i];
+	}
+	GFREE(slots);
+	slots=newslots;
+	capacity=newcap;
+}
+
+uint64 FqDupTable::findSlot(const char* seq, int slen, int mlen, int ulen,
+		const byte* & key, int& ksize, uint32& h, byte& flags) {
+	ksize=packKey(seq, slen);
+	bool raw=(ksize<0);
+	key=kbuf;
+	if (raw) {
+		ksize=slen;
+		key=(const byte*)seq;
+	}
+	h=dupHash(key, ksize, slen, raw, mlen, ulen);
+	flags=0;
+	if (raw) flags|=fdup_Raw;
+	if (mlen>0) flags|=fdup_Pair;
+	if (ulen>0) flags|=fdup_Umi;
+	int hsize=recHdrSize(flags);
+	byte ul=(byte)ulen;
+	uint64 mask=capacity-1;
+	uint64 i=h & mask;
+	while (slots[i].rofs) {
+		if (slots[i].hcode==h && slots[i].len==(uint32)slen) {
+			char* rec=recPtr(slots[i].rofs);
+			byte rflags=(byte)rec[8];
+			if ((rflags & (fdup_Raw|fdup_Pair|fdup_Umi))==flags &&
+					(mlen==0 || memcmp(rec+FQDUP_HDR_SIZE, &mlen, 4)==0) &&
+					(ulen==0 || (byte)*recUmiPtr(rec, flags)==ul) &&
+					memcmp(rec+hsize, key, ksize)==0)
+				return i;
+		}
+		i=(i+1) & mask;
+	}
+	return i;
+}
+
+int FqDupTable::add(const char* seq, int slen, const char* qv, int qlen, const char* name,
+		int dupcount, int mlen, int ulen) {
+	if (ulen>255 || ulen>slen)
+		GError("Error at FqDupTable::add(): invalid UMI length (%d)!\n", ulen);
+	int rlen=slen-ulen; //qv only cover the read sequence
+	if (qlen>0 && qlen!=rlen)
+		GError("Error at FqDupTable::add(): sequence and quality values have different length!\n");
+	if ((numKeys+1)*10>capacity*7) grow(); //keep load factor under 0.7
+	const byte* key=NULL;
+	int ksize=0;
+	uint32 h=0;
+	byte flags=0;
+	uint64 i=findSlot(seq, slen, mlen, ulen, key, ksize, h, flags);
+	int hsize=recHdrSize(flags);
+	if (slots[i].rofs) {
+		//found it, collapse this read into the existing record
+		char* rec=recPtr(slots[i].rofs);
+		int rqlen=(rec[8] & fdup_Qv) ? rlen : 0;
+		if (qlen!=rqlen)
+			GError("Error at FqDupTable::add(): cannot collapse reads with different length!\n");
+		int count=0;
+		memcpy(&count, rec, 4);
+		count+=dupcount;
+		memcpy(rec, &count, 4);
+		char* rqv=rec+hsize+ksize;
+		if (dupcount==1) {
+			for (int j=0;j<qlen;j++)
+				rqv[j]+=(qv[j]-rqv[j])/count; //the mean is calculated incrementally
+		}
+		else {
+			for (int j=0;j<qlen;j++)
+				rqv[j]+=((qv[j]-rqv[j])*dupcount)/count;
+		}
+		return count;
+	}
+	//new key
+	if (qlen>0) flags|=fdup_Qv;
+	int nlen=0;
+	if (keepNames && name!=NULL) {
+		flags|=fdup_Name;
+		nlen=strlen(name)+1;
+	}
+	char* rec=NULL;
+	uint64 rofs=newRecord(hsize+ksize+qlen+nlen, rec);
+	int count=dupcount;
+	memcpy(rec, &count, 4);
+	memcpy(rec+4, &slen, 4);
+	rec[8]=(char)flags;
+	if (mlen>0) memcpy(rec+FQDUP_HDR_SIZE, &mlen, 4);
+	if (ulen>0) {
+		char* u=recUmiPtr(rec, flags);
+		u[0]=(char)ulen;
+		memset(u+1, 0, 8); //not merged
+	}
+	char* p=rec+hsize;
+	memcpy(p, key, ksize);
+	p+=ksize;
+	if (qlen>0) {
+		memcpy(p, qv, qlen);
+		p+=qlen;
+	}
+	if (nlen) memcpy(p, name, nlen);
+	slots[i].rofs=rofs;
+	slots[i].hcode=h;
+	slots[i].len=slen;
+	numKeys++;
+	return count;
+}
+
+char* FqDupTable::decodeRecord(char* rec, FqDupView& v) {
+	memcpy(&v.count, rec, 4);
+	memcpy(&v.len, rec+4, 4);
+	byte flags=(byte)rec[8];
+	char* p=rec+FQDUP_HDR_SIZE;
+	v.mlen=0;
+	if (flags & fdup_Pair) {
+		memcpy(&v.mlen, p, 4);
+		p+=4;
+	}
+	v.ulen=0;
+	if (flags & fdup_Umi) {
+		v.ulen=(byte)p[0];
+		p+=9;
+	}
+	if (v.len+1>sbufCap) {
+		sbufCap=v.len+256;
+		GREALLOC(sbuf, sbufCap);
+	}
+	if (flags & fdup_Raw) {
+		memcpy(sbuf, p, v.len);
+		p+=v.len;
+	}
+	else {
+		static const char* nt="ACGT";
+		for (int i=0;i<v.len;i++)
+			sbuf[i]=nt[(((byte)p[i>>2])>>((i&3)<<1)) & 3];
+		p+=(v.len+3)>>2;
+	}
+	sbuf[v.len]=0;
+	v.seq=sbuf;
+	v.qlen=0;
+	v.qv=NULL;
+	if (flags & fdup_Qv) {
+		v.qlen=v.len-v.ulen;
+		v.qv=p;
+		p+=v.qlen;
+	}
+	v.name=NULL;
+	if (flags & fdup_Name) {
+		v.name=p;
+		p+=strlen(p)+1;
+	}
+	return p;
+}
+
+bool FqDupTable::nextRecord(FqDupView& v) {
+	while (iterChunk<numChunks) {
+		while (iterPos<chunk_used[iterChunk]) {
+			char* rec=chunks[iterChunk]+iterPos;
+			iterPos=decodeRecord(rec, v)-chunks[iterChunk];
+			if (v.count>0) return true; //count 0: merged into another UMI
+		}
+		iterChunk++;
+		iterPos=0;
+	}
+	return false;
+}
+
+uint64 FqDupTable::mergeUMIs() {
+	//first pass: link each record to its best neighbor, using the original counts
+	static const char* nt="ACGT";
+	FqDupView v;
+	uint64 nlinks=0;
+	for (int c=0;c<numChunks;c++) {
+		uint64 pos=0;
+		while (pos<chunk_used[c]) {
+			char* rec=chunks[c]+pos;
+			uint64 rofs=(((uint64)(c+1))<<32) | pos;
+			pos=decodeRecord(rec, v)-chunks[c];
+			if (v.ulen==0) continue;
+			char* s=sbuf; //packKey() does not touch sbuf
+			uint64 best=0;
+			int bestcount=0;
+			for (int i=0;i<v.ulen;i++) {
+				char b=s[i];
+				for (int j=0;j<4;j++) {
+					if (nt[j]==b) continue;
+					s[i]=nt[j];
+					const byte* key=NULL;
+					int ksize=0;
+					uint32 h=0;
+					byte flags=0;
+					uint64 si=findSlot(s, v.len, v.mlen, v.ulen, key, ksize, h, flags);
+					uint64 nofs=slots[si].rofs;
+					if (nofs==0) continue;
+					int ncount=0;
+					memcpy(&ncount, recPtr(nofs), 4);
+					//directional rule; ties between equal counts go to the
+					//record seen first, so links can never form a cycle
+					if (ncount<2*v.count-1 || (ncount==v.count && nofs>rofs)) continue;
+					if (ncount>bestcount || (ncount==bestcount && nofs<best)) {
+						best=nofs;
+						bestcount=ncount;
+					}
+				}
+				s[i]=b;
+			}
+			if (best) {
+				memcpy(recUmiPtr(rec, (byte)rec[8])+1, &best, 8);
+				nlinks++;
+			}
+		}
+	}
+	if (nlinks==0) return 0;
+	//second pass: fold each linked record into the root of its chain
+	for (int c=0;c<numChunks;c++) {
+		uint64 pos=0;
+		while (pos<chunk_used[c]) {
+			char* rec=chunks[c]+pos;
+			pos=decodeRecord(rec, v)-chunks[c];
+			if (v.ulen==0) continue;
+			uint64 link=0;
+			memcpy(&link, recUmiPtr(rec, (byte)rec[8])+1, 8);
+			if (link==0) continue;
+			char* root=NULL;
+			while (link) {
+				root=recPtr(link);
+				memcpy(&link, recUmiPtr(root, (byte)root[8])+1, 8);
+			}
+			int rcount=0;
+			memcpy(&rcount, root, 4);
+			rcount+=v.count;
+			memcpy(root, &rcount, 4);
+			if (v.qlen>0) {
+				byte rflags=(byte)root[8];
+				char* rqv=root+recHdrSize(rflags)+((rflags & fdup_Raw) ? v.len : (v.len+3)>>2);
+				for (int j=0;j<v.qlen;j++)
+					rqv[j]+=((v.qv[j]-rqv[j])*v.count)/rcount;
+			}
+			int zero=0;
+			memcpy(rec, &zero, 4);
+		}
+	}
+	return nlinks;
+}
+
+//--------------- disk spilling (--mem) ----------------
+
+static uint32 spillHash(const char* seq, int slen, int level) {
+	//independent of the table hash, so a partition does not map
+	//to a cluster of slots when it's reloaded
+	uint64 h=0x84222325cbf29ce4ULL+level*0x9E3779B97F4A7C15ULL;
+	int i=0;
+	uint64 w;
+	for (;i+8<=slen;i+=8) {
+		memcpy(&w, seq+i, 8);
+		h=dupMix(h^w);
+	}
+	if (i<slen) {
+		w=slen;
+		memcpy(&w, seq+i, slen-i);
+		h=dupMix(h^w);
+	}
+	return (uint32)(h>>32);
+}
+
+//run file record: count(4) slen(4) qlen(4) nlen(4) mlen(4) ulen(4) seq qv name
+static void writeRunRec(FILE* f, int count, const char* seq, int slen,
+		const char* qv, int qlen, const char* name, int mlen, int ulen) {
+	int nlen=(name==NULL)? 0 : strlen(name);
+	int hdr[6]={count, slen, qlen, nlen, mlen, ulen};
+	if (fwrite(hdr, sizeof(int), 6, f)!=6 || fwrite(seq, 1, slen, f)!=(size_t)slen
+			|| (qlen && fwrite(qv, 1, qlen, f)!=(size_t)qlen)
+			|| (nlen && fwrite(name, 1, nlen, f)!=(size_t)nlen))
+		GError("Error writing temporary collapse file (disk full?)\n");
+}
+
+struct SRunRec {
+	int hdr[6];
+	char* buf;
+	int bufCap;
+	SRunRec():buf(NULL), bufCap(0) { }
+	~SRunRec() { GFREE(buf); }
+	int count() { return hdr[0]; }
+	int slen() { return hdr[1]; }
+	int qlen() { return hdr[2]; }
+	int mlen() { return hdr[4]; }
+	int ulen() { return hdr[5]; }
+	char* seq() { return buf; }
+	char* qv() { return buf+hdr[1]+1; }
+	char* name() { return hdr[3] ? buf+hdr[1]+hdr[2]+2 : NULL; }
+	bool read(FILE* f) {
+		if (fread(hdr, sizeof(int), 6, f)!=6) return false;
+		int rsize=hdr[1]+hdr[2]+hdr[3]+3;
+		if (rsize>bufCap) {
+			bufCap=rsize+256;
+			GREALLOC(buf, bufCap);
+		}
+		//keep each field 0-terminated
+		if (fread(seq(), 1, hdr[1], f)!=(size_t)hdr[1] ||
+				fread(qv(), 1, hdr[2], f)!=(size_t)hdr[2])
+			GError("Error: truncated temporary collapse file!\n");
+		buf[hdr[1]]=0;
+		qv()[hdr[2]]=0;
+		char* n=buf+hdr[1]+hdr[2]+2;
+		if (fread(n, 1, hdr[3], f)!=(size_t)hdr[3])
+			GError("Error: truncated temporary collapse file!\n");
+		n[hdr[3]]=0;
+		return true;
+	}
+};
+
+FqDupSpill::~FqDupSpill() {
+	if (parts) closeParts(parts);
+	for (int i=0;i<runs.Count();i++)
+		unlink(runs[i].fname.chars());
+	if (tmpCreated) rmdir(tmpDir.chars());
+}
+
+void FqDupSpill::setMemLimit(uint64 maxmem, const char* tmpdir) {
+	memLimit=maxmem;
+	tmpDir=(tmpdir==NULL || tmpdir[0]==0) ? "/tmp" : tmpdir;
+	tmpDir.chomp('/');
+	tmpDir+="/fqtrim_XXXXXX";
+}
+
+//the run files go to a private directory (mode 0700), created on the first spill
+void FqDupSpill::createTmpDir() {
+	if (tmpCreated) return;
+	char* d=Gstrdup(tmpDir.chars());
+	if (mkdtemp(d)==NULL)
+		GError("Error creating temporary directory %s\n", tmpDir.chars());
+	tmpDir=d;
+	GFREE(d);
+	tmpCreated=true;
+}
+
+FILE** FqDupSpill::openParts(int level, GVec<FqDupRun>& newruns) {
+	FILE** fparts=NULL;
+	GMALLOC(fparts, FQDUP_SPILL_PARTS*sizeof(FILE*));
+	for (int i=0;i<FQDUP_SPILL_PARTS;i++) {
+		GStr fname;
+		{
+#ifndef NOTHREADS
+			GLockGuard<GFastMutex> guard(runsMutex);
+#endif
+			createTmpDir();
+			fname=tmpDir;
+			fname.appendfmt("/%d.tmp", fileCount++);
+		}
+		//never follow or reuse an existing file
+		int fd=open(fname.chars(), O_CREAT|O_EXCL|O_WRONLY, 0600);
+		fparts[i]=(fd<0) ? NULL : fdopen(fd, "wb");
+		if (fparts[i]==NULL)
+			GError("Error creating temporary collapse file %s\n", fname.chars());
+		setvbuf(fparts[i], NULL, _IOFBF, 256*1024);
+		FqDupRun run(fname.chars(), level);
+		newruns.Add(run);
+	}
+	return fparts;
+}
+
+void FqDupSpill::closeParts(FILE** fparts) {
+	for (int i=0;i<FQDUP_SPILL_PARTS;i++)
+		if (fclose(fparts[i])!=0)
+			GError("Error writing temporary collapse file (disk full?)\n");
+	GFREE(fparts);
+}
+
+void FqDupSpill::spillTable(FqDupTable& t, FILE** fparts, int level) {
+	FqDupView v;
+	t.startIterate();
+	while (t.nextRecord(v)) {
+		int p=spillHash(v.seq+v.ulen, v.len-v.ulen, level) % FQDUP_SPILL_PARTS;
+		writeRunRec(fparts[p], v.count, v.seq, v.len, v.qv, v.qlen, v.name, v.mlen, v.ulen);
+	}
+	t.Clear(true);
+}
+
+void FqDupSpill::add(const char* seq, int slen, const char* qv, int qlen, const char* name,
+		int mlen, int ulen) {
+	if (parts==NULL) {
+		table->add(seq, slen, qv, qlen, name, 1, mlen, ulen);
+		if (memLimit==0 || table->memUsed()<=memLimit) return;
+		//memory limit reached, switch to run files from now on
+		parts=openParts(0, runs);
+		partsLevel=0;
+		numSpilled+=table->Count();
+		spillTable(*table, parts, 0);
+		return;
+	}
+	int p=spillHash(seq+ulen, slen-ulen, partsLevel) % FQDUP_SPILL_PARTS;
+	if (!table->namesKept()) name=NULL;
+	writeRunRec(parts[p], 1, seq, slen, qv, qlen, name, mlen, ulen);
+	numSpilled++;
+}
+
+void FqDupSpill::reset() {
+	finish();
+	for (int i=0;i<runs.Count();i++)
+		unlink(runs[i].fname.chars());
+	runs.Clear();
+	fileCount=0;
+	numSpilled=0;
+}
+
+void FqDupSpill::finish() {
+	if (parts==NULL) return;
+	closeParts(parts);
+	parts=NULL;
+}
+
+bool FqDupSpill::loadNext(FqDupTable& t, uint64 maxmem) {
+	SRunRec rec;
+	t.Clear();
+	while (true) {
+		FqDupRun run;
+		{
+#ifndef NOTHREADS
+			GLockGuard<GFastMutex> guard(runsMutex);
+#endif
+			if (runs.Count()==0) return false;
+			run=runs.Pop();
+		}
+		FILE* f=fopen(run.fname.chars(), "rb");
+		if (f==NULL) GError("Error opening temporary collapse file %s\n", run.fname.chars());
+		setvbuf(f, NULL, _IOFBF, 256*1024);
+		FILE** subparts=NULL;
+		GVec<FqDupRun> subruns;
+		int sublevel=run.level+1;
+		while (rec.read(f)) {
+			if (subparts) {
+				int p=spillHash(rec.seq()+rec.ulen(), rec.slen()-rec.ulen(), sublevel) % FQDUP_SPILL_PARTS;
+				writeRunRec(subparts[p], rec.count(), rec.seq(), rec.slen(),
+						rec.qv(), rec.qlen(), rec.name(), rec.mlen(), rec.ulen());
+				continue;
+			}
+			t.add(rec.seq(), rec.slen(), rec.qv(), rec.qlen(), rec.name(), rec.count(),
+					rec.mlen(), rec.ulen());
+			if (maxmem && t.memUsed()>maxmem && sublevel<=FQDUP_MAX_LEVEL) {
+				//this partition is still too large, split it again
+				subparts=openParts(sublevel, subruns);
+				spillTable(t, subparts, sublevel);
+			}
+		}
+		fclose(f);
+		unlink(run.fname.chars());
+		if (subparts==NULL) return true;
+		closeParts(subparts);
+		{
+#ifndef NOTHREADS
+			GLockGuard<GFastMutex> guard(runsMutex);
+#endif
+			for (int i=0;i<subruns.Count();i++)
+				runs.Add(subruns[i]);
+		}
+	}
+}
+
+uint64 parseMemSize(const char* s) {
+	char* endp=NULL;
+	double v=strtod(s, &endp);
+	if (endp==s || v<=0) return 0;
+	uint64 m=1024ULL*1024ULL;
+	switch (toupper(*endp)) {
+		case 'K': m=1024ULL; break;
+		case 'M': break;
+		case 'G': m=1024ULL*1024ULL*1024ULL; break;
+		case 'T': m=1024ULL*1024ULL*1024ULL*1024ULL; break;
+		case 0: break;
+		default: return 0;
+	}
+	return (uint64)(v*m);
+}
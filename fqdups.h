@@ -0,0 +1,168 @@
+#ifndef FQ_DUPS_H
+#define FQ_DUPS_H
+#include "GBase.h"
+#include "GStr.h"
+#include "GVec.hh"
+#ifndef NOTHREADS
+#include "GThreads.h"
+#endif
+
+// Compact table of unique read sequences, used for collapsing duplicates (-C)
+//
+// Every unique key gets a variable length record appended to a chunked byte
+// pool (so records are kept in insertion order):
+//   count(4) | len(4) | flags(1) | [mlen(4)] | [ulen(1) link(8)] | key | mean qv (optional) | name\0 (optional)
+// Keys made only of A,C,G,T are stored 2-bit packed (4 bases per byte); any
+// other character (N etc.) sends the key down the "exception" path, where the
+// sequence is kept verbatim.
+// A read pair is collapsed as a single key, the concatenation of the two
+// mate sequences, with the length of the first mate (mlen) also stored in
+// the record and compared (so memory is still proportional to unique pairs).
+// With UMIs the key is the UMI followed by the read sequence, and the UMI
+// length (ulen) is stored in the record; quality values are kept only for the
+// read sequence. mergeUMIs() can then fold records whose UMIs are 1 mismatch
+// apart (same read sequence) into the more abundant one, using the link field.
+// The index is a flat open-addressing array of 16 byte slots (linear probing)
+// holding only the record offset, the full hash and the key length, so a probe
+// rarely touches the pool unless the key is very likely to match.
+
+struct FqDupSlot {
+	uint64 rofs; //offset of the record in the pool (0 = empty slot)
+	uint32 hcode; //hash code of the key
+	uint32 len; //key length
+};
+
+struct FqDupView { //a record as returned by FqDupTable::nextRecord()
+	int count; //duplication count
+	int len; //sequence length
+	int ulen; //UMI length (the UMI is the seq prefix), 0 if no UMI
+	int mlen; //for a read pair, length of mate 1 (seq+ulen+mlen is mate 2), 0 otherwise
+	int qlen; //0 if there are no quality values (FASTA input), len-ulen otherwise
+	const char* seq; //decoded sequence (table owned buffer, valid until the next call)
+	char* qv; //average quality values (points into the pool, not 0-terminated!)
+	const char* name; //name of the first read seen, NULL if names are not kept
+};
+
+class FqDupTable {
+ protected:
+	FqDupSlot* slots;
+	uint64 capacity; //number of slots, always a power of 2
+	int initBits;
+	uint64 numKeys;
+	//record pool:
+	char** chunks;
+	uint64* chunk_used;
+	uint64* chunk_size;
+	int numChunks;
+	int allocChunks;
+	uint64 poolSize; //total bytes allocated for the pool
+	bool keepNames;
+	//scratch buffers:
+	byte* kbuf; //packed key of the last lookup
+	int kbufCap;
+	char* sbuf; //decoded sequence for iteration
+	int sbufCap;
+	//iteration state:
+	int iterChunk;
+	uint64 iterPos;
+	char* recPtr(uint64 rofs) {
+		return chunks[(rofs>>32)-1]+(rofs & 0xFFFFFFFFULL);
+	}
+	uint64 newRecord(uint64 rsize, char* & rec);
+	void grow();
+	int packKey(const char* seq, int slen); //returns key size, or -1 for the exception path
+	//slot holding the given key, or the empty slot where it should be added
+	uint64 findSlot(const char* seq, int slen, int mlen, int ulen,
+			const byte* & key, int& ksize, uint32& h, byte& flags);
+	char* decodeRecord(char* rec, FqDupView& v); //returns the end of the record
+ public:
+	FqDupTable(bool keep_names=true, int init_bits=16);
+	~FqDupTable();
+	void setKeepNames(bool v) { keepNames=v; }
+	bool namesKept() { return keepNames; }
+	//add a read sequence, or update the count and the mean quality values
+	//of an existing record; returns the updated duplicate count
+	//(dupcount>1 adds an already collapsed record, e.g. reloaded from disk)
+	//mlen>0 means seq (and qv) is the concatenation of a read pair,
+	//with the first mlen bases coming from mate 1
+	//ulen>0 means seq starts with a UMI of that length (not covered by qv)
+	int add(const char* seq, int slen, const char* qv, int qlen, const char* name,
+			int dupcount=1, int mlen=0, int ulen=0);
+	//directional 1-mismatch UMI merging: a record is merged into its most
+	//abundant neighbor (same read sequence, UMI 1 mismatch away) if that has
+	//a count of at least 2*count-1; merged records are skipped by nextRecord()
+	//returns the number of records merged
+	uint64 mergeUMIs();
+	uint64 Count() { return numKeys; }
+	uint64 memUsed() { return poolSize+capacity*sizeof(FqDupSlot); }
+	void Clear(bool shrink=false); //shrink: also free the index array
+
+	//iterate over all records, in the order they were first added
+	void startIterate() { iterChunk=0; iterPos=0; }
+	bool nextRecord(FqDupView& v);
+};
+
+// Bounded memory collapsing (--mem): the in-memory FqDupTable is used until
+// it grows over the memory limit; at that point all its records are written
+// (already collapsed) to FQDUP_SPILL_PARTS temporary run files partitioned
+// by key hash, and all the reads that follow are appended there too.
+// UMIs are not part of the partitioning hash, so all the UMIs seen with a
+// read sequence end up in the same run file (needed by mergeUMIs()).
+// Each run file can then be collapsed independently with loadNext(); a run
+// too large for the memory limit is split again using other hash bits.
+// Records of a key are always reloaded in the order they were seen,
+// so the counts and quality values are the same as with in-memory -C.
+
+#define FQDUP_SPILL_PARTS 64
+#define FQDUP_MAX_LEVEL 4
+#define FQDUP_MIN_MEM (32ULL<<20)
+
+struct FqDupRun {
+	GStr fname;
+	int level; //partitioning level, selects the hash seed
+	FqDupRun(const char* fn=NULL, int lvl=0):fname(fn), level(lvl) { }
+};
+
+class FqDupSpill {
+ protected:
+	FqDupTable* table; //in-memory table used before spilling
+	uint64 memLimit; //0 = no limit
+	GStr tmpDir; //directory of the run files (a mkdtemp() template until created)
+	bool tmpCreated;
+	int fileCount; //number of run files created so far
+	FILE** parts; //run files being written (first level only)
+	int partsLevel;
+	GVec<FqDupRun> runs; //run files waiting to be collapsed
+	uint64 numSpilled; //number of records written to run files
+#ifndef NOTHREADS
+	GFastMutex runsMutex;
+#endif
+	void createTmpDir();
+	FILE** openParts(int level, GVec<FqDupRun>& newruns);
+	void closeParts(FILE** fparts);
+	void spillTable(FqDupTable& t, FILE** fparts, int level);
+ public:
+	FqDupSpill(FqDupTable& t):table(&t), memLimit(0), tmpDir(), tmpCreated(false),
+	    fileCount(0), parts(NULL), partsLevel(0), runs(), numSpilled(0) { }
+	~FqDupSpill();
+	void setMemLimit(uint64 maxmem, const char* tmpdir);
+	uint64 getMemLimit() { return memLimit; }
+	bool spilled() { return fileCount>0; }
+	int numRunFiles() { return fileCount; }
+	uint64 spilledRecords() { return numSpilled; }
+	//collapse a read in memory, or append it to its run file if spilling
+	void add(const char* seq, int slen, const char* qv, int qlen, const char* name,
+			int mlen=0, int ulen=0);
+	//stop writing run files (must be called after the last add())
+	void finish();
+	//discard any run files left and get ready for another input file
+	void reset();
+	//collapse the next run file into t (t is cleared first);
+	//returns false when no more run files are left; thread safe
+	bool loadNext(FqDupTable& t, uint64 maxmem);
+};
+
+//parse a memory size like 512M, 4G, 800000K (a plain number means MB)
+uint64 parseMemSize(const char* s);
+
+#endif
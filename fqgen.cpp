@@ -0,0 +1,98 @@
+#include "GArgs.h"
+#include "GStr.h"
+#include "fqgen.h"
+
+// Writes the synthetic reads of fqgen.h to FASTQ files (make bench)
+
+#define USAGE "fqgen: synthetic FASTQ reads for fqtrim benchmarks. Usage:\n\
+fqgen [-n <num_reads>] [-l <read_len>] [-s <seed>] [-q <q5>,<q3>]\\\n\
+   [--nrate <f>] [--polya <f>] [--adapter <f>] [--adpos <min>,<max>]\\\n\
+   [--dups <f>] [--adfile <adapters.txt>] [-o <out.fq>] [-2 <out_mates.fq>]\n\
+\n\
+Options:\n\
+-n number of reads (or pairs) to generate (default: 100000)\n\
+-l length of the reads (default: 100)\n\
+-s random seed (default: 1)\n\
+-q base quality at the 5' and 3' ends of the reads; quality values decay\n\
+   linearly between them, with some noise (default: 38,20)\n\
+-o output file (default: stdout)\n\
+-2 also generate the mates of the reads into this file (paired reads)\n\
+--nrate fraction of bases replaced by N (default: 0.002)\n\
+--polya fraction of reads ending in a poly-A tail (poly-T start for the mates,\n\
+   default: 0.02)\n\
+--adapter fraction of reads with a 3' adapter, i.e. from inserts shorter than\n\
+   the read length (default: 0.1)\n\
+--adpos range for the start of the adapter in these reads, as fractions of\n\
+   the read length (default: 0.3,0.95)\n\
+--dups fraction of reads (or pairs) duplicating a previous read (default: 0.2)\n\
+--adfile write the 3' adapter sequences used into this file (fqtrim -f format)\n\
+"
+
+int main(int argc, char* argv[]) {
+	GArgs args(argc, argv, "nrate=polya=adapter=adpos=dups=adfile=hn:l:s:q:o:2:");
+	int e;
+	if ((e=args.isError())>0 || args.getOpt('h')!=NULL) {
+		GMessage("%s\n", USAGE);
+		if (e>0) GMessage("Invalid argument: %s\n", argv[e]);
+		exit(1);
+	}
+	GenParams p;
+	uint64 numReads=100000;
+	uint64 seed=1;
+	GStr s;
+	if ((s=args.getOpt('n')).is_empty()==false) numReads=strtoull(s.chars(), NULL, 10);
+	if ((s=args.getOpt('l')).is_empty()==false) p.len=s.asInt();
+	if (p.len<10) GError("Error: read length must be at least 10\n");
+	if ((s=args.getOpt('s')).is_empty()==false) seed=strtoull(s.chars(), NULL, 10);
+	if ((s=args.getOpt('q')).is_empty()==false &&
+	    sscanf(s.chars(), "%d,%d", &p.q5, &p.q3)!=2)
+		GError("Error: invalid -q value (%s), expected <q5>,<q3>\n", s.chars());
+	if ((s=args.getOpt("nrate")).is_empty()==false) p.nrate=s.asReal();
+	if ((s=args.getOpt("polya")).is_empty()==false) p.polya=s.asReal();
+	if ((s=args.getOpt("adapter")).is_empty()==false) p.adapter=s.asReal();
+	if ((s=args.getOpt("dups")).is_empty()==false) p.dups=s.asReal();
+	if ((s=args.getOpt("adpos")).is_empty()==false &&
+	    (sscanf(s.chars(), "%lf,%lf", &p.admin, &p.admax)!=2 || p.admin<0 || p.admax>1 || p.admin>p.admax))
+		GError("Error: invalid --adpos value (%s), expected <min>,<max> in [0,1]\n", s.chars());
+	FILE* fout=stdout;
+	FILE* fout2=NULL;
+	if ((s=args.getOpt('o')).is_empty()==false && s!="-") {
+		fout=fopen(s.chars(), "w");
+		if (fout==NULL) GError("Error creating file %s\n", s.chars());
+	}
+	if ((s=args.getOpt('2')).is_empty()==false) {
+		fout2=fopen(s.chars(), "w");
+		if (fout2==NULL) GError("Error creating file %s\n", s.chars());
+	}
+	if ((s=args.getOpt("adfile")).is_empty()==false) {
+		FILE* fa=fopen(s.chars(), "w");
+		if (fa==NULL) GError("Error creating file %s\n", s.chars());
+		fprintf(fa, ",%s\n", FQGEN_ADAPTER1);
+		if (fout2) fprintf(fa, ",%s\n", FQGEN_ADAPTER2);
+		fclose(fa);
+	}
+	FqReadGen gen(p, seed, fout2!=NULL);
+	char* seq=NULL;
+	char* qv=NULL;
+	char* seq2=NULL;
+	char* qv2=NULL;
+	GMALLOC(seq, p.len+1);
+	GMALLOC(qv, p.len+1);
+	GMALLOC(seq2, p.len+1);
+	GMALLOC(qv2, p.len+1);
+	for (uint64 r=0;r<numReads;r++) {
+		gen.next(seq, qv, seq2, qv2);
+		if (fout2) {
+			fprintf(fout, "@gen.%llu/1\n%s\n+\n%s\n", (unsigned long long)r, seq, qv);
+			fprintf(fout2, "@gen.%llu/2\n%s\n+\n%s\n", (unsigned long long)r, seq2, qv2);
+		}
+		else fprintf(fout, "@gen.%llu\n%s\n+\n%s\n", (unsigned long long)r, seq, qv);
+	}
+	GFREE(qv2);
+	GFREE(seq2);
+	GFREE(qv);
+	GFREE(seq);
+	if (fout!=stdout) fclose(fout);
+	if (fout2) fclose(fout2);
+	return 0;
+}
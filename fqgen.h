@@ -0,0 +1,139 @@
+#ifndef FQ_GEN_H
+#define FQ_GEN_H
+#include "GBase.h"
+
+// Deterministic synthetic reads, for the benchmarks: written to files by
+// fqgen, or generated in memory by fqkbench. The same parameters and seed
+// always give the same reads.
+
+//Illumina TruSeq 3' adapters of read 1 and read 2
+#define FQGEN_ADAPTER1 "AGATCGGAAGAGCACACGTCTGAACTCCAGTCAC"
+#define FQGEN_ADAPTER2 "AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGTAGATCTCGGTGG"
+
+#define FQGEN_DUP_POOL 4096 //reads kept for duplication
+
+//small self-contained PRNG (xorshift64*), so the output does not depend
+//on the C library
+struct GenRand {
+	uint64 s;
+	GenRand(uint64 seed):s(0) { //seed scrambled by splitmix64
+		uint64 z=seed+0x9E3779B97F4A7C15ULL;
+		z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+		z=(z^(z>>27))*0x94D049BB133111EBULL;
+		s=z^(z>>31);
+		if (s==0) s=1;
+	}
+	uint64 next() {
+		s^=s>>12; s^=s<<25; s^=s>>27;
+		return s*2685821657736338717ULL;
+	}
+	double unif() { return (next()>>11)*(1.0/9007199254740992.0); }
+	int range(int n) { return (int)((next()>>33)%(uint64)n); }
+	bool chance(double p) { return p>0 && unif()<p; }
+};
+
+struct GenParams {
+	int len;
+	int q5, q3; //base quality at the 5' and 3' ends (decaying linearly)
+	double nrate; //fraction of N bases
+	double polya; //fraction of reads with a poly-A tail
+	double adapter; //fraction of reads running into the 3' adapter
+	double admin, admax; //range for the adapter start, as fractions of len
+	double dups; //fraction of duplicated reads
+	GenParams():len(100), q5(38), q3(20), nrate(0.002), polya(0.02), adapter(0.1),
+	    admin(0.3), admax(0.95), dups(0.2) { }
+};
+
+class FqReadGen {
+	GenParams p;
+	GenRand rnd;
+	bool paired;
+	char* frag;
+	char* rcfrag;
+	char* pool; //sequences of the last reads, some of which get duplicated
+	int poolsize;
+	uint64 numPooled;
+	static char base(int i) { return "ACGT"[i]; }
+	static void revComp(char* d, const char* s, int n) {
+		for (int i=0;i<n;i++) {
+			char c=s[n-1-i];
+			d[i]= (c=='A') ? 'T' : (c=='C') ? 'G' : (c=='G') ? 'C' : 'A';
+		}
+	}
+	//read sequence from a fragment: the fragment, then the adapter, then random bases
+	void fillRead(char* r, const char* fr, int flen, const char* adapter) {
+		int i=0;
+		for (;i<p.len && i<flen;i++) r[i]=fr[i];
+		for (int a=0;i<p.len && adapter[a];i++,a++) r[i]=adapter[a];
+		for (;i<p.len;i++) r[i]=base(rnd.range(4));
+		r[p.len]=0;
+	}
+	//N bases and qualities (a new sequencing of the same molecule, for duplicates too)
+	void sequence(char* seq, char* qv) {
+		for (int i=0;i<p.len;i++) {
+			int q=p.q5-(p.q5-p.q3)*i/(p.len>1 ? p.len-1 : 1)+rnd.range(7)-3;
+			if (q<2) q=2;
+			if (q>41) q=41;
+			if (rnd.chance(p.nrate)) {
+				seq[i]='N';
+				q=2;
+			}
+			qv[i]=(char)(q+33);
+		}
+		qv[p.len]=0;
+	}
+ public:
+	FqReadGen(GenParams& params, uint64 seed, bool pairs):p(params), rnd(seed), paired(pairs),
+	    frag(NULL), rcfrag(NULL), pool(NULL), poolsize(0), numPooled(0) {
+		GMALLOC(frag, 2*p.len+1);
+		GMALLOC(rcfrag, 2*p.len+1);
+		poolsize=paired ? 2*(p.len+1) : p.len+1;
+		GMALLOC(pool, (size_t)FQGEN_DUP_POOL*poolsize);
+	}
+	~FqReadGen() {
+		GFREE(pool);
+		GFREE(rcfrag);
+		GFREE(frag);
+	}
+	//next read (and mate, if paired): len+1 bytes for each sequence and qv
+	void next(char* seq, char* qv, char* seq2=NULL, char* qv2=NULL) {
+		int len=p.len;
+		if (numPooled>0 && rnd.chance(p.dups)) {
+			char* d=pool+(size_t)rnd.range(GMIN(numPooled, (uint64)FQGEN_DUP_POOL))*poolsize;
+			memcpy(seq, d, len+1);
+			sequence(seq, qv);
+			if (paired) {
+				memcpy(seq2, d+len+1, len+1);
+				sequence(seq2, qv2);
+			}
+			return;
+		}
+		//fragment: longer than the reads, unless they run into the adapter
+		int flen=len+rnd.range(len+1);
+		bool polyA=rnd.chance(p.polya);
+		if (rnd.chance(p.adapter)) {
+			int amin=(int)(p.admin*len), amax=(int)(p.admax*len);
+			flen=amin+rnd.range(amax-amin+1);
+		}
+		else if (polyA) flen=len; //the tail should be seen at the read end
+		for (int i=0;i<flen;i++) frag[i]=base(rnd.range(4));
+		if (polyA) {
+			int tlen=8+rnd.range(GMAX(1, flen/3-8));
+			if (tlen>flen) tlen=flen;
+			memset(frag+flen-tlen, 'A', tlen);
+		}
+		char* d=pool+(size_t)(numPooled % FQGEN_DUP_POOL)*poolsize;
+		numPooled++;
+		fillRead(seq, frag, flen, FQGEN_ADAPTER1);
+		memcpy(d, seq, len+1);
+		sequence(seq, qv);
+		if (paired) {
+			revComp(rcfrag, frag, flen);
+			fillRead(seq2, rcfrag, flen, FQGEN_ADAPTER2);
+			memcpy(d+len+1, seq2, len+1);
+			sequence(seq2, qv2);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "fqjson.h"
+#include <math.h>
+
+void FqJson::member(const char* name) {
+	if (depth>0) {
+		fputs(first[depth] ? "\n" : ",\n", f);
+		fprintf(f, "%*s", 2*depth, "");
+	}
+	first[depth]=false;
+	if (name) {
+		str(name);
+		fputs(": ", f);
+	}
+}
+
+void FqJson::str(const char* s) {
+	fputc('"', f);
+	for (;*s;s++) {
+		unsigned char c=*s;
+		if (c=='"' || c=='\\') fprintf(f, "\\%c", c);
+		else if (c=='\n') fputs("\\n", f);
+		else if (c=='\t') fputs("\\t", f);
+		else if (c<0x20) fprintf(f, "\\u%04x", c);
+		else fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+void FqJson::beginObject(const char* name) {
+	if (depth+1>=FQJSON_MAXDEPTH) GError("Error: JSON output nested too deep\n");
+	member(name);
+	fputc('{', f);
+	first[++depth]=true;
+}
+
+void FqJson::endObject() {
+	bool empty=first[depth--];
+	if (!empty) fprintf(f, "\n%*s", 2*depth, "");
+	fputc('}', f);
+	if (depth==0) fputc('\n', f);
+}
+
+void FqJson::beginArray(const char* name) {
+	if (depth+1>=FQJSON_MAXDEPTH) GError("Error: JSON output nested too deep\n");
+	member(name);
+	fputc('[', f);
+	first[++depth]=true;
+}
+
+void FqJson::endArray() {
+	bool empty=first[depth--];
+	if (!empty) fprintf(f, "\n%*s", 2*depth, "");
+	fputc(']', f);
+}
+
+void FqJson::addInt(const char* name, uint64 v) {
+	member(name);
+	fprintf(f, "%llu", v);
+}
+
+void FqJson::addNum(const char* name, double v) {
+	member(name);
+	if (isfinite(v)) fprintf(f, "%.10g", v);
+	else fputs("null", f);
+}
+
+void FqJson::addStr(const char* name, const char* s) {
+	member(name);
+	str(s ? s : "");
+}
+
+void FqJson::addBool(const char* name, bool v) {
+	member(name);
+	fputs(v ? "true" : "false", f);
+}
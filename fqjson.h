@@ -0,0 +1,29 @@
+#ifndef FQ_JSON_H
+#define FQ_JSON_H
+#include "GBase.h"
+
+// Minimal streaming JSON writer, for --json-stats: values are written to
+// the file as they are added, as members of the innermost open object
+// (name given) or array (name NULL), indented by nesting level.
+
+#define FQJSON_MAXDEPTH 16
+
+class FqJson {
+	FILE* f;
+	int depth;
+	bool first[FQJSON_MAXDEPTH]; //no member written yet at this level
+	void member(const char* name); //separator, indentation and name
+	void str(const char* s); //quoted and escaped
+ public:
+	FqJson(FILE* fout):f(fout), depth(0) { first[0]=true; }
+	void beginObject(const char* name=NULL);
+	void endObject();
+	void beginArray(const char* name=NULL);
+	void endArray();
+	void addInt(const char* name, uint64 v);
+	void addNum(const char* name, double v); //null if not finite
+	void addStr(const char* name, const char* s);
+	void addBool(const char* name, bool v);
+};
+
+#endif
@@ -0,0 +1,310 @@
+#include "GArgs.h"
+#include "GStr.h"
+#include "fqkernels.h"
+#include "fqprof.h"
+#include "fqgen.h"
+#include "fqsimd.h"
+
+// Microbenchmarks of the trimming kernels (make kbench): each kernel runs
+// over the same in-memory corpus of synthetic reads (fqgen.h), without any
+// file I/O, and is reported in ns per read and bytes per cycle (of the cycle
+// counter used by --profile, i.e. the TSC on x86). The checksum of the
+// results of each kernel is also reported, it should not change between
+// builds unless the kernel's output changed.
+
+#define USAGE "fqkbench: fqtrim kernel microbenchmarks. Usage:\n\
+fqkbench [-n <num_reads>] [-l <read_len>] [-s <seed>] [-r <repeats>]\\\n\
+   [-k <kernel>[,..]] [-S <simd_level>] [-o <results.tsv>] [-c <baseline.tsv>]\n\
+\n\
+Options:\n\
+-n number of reads in the corpus (default: 20000)\n\
+-l read length (default: 100)\n\
+-s random seed for the corpus (default: 1)\n\
+-r runs over the corpus for each kernel, the fastest is reported (default: 5)\n\
+-k only run these kernels (qtrim, ntrim, trim_poly3, trim_poly5,\n\
+   trim_adapter3, trim_adapter5, dust, getFastxRead, write1Read)\n\
+-S SIMD level of the kernels (scalar, sse4.2, avx2 or avx512; default: the\n\
+   best the CPU supports)\n\
+-o write the results to this file (default: stdout)\n\
+-c compare the results with those of another build (a previous -o file)\n\
+"
+
+//Illumina 5' adapter, for trim_adapter5
+#define KBENCH_ADAPTER5 "ACACTCTTTCCCTACACGACGCTCTTCCGATCT"
+
+struct KCorpus {
+	GVec<RData> reads;
+	GStr fastq; //the same reads, as FASTQ text
+	uint64 bases;
+	char* outbuf; //for write1Read
+	size_t outcap;
+	KCorpus():reads(), fastq(), bases(0), outbuf(NULL), outcap(0) { }
+	~KCorpus() { GFREE(outbuf); }
+};
+
+typedef uint64 (*KernelFunc)(KCorpus& c, CTrimKernels& tk);
+
+uint64 k_qtrim(KCorpus& c, CTrimKernels& tk) {
+	uint64 sum=0;
+	for (int i=0;i<c.reads.Count();i++) {
+		int l5=0, l3=0;
+		if (tk.qtrim(c.reads[i].qv.chars(), c.reads[i].qv.length(), l5, l3)) sum+=l5+l3;
+	}
+	return sum;
+}
+
+uint64 k_ntrim(KCorpus& c, CTrimKernels& tk) {
+	uint64 sum=0;
+	for (int i=0;i<c.reads.Count();i++) {
+		int l5=0, l3=0;
+		double pN=0;
+		if (tk.ntrim(c.reads[i].seq.chars(), c.reads[i].seq.length(), l5, l3, pN)) sum+=l5+l3;
+	}
+	return sum;
+}
+
+uint64 k_trim_poly3(KCorpus& c, CTrimKernels& tk) {
+	uint64 sum=0;
+	for (int i=0;i<c.reads.Count();i++) {
+		int l5=0, l3=0;
+		if (tk.trim_poly3(c.reads[i].seq.chars(), c.reads[i].seq.length(), l5, l3, polyA_seed)) sum+=l5+l3;
+	}
+	return sum;
+}
+
+uint64 k_trim_poly5(KCorpus& c, CTrimKernels& tk) {
+	uint64 sum=0;
+	for (int i=0;i<c.reads.Count();i++) {
+		int l5=0, l3=0;
+		if (tk.trim_poly5(c.reads[i].seq.chars(), c.reads[i].seq.length(), l5, l3, polyT_seed)) sum+=l5+l3;
+	}
+	return sum;
+}
+
+uint64 k_trim_adapter3(KCorpus& c, CTrimKernels& tk) {
+	uint64 sum=0;
+	for (int i=0;i<c.reads.Count();i++) {
+		int l5=0, l3=0, aidx=0;
+		if (tk.trim_adapter3(c.reads[i].seq.chars(), c.reads[i].seq.length(), l5, l3, aidx)) sum+=l5+l3;
+	}
+	return sum;
+}
+
+uint64 k_trim_adapter5(KCorpus& c, CTrimKernels& tk) {
+	uint64 sum=0;
+	for (int i=0;i<c.reads.Count();i++) {
+		int l5=0, l3=0, aidx=0;
+		if (tk.trim_adapter5(c.reads[i].seq.chars(), c.reads[i].seq.length(), l5, l3, aidx)) sum+=l5+l3;
+	}
+	return sum;
+}
+
+uint64 k_dust(KCorpus& c, CTrimKernels& tk) {
+	uint64 sum=0;
+	for (int i=0;i<c.reads.Count();i++)
+		sum+=tk.dust(c.reads[i].seq.chars(), c.reads[i].seq.length());
+	return sum;
+}
+
+uint64 k_getFastxRead(KCorpus& c, CTrimKernels&) {
+	FILE* f=fmemopen((void*)c.fastq.chars(), c.fastq.length(), "r");
+	if (f==NULL) GError("Error: fmemopen() failed\n");
+	GLineReader lr(f);
+	RData rd;
+	GStr fname("corpus");
+	bool fasta=false;
+	uint64 sum=0;
+	while (getFastxRead(lr, rd, fname, fasta))
+		sum+=rd.seq.length()+rd.qv.length();
+	fclose(f);
+	return sum;
+}
+
+uint64 k_write1Read(KCorpus& c, CTrimKernels&) {
+	FILE* f=fmemopen(c.outbuf, c.outcap, "w");
+	if (f==NULL) GError("Error: fmemopen() failed\n");
+	for (int i=0;i<c.reads.Count();i++)
+		write1Read(f, c.reads[i], i+1);
+	uint64 sum=ftell(f);
+	fclose(f);
+	return sum;
+}
+
+struct KBench {
+	const char* name;
+	KernelFunc run;
+	bool textBytes; //throughput over the FASTQ text rather than the bases
+};
+
+static KBench kernels[]={
+	{ "qtrim", k_qtrim, false },
+	{ "ntrim", k_ntrim, false },
+	{ "trim_poly3", k_trim_poly3, false },
+	{ "trim_poly5", k_trim_poly5, false },
+	{ "trim_adapter3", k_trim_adapter3, false },
+	{ "trim_adapter5", k_trim_adapter5, false },
+	{ "dust", k_dust, false },
+	{ "getFastxRead", k_getFastxRead, true },
+	{ "write1Read", k_write1Read, true },
+	{ NULL, NULL, false }
+};
+
+struct KResult {
+	GStr name;
+	double nsPerRead;
+	double bytesPerCycle;
+	uint64 checksum;
+	KResult():name(), nsPerRead(0), bytesPerCycle(0), checksum(0) { }
+};
+
+static void makeCorpus(KCorpus& c, int nreads, int rlen, uint64 seed) {
+	GenParams gp;
+	gp.len=rlen;
+	FqReadGen gen(gp, seed, false);
+	char* seq=NULL;
+	char* qv=NULL;
+	GMALLOC(seq, rlen+1);
+	GMALLOC(qv, rlen+1);
+	c.reads.setCount(nreads);
+	for (int i=0;i<nreads;i++) {
+		gen.next(seq, qv);
+		RData& rd=c.reads[i];
+		char rid[32];
+		sprintf(rid, "gen.%d", i);
+		rd.rid=rid;
+		rd.seq=seq;
+		rd.qv=qv;
+		c.bases+=rlen;
+		c.fastq.append("@");
+		c.fastq.append(rid);
+		c.fastq.append("\n");
+		c.fastq.append(seq);
+		c.fastq.append("\n+\n");
+		c.fastq.append(qv);
+		c.fastq.append("\n");
+	}
+	GFREE(qv);
+	GFREE(seq);
+	c.outcap=c.fastq.length()*2+4096;
+	GMALLOC(c.outbuf, c.outcap);
+}
+
+static bool selected(GStr& only, const char* name) {
+	if (only.is_empty()) return true;
+	GStr l(","), n(",");
+	l.append(only.chars());
+	l.append(",");
+	n.append(name);
+	n.append(",");
+	return (strstr(l.chars(), n.chars())!=NULL);
+}
+
+static void compareResults(GVec<KResult>& res, const char* basefile) {
+	FILE* f=fopen(basefile, "r");
+	if (f==NULL) GError("Error: cannot open %s\n", basefile);
+	GVec<KResult> base;
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0]=='#' || strncmp(line, "kernel\t", 7)==0) continue;
+		char name[256];
+		KResult r;
+		unsigned long long cs=0;
+		if (sscanf(line, "%255s %lf %lf %llu", name, &r.nsPerRead, &r.bytesPerCycle, &cs)!=4) continue;
+		r.name=name;
+		r.checksum=cs;
+		base.Add(r);
+	}
+	fclose(f);
+	GMessage("\nComparison with %s:\n", basefile);
+	GMessage("%-14s %10s %10s %8s  %s\n", "kernel", "ns/read", "base", "speedup", "checksum");
+	for (int i=0;i<res.Count();i++) {
+		KResult& r=res[i];
+		int b=-1;
+		for (int j=0;j<base.Count();j++)
+			if (base[j].name==r.name) { b=j; break; }
+		if (b<0) {
+			GMessage("%-14s %10.1f %10s %8s  -\n", r.name.chars(), r.nsPerRead, "-", "-");
+			continue;
+		}
+		GMessage("%-14s %10.1f %10.1f %7.2fx  %s\n", r.name.chars(), r.nsPerRead, base[b].nsPerRead,
+		    r.nsPerRead>0 ? base[b].nsPerRead/r.nsPerRead : 0.0,
+		    r.checksum==base[b].checksum ? "same" : "DIFFERENT");
+	}
+}
+
+int main(int argc, char* argv[]) {
+	GArgs args(argc, argv, "hn:l:s:r:k:S:o:c:");
+	int e;
+	if ((e=args.isError())>0 || args.getOpt('h')!=NULL) {
+		GMessage("%s\n", USAGE);
+		if (e>0) GMessage("Invalid argument: %s\n", argv[e]);
+		exit(1);
+	}
+	int nreads=20000, rlen=100, repeats=5;
+	uint64 seed=1;
+	GStr only, s;
+	if ((s=args.getOpt('n')).is_empty()==false) nreads=GMAX(1, s.asInt());
+	if ((s=args.getOpt('l')).is_empty()==false) rlen=s.asInt();
+	if (rlen<10) GError("Error: read length must be at least 10\n");
+	if ((s=args.getOpt('s')).is_empty()==false) seed=strtoull(s.chars(), NULL, 10);
+	if ((s=args.getOpt('r')).is_empty()==false) repeats=GMAX(1, s.asInt());
+	if ((s=args.getOpt('k')).is_empty()==false) only=s;
+	s=args.getOpt('S');
+	if (!fqSimdInit(s.chars()))
+		GError("Error: SIMD level %s is not available here (CPU: %s)\n", s.chars(),
+		    fqSimdCpuFeatures().chars());
+	GMessage("SIMD kernels: %s (CPU: %s)\n", fqSimdLevelName(fqsimd.level), fqSimdCpuFeatures().chars());
+	//the trimming options of the kernels: fqtrim -q 20 -f <the corpus adapters>
+	qvtrim_qmin=20;
+	qv_phredtype=33;
+	GStr a3(FQGEN_ADAPTER1), a5(KBENCH_ADAPTER5);
+	addAdapter(adapters3, a3, galn_TrimRight);
+	addAdapter(adapters5, a5, galn_TrimLeft);
+	KCorpus corpus;
+	makeCorpus(corpus, nreads, rlen, seed);
+	FqTrimOptions opts;
+	CTrimKernels tk(opts);
+	//cycle counter rate
+	uint64 t0=fqNanoTime(), c0=fqCycles();
+	while (fqNanoTime()-t0<20000000) ;
+	double cyclesPerNs=(double)(fqCycles()-c0)/(fqNanoTime()-t0);
+	GVec<KResult> results;
+	for (int k=0;kernels[k].name!=NULL;k++) {
+		KBench& kb=kernels[k];
+		if (!selected(only, kb.name)) continue;
+		KResult kr;
+		kr.name=kb.name;
+		uint64 best=0;
+		for (int r=0;r<repeats;r++) {
+			uint64 ns=fqNanoTime();
+			uint64 cs=kb.run(corpus, tk);
+			ns=fqNanoTime()-ns;
+			if (r>0 && cs!=kr.checksum)
+				GError("Error: kernel %s gave different results over the same corpus\n", kb.name);
+			kr.checksum=cs;
+			if (r==0 || ns<best) best=ns;
+		}
+		uint64 bytes=kb.textBytes ? corpus.fastq.length() : corpus.bases;
+		kr.nsPerRead=(double)best/nreads;
+		kr.bytesPerCycle=(best>0) ? bytes/(best*cyclesPerNs) : 0;
+		GMessage("%-14s %10.1f ns/read %8.3f bytes/cycle\n", kb.name, kr.nsPerRead, kr.bytesPerCycle);
+		results.Add(kr);
+	}
+	FILE* fout=stdout;
+	if ((s=args.getOpt('o')).is_empty()==false) {
+		fout=fopen(s.chars(), "w");
+		if (fout==NULL) GError("Error creating file %s\n", s.chars());
+	}
+	fprintf(fout, "#fqkbench\treads=%d\tlength=%d\tseed=%llu\trepeats=%d\tsimd=%s\n", nreads, rlen,
+	    (unsigned long long)seed, repeats, fqSimdLevelName(fqsimd.level));
+	fprintf(fout, "kernel\tns_per_read\tbytes_per_cycle\tchecksum\n");
+	for (int i=0;i<results.Count();i++) {
+		KResult& r=results[i];
+		fprintf(fout, "%s\t%.2f\t%.4f\t%llu\n", r.name.chars(), r.nsPerRead, r.bytesPerCycle,
+		    (unsigned long long)r.checksum);
+	}
+	if (fout!=stdout) fclose(fout);
+	if ((s=args.getOpt('c')).is_empty()==false)
+		compareResults(results, s.chars());
+	return 0;
+}
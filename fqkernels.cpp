@@ -0,0 +1,1252 @@
+#include "fqkernels.h"
+#include "fqprof.h"
+#include "fqadstats.h"
+#include "fqsimd.h"
+#include <ctype.h>
+
+bool verbose=false;
+int umi_len=0; //--umi <umi_len>, UMI is the 5' end prefix of the read (mate 1)
+bool doPolyTrim=true;
+bool fastaOutput=false;
+bool trimInfo=false; //trim info added to the output reads
+bool dustMask=false;
+bool revCompl=false; //also reverse complement adapter sequences
+int adapter_idx=0;
+bool polyBothEnds=false;
+bool showAdapterIdx=false;
+bool doDust=false;
+bool doCollapse=false;
+char isACGT[256];
+int min_read_len=16;
+double max_perc_N=5.0;
+double perc_lenN=12.0; // incremental distance from ends, in percentage of read length
+          // where N-trimming is allowed (default:12 %) (autolimited to 20)
+int dist_lenN=0; // incremental distance from either end (in bp) 
+          // where N-trimming is allowed (default: none, perc_lenN controls it)
+int dust_cutoff=16;
+bool convert_phred=false;
+GStr prefix;
+int qvtrim_qmin=0;
+int qvtrim_max=0;  //(-t) for -q, do not trim the 3'-end more than this number of bases
+int qvtrim_win=6;  //(-w) for -q, sliding window length for avg qual calculation
+int qv_phredtype=0; // could be 64 or 33 (0 means undetermined yet)
+int qv_cvtadd=0; //could be -31 or +31
+int match_reward=1;
+int mismatch_penalty=3;
+int Xdrop=8;
+int minEndAdapter=6;
+double min_pid3=94.0; //min % identity for primer/adapter match at 3' end
+double min_pid5=96.0; //min % identity for primer/adapter match at 5' end
+int poly_minScore=12; //i.e. an exact match of 6 bases at the proper ends WILL be trimmed
+const char *polyA_seed="AAAA";
+const char *polyT_seed="TTTT";
+
+void initACGT() {
+  memset((void*)isACGT, 0, 256);
+  isACGT['A']=isACGT['a']=isACGT['C']=isACGT['c']=1;
+  isACGT['G']=isACGT['g']=isACGT['T']=isACGT['t']=1;
+}
+
+GPVec<CASeqData> adapters5(false);
+GPVec<CASeqData> adapters3(false);
+GPVec<CASeqData> all_adapters(true);
+
+void addAdapter(GPVec<CASeqData>& adapters, GStr& seq, GAlnTrimType trim_type) {
+  if (seq.is_empty() || seq=="-" ||
+      seq=="N/A" || seq==".") return;
+ ++adapter_idx;
+ CASeqData* adata = new CASeqData(revCompl, adapter_idx);
+ int idx=adapters.Add(adata);
+ if (idx<0) GError("Error: failed to add adapter!\n");
+ adapters[idx]->trim_type=trim_type;
+ adapters[idx]->update(seq.chars());
+ if (trim_type==galn_TrimEither) {
+  //special case, can only be used with adapters==adapters5
+  //add to adapters3 automatically
+  adapters3.Add(adata);
+ }
+ all_adapters.Add(adata);
+}
+
+
+int loadAdapters(const char* fname) {
+  GLineReader lr(fname);
+  char* l;
+  while ((l=lr.nextLine())!=NULL) {
+   if (lr.tlength()<=3 || l[0]=='#') continue;
+   if ( l[0]==' ' || l[0]=='\t' || l[0]==',' ||
+        l[0]==';'|| l[0]==':' ) { //starts with a delimiter
+       //so we're reading 3' adapter here
+      int i=1;
+      while (l[i]!=0 && isspace(l[i])) {
+        i++;
+        }
+      if (l[i]!=0) {
+        GStr s(&(l[i]));
+        addAdapter(adapters3, s, galn_TrimRight);
+        continue;
+        }
+      }
+    else {
+      //5' adapter (at least)
+      GStr s(l);
+      char lastc=s[s.length()-1];
+      s.startTokenize("\t ;,:");
+      GStr a5,a3;
+      if (s.nextToken(a5))
+            s.nextToken(a3);
+      else {
+         //GMessage("No token found on adapter line\n");
+         continue; //nothing on this line
+         }
+      bool nodelim=(lastc>='A');
+      GAlnTrimType ttype5=galn_TrimLeft;
+      //GMessage("tokens found: <%s> , <%s>\n",a5.chars(),a3.chars());
+      a5.upper();
+      a3.upper();
+      if ((a3.is_empty() && nodelim) || a3==a5 || a3=="=") {
+         a3.clear();
+         ttype5=galn_TrimEither;
+         }
+      addAdapter(adapters5, a5, ttype5);
+      addAdapter(adapters3, a3, galn_TrimRight);
+      }
+   }
+   return adapters5.Count()+adapters3.Count();
+}
+
+class NData {
+ public:
+   GVec<int>& NPos; //N positions, in a buffer reused for each read
+   //int NCount;
+   int end5;
+   int end3;
+   int n5; //left side N position (index in NPos)
+   int n3; //right side N position (index in NPos)
+   int seqlen;
+   double perc_N; //percentage of Ns in end5..end3 range only!
+   const char* seq;
+   bool valid;
+   NData(const char* rseq, int len, GVec<int>& npos):NPos(npos), end5(0),end3(len-1),n5(0),n3(-1),
+       seqlen(len), perc_N(0),seq(rseq),valid(true) {
+     NPos.setCount(0);
+     for (int i=0;i<seqlen;i++)
+        if (seq[i]=='N') {// if (!ichrInStr(rseq[i], "ACGT")
+           NPos.Add(i);
+           }
+     n3=NPos.Count()-1; // -1 if no Ns
+     N_calc();
+   }
+  void N_trim(int distN, double percN); //former N_analyze();
+  double N_calc() { //only in the end5-end3 region
+     if (n5<=n3) {
+       perc_N=((n3-n5+1)*100.0)/(end3-end5+1);
+       }
+      else perc_N=0; 
+    return perc_N;
+  }
+ };
+
+
+void NData::N_trim(int distN, double percN) { //N_analyze(NData& feat, int l5, int l3, int p5, int p3) {
+/* assumes feat was filled properly */
+ int old_dif, t5,t3,v;
+ int l3=end3;
+ int l5=end5;
+ while (l3>=l5+2 && n5<=n3) {
+   t5=NPos[n5]-l5; //left side possible trimming
+   t3=l3-NPos[n3]; //right side potential trimming
+   old_dif=n3-n5;
+   if (distN) { 
+      v=distN;
+   }
+   else {
+     v=iround(percN*(l3-l5+1)/100);
+     if (v>20) v=20; // enforce N-search limit for very long reads
+        else if (v<1) v=1;
+   }   
+   if (t5 <= v ) {
+     l5=NPos[n5]+1;
+     n5++; //we can trim at 5' end up to after leftmost N
+   }
+   if (t3 <= v) {
+     l3=NPos[n3]-1;
+     n3--; //we can trim at 3' before leftmost N;
+   }
+   // restNs=p3-p5; number of Ns in the new CLR 
+   if (n3-n5==old_dif) { // no change, return
+     break;
+   }
+ }
+ end5=l5;
+ end3=l3;
+ N_calc();
+ return;
+ /*
+ if (l3<l5+2 || p5>p3 ) {
+   feat.end5=l5+1;
+   feat.end3=l3+1;
+   return;
+   }
+
+ t5=feat.NPos[p5]-l5; //left side possible trimming
+ t3=l3-feat.NPos[p3]; //right side potential trimming
+ old_dif=p3-p5;
+ v=(int)((((double)(l3-l5))*perc_lenN)/100);
+ if (v>20) v=20; // enforce N-search limit for very long reads
+    else if (v<1) v=1;
+ if (t5 < v ) {
+   l5=feat.NPos[p5]+1;
+   p5++; //we can trim at 5' end up to after leftmost N
+   }
+ if (t3 < v) {
+   l3=feat.NPos[p3]-1;
+   p3--; //we can trim at 3' before leftmost N;
+   }
+ // restNs=p3-p5; number of Ns in the new CLR 
+ if (p3-p5==old_dif) { // no change, return
+           feat.end5=l5+1;
+           feat.end3=l3+1;
+           return;
+           }
+    else
+      N_analyze(feat, l5,l3, p5,p3);
+ */
+}
+
+
+int guessPhred(const char* q, int len) {
+  int vmin, vmax;
+  fqsimd.qualRange(q, len, vmin, vmax);
+  if (vmax>95) return 64;
+  if (vmin<64) return 33;
+  return 0;
+}
+
+void setPhredType(int phred) {
+  if (phred==33) { qv_phredtype=33; qv_cvtadd=31; }
+  else if (phred==64) { qv_phredtype=64; qv_cvtadd=-31; }
+}
+
+bool CTrimKernels::qtrim(const char* qvs, int len, int &l5, int &l3) {
+if (opt.qvtrim_qmin==0 || len==0) return false;
+FQ_PROF(FQP_QTRIM);
+l5=0;
+l3=len-1;
+if (fqsimd.level>FQSIMD_SCALAR) { //a vector scan is cheap enough to skip the windows
+  int qlow, qhigh;
+  fqsimd.qualRange(qvs, len, qlow, qhigh);
+  if (qlow-qv_phredtype>=opt.qvtrim_qmin) return false; //no base below the threshold
+  }
+int winlen=GMIN(opt.qvtrim_win, len/4);
+if (winlen<3) {
+ //no sliding window
+ //scan from the ends and look for two consecutive bases above the threshold
+ for (;l3>2;l3--) {
+    if (qvs[l3]-qv_phredtype>=opt.qvtrim_qmin && qvs[l3-1]-qv_phredtype>=opt.qvtrim_qmin) break;
+ }
+// qtrim 5' end
+ for (l5=0;l5<len-3;l5++) {
+    if (qvs[l5]-qv_phredtype>=opt.qvtrim_qmin && qvs[l5+1]-qv_phredtype>=opt.qvtrim_qmin) break;
+ }
+}
+else {
+ // trim 3'
+ //sliding window from the 5' end until avg qual drops below the threshold
+ //init sum
+
+ int qsum=0;
+ /*
+ int qilow=-1; //first base index where qv drops below qmin
+ for (int q=0;q<winlen;q++) {
+   int qvq=qvs[q]-qv_phredtype;
+   qsum+=qvq;
+   if (qilow<0 && qvq<qvtrim_qmin) qilow=q;
+   }
+ double qavg=((double)qsum)/winlen;
+ if (qavg<qvtrim_qmin) { //first window fail
+   l3=qilow-1;
+ }
+ else {
+   for (int i=1;i<=qvs.length()-qvtrim_win;i++) {
+     qsum -= qvs[i-1]-qv_phredtype;
+     int inew=i+qvtrim_win-1;
+     int qvnew=qvs[inew]-qv_phredtype;
+     qsum += qvnew;
+     //if (qilow<i && qvnew<qvtrim_qmin) qilow=inew;
+     qavg=((double)qsum)/qvtrim_win;
+     //GMessage("i=%d (%c), inew=%d (%c), qilow=%d, qavg=%4.2f\n", i, qvs[i], inew, qvs[inew], qilow, qavg);
+     if (qavg<qvtrim_qmin) {
+       for (int qlo=i;qlo<i+qvtrim_win;qlo++) {
+          if (qvs[qlo]-qv_phredtype<qvtrim_qmin) {
+            l3=qlo-1;
+            break;
+          }
+       }
+       //l3=qilow-1;
+       break;
+       }
+   } //for each sliding window
+ }
+ */
+ int qi5=l5; //suggested qv trim 5' base index
+ int qi3=l3; //suggested qv trim 3' base index
+ double qavg; //avg. qv for the current window
+ int i5bw=-1; //index of first base below threshold in current window
+ int i3bw=-1; //index of last base below threshold in current window
+ bool okfound=false; //found a window above threshold
+ for (int i=0;i<winlen;++i) {
+   int cq=qvs[i]-qv_phredtype;
+   qsum+=cq;
+   if (cq<opt.qvtrim_qmin) {
+	   i3bw=i;
+	   if (i5bw<0) i5bw=i;
+   }
+ }
+ qavg=((double)qsum)/winlen;
+ if (iround(qavg)<opt.qvtrim_qmin) {
+	 //propose 5' trimming by qv
+	 qi5=i3bw+1;
+ }
+ else { okfound=true; }
+ //now scan the rest of the read
+ if (okfound) i5bw=-1;
+ for (int i=1;i<=len-winlen;i++) {
+   if (i5bw<i) i5bw=-1;
+   qsum -= qvs[i-1]-qv_phredtype;
+   int inew=i+winlen-1;
+   int qvnew=qvs[inew]-qv_phredtype;
+   if (qvnew<opt.qvtrim_qmin) {
+      if (i5bw<0) i5bw=inew;
+      i3bw=inew;
+   }
+   qsum += qvnew;
+   //if (qilow<i && qvnew<qvtrim_qmin) qilow=inew;
+   qavg=((double)qsum)/winlen;
+   if (qavg<opt.qvtrim_qmin) { //bad qv window
+	 if (okfound) {
+		 //trimming 3' now
+		 qi3=i5bw-1;
+	     break;
+	 } else {
+		 //still trimming 5', shame
+		 qi5=i3bw+1;
+		 if (len-qi5<opt.min_read_len)
+			 break;
+	 }
+   }
+   else okfound=true;
+ } //for each sliding window
+ if (!okfound) {
+	 //fatal trimming at 5' end
+	 l5=qi5;
+	 return true;
+ }
+ l5=qi5;
+ l3=qi3;
+}
+
+if (opt.qvtrim_max>0) {
+  if (len-1-l3>opt.qvtrim_max) l3=len-1-opt.qvtrim_max;
+  if (l5>opt.qvtrim_max) l5=opt.qvtrim_max;
+  }
+return (l5>0 || l3<len-1);
+}
+
+bool CTrimKernels::ntrim(const char* rseq, int len, int &l5, int &l3, double& pN) {
+ //count Ns in the sequence, trim N-rich ends
+ FQ_PROF(FQP_NTRIM);
+ NData feat(rseq, len, npos);
+ l5=feat.end5;
+ l3=feat.end3;
+ pN=0.0;
+ if (feat.NPos.Count()==0) return false;
+ //int clrNcount = N_analyze(feat, feat.end5-1, feat.end3-1, 0, feat.NPos.Count()-1); //feat.NCount-1);
+ feat.N_trim(opt.dist_lenN, opt.perc_lenN); //tries to trim terminal Ns, recalculates perc_N
+ pN=feat.perc_N;
+ if (l5==feat.end5 && l3==feat.end3) {
+    if (feat.perc_N>opt.max_perc_N) {
+           #ifdef TRIMDEBUG
+           GMessage(" ### : N_trim() did nothing but remaining range %d-%d has internal %N = %4.2f\n", 
+               feat.end5, feat.end3, feat.perc_N);
+           #endif
+           feat.valid=false;
+           return true;
+           }
+      else {
+       return false; //no trimming
+       }
+    }
+ l5=feat.end5;
+ l3=feat.end3;
+ //feat.N_calc(); feat.N_trim() did this already
+ #ifdef TRIMDEBUG
+     GMessage(" ### : after N_trim() clear range %d-%d has %N = %4.2f :\n%.*s\n", 
+          feat.end5, feat.end3, feat.perc_N, feat.end3-feat.end5+1, rseq+feat.end5);
+ #endif
+ /*
+  if (l3-l5+1<min_read_len) {
+   feat.valid=false;
+   return true;
+   }
+ if (feat.perc_N>opt.max_perc_N) {
+      feat.valid=false;
+      return true;
+      }
+ */
+ return true;
+ }
+
+//--------------- dust functions ----------------
+class DNADuster {
+ public:
+  int dustword;
+  int dustwindow;
+  int dustwindow2;
+  int dustcutoff;
+  int mv, iv, jv;
+  int counts[32*32*32];
+  int iis[32*32*32];
+  DNADuster(int cutoff=16, int winsize=32, int wordsize=3) {
+    dustword=wordsize;
+    dustwindow=winsize;
+    dustwindow2 = (winsize>>1);
+    dustcutoff=cutoff;
+    mv=0;
+    iv=0;
+    jv=0;
+    }
+  void setWindowSize(int value) {
+    dustwindow = value;
+    dustwindow2 = (dustwindow >> 1);
+    }
+  void setWordSize(int value) {
+    dustword=value;
+    }
+void wo1(int len, const char* s, int ivv) {
+  int i, ii, j, v, t, n, n1, sum;
+  int js, nis;
+  n = 32 * 32 * 32;
+  n1 = n - 1;
+  nis = 0;
+  i = 0;
+  ii = 0;
+  sum = 0;
+  v = 0;
+  for (j=0; j < len; j++, s++) {
+        ii <<= 5;
+        if (*s<=32) {
+           i=0;
+           continue;
+           }
+        ii |= *s - 'A'; //assume uppercase!
+        ii &= n1;
+        i++;
+        if (i >= dustword) {
+              for (js=0; js < nis && iis[js] != ii; js++) ;
+              if (js == nis) {
+                    iis[nis] = ii;
+                    counts[ii] = 0;
+                    nis++;
+              }
+              if ((t = counts[ii]) > 0) {
+                    sum += t;
+                    v = 10 * sum / j;
+                    if (mv < v) {
+                          mv = v;
+                          iv = ivv;
+                          jv = j;
+                    }
+              }
+              counts[ii]++;
+        }
+  }
+}
+
+int wo(int len, const char* s, int* beg, int* end) {
+      int i, l1;
+      l1 = len - dustword + 1;
+      if (l1 < 0) {
+            *beg = 0;
+            *end = len - 1;
+            return 0;
+            }
+      mv = 0;
+      iv = 0;
+      jv = 0;
+      for (i=0; i < l1; i++) {
+            wo1(len-i, s+i, i);
+            }
+      *beg = iv;
+      *end = iv + jv;
+      return mv;
+ }
+
+void dust(const char* seq, char* seqmsk, int seqlen, int cutoff=0) { //, maskFunc maskfn) {
+  int i, j, l, a, b, v;
+  if (cutoff==0) cutoff=dustcutoff;
+  a=0;b=0;
+  //GMessage("Dust cutoff=%d\n", cutoff);
+  for (i=0; i < seqlen; i += dustwindow2) {
+        l = (seqlen > i+dustwindow) ? dustwindow : seqlen-i;
+        v = wo(l, seq+i, &a, &b);
+        if (v > cutoff) {
+           //for (j = a; j <= b && j < dustwindow2; j++) {
+           for (j = a; j <= b; j++) {
+                    seqmsk[i+j]='N';//could be made lowercase instead
+                    }
+           }
+         }
+//return first;
+ }
+};
+
+//static DNADuster duster;
+
+//mask the len bases at rseq into seq, returns the number of Ns in it
+static int dustN(const char* rseq, int len, char* seq) {
+ DNADuster duster;
+ memcpy(seq, rseq, len);
+ duster.dust(rseq, seq, len, dust_cutoff);
+ //check the number of Ns:
+ int ncount=0;
+ for (int i=0;i<len;i++) {
+   if (seq[i]=='N') ncount++;
+   }
+ return ncount;
+}
+
+int dust(GStr& rseq) {
+ FQ_PROF(FQP_DUST);
+ char* seq=Gstrdup(rseq.chars());
+ int ncount=dustN(rseq.chars(), rseq.length(), seq);
+ if (dustMask) rseq=seq; //hard masking requested
+ GFREE(seq);
+ return ncount;
+ }
+
+int CTrimKernels::dust(const char* seq, int len) {
+ FQ_PROF(FQP_DUST);
+ if (len>dustcap) {
+   dustcap=len;
+   GREALLOC(dustmsk, dustcap);
+   }
+ return dustN(seq, len, dustmsk);
+}
+
+struct SLocScore {
+  int pos;
+  int score;
+  SLocScore(int p=0,int s=0) {
+    pos=p;
+    score=s;
+    }
+  void set(int p, int s) {
+    pos=p;
+    score=s;
+    }
+  void add(int p, int add) {
+    pos=p;
+    score+=add;
+    }
+};
+
+bool CTrimKernels::trim_poly3(const char* seq, int rlen, int &l5, int &l3, const char* poly_seed) {
+ if (!opt.doPolyTrim) return false;
+ FQ_PROF(FQP_POLY);
+ l5=0;
+ l3=rlen-1;
+ char polyChar=poly_seed[0];
+ //assumes N trimming was already done
+ //so a poly match should be very close to the end of the read
+ // -- find the initial match (seed)
+ int li=fqsimd.polySeed3(seq, rlen, polyChar);
+ if (li<0) return false;
+ //seed found, try to extend it both ways
+ //extend right
+ int ri=li+3;
+ SLocScore loc(ri, poly_m_score<<2);
+ SLocScore maxloc(loc);
+ //extend right
+ while (ri<rlen-1) {
+   ri++;
+   if (seq[ri]==polyChar) {
+                loc.add(ri,poly_m_score);
+                }
+   else if (seq[ri]=='N') {
+                loc.add(ri,0);
+                }
+   else { //mismatch
+        loc.add(ri,poly_mis_score);
+        if (maxloc.score-loc.score>poly_dropoff_score) break;
+        }
+   if (maxloc.score<=loc.score) {
+      maxloc=loc;
+      }
+   }
+ ri=maxloc.pos;
+ if (ri<rlen-6) return false; //no trimming wanted, too far from 3' end
+ //ri = right boundary for the poly match
+ //extend left
+ loc.set(li, maxloc.score);
+ maxloc.pos=li;
+ while (li>0) {
+    li--;
+    if (seq[li]==polyChar) {
+                 loc.add(li,poly_m_score);
+                 }
+    else if (seq[li]=='N') {
+                 loc.add(li,0);
+                 }
+    else { //mismatch
+         loc.add(li,poly_mis_score);
+         if (maxloc.score-loc.score>poly_dropoff_score) break;
+         }
+    if (maxloc.score<=loc.score) {
+       maxloc=loc;
+       }
+    }
+li=maxloc.pos;
+if ((maxloc.score==opt.poly_minScore && ri==rlen-1) ||
+    (maxloc.score>opt.poly_minScore && ri>=rlen-3) ||
+    (maxloc.score>(opt.poly_minScore*3) && ri>=rlen-8)) {
+  //trimming this li-ri match at 3' end
+    l3=li-1;
+    if (l3<0) l3=0;
+    return true;
+    }
+return false;
+}
+
+bool CTrimKernels::trim_poly5(const char* seq, int rlen, int &l5, int &l3, const char* poly_seed) {
+ if (!opt.doPolyTrim) return false;
+ FQ_PROF(FQP_POLY);
+ l5=0;
+ l3=rlen-1;
+ char polyChar=poly_seed[0];
+ //assumes N trimming was already done
+ //so a poly match should be very close to the end of the read
+ // -- find the initial match (seed)
+ //4-mer seeds are looked for up to 12 bases from the 5' end
+ int li=fqsimd.polySeed5(seq, rlen, polyChar);
+ if (li<0) return false;
+ //seed found, try to extend it both ways
+ //extend left
+ int ri=li+3; //save rightmost base of the seed
+ SLocScore loc(li, poly_m_score<<2);
+ SLocScore maxloc(loc);
+ while (li>0) {
+    li--;
+    if (seq[li]==polyChar) {
+                 loc.add(li,poly_m_score);
+                 }
+    else if (seq[li]=='N') {
+                 loc.add(li,0);
+                 }
+    else { //mismatch
+         loc.add(li,poly_mis_score);
+         if (maxloc.score-loc.score>poly_dropoff_score) break;
+         }
+    if (maxloc.score<=loc.score) {
+       maxloc=loc;
+       }
+    }
+ li=maxloc.pos;
+ if (li>5) return false; //no trimming wanted, too far from 5' end
+ //li = right boundary for the poly match
+
+ //extend right
+ loc.set(ri, maxloc.score);
+ maxloc.pos=ri;
+ while (ri<rlen-1) {
+   ri++;
+   if (seq[ri]==polyChar) {
+                loc.add(ri,poly_m_score);
+                }
+   else if (seq[ri]=='N') {
+                loc.add(ri,0);
+                }
+   else { //mismatch
+        loc.add(ri,poly_mis_score);
+        if (maxloc.score-loc.score>poly_dropoff_score) break;
+        }
+   if (maxloc.score<=loc.score) {
+      maxloc=loc;
+      }
+   }
+ri=maxloc.pos;
+if ((maxloc.score==opt.poly_minScore && li==0) ||
+     (maxloc.score>opt.poly_minScore && li<2)
+     || (maxloc.score>(opt.poly_minScore*3) && li<8)) {
+    //adjust l5 to reflect this trimming of 5' end
+    l5=ri+1;
+    if (l5>rlen-1) l5=rlen-1;
+    return true;
+    }
+return false;
+}
+
+bool CTrimKernels::trim_adapter3(const char* seq, int rlen, int&l5, int &l3, int& aidx) {
+ if (adapters3.Count()==0) return false;
+ FQ_PROF(FQP_ADAPTER);
+ //GMessage("Trimming adapter 3!\n");
+ l5=0;
+ l3=rlen-1;
+ bool trimmed=false;
+ GXSeqData seqdata;
+ int numruns=opt.revCompl ? 2 : 1;
+ GList<GXAlnInfo> bestalns(true, true, false);
+ aidx=-1;
+ for (int ai=0;ai<adapters3.Count();ai++) {
+   for (int r=0;r<numruns;r++) {
+     if (r) {
+  	  seqdata.update(adapters3[ai]->seqr.chars(), adapters3[ai]->seqr.length(),
+  		 adapters3[ai]->pzr, seq, rlen, adapters3[ai]->amlen);
+        }
+     else {
+  	    seqdata.update(adapters3[ai]->seq.chars(), adapters3[ai]->seq.length(),
+  		 adapters3[ai]->pz, seq, rlen, adapters3[ai]->amlen);
+        }
+     //GXAlnInfo* aln=match_adapter(seqdata, adapters3[ai]->trim_type, minEndAdapter, gxmem_r, min_pid3);
+     GXAlnInfo* aln=match_adapter(seqdata, galn_TrimRight, opt.minEndAdapter, gxmem_r, opt.min_pid3);
+	 if (adstats) adstats->addCall(adapters3[ai]->fidx, FQAD_END3, r);
+	 if (aln) {
+	   aln->udata=(adapters3[ai]->fidx<<1)|r; //adapter and strand
+	   if (aln->strong) {
+		   trimmed=true;
+		   bestalns.Add(aln);
+		   break; //will check the rest next time
+		   }
+	    else bestalns.Add(aln);
+	   }
+   }//forward and reverse adapters
+   if (trimmed) break; //will check the rest in the next cycle
+  }//for each 3' adapter
+ if (bestalns.Count()>0) {
+	   GXAlnInfo* aln=bestalns[0];
+	   if (aln->sl-1 > rlen-aln->sr) {
+		   //keep left side
+		   l3-=(rlen-aln->sl+1);
+		   if (l3<0) l3=0;
+		   adHitPos=aln->sl-1;
+		   }
+	   else { //keep right side
+		   l5+=aln->sr;
+		   if (l5>=rlen) l5=rlen-1;
+		   adHitPos=aln->sr;
+		   }
+	   //delete aln;
+	   //if (l3-l5+1<min_read_len) return true;
+	   aidx=aln->udata>>1;
+	   adHitStrand=aln->udata & 1;
+	   adHitStrong=aln->strong;
+	   return true; //break the loops here to report a good find
+     }
+  aidx=-1;
+  return false;
+ }
+
+bool CTrimKernels::trim_adapter5(const char* seq, int rlen, int&l5, int &l3, int& aidx) {
+ if (adapters5.Count()==0) return false;
+ FQ_PROF(FQP_ADAPTER);
+ l5=0;
+ l3=rlen-1;
+ bool trimmed=false;
+ GXSeqData seqdata;
+ int numruns=opt.revCompl ? 2 : 1;
+ GList<GXAlnInfo> bestalns(true, true, false);
+ aidx=-1;
+ for (int ai=0;ai<adapters5.Count();ai++) {
+   for (int r=0;r<numruns;r++) {
+     if (r) {
+  	  seqdata.update(adapters5[ai]->seqr.chars(), adapters5[ai]->seqr.length(),
+  		 adapters5[ai]->pzr, seq, rlen, adapters5[ai]->amlen);
+        }
+     else {
+  	    seqdata.update(adapters5[ai]->seq.chars(), adapters5[ai]->seq.length(),
+  		 adapters5[ai]->pz, seq, rlen, adapters5[ai]->amlen);
+        }
+	 //GXAlnInfo* aln=match_adapter(seqdata, adapters5[ai]->trim_type,
+     GXAlnInfo* aln=match_adapter(seqdata, galn_TrimLeft,
+		                                       opt.minEndAdapter, gxmem_l, opt.min_pid5);
+	 if (adstats) adstats->addCall(adapters5[ai]->fidx, FQAD_END5, r);
+	 if (aln) {
+	   aln->udata=(adapters5[ai]->fidx<<1)|r; //adapter and strand
+	   if (aln->strong) {
+		   trimmed=true;
+		   bestalns.Add(aln);
+		   break; //will check the rest next time
+		   }
+	    else bestalns.Add(aln);
+	   }
+	 } //forward and reverse?
+   if (trimmed) break; //will check the rest in the next cycle
+  }//for each 5' adapter
+  if (bestalns.Count()>0) {
+	   GXAlnInfo* aln=bestalns[0];
+	   if (aln->sl-1 > rlen-aln->sr) {
+		   //keep left side
+		   l3-=(rlen-aln->sl+1);
+		   if (l3<0) l3=0;
+		   adHitPos=aln->sl-1;
+		   }
+	   else { //keep right side
+		   l5+=aln->sr;
+		   if (l5>=rlen) l5=rlen-1;
+		   adHitPos=aln->sr;
+		   }
+	   //delete aln;
+	   //if (l3-l5+1<min_read_len) return true;
+	   aidx=aln->udata>>1;
+	   adHitStrand=aln->udata & 1;
+	   adHitStrong=aln->strong;
+	   return true; //break the loops here to report a good find
+     }
+  aidx=-1;
+  return false;
+}
+
+//convert qvs to/from phred64 from/to phread33
+struct STrimState { //the part of the read left to trim (wlen bases at wseq)
+ int w5;
+ int w3;
+ const char* wseq;
+ int wlen;
+ bool w3upd;
+ bool w5upd;
+ bool wupd;
+ int minlen;
+ STrimState(const char* rseq, int rlen, int min_len):w5(0), w3(rlen-1),
+     wseq(rseq), wlen(rlen), w3upd(true), w5upd(true), wupd(true),
+     minlen(min_len) {
+ }
+
+ char update(char trim_code, int& trim5, int& trim3) {
+   trim5+=w5;
+   trim3+=(wlen-1-w3);
+ //#ifdef TRIMDEBUG
+ //  GMessage("#### TRIM by '%c' code ( w5-w3 = %d-%d ):\n",trim_code, w5,w3);
+ //#endif
+   //-- keep only the w5..w3 range
+   wseq+=w5;
+   wlen=w3-w5+1;
+   if (wlen<minlen) {
+       return trim_code; //return last operation code as "trash code"
+   }
+   w5=0;
+   w3=wlen-1;
+   return 0;
+ }
+ 
+};
+
+//the steps not in F are left out of each specialization at compile time
+template<int F> char CTrimKernels::process_read_t(STrimRead &r) {
+ //returns 0 if the read was untouched, 1 if it was just trimmed
+ // and a trash code if it was trashed
+ if (r.len-r.trim5-r.trim3<opt.min_read_len) {
+   return 's'; //too short already
+   }
+//count Ns
+b_totalIn+=r.len;
+b_totalN+=fqsimd.countNonACGT(r.seq, r.len);
+double percN=0;
+char trim_code=0;
+
+//the part of the read left to trim, not copied
+const char* wseq=r.seq;
+int wlen=r.len;
+
+int w5=r.trim5;
+int w3=r.len-r.trim3-1;
+
+//first do the q-based trimming
+if ((F & FQT_QTRIM) && r.qv!=NULL && qtrim(r.qv, r.len, w5, w3)) { // qv-threshold trimming
+   trim_code='Q';
+   int t5=(w5-r.trim5);
+   if (t5>0) {
+      STrimOp trimop(5,trim_code,t5);
+      r.trimhist.Add(trimop);
+   }
+   int t3=(r.l3()-w3);
+   if (t3>0) {
+      STrimOp trimop(3,trim_code,t3);
+      r.trimhist.Add(trimop);
+   }
+   #ifdef TRIMDEBUG
+     GMessage("#DBG# qv trimming: %d from 5'end; %d from 3'end\n",t5,t3);
+   #endif
+   b_trimQ+=t5+t3;
+   num_trimQ++;
+   r.trim5=w5;
+   r.trim3=r.len-1-w3;
+   if (r.len-r.trim5-r.trim3<opt.min_read_len) {
+     return trim_code; //invalid read
+     }
+   //-- keep only the w5..w3 range
+   wseq=r.seq+r.trim5;
+   wlen=r.len-r.trim3-r.trim5;
+   } //qv trimming
+// N-trimming on the remaining read seq
+if (ntrim(wseq, wlen, w5, w3, percN)) {
+   //Note: ntrim sets w5 to the number of trimmed bases at read start
+   //     and w3 to the new end of read sequence
+#ifdef TRIMDEBUG
+   GMessage("#DBG# N trim: keeping %d-%d range: %.*s\n",w5+1,w3, w3-w5+1, wseq+w5);
+#endif
+   int trim3=(wlen-1-w3);
+   trim_code='N';
+   b_trimN+=w5+trim3;
+   num_trimN++;
+   if (w5>0) {
+      STrimOp trimop(5,trim_code,w5);
+      r.trimhist.Add(trimop);
+   }
+   if (trim3>0) {
+      STrimOp trimop(3,trim_code,trim3);
+      r.trimhist.Add(trimop);
+   }
+   r.trim5+=w5;
+   r.trim3+=trim3;
+   if (w3-w5+1<opt.min_read_len) {
+     return trim_code; //to be trashed
+   }
+   if (percN > opt.max_perc_N) {
+     return trim_code;
+   }
+    //-- keep only the w5..w3 range
+   wseq+=w5;
+   wlen=w3-w5+1;
+}
+
+//clean the more dirty end first - 3'
+bool trimmedA=false;
+bool trimmedT=false;
+bool trimmedV=false;
+STrimState ts(wseq,wlen,opt.min_read_len); //work with this structure from now on
+do {
+  int prev_t3=r.trim3;
+  int prev_t5=r.trim5;
+  trim_code=0;
+  if ((F & FQT_POLY) && ts.w3upd) {
+    if (trim_poly3(ts.wseq, ts.wlen, ts.w5, ts.w3, polyA_seed)) {
+      trim_code='A';
+      STrimOp trimop(3, trim_code, (ts.w5+(ts.wlen-1-ts.w3)));
+      #ifdef TRIMDEBUG
+        GMessage("#DBG# 3' polyA trimming %d bases\n",trimop.tlen);
+      #endif
+      r.trimhist.Add(trimop);
+      b_trimA+=trimop.tlen;
+      if (!trimmedA) { num_trimA++; trimmedA=true; }
+    }
+    else
+    if ((F & FQT_POLY_BOTH) && trim_poly3(ts.wseq, ts.wlen, ts.w5, ts.w3, polyT_seed)) {
+      trim_code='T';
+      STrimOp trimop(3, trim_code, (ts.w5+(ts.wlen-1-ts.w3)));
+     #ifdef TRIMDEBUG
+       GMessage("#DBG# 3' polyT trimming %d bases\n",trimop.tlen);
+     #endif
+      r.trimhist.Add(trimop);
+      b_trimT+=trimop.tlen;
+      if (!trimmedT) { num_trimT++; trimmedT=true; }
+    }
+    if (trim_code) {
+      ts.wupd=true;
+      if (ts.update(trim_code, r.trim5, r.trim3))
+         return trim_code;
+      trim_code=0;
+    }
+   }
+   int tidx=-1;
+   if ((F & FQT_ADAPTERS) && ts.wupd && trim_adapter3(ts.wseq, ts.wlen, ts.w5, ts.w3, tidx)) {
+       if (adstats) adstats->addHit(tidx, FQAD_END3, adHitStrand, adHitStrong, r.trim5+adHitPos);
+       if (opt.showAdapterIdx && tidx>=0) trim_code=('a'+tidx);
+         else trim_code='V';
+       STrimOp trimop(3, trim_code, (ts.w5+(ts.wlen-1-ts.w3)));
+       #ifdef TRIMDEBUG
+          GMessage("#DBG# 3' adapter trimming %d bases\n",trimop.tlen);
+       #endif
+
+       r.trimhist.Add(trimop);
+       b_trimV+=trimop.tlen;
+       if (!trimmedV) { num_trimV++; trimmedV=true; }
+   }
+   if (trim_code) {
+    if (ts.update(trim_code, r.trim5, r.trim3))
+        return trim_code;
+    //wseq, w5, w3 were updated, let this fall through to next check
+    trim_code=0;
+   }
+   if ((F & FQT_POLY) && ts.w5upd) {
+    if (trim_poly5(ts.wseq, ts.wlen, ts.w5, ts.w3, polyT_seed)) {
+        trim_code='T';
+        STrimOp trimop(5, trim_code,(ts.w5+(ts.wlen-1-ts.w3)));
+        #ifdef TRIMDEBUG
+          GMessage("#DBG# 5' polyT trimming %d bases\n",trimop.tlen);
+        #endif
+        r.trimhist.Add(trimop);
+        b_trimT+=trimop.tlen;
+        if (!trimmedT) { num_trimT++; trimmedT=true; }
+    }
+    else
+    if ((F & FQT_POLY_BOTH) && trim_poly5(ts.wseq, ts.wlen, ts.w5, ts.w3, polyA_seed)) {
+        trim_code='A';
+        STrimOp trimop(5, trim_code,(ts.w5+(ts.wlen-1-ts.w3)));
+		#ifdef TRIMDEBUG
+		  GMessage("#DBG# 5' polyA trimming %d bases\n",trimop.tlen);
+		#endif
+        r.trimhist.Add(trimop);
+        b_trimA+=trimop.tlen;
+        if (!trimmedA) { num_trimA++; trimmedA=true; }
+    }
+    if (trim_code) {
+      ts.wupd=true;
+      if (ts.update(trim_code, r.trim5, r.trim3))
+         return trim_code;
+      trim_code=0;
+    }
+   }
+   tidx=-1;
+   if ((F & FQT_ADAPTERS) && ts.wupd && trim_adapter5(ts.wseq, ts.wlen, ts.w5, ts.w3, tidx)) {
+      if (adstats) adstats->addHit(tidx, FQAD_END5, adHitStrand, adHitStrong, r.trim5+adHitPos);
+      if (opt.showAdapterIdx && tidx>=0) trim_code=('a'+tidx);
+   	   else trim_code='V';
+      STrimOp trimop(5, trim_code,(ts.w5+(ts.wlen-1-ts.w3)));
+	  #ifdef TRIMDEBUG
+	    GMessage("#DBG# 5' adapter trimming %d bases\n",trimop.tlen);
+	  #endif
+      r.trimhist.Add(trimop);
+      b_trimV+=trimop.tlen;
+      if (!trimmedV) { num_trimV++; trimmedV=true; }
+      }
+  //checked the 3' end
+  if (trim_code) {
+    if (ts.update(trim_code, r.trim5, r.trim3))
+        return trim_code;
+    //wseq, w5, w3 were updated, let this fall through to next check
+    trim_code=0;
+  }
+  ts.w3upd=(r.trim3!=prev_t3);
+  ts.w5upd=(r.trim5!=prev_t5);
+  ts.wupd=(ts.w3upd || ts.w5upd);
+} while (ts.wupd);
+//with -C, surviving reads go to the duplicates table in flushBatch()
+//and the dust filter is only applied to the unique reads at the end
+if (F & FQT_DUST) {
+   //apply the dust filter now
+   int dustbases=dust(ts.wseq, ts.wlen);
+   if (dustbases>(ts.wlen>>1)) {
+      return 'D';//trash code
+      }
+   }
+return (r.trim5>0 || r.trim3>0) ? 1 : 0;
+}
+
+//process_read() specializations, indexed by their FQT_* flags
+template<int F> struct SProcessReadTable {
+  static void fill(ProcessReadFunc* t) {
+    t[F]=&CTrimKernels::process_read_t<F>;
+    SProcessReadTable<F-1>::fill(t);
+  }
+};
+template<> struct SProcessReadTable<-1> {
+  static void fill(ProcessReadFunc*) { }
+};
+struct SProcessReadSpecs {
+  ProcessReadFunc funcs[FQT_NUM_SPECS];
+  SProcessReadSpecs() { SProcessReadTable<FQT_NUM_SPECS-1>::fill(funcs); }
+};
+static SProcessReadSpecs processReadSpecs;
+
+CTrimKernels::CTrimKernels(const FqTrimOptions& o, bool alnbuffers):STrimCounts(), opt(o),
+		processFunc(NULL), gxmem_l(NULL), gxmem_r(NULL), adstats(NULL), adHitPos(0),
+		adHitStrand(0), adHitStrong(false), npos(), dustmsk(NULL), dustcap(0) {
+  processFunc=processReadSpecs.funcs[opt.features];
+  if (!alnbuffers) return;
+  if (adapters5.Count()>0)
+    gxmem_l=new CGreedyAlignData(opt.match_reward, opt.mismatch_penalty, opt.Xdrop);
+  if (adapters3.Count()>0)
+    gxmem_r=new CGreedyAlignData(opt.match_reward, opt.mismatch_penalty, opt.Xdrop);
+}
+
+void FqTrimOptions::load() {
+  min_read_len=::min_read_len;
+  qvtrim_qmin=::qvtrim_qmin;
+  qvtrim_max=::qvtrim_max;
+  qvtrim_win=::qvtrim_win;
+  max_perc_N=::max_perc_N;
+  perc_lenN=::perc_lenN;
+  dist_lenN=::dist_lenN;
+  doPolyTrim=::doPolyTrim;
+  polyBothEnds=::polyBothEnds;
+  poly_minScore=::poly_minScore;
+  revCompl=::revCompl;
+  showAdapterIdx=::showAdapterIdx;
+  match_reward=::match_reward;
+  mismatch_penalty=::mismatch_penalty;
+  Xdrop=::Xdrop;
+  minEndAdapter=::minEndAdapter;
+  min_pid3=::min_pid3;
+  min_pid5=::min_pid5;
+  features=0;
+  if (qvtrim_qmin!=0) features|=FQT_QTRIM;
+  if (doPolyTrim) {
+    features|=FQT_POLY;
+    if (polyBothEnds) features|=FQT_POLY_BOTH;
+  }
+  if (adapters5.Count()+adapters3.Count()>0) features|=FQT_ADAPTERS;
+  //with -C the dust filter is applied to the unique reads instead
+  if (doDust && !doCollapse) features|=FQT_DUST;
+}
+
+void convertPhred(GStr& q) {
+ for (int i=0;i<q.length();i++) q[i]+=qv_cvtadd;
+}
+
+void convertPhred(char* q, int len) {
+ fqsimd.addQual(q, len, qv_cvtadd);
+}
+
+bool getFastxRead(GLineReader& fq, RData& rd, GStr& infname, bool& fasta) {
+	 if (fq.eof()) return false;
+	 char* l=fq.getLine();
+	 while (l!=NULL && (l[0]==0 || isspace(l[0]))) l=fq.getLine(); //ignore empty lines
+	 if (l==NULL) return false;
+	 /* if (rawFormat) {
+	      //TODO: implement raw qseq parsing here?
+	      //if (raw type=N) then continue; //skip invalid/bad records
+	      } //raw qseq format
+	 else { // FASTQ or FASTA */
+	 fasta=(l[0]=='>');
+	 if (!fasta && l[0]!='@') GError("Error: fasta/fastq record marker not found(%s)\n%s\n",
+	      infname.chars(), l);
+	 GStr s(l);
+	 rd.rid=&(l[1]);
+	 for (int i=0;i<rd.rid.length();i++)
+	    if (rd.rid[i]<=' ') {
+	       if (i<rd.rid.length()-2) rd.rinfo=rd.rid.substr(i+1);
+	       rd.rid.cut(i);
+	       break;
+	       }
+	  //now get the sequence
+	 if ((l=fq.getLine())==NULL)
+	      GError("Error: unexpected EOF after header for read %s (%s)\n",
+	      		rd.rid.chars(), infname.chars());
+	 rd.seq=l; //this must be the DNA line
+	 while ((l=fq.getLine())!=NULL) {
+	      //seq can span multiple lines
+	      if (l[0]=='>' || l[0]=='+') {
+	           fq.pushBack();
+	           break; //
+	           }
+	      rd.seq+=l;
+	      } //check for multi-line seq
+	 if (!fasta) { //reading fastq quality values, which can also be multi-line
+	    if ((l=fq.getLine())==NULL)
+	        GError("Error: unexpected EOF after sequence for %s\n", rd.rid.chars());
+	    if (l[0]!='+') GError("Error: fastq qv header marker not detected!\n");
+	    if ((l=fq.getLine())==NULL)
+	        GError("Error: unexpected EOF after qv header for %s\n", rd.rid.chars());
+	    rd.qv=l;
+	    //if (rqv.length()!=rseq.length())
+	    //  GError("Error: qv len != seq len for %s\n", rname.chars());
+	    while (rd.qv.length()<rd.seq.length() && ((l=fq.getLine())!=NULL)) {
+	      rd.qv+=l; //append to qv string
+	      }
+	    }// fastq
+	 if (rd.seq.is_empty()) {
+		 rd.seq="A";
+		 rd.qv="B";
+	 }
+	 // } //<-- FASTA or FASTQ
+	 rd.seq.upper();
+	 return true;
+}
+
+void printHeader(FILE* f_out, char recmarker, RData& rd) { //GStr& rname, GStr& rinfo) {
+ //GMessage("printing Header..%c%s\n",recmarker, rname.chars());
+ fprintf(f_out, "%c%s",recmarker, rd.rid.chars());
+ if (!rd.umi.is_empty() && umiInName())
+    fprintf(f_out, "_%s", rd.umi.chars());
+ if (trimInfo) 
+    fprintf(f_out, " %d %d", rd.trim5, rd.trim3);
+ if (!rd.rinfo.is_empty())
+    fprintf(f_out, " %s", rd.rinfo.chars());
+ fprintf(f_out, "\n");
+ }
+
+bool umiInName() {
+  //append _<UMI> to the output read names, unless they are the original
+  //names already carrying the UMI
+  return (umi_len>0 || !prefix.is_empty());
+}
+
+void getOutSeq(RData& rd, GStr& seq, GStr& qv) {
+  //trimmed sequence and quality values, as written in the output
+  seq=rd.getTrimSeq();
+  qv=rd.getTrimQv();
+  if (seq.is_empty()) {
+     seq="A";
+     qv="B";
+  }
+}
+
+void getOutName(RData& rd, uint64 counter, GStr& name) {
+  //the header line of the output read, without the record marker
+  if (prefix.is_empty()) {
+    name=rd.rid;
+    if (!rd.umi.is_empty() && umiInName())
+      name.append('_').append(rd.umi);
+    if (trimInfo)
+      name.appendfmt(" %d %d", rd.trim5, rd.trim3);
+    if (!rd.rinfo.is_empty())
+      name.append(' ').append(rd.rinfo);
+    }
+  else {
+    name=prefix;
+    name.appendfmt("_%08llu", counter);
+    if (!rd.umi.is_empty())
+      name.append('_').append(rd.umi);
+    if (trimInfo)
+      name.appendfmt(" %d %d", rd.trim5, rd.trim3);
+    }
+}
+
+void write1Read(FILE* fout, RData& rd, uint64 counter) {
+  //GStr& rname, GStr& rinfo, GStr& rseq, GStr& rqv,
+  GStr seq;
+  GStr qv;
+  getOutSeq(rd, seq, qv);
+  bool asFasta=(rd.qv.is_empty() || fastaOutput);
+  if (asFasta) {
+   if (prefix.is_empty()) {
+      printHeader(fout, '>', rd);
+      //fprintf(fout, "%s\n", rd.seq.chars()); //plain one-line fasta for now
+      writeFasta(fout, NULL, NULL, seq.chars(), 100, seq.length());
+      }
+     else {
+      fprintf(fout, ">%s_%08llu",prefix.chars(), counter);
+      if (!rd.umi.is_empty())
+        fprintf(fout, "_%s", rd.umi.chars());
+      if (trimInfo) 
+        fprintf(fout," %d %d", rd.trim5, rd.trim3);
+      //fprintf(fout, "\n%s\n", rd.seq.chars());
+      writeFasta(fout, NULL, NULL, seq.chars(), 100, seq.length());
+      }
+    }
+  else {  //fastq
+   if (convert_phred) convertPhred(qv);
+   if (prefix.is_empty()) {
+      printHeader(fout, '@', rd);
+      fprintf(fout, "%s\n+\n%s\n", seq.chars(), qv.chars());
+      }
+     else {
+      fprintf(fout, "@%s_%08llu", prefix.chars(), counter);
+      if (!rd.umi.is_empty())
+        fprintf(fout, "_%s", rd.umi.chars());
+      if (trimInfo) 
+        fprintf(fout," %d %d", rd.trim5, rd.trim3);
+      fprintf(fout,"\n%s\n+\n%s\n", seq.chars(), qv.chars() );
+      }
+    }
+}
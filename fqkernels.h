@@ -0,0 +1,314 @@
+#ifndef FQ_KERNELS_H
+#define FQ_KERNELS_H
+#include "GBase.h"
+#include "GStr.h"
+#include "GList.hh"
+#include "GAlnExtend.h"
+
+// The read trimming primitives of fqtrim (quality, N, poly-A/T and adapter
+// trimming, dust, FASTQ parsing and output of a read) with the parameters
+// they use, kept apart from the file handling and threading of fqtrim.cpp
+// so they can also be linked into the kernel benchmarks (fqkbench).
+
+//trimming parameters, set from the command line options
+extern bool verbose;
+extern bool doPolyTrim;
+extern bool revCompl; //also reverse complement adapter sequences
+extern bool dustMask;
+extern int dust_cutoff;
+extern int min_read_len;
+extern double max_perc_N;
+extern double perc_lenN; //N-trimming distance from the ends, in percentage of read length
+extern int dist_lenN; //N-trimming distance from the ends in bp (perc_lenN if 0)
+extern int qvtrim_qmin;
+extern int qvtrim_max; //(-t) for -q, do not trim the 3'-end more than this number of bases
+extern int qvtrim_win; //(-w) for -q, sliding window length for avg qual calculation
+extern int qv_phredtype; //could be 64 or 33 (0 means undetermined yet)
+extern int qv_cvtadd; //could be -31 or +31
+extern int match_reward; //adapter alignment scoring
+extern int mismatch_penalty;
+extern int Xdrop;
+extern int minEndAdapter;
+extern double min_pid3; //min % identity for primer/adapter match at 3' end
+extern double min_pid5; //min % identity for primer/adapter match at 5' end
+const int poly_m_score=2; //match score for poly-A/T extension
+const int poly_mis_score=-3; //mismatch for poly-A/T extension
+const int poly_dropoff_score=7;
+extern int poly_minScore; //i.e. an exact match of 6 bases at the proper ends WILL be trimmed
+extern const char *polyA_seed;
+extern const char *polyT_seed;
+extern int adapter_idx;
+extern bool polyBothEnds; //attempt poly-A/T trimming at both ends
+extern bool showAdapterIdx; //trash/trim code of adapters is 'a'+adapter index
+extern bool doDust;
+extern bool doCollapse; //-C: dust is applied to the unique reads instead
+extern char isACGT[256];
+//output format
+extern bool fastaOutput;
+extern bool trimInfo; //trim info added to the output reads
+extern bool convert_phred;
+extern GStr prefix;
+extern int umi_len;
+
+struct STrimOp {
+	byte tend; //5 or 3
+	char tcode; //'N','A','T','V' or 'a'..'z'
+	short tlen; //trim length
+	STrimOp(byte e=0, char c=0, short l=0) {
+		assign(e,c,l);
+	}
+	void assign(byte e,char c, short l) {
+		tend=e;
+		tcode=c;
+		tlen=l;
+	}
+};
+
+struct RData {
+	GStr seq;
+	GStr qv;
+	GStr rid;
+	GStr rinfo;
+	GStr umi;
+	GVec<STrimOp> trimhist;
+	int trim5;
+	int trim3;
+	char trashcode;
+	int l3() { return seq.length()-trim3-1; }
+	RData():seq(),qv(),rid(),rinfo(),umi(), trimhist(), trim5(0), trim3(0), trashcode(0) {}
+	GStr getTrimSeq() {
+		if (trim5 || trim3)
+			return seq.substr(trim5, seq.length()-trim5-trim3);
+			else return seq;
+	}
+	GStr getTrimQv() {
+		if (trim5 || trim3)
+			return qv.substr(trim5, qv.length()-trim5-trim3);
+		else return qv;
+	}
+
+	void clear() { seq="";qv="";rid="";rinfo="";umi=""; trimhist.Clear();
+	               trim5=0; trim3=0; trashcode=0; }
+};
+
+struct CASeqData {
+	//positional data for every possible hexamer in an adapter
+	GVec<uint16>* pz[4096]; //0-based coordinates of all possible hexamers in the adapter sequence
+	GVec<uint16>* pzr[4096]; //0-based coordinates of all possible hexamers for the reverse complement of the adapter sequence
+	GStr seq; //actual adapter sequence data
+	GStr seqr; //reverse complement sequence
+	int fidx; //index of adapter in the file (order they are given)
+	int amlen; //fraction of adapter length matching that's enough to consider the alignment
+	GAlnTrimType trim_type;
+	bool use_reverse;
+	CASeqData(bool rev=false, int aidx=0):seq(),seqr(),
+			fidx(aidx), amlen(0), use_reverse(rev) {
+		trim_type=galn_None; //should be updated later!
+		for (int i=0;i<4096;i++) {
+			pz[i]=NULL;
+			pzr[i]=NULL;
+		}
+	}
+
+	void update(const char* s) {
+		seq=s;
+		table6mers(seq.chars(), seq.length(), pz);
+		amlen=calc_safelen(seq.length());
+		if (!use_reverse) return;
+		//reverse complement
+		seqr=s;
+		int slen=seq.length();
+		for (int i=0;i<slen;i++)
+			seqr[i]=ntComplement(seq[slen-i-1]);
+		table6mers(seqr.chars(), seqr.length(), pzr);
+	}
+
+	void freePosData() {
+		for (int i=0;i<4096;i++) {
+			delete pz[i];
+			delete pzr[i];
+		}
+	}
+	~CASeqData() { freePosData(); }
+};
+
+extern GPVec<CASeqData> adapters5;
+extern GPVec<CASeqData> adapters3;
+extern GPVec<CASeqData> all_adapters;
+
+void addAdapter(GPVec<CASeqData>& adapters, GStr& seq, GAlnTrimType trim_type);
+int loadAdapters(const char* fname);
+
+struct STrimCounts { //trimming stats of a thread, for one input file
+	uint64 incounter;
+	uint64 outcounter;
+	uint64 trash_s;
+	uint64 trash_poly;
+	uint64 trash_Q;
+	uint64 trash_N;
+	uint64 trash_D;
+	uint64 trash_V;
+	uint64 trash_X;
+	uint64 num_trimN, num_trimQ, num_trimV,
+	  num_trimA, num_trimT, num_trim5, num_trim3;
+
+	uint64 b_totalIn, b_totalN, b_trimN, b_trimQ,
+	  b_trimV, b_trimA, b_trimT, b_trim5, b_trim3;
+	STrimCounts():incounter(0), outcounter(0),trash_s(0), trash_poly(0),
+			trash_Q(0), trash_N(0), trash_D(0), trash_V(0),
+			trash_X(0),
+			num_trimN(0), num_trimQ(0), num_trimV(0), num_trimA(0), num_trimT(0), num_trim5(0), num_trim3(0),
+			b_totalIn(0), b_totalN(0), b_trimN(0), b_trimQ(0), b_trimV(0),
+			b_trimA(0), b_trimT(0), b_trim5(0), b_trim3(0) { }
+	void clearCounts() { *this=STrimCounts(); }
+	void countTrashed(char trashcode) { //a read/pair with this trash code
+		if (trashcode<=1) return;
+		if (trashcode=='s') trash_s++;
+		else if (trashcode=='A' || trashcode=='T') trash_poly++;
+		else if (trashcode=='Q') trash_Q++;
+		else if (trashcode=='N') trash_N++;
+		else if (trashcode=='D') trash_D++;
+		else if (trashcode=='V') trash_V++;
+		else trash_X++;
+	}
+	void addCounts(STrimCounts& c) {
+	  incounter+=c.incounter;
+	  outcounter+=c.outcounter;
+	  trash_s+=c.trash_s;
+	  trash_poly+=c.trash_poly;
+	  trash_Q+=c.trash_Q;
+	  trash_N+=c.trash_N;
+	  trash_D+=c.trash_D;
+	  trash_V+=c.trash_V;
+	  trash_X+=c.trash_X;
+	  num_trimN+=c.num_trimN;
+	  num_trimQ+=c.num_trimQ;
+	  num_trimV+=c.num_trimV;
+	  num_trimA+=c.num_trimA;
+	  num_trimT+=c.num_trimT;
+	  num_trim5+=c.num_trim5;
+	  num_trim3+=c.num_trim3;
+	  b_totalIn+=c.b_totalIn;
+	  b_totalN+=c.b_totalN;
+	  b_trimN+=c.b_trimN;
+	  b_trimQ+=c.b_trimQ;
+	  b_trimV+=c.b_trimV;
+	  b_trimA+=c.b_trimA;
+	  b_trimT+=c.b_trimT;
+	  b_trim5+=c.b_trim5;
+	  b_trim3+=c.b_trim3;
+	}
+};
+
+//the trimming steps of process_read(), each specialization of it is compiled
+//for one combination of these
+enum {
+	FQT_QTRIM=1, //-q
+	FQT_POLY=2, //poly-A/T (not -A)
+	FQT_POLY_BOTH=4, //-B, poly-A/T at both ends
+	FQT_ADAPTERS=8, //-f, -5 or -3
+	FQT_DUST=16, //-D, applied to each read (not with -C)
+	FQT_NUM_SPECS=32
+};
+
+//the trimming options of a run: set from the globals above once the command
+//line was parsed (load()), then only read (shared by the trimming threads).
+//The Phred type (qv_phredtype) is not one of them, but it is only read too:
+//without -P it is detected by the reader, before any read is trimmed.
+struct FqTrimOptions {
+	int features; //FQT_* steps enabled
+	int min_read_len;
+	int qvtrim_qmin, qvtrim_max, qvtrim_win;
+	double max_perc_N, perc_lenN;
+	int dist_lenN;
+	bool doPolyTrim, polyBothEnds;
+	int poly_minScore;
+	bool revCompl, showAdapterIdx;
+	int match_reward, mismatch_penalty, Xdrop;
+	int minEndAdapter;
+	double min_pid3, min_pid5;
+	FqTrimOptions() { load(); }
+	void load();
+};
+
+//a read given to process_read(): its bases (upper case) and quality chars
+//(NULL for FASTA), which are not copied, and the trimming done to it
+struct STrimRead {
+	const char* seq;
+	const char* qv;
+	int len;
+	int trim5;
+	int trim3;
+	GVec<STrimOp>& trimhist;
+	STrimRead(const char* s, const char* q, int l, GVec<STrimOp>& hist):seq(s), qv(q),
+		len(l), trim5(0), trim3(0), trimhist(hist) { }
+	int l3() { return len-trim3-1; }
+};
+
+class FqAdStats;
+struct CTrimKernels;
+typedef char (CTrimKernels::*ProcessReadFunc)(STrimRead& r);
+
+//the trimming functions of a thread, with its adapter alignment buffers
+//and trimming stats
+struct CTrimKernels: public STrimCounts {
+	const FqTrimOptions& opt;
+	ProcessReadFunc processFunc; //the process_read() specialization for opt
+	CGreedyAlignData* gxmem_l;
+	CGreedyAlignData* gxmem_r;
+	FqAdStats* adstats; //--adstats, adapter hits of this thread (if not NULL)
+	//the alignment used by the last trim_adapter*() returning true:
+	int adHitPos; //trim position, in seq
+	int adHitStrand; //1 if the reverse complement of the adapter matched
+	bool adHitStrong;
+	GVec<int> npos; //N positions, for ntrim()
+	char* dustmsk; //masking buffer of dust()
+	int dustcap;
+	CTrimKernels(const FqTrimOptions& o, bool alnbuffers=true);
+	~CTrimKernels() {
+		delete gxmem_l;
+		delete gxmem_r;
+		GFREE(dustmsk);
+	}
+	//all work on the len bases (or quality chars) at seq, in place, giving
+	//the range to keep in l5..l3; they return true if any trimming occured
+	bool ntrim(const char* seq, int len, int &l5, int &l3, double& pN);
+	bool qtrim(const char* qvs, int len, int &l5, int &l3);
+	bool trim_poly5(const char* seq, int len, int &l5, int &l3, const char* poly_seed);
+	bool trim_poly3(const char* seq, int len, int &l5, int &l3, const char* poly_seed);
+	bool trim_adapter5(const char* seq, int len, int &l5, int &l3, int &aidx);
+	bool trim_adapter3(const char* seq, int len, int &l5, int &l3, int &aidx);
+	int dust(const char* seq, int len); //number of bases dust would mask
+	//all the trimming of a read: sets r.trim5, r.trim3 and r.trimhist, returns 0
+	//if the read was untouched, 1 if it was trimmed and a trash code if it was trashed
+	char process_read(STrimRead& r) { return (this->*processFunc)(r); }
+	char process_read(RData& r) {
+		STrimRead t(r.seq.chars(), r.qv.is_empty() ? NULL : r.qv.chars(),
+			r.seq.length(), r.trimhist);
+		t.trim5=r.trim5;
+		t.trim3=r.trim3;
+		char c=(this->*processFunc)(t);
+		r.trim5=t.trim5;
+		r.trim3=t.trim3;
+		return c;
+	}
+	template<int F> char process_read_t(STrimRead& r); //F: FQT_* steps
+};
+
+void initACGT(); //set up isACGT[]
+//Phred type (33 or 64) telling apart the quality string, 0 if it cannot
+int guessPhred(const char* q, int len);
+void setPhredType(int phred); //set qv_phredtype and qv_cvtadd (33 or 64)
+
+int dust(GStr& seq); //returns the number of masked bases (masking seq if dustMask)
+void convertPhred(char* q, int len); //to the other Phred type
+void convertPhred(GStr& q);
+//parse the next FASTQ or FASTA record (fasta is set by the record type)
+bool getFastxRead(GLineReader& fq, RData& rd, GStr& infname, bool& fasta);
+bool umiInName();
+void printHeader(FILE* f_out, char recmarker, RData& rd);
+void getOutSeq(RData& rd, GStr& seq, GStr& qv);
+void getOutName(RData& rd, uint64 counter, GStr& name); //as in the output header line
+void write1Read(FILE* fout, RData& rd, uint64 counter);
+
+#endif
@@ -0,0 +1,931 @@
+#include "fqkref.h"
+
+// Frozen copy of the trimming kernels of fqkernels.cpp, as they were before
+// any of them was optimized. Only used by the equivalence tests (fqcheck):
+// do NOT change anything here, unless the trimming results of fqtrim are
+// meant to change too (and then fqkernels.cpp must get the same change).
+
+namespace fqref {
+
+class NData {
+ public:
+   GVec<int> NPos; //there should be no reads longer than 1K ?
+   //int NCount;
+   int end5;
+   int end3;
+   int n5; //left side N position (index in NPos)
+   int n3; //right side N position (index in NPos)
+   int seqlen;
+   double perc_N; //percentage of Ns in end5..end3 range only!
+   const char* seq;
+   bool valid;
+   NData():NPos(),end5(0),end3(0),n5(0),n3(-1),seqlen(0),
+         perc_N(0),seq(NULL),valid(true) {  }
+   NData(GStr& rseq):NPos(rseq.length()), end5(0),end3(rseq.length()-1),n5(0),n3(-1),
+       seqlen(rseq.length()), perc_N(0),seq(rseq.chars()),valid(true) {
+     //init(rseq);
+     for (int i=0;i<seqlen;i++)
+        if (seq[i]=='N') {// if (!ichrInStr(rseq[i], "ACGT")
+           NPos.Add(i);
+           }
+     n3=NPos.Count()-1; // -1 if no Ns
+     N_calc();
+   }
+  void N_trim(); //former N_analyze();
+  double N_calc() { //only in the end5-end3 region
+     if (n5<=n3) {
+       perc_N=((n3-n5+1)*100.0)/(end3-end5+1);
+       }
+      else perc_N=0; 
+    return perc_N;
+  }
+ };
+
+
+void NData::N_trim() { //N_analyze(NData& feat, int l5, int l3, int p5, int p3) {
+/* assumes feat was filled properly */
+ int old_dif, t5,t3,v;
+ int l3=end3;
+ int l5=end5;
+ while (l3>=l5+2 && n5<=n3) {
+   t5=NPos[n5]-l5; //left side possible trimming
+   t3=l3-NPos[n3]; //right side potential trimming
+   old_dif=n3-n5;
+   if (dist_lenN) { 
+      v=dist_lenN;
+   }
+   else {
+     v=iround(perc_lenN*(l3-l5+1)/100);
+     if (v>20) v=20; // enforce N-search limit for very long reads
+        else if (v<1) v=1;
+   }   
+   if (t5 <= v ) {
+     l5=NPos[n5]+1;
+     n5++; //we can trim at 5' end up to after leftmost N
+   }
+   if (t3 <= v) {
+     l3=NPos[n3]-1;
+     n3--; //we can trim at 3' before leftmost N;
+   }
+   // restNs=p3-p5; number of Ns in the new CLR 
+   if (n3-n5==old_dif) { // no change, return
+     break;
+   }
+ }
+ end5=l5;
+ end3=l3;
+ N_calc();
+ return;
+ /*
+ if (l3<l5+2 || p5>p3 ) {
+   feat.end5=l5+1;
+   feat.end3=l3+1;
+   return;
+   }
+
+ t5=feat.NPos[p5]-l5; //left side possible trimming
+ t3=l3-feat.NPos[p3]; //right side potential trimming
+ old_dif=p3-p5;
+ v=(int)((((double)(l3-l5))*perc_lenN)/100);
+ if (v>20) v=20; // enforce N-search limit for very long reads
+    else if (v<1) v=1;
+ if (t5 < v ) {
+   l5=feat.NPos[p5]+1;
+   p5++; //we can trim at 5' end up to after leftmost N
+   }
+ if (t3 < v) {
+   l3=feat.NPos[p3]-1;
+   p3--; //we can trim at 3' before leftmost N;
+   }
+ // restNs=p3-p5; number of Ns in the new CLR 
+ if (p3-p5==old_dif) { // no change, return
+           feat.end5=l5+1;
+           feat.end3=l3+1;
+           return;
+           }
+    else
+      N_analyze(feat, l5,l3, p5,p3);
+ */
+}
+
+
+bool CTrimKernels::qtrim(GStr& qvs, int &l5, int &l3) {
+if (qvtrim_qmin==0 || qvs.is_empty()) return false;
+l5=0;
+l3=qvs.length()-1;
+if (qv_phredtype==0) {
+  //try to guess the Phred type
+  int vmin=256, vmax=0;
+  for (int i=0;i<qvs.length();i++) {
+     if (vmin>qvs[i]) vmin=qvs[i];
+     if (vmax<qvs[i]) vmax=qvs[i];
+     }
+  if (vmin<64) { qv_phredtype=33; qv_cvtadd=31; }
+  if (vmax>95) { qv_phredtype=64; qv_cvtadd=-31; }
+  if (qv_phredtype==0) {
+    GError("Error: couldn't determine Phred type, please use the -p33 or -p64 !\n");
+    }
+  if (verbose)
+    GMessage("Input reads have Phred-%d quality values.\n", (qv_phredtype==33 ? 33 : 64));
+} //guessing Phred type
+int winlen=GMIN(qvtrim_win, qvs.length()/4);
+if (winlen<3) {
+ //no sliding window
+ //scan from the ends and look for two consecutive bases above the threshold
+ for (;l3>2;l3--) {
+    if (qvs[l3]-qv_phredtype>=qvtrim_qmin && qvs[l3-1]-qv_phredtype>=qvtrim_qmin) break;
+ }
+// qtrim 5' end
+ for (l5=0;l5<qvs.length()-3;l5++) {
+    if (qvs[l5]-qv_phredtype>=qvtrim_qmin && qvs[l5+1]-qv_phredtype>=qvtrim_qmin) break;
+ }
+}
+else {
+ // trim 3'
+ //sliding window from the 5' end until avg qual drops below the threshold
+ //init sum
+
+ int qsum=0;
+ /*
+ int qilow=-1; //first base index where qv drops below qmin
+ for (int q=0;q<winlen;q++) {
+   int qvq=qvs[q]-qv_phredtype;
+   qsum+=qvq;
+   if (qilow<0 && qvq<qvtrim_qmin) qilow=q;
+   }
+ double qavg=((double)qsum)/winlen;
+ if (qavg<qvtrim_qmin) { //first window fail
+   l3=qilow-1;
+ }
+ else {
+   for (int i=1;i<=qvs.length()-qvtrim_win;i++) {
+     qsum -= qvs[i-1]-qv_phredtype;
+     int inew=i+qvtrim_win-1;
+     int qvnew=qvs[inew]-qv_phredtype;
+     qsum += qvnew;
+     //if (qilow<i && qvnew<qvtrim_qmin) qilow=inew;
+     qavg=((double)qsum)/qvtrim_win;
+     //GMessage("i=%d (%c), inew=%d (%c), qilow=%d, qavg=%4.2f\n", i, qvs[i], inew, qvs[inew], qilow, qavg);
+     if (qavg<qvtrim_qmin) {
+       for (int qlo=i;qlo<i+qvtrim_win;qlo++) {
+          if (qvs[qlo]-qv_phredtype<qvtrim_qmin) {
+            l3=qlo-1;
+            break;
+          }
+       }
+       //l3=qilow-1;
+       break;
+       }
+   } //for each sliding window
+ }
+ */
+ int qi5=l5; //suggested qv trim 5' base index
+ int qi3=l3; //suggested qv trim 3' base index
+ double qavg; //avg. qv for the current window
+ int i5bw=-1; //index of first base below threshold in current window
+ int i3bw=-1; //index of last base below threshold in current window
+ bool okfound=false; //found a window above threshold
+ for (int i=0;i<winlen;++i) {
+   int cq=qvs[i]-qv_phredtype;
+   qsum+=cq;
+   if (cq<qvtrim_qmin) {
+	   i3bw=i;
+	   if (i5bw<0) i5bw=i;
+   }
+ }
+ qavg=((double)qsum)/winlen;
+ if (iround(qavg)<qvtrim_qmin) {
+	 //propose 5' trimming by qv
+	 qi5=i3bw+1;
+ }
+ else { okfound=true; }
+ //now scan the rest of the read
+ if (okfound) i5bw=-1;
+ for (int i=1;i<=qvs.length()-winlen;i++) {
+   if (i5bw<i) i5bw=-1;
+   qsum -= qvs[i-1]-qv_phredtype;
+   int inew=i+winlen-1;
+   int qvnew=qvs[inew]-qv_phredtype;
+   if (qvnew<qvtrim_qmin) {
+      if (i5bw<0) i5bw=inew;
+      i3bw=inew;
+   }
+   qsum += qvnew;
+   //if (qilow<i && qvnew<qvtrim_qmin) qilow=inew;
+   qavg=((double)qsum)/winlen;
+   if (qavg<qvtrim_qmin) { //bad qv window
+	 if (okfound) {
+		 //trimming 3' now
+		 qi3=i5bw-1;
+	     break;
+	 } else {
+		 //still trimming 5', shame
+		 qi5=i3bw+1;
+		 if (qvs.length()-qi5<min_read_len)
+			 break;
+	 }
+   }
+   else okfound=true;
+ } //for each sliding window
+ if (!okfound) {
+	 //fatal trimming at 5' end
+	 l5=qi5;
+	 return true;
+ }
+ l5=qi5;
+ l3=qi3;
+}
+
+if (qvtrim_max>0) {
+  if (qvs.length()-1-l3>qvtrim_max) l3=qvs.length()-1-qvtrim_max;
+  if (l5>qvtrim_max) l5=qvtrim_max;
+  }
+return (l5>0 || l3<qvs.length()-1);
+}
+
+bool CTrimKernels::ntrim(GStr& rseq, int &l5, int &l3, double& pN) {
+ //count Ns in the sequence, trim N-rich ends
+ NData feat(rseq);
+ l5=feat.end5;
+ l3=feat.end3;
+ pN=0.0;
+ if (feat.NPos.Count()==0) return false;
+ //int clrNcount = N_analyze(feat, feat.end5-1, feat.end3-1, 0, feat.NPos.Count()-1); //feat.NCount-1);
+ feat.N_trim(); //tries to trim terminal Ns, recalculates perc_N
+ pN=feat.perc_N;
+ if (l5==feat.end5 && l3==feat.end3) {
+    if (feat.perc_N>max_perc_N) {
+           #ifdef TRIMDEBUG
+           GMessage(" ### : N_trim() did nothing but remaining range %d-%d has internal %N = %4.2f\n", 
+               feat.end5, feat.end3, feat.perc_N);
+           #endif
+           feat.valid=false;
+           return true;
+           }
+      else {
+       return false; //no trimming
+       }
+    }
+ l5=feat.end5;
+ l3=feat.end3;
+ //feat.N_calc(); feat.N_trim() did this already
+ #ifdef TRIMDEBUG
+     GStr r=rseq.substr(feat.end5, feat.end3-feat.end5+1);
+     GMessage(" ### : after N_trim() clear range %d-%d has %N = %4.2f :\n%s\n", 
+          feat.end5, feat.end3, feat.perc_N, r.chars());
+ #endif
+ /*
+  if (l3-l5+1<min_read_len) {
+   feat.valid=false;
+   return true;
+   }
+ if (feat.perc_N>max_perc_N) {
+      feat.valid=false;
+      return true;
+      }
+ */
+ return true;
+ }
+
+//--------------- dust functions ----------------
+class DNADuster {
+ public:
+  int dustword;
+  int dustwindow;
+  int dustwindow2;
+  int dustcutoff;
+  int mv, iv, jv;
+  int counts[32*32*32];
+  int iis[32*32*32];
+  DNADuster(int cutoff=16, int winsize=32, int wordsize=3) {
+    dustword=wordsize;
+    dustwindow=winsize;
+    dustwindow2 = (winsize>>1);
+    dustcutoff=cutoff;
+    mv=0;
+    iv=0;
+    jv=0;
+    }
+  void setWindowSize(int value) {
+    dustwindow = value;
+    dustwindow2 = (dustwindow >> 1);
+    }
+  void setWordSize(int value) {
+    dustword=value;
+    }
+void wo1(int len, const char* s, int ivv) {
+  int i, ii, j, v, t, n, n1, sum;
+  int js, nis;
+  n = 32 * 32 * 32;
+  n1 = n - 1;
+  nis = 0;
+  i = 0;
+  ii = 0;
+  sum = 0;
+  v = 0;
+  for (j=0; j < len; j++, s++) {
+        ii <<= 5;
+        if (*s<=32) {
+           i=0;
+           continue;
+           }
+        ii |= *s - 'A'; //assume uppercase!
+        ii &= n1;
+        i++;
+        if (i >= dustword) {
+              for (js=0; js < nis && iis[js] != ii; js++) ;
+              if (js == nis) {
+                    iis[nis] = ii;
+                    counts[ii] = 0;
+                    nis++;
+              }
+              if ((t = counts[ii]) > 0) {
+                    sum += t;
+                    v = 10 * sum / j;
+                    if (mv < v) {
+                          mv = v;
+                          iv = ivv;
+                          jv = j;
+                    }
+              }
+              counts[ii]++;
+        }
+  }
+}
+
+int wo(int len, const char* s, int* beg, int* end) {
+      int i, l1;
+      l1 = len - dustword + 1;
+      if (l1 < 0) {
+            *beg = 0;
+            *end = len - 1;
+            return 0;
+            }
+      mv = 0;
+      iv = 0;
+      jv = 0;
+      for (i=0; i < l1; i++) {
+            wo1(len-i, s+i, i);
+            }
+      *beg = iv;
+      *end = iv + jv;
+      return mv;
+ }
+
+void dust(const char* seq, char* seqmsk, int seqlen, int cutoff=0) { //, maskFunc maskfn) {
+  int i, j, l, a, b, v;
+  if (cutoff==0) cutoff=dustcutoff;
+  a=0;b=0;
+  //GMessage("Dust cutoff=%d\n", cutoff);
+  for (i=0; i < seqlen; i += dustwindow2) {
+        l = (seqlen > i+dustwindow) ? dustwindow : seqlen-i;
+        v = wo(l, seq+i, &a, &b);
+        if (v > cutoff) {
+           //for (j = a; j <= b && j < dustwindow2; j++) {
+           for (j = a; j <= b; j++) {
+                    seqmsk[i+j]='N';//could be made lowercase instead
+                    }
+           }
+         }
+//return first;
+ }
+};
+
+//static DNADuster duster;
+
+int dust(GStr& rseq) {
+ DNADuster duster;
+ char* seq=Gstrdup(rseq.chars());
+ duster.dust(rseq.chars(), seq, rseq.length(), dust_cutoff);
+ //check the number of Ns:
+ int ncount=0;
+ for (int i=0;i<rseq.length();i++) {
+   if (seq[i]=='N') ncount++;
+   }
+ if (dustMask) rseq=seq; //hard masking requested
+ GFREE(seq);
+ return ncount;
+ }
+
+struct SLocScore {
+  int pos;
+  int score;
+  SLocScore(int p=0,int s=0) {
+    pos=p;
+    score=s;
+    }
+  void set(int p, int s) {
+    pos=p;
+    score=s;
+    }
+  void add(int p, int add) {
+    pos=p;
+    score+=add;
+    }
+};
+
+bool CTrimKernels::trim_poly3(GStr &seq, int &l5, int &l3, const char* poly_seed) {
+ if (!doPolyTrim) return false;
+ int rlen=seq.length();
+ l5=0;
+ l3=rlen-1;
+ int32 seedVal=*(int32*)poly_seed;
+ char polyChar=poly_seed[0];
+ //assumes N trimming was already done
+ //so a poly match should be very close to the end of the read
+ // -- find the initial match (seed)
+ int lmin=GMAX((rlen-16), 0);
+ int li;
+ for (li=rlen-4;li>lmin;li--) {
+   if (seedVal==*(int*)&(seq[li])) {
+      break;
+      }
+   }
+ if (li<=lmin) return false;
+ //seed found, try to extend it both ways
+ //extend right
+ int ri=li+3;
+ SLocScore loc(ri, poly_m_score<<2);
+ SLocScore maxloc(loc);
+ //extend right
+ while (ri<rlen-1) {
+   ri++;
+   if (seq[ri]==polyChar) {
+                loc.add(ri,poly_m_score);
+                }
+   else if (seq[ri]=='N') {
+                loc.add(ri,0);
+                }
+   else { //mismatch
+        loc.add(ri,poly_mis_score);
+        if (maxloc.score-loc.score>poly_dropoff_score) break;
+        }
+   if (maxloc.score<=loc.score) {
+      maxloc=loc;
+      }
+   }
+ ri=maxloc.pos;
+ if (ri<rlen-6) return false; //no trimming wanted, too far from 3' end
+ //ri = right boundary for the poly match
+ //extend left
+ loc.set(li, maxloc.score);
+ maxloc.pos=li;
+ while (li>0) {
+    li--;
+    if (seq[li]==polyChar) {
+                 loc.add(li,poly_m_score);
+                 }
+    else if (seq[li]=='N') {
+                 loc.add(li,0);
+                 }
+    else { //mismatch
+         loc.add(li,poly_mis_score);
+         if (maxloc.score-loc.score>poly_dropoff_score) break;
+         }
+    if (maxloc.score<=loc.score) {
+       maxloc=loc;
+       }
+    }
+li=maxloc.pos;
+if ((maxloc.score==poly_minScore && ri==rlen-1) ||
+    (maxloc.score>poly_minScore && ri>=rlen-3) ||
+    (maxloc.score>(poly_minScore*3) && ri>=rlen-8)) {
+  //trimming this li-ri match at 3' end
+    l3=li-1;
+    if (l3<0) l3=0;
+    return true;
+    }
+return false;
+}
+
+bool CTrimKernels::trim_poly5(GStr &seq, int &l5, int &l3, const char* poly_seed) {
+ if (!doPolyTrim) return false;
+ int rlen=seq.length();
+ l5=0;
+ l3=rlen-1;
+ int32 seedVal=*(int32*)poly_seed;
+ char polyChar=poly_seed[0];
+ //assumes N trimming was already done
+ //so a poly match should be very close to the end of the read
+ // -- find the initial match (seed)
+ int lmax=GMIN(12, rlen-4);//how far from 5' end to look for 4-mer seeds
+ int li;
+ for (li=0;li<=lmax;li++) {
+   if (seedVal==*(int*)&(seq[li])) {
+      break;
+      }
+   }
+ if (li>lmax) return false;
+ //seed found, try to extend it both ways
+ //extend left
+ int ri=li+3; //save rightmost base of the seed
+ SLocScore loc(li, poly_m_score<<2);
+ SLocScore maxloc(loc);
+ while (li>0) {
+    li--;
+    if (seq[li]==polyChar) {
+                 loc.add(li,poly_m_score);
+                 }
+    else if (seq[li]=='N') {
+                 loc.add(li,0);
+                 }
+    else { //mismatch
+         loc.add(li,poly_mis_score);
+         if (maxloc.score-loc.score>poly_dropoff_score) break;
+         }
+    if (maxloc.score<=loc.score) {
+       maxloc=loc;
+       }
+    }
+ li=maxloc.pos;
+ if (li>5) return false; //no trimming wanted, too far from 5' end
+ //li = right boundary for the poly match
+
+ //extend right
+ loc.set(ri, maxloc.score);
+ maxloc.pos=ri;
+ while (ri<rlen-1) {
+   ri++;
+   if (seq[ri]==polyChar) {
+                loc.add(ri,poly_m_score);
+                }
+   else if (seq[ri]=='N') {
+                loc.add(ri,0);
+                }
+   else { //mismatch
+        loc.add(ri,poly_mis_score);
+        if (maxloc.score-loc.score>poly_dropoff_score) break;
+        }
+   if (maxloc.score<=loc.score) {
+      maxloc=loc;
+      }
+   }
+ri=maxloc.pos;
+if ((maxloc.score==poly_minScore && li==0) ||
+     (maxloc.score>poly_minScore && li<2)
+     || (maxloc.score>(poly_minScore*3) && li<8)) {
+    //adjust l5 to reflect this trimming of 5' end
+    l5=ri+1;
+    if (l5>rlen-1) l5=rlen-1;
+    return true;
+    }
+return false;
+}
+
+bool CTrimKernels::trim_adapter3(GStr& seq, int&l5, int &l3, int& aidx) {
+ if (adapters3.Count()==0) return false;
+ //GMessage("Trimming adapter 3!\n");
+ int rlen=seq.length();
+ l5=0;
+ l3=rlen-1;
+ bool trimmed=false;
+ GStr wseq(seq);
+ int wlen=rlen;
+ GXSeqData seqdata;
+ int numruns=revCompl ? 2 : 1;
+ GList<GXAlnInfo> bestalns(true, true, false);
+ aidx=-1;
+ for (int ai=0;ai<adapters3.Count();ai++) {
+   for (int r=0;r<numruns;r++) {
+     if (r) {
+  	  seqdata.update(adapters3[ai]->seqr.chars(), adapters3[ai]->seqr.length(),
+  		 adapters3[ai]->pzr, wseq.chars(), wlen, adapters3[ai]->amlen);
+        }
+     else {
+  	    seqdata.update(adapters3[ai]->seq.chars(), adapters3[ai]->seq.length(),
+  		 adapters3[ai]->pz, wseq.chars(), wlen, adapters3[ai]->amlen);
+        }
+     //GXAlnInfo* aln=match_adapter(seqdata, adapters3[ai]->trim_type, minEndAdapter, gxmem_r, min_pid3);
+     GXAlnInfo* aln=match_adapter(seqdata, galn_TrimRight, minEndAdapter, gxmem_r, min_pid3);
+	 if (aln) {
+	   aln->udata=adapters3[ai]->fidx;
+	   if (aln->strong) {
+		   trimmed=true;
+		   bestalns.Add(aln);
+		   break; //will check the rest next time
+		   }
+	    else bestalns.Add(aln);
+	   }
+   }//forward and reverse adapters
+   if (trimmed) break; //will check the rest in the next cycle
+  }//for each 3' adapter
+ if (bestalns.Count()>0) {
+	   GXAlnInfo* aln=bestalns[0];
+	   if (aln->sl-1 > wlen-aln->sr) {
+		   //keep left side
+		   l3-=(wlen-aln->sl+1);
+		   if (l3<0) l3=0;
+		   }
+	   else { //keep right side
+		   l5+=aln->sr;
+		   if (l5>=rlen) l5=rlen-1;
+		   }
+	   //delete aln;
+	   //if (l3-l5+1<min_read_len) return true;
+	   wseq=seq.substr(l5,l3-l5+1);
+	   wlen=wseq.length();
+	   aidx=aln->udata;
+	   return true; //break the loops here to report a good find
+     }
+  aidx=-1;
+  return false;
+ }
+
+bool CTrimKernels::trim_adapter5(GStr& seq, int&l5, int &l3, int& aidx) {
+ if (adapters5.Count()==0) return false;
+ int rlen=seq.length();
+ l5=0;
+ l3=rlen-1;
+ bool trimmed=false;
+ GStr wseq(seq);
+ int wlen=rlen;
+ GXSeqData seqdata;
+ int numruns=revCompl ? 2 : 1;
+ GList<GXAlnInfo> bestalns(true, true, false);
+ aidx=-1;
+ for (int ai=0;ai<adapters5.Count();ai++) {
+   for (int r=0;r<numruns;r++) {
+     if (r) {
+  	  seqdata.update(adapters5[ai]->seqr.chars(), adapters5[ai]->seqr.length(),
+  		 adapters5[ai]->pzr, wseq.chars(), wlen, adapters5[ai]->amlen);
+        }
+     else {
+  	    seqdata.update(adapters5[ai]->seq.chars(), adapters5[ai]->seq.length(),
+  		 adapters5[ai]->pz, wseq.chars(), wlen, adapters5[ai]->amlen);
+        }
+	 //GXAlnInfo* aln=match_adapter(seqdata, adapters5[ai]->trim_type,
+     GXAlnInfo* aln=match_adapter(seqdata, galn_TrimLeft,
+		                                       minEndAdapter, gxmem_l, min_pid5);
+	 if (aln) {
+	   aln->udata=adapters5[ai]->fidx;
+	   if (aln->strong) {
+		   trimmed=true;
+		   bestalns.Add(aln);
+		   break; //will check the rest next time
+		   }
+	    else bestalns.Add(aln);
+	   }
+	 } //forward and reverse?
+   if (trimmed) break; //will check the rest in the next cycle
+  }//for each 5' adapter
+  if (bestalns.Count()>0) {
+	   GXAlnInfo* aln=bestalns[0];
+	   if (aln->sl-1 > wlen-aln->sr) {
+		   //keep left side
+		   l3-=(wlen-aln->sl+1);
+		   if (l3<0) l3=0;
+		   }
+	   else { //keep right side
+		   l5+=aln->sr;
+		   if (l5>=rlen) l5=rlen-1;
+		   }
+	   //delete aln;
+	   //if (l3-l5+1<min_read_len) return true;
+	   wseq=seq.substr(l5,l3-l5+1);
+	   wlen=wseq.length();
+	   aidx=aln->udata;
+	   return true; //break the loops here to report a good find
+     }
+  aidx=-1;
+  return false;
+}
+
+//convert qvs to/from phred64 from/to phread33
+struct STrimState {
+ int w5;
+ int w3;
+ GStr wseq;
+ GStr wqv;
+ bool w3upd;
+ bool w5upd;
+ bool wupd;
+ STrimState(GStr& rseq, GStr& rqv):w5(0), w3(rseq.length()-1),
+     wseq(rseq.chars()), wqv(rqv.chars()), w3upd(true), w5upd(true), wupd(true) {
+ }
+
+ char update(char trim_code, int& trim5, int& trim3) {
+   trim5+=w5;
+   trim3+=(wseq.length()-1-w3);
+ //#ifdef TRIMDEBUG
+ //  GMessage("#### TRIM by '%c' code ( w5-w3 = %d-%d ):\n",trim_code, w5,w3);
+ //  showTrim(wseq, wqv, w5, w3);
+ //#endif
+   //-- keep only the w5..w3 range
+   wseq=wseq.substr(w5, w3-w5+1);
+   if (!wqv.is_empty())
+      wqv=wqv.substr(w5, w3-w5+1);
+   if (w3-w5+1<min_read_len) {
+       return trim_code; //return last operation code as "trash code"
+   }
+   w5=0;
+   w3=wseq.length()-1;
+   return 0;
+ }
+ 
+};
+
+char CTrimKernels::process_read(RData &r) {
+ //returns 0 if the read was untouched, 1 if it was just trimmed
+ // and a trash code if it was trashed
+ if (r.seq.length()-r.trim5-r.trim3<min_read_len) {
+   return 's'; //too short already
+   }
+//count Ns
+b_totalIn+=r.seq.length();
+for (int i=0;i<r.seq.length();i++) {
+ if (isACGT[(int)r.seq[i]]==0) b_totalN++;
+ }
+double percN=0;
+char trim_code=0;
+
+GStr wseq(r.seq.chars());
+GStr wqv(r.qv.chars());
+
+int w5=r.trim5;
+int w3=r.seq.length()-r.trim3-1;
+
+//first do the q-based trimming
+if (qvtrim_qmin!=0 && !wqv.is_empty() && qtrim(wqv, w5, w3)) { // qv-threshold trimming
+   trim_code='Q';
+   int t5=(w5-r.trim5);
+   if (t5>0) {
+      STrimOp trimop(5,trim_code,t5);
+      r.trimhist.Add(trimop);
+   }
+   int t3=(r.l3()-w3);
+   if (t3>0) {
+      STrimOp trimop(3,trim_code,t3);
+      r.trimhist.Add(trimop);
+   }
+   #ifdef TRIMDEBUG
+     GMessage("#DBG# qv trimming: %d from 5'end; %d from 3'end\n",t5,t3);
+   #endif
+   b_trimQ+=t5+t3;
+   num_trimQ++;
+   r.trim5=w5;
+   r.trim3=r.seq.length()-1-w3;
+   if (r.seq.length()-r.trim5-r.trim3<min_read_len) {
+     return trim_code; //invalid read
+     }
+   //-- keep only the w5..w3 range
+   wseq=wseq.substr(r.trim5, r.seq.length()-r.trim3-r.trim5);
+   if (!wqv.is_empty())
+      wqv=wqv.substr(r.trim5, r.seq.length()-r.trim3-r.trim5);
+   } //qv trimming
+// N-trimming on the remaining read seq
+if (ntrim(wseq, w5, w3, percN)) {
+   //Note: ntrim sets w5 to the number of trimmed bases at read start
+   //     and w3 to the new end of read sequence
+#ifdef TRIMDEBUG
+   GMessage("#DBG# N trim: keeping %d-%d range: %s\n",w5+1,w3, wseq.substr(w5, w3-w5+1).chars() );
+#endif
+   int trim3=(wseq.length()-1-w3);
+   trim_code='N';
+   b_trimN+=w5+trim3;
+   num_trimN++;
+   if (w5>0) {
+      STrimOp trimop(5,trim_code,w5);
+      r.trimhist.Add(trimop);
+   }
+   if (trim3>0) {
+      STrimOp trimop(3,trim_code,trim3);
+      r.trimhist.Add(trimop);
+   }
+   r.trim5+=w5;
+   r.trim3+=trim3;
+   if (w3-w5+1<min_read_len) {
+     return trim_code; //to be trashed
+   }
+   if (percN > max_perc_N) {
+     return trim_code;
+   }
+    //-- keep only the w5..w3 range
+   wseq=wseq.substr(w5, w3-w5+1);
+   if (!wqv.is_empty())
+      wqv=wqv.substr(w5, w3-w5+1);
+   //w5=0;
+   //w3=wseq.length()-1;
+}
+
+//clean the more dirty end first - 3'
+bool trimmedA=false;
+bool trimmedT=false;
+bool trimmedV=false;
+STrimState ts(wseq,wqv); //work with this structure from now on
+do {
+  int prev_t3=r.trim3;
+  int prev_t5=r.trim5;
+  trim_code=0;
+  if (ts.w3upd) {
+    if (trim_poly3(ts.wseq, ts.w5, ts.w3, polyA_seed)) {
+      trim_code='A';
+      STrimOp trimop(3, trim_code, (ts.w5+(ts.wseq.length()-1-ts.w3)));
+      #ifdef TRIMDEBUG
+        GMessage("#DBG# 3' polyA trimming %d bases\n",trimop.tlen);
+      #endif
+      r.trimhist.Add(trimop);
+      b_trimA+=trimop.tlen;
+      if (!trimmedA) { num_trimA++; trimmedA=true; }
+    }
+    else
+    if (polyBothEnds && trim_poly3(ts.wseq, ts.w5, ts.w3, polyT_seed)) {
+      trim_code='T';
+      STrimOp trimop(3, trim_code, (ts.w5+(ts.wseq.length()-1-ts.w3)));
+     #ifdef TRIMDEBUG
+       GMessage("#DBG# 3' polyT trimming %d bases\n",trimop.tlen);
+     #endif
+      r.trimhist.Add(trimop);
+      b_trimT+=trimop.tlen;
+      if (!trimmedT) { num_trimT++; trimmedT=true; }
+    }
+    if (trim_code) {
+      ts.wupd=true;
+      if (ts.update(trim_code, r.trim5, r.trim3))
+         return trim_code;
+      trim_code=0;
+    }
+   }
+   int tidx=-1;
+   if (ts.wupd && trim_adapter3(ts.wseq, ts.w5, ts.w3, tidx)) {
+       if (showAdapterIdx && tidx>=0) trim_code=('a'+tidx);
+         else trim_code='V';
+       STrimOp trimop(3, trim_code, (ts.w5+(ts.wseq.length()-1-ts.w3)));
+       #ifdef TRIMDEBUG
+          GMessage("#DBG# 3' adapter trimming %d bases\n",trimop.tlen);
+       #endif
+
+       r.trimhist.Add(trimop);
+       b_trimV+=trimop.tlen;
+       if (!trimmedV) { num_trimV++; trimmedV=true; }
+   }
+   if (trim_code) {
+    if (ts.update(trim_code, r.trim5, r.trim3))
+        return trim_code;
+    //wseq, w5, w3 were updated, let this fall through to next check
+    trim_code=0;
+   }
+   if (ts.w5upd) {
+    if (trim_poly5(ts.wseq, ts.w5, ts.w3, polyT_seed)) {
+        trim_code='T';
+        STrimOp trimop(5, trim_code,(ts.w5+(ts.wseq.length()-1-ts.w3)));
+        #ifdef TRIMDEBUG
+          GMessage("#DBG# 5' polyT trimming %d bases\n",trimop.tlen);
+        #endif
+        r.trimhist.Add(trimop);
+        b_trimT+=trimop.tlen;
+        if (!trimmedT) { num_trimT++; trimmedT=true; }
+    }
+    else
+    if (polyBothEnds && trim_poly5(ts.wseq, ts.w5, ts.w3, polyA_seed)) {
+        trim_code='A';
+        STrimOp trimop(5, trim_code,(ts.w5+(ts.wseq.length()-1-ts.w3)));
+		#ifdef TRIMDEBUG
+		  GMessage("#DBG# 5' polyA trimming %d bases\n",trimop.tlen);
+		#endif
+        r.trimhist.Add(trimop);
+        b_trimA+=trimop.tlen;
+        if (!trimmedA) { num_trimA++; trimmedA=true; }
+    }
+    if (trim_code) {
+      ts.wupd=true;
+      if (ts.update(trim_code, r.trim5, r.trim3))
+         return trim_code;
+      trim_code=0;
+    }
+   }
+   tidx=-1;
+   if (ts.wupd && trim_adapter5(ts.wseq, ts.w5, ts.w3, tidx)) {
+      if (showAdapterIdx && tidx>=0) trim_code=('a'+tidx);
+   	   else trim_code='V';
+      STrimOp trimop(5, trim_code,(ts.w5+(ts.wseq.length()-1-ts.w3)));
+	  #ifdef TRIMDEBUG
+	    GMessage("#DBG# 5' adapter trimming %d bases\n",trimop.tlen);
+	  #endif
+      r.trimhist.Add(trimop);
+      b_trimV+=trimop.tlen;
+      if (!trimmedV) { num_trimV++; trimmedV=true; }
+      }
+  //checked the 3' end
+  if (trim_code) {
+    if (ts.update(trim_code, r.trim5, r.trim3))
+        return trim_code;
+    //wseq, w5, w3 were updated, let this fall through to next check
+    trim_code=0;
+  }
+  ts.w3upd=(r.trim3!=prev_t3);
+  ts.w5upd=(r.trim5!=prev_t5);
+  ts.wupd=(ts.w3upd || ts.w5upd);
+} while (ts.wupd);
+//with -C, surviving reads go to the duplicates table in flushBatch()
+//and the dust filter is only applied to the unique reads at the end
+if (!doCollapse && doDust) {
+   //apply the dust filter now
+   int dustbases=fqref::dust(ts.wseq);
+   if (dustbases>(ts.wseq.length()>>1)) {
+      return 'D';//trash code
+      }
+   }
+return (r.trim5>0 || r.trim3>0) ? 1 : 0;
+}
+
+} //namespace fqref
@@ -0,0 +1,37 @@
+#ifndef FQ_KREF_H
+#define FQ_KREF_H
+#include "fqkernels.h"
+
+// The reference trimming kernels (fqkref.cpp): the original implementations
+// of the CTrimKernels methods and of dust(), using the same parameters, for
+// checking that the optimized ones in fqkernels.cpp give the same results.
+
+namespace fqref {
+
+struct CTrimKernels: public STrimCounts {
+	CGreedyAlignData* gxmem_l;
+	CGreedyAlignData* gxmem_r;
+	CTrimKernels():STrimCounts(), gxmem_l(NULL), gxmem_r(NULL) {
+		if (adapters5.Count()>0)
+			gxmem_l=new CGreedyAlignData(match_reward, mismatch_penalty, Xdrop);
+		if (adapters3.Count()>0)
+			gxmem_r=new CGreedyAlignData(match_reward, mismatch_penalty, Xdrop);
+	}
+	~CTrimKernels() {
+		delete gxmem_l;
+		delete gxmem_r;
+	}
+	bool ntrim(GStr& rseq, int &l5, int &l3, double& pN);
+	bool qtrim(GStr& qvs, int &l5, int &l3);
+	bool trim_poly5(GStr &seq, int &l5, int &l3, const char* poly_seed);
+	bool trim_poly3(GStr &seq, int &l5, int &l3, const char* poly_seed);
+	bool trim_adapter5(GStr& seq, int &l5, int &l3, int &aidx);
+	bool trim_adapter3(GStr& seq, int &l5, int &l3, int &aidx);
+	char process_read(RData& r);
+};
+
+int dust(GStr& seq);
+
+} //namespace fqref
+
+#endif
@@ -0,0 +1,134 @@
+#include "fqlib.h"
+#include "fqsimd.h"
+#include <ctype.h>
+
+static FqTrimOptions* libOpts=NULL; //set by fqTrimInit()
+
+static bool setupError(GStr* err, const char* msg) {
+	if (err) *err=msg;
+	return false;
+}
+
+bool fqTrimInit(const FqTrimSetup& s, GStr* err) {
+	if (s.phred!=33 && s.phred!=64)
+		return setupError(err, "the Phred type must be 33 or 64");
+	if (s.polyTrim && s.polyMin<=2)
+		return setupError(err, "invalid minimum poly-A/T length");
+	if (s.qwin<1) return setupError(err, "invalid quality window length");
+	if (s.adaptersFile!=NULL && (s.adapter5!=NULL || s.adapter3!=NULL))
+		return setupError(err, "adapter file and adapter sequences cannot be used together");
+	if (s.adaptersFile!=NULL && fileExists(s.adaptersFile)<2)
+		return setupError(err, "cannot find the adapter file");
+	if (!fqSimdInit(s.simd)) return setupError(err, "SIMD level not available");
+	fqTrimDone();
+	verbose=false;
+	min_read_len=s.minReadLen;
+	qvtrim_qmin=s.qmin;
+	qvtrim_win=s.qwin;
+	qvtrim_max=s.qmax3;
+	qv_phredtype=s.phred;
+	qv_cvtadd=0;
+	convert_phred=false;
+	max_perc_N=s.maxPercN;
+	dist_lenN=s.nDist;
+	perc_lenN=s.nPercDist;
+	doPolyTrim=s.polyTrim;
+	polyBothEnds=s.polyBothEnds;
+	poly_minScore=s.polyMin*poly_m_score;
+	doDust=s.dust;
+	dustMask=false; //the reads are not changed
+	doCollapse=false;
+	dust_cutoff=s.dustCutoff;
+	revCompl=s.revCompl;
+	showAdapterIdx=s.showAdapterIdx;
+	match_reward=s.matchReward;
+	mismatch_penalty=s.mismatchPenalty;
+	Xdrop=s.xdrop;
+	minEndAdapter=s.minEndAdapter;
+	min_pid5=s.minPid5;
+	min_pid3=s.minPid3;
+	initACGT();
+	if (s.adaptersFile!=NULL) loadAdapters(s.adaptersFile);
+	if (s.adapter5!=NULL) {
+		GStr a(s.adapter5);
+		a.upper();
+		addAdapter(adapters5, a, galn_TrimLeft);
+	}
+	if (s.adapter3!=NULL) {
+		GStr a(s.adapter3);
+		a.upper();
+		addAdapter(adapters3, a, galn_TrimRight);
+	}
+	libOpts=new FqTrimOptions();
+	return true;
+}
+
+void fqTrimDone() {
+	delete libOpts;
+	libOpts=NULL;
+	adapters5.Clear();
+	adapters3.Clear();
+	all_adapters.Clear();
+	adapter_idx=0;
+}
+
+static const FqTrimOptions& trimOptions() {
+	if (libOpts==NULL) GError("Error: fqTrimInit() must be called before trimming!\n");
+	return *libOpts;
+}
+
+FqTrimmer::FqTrimmer():k(trimOptions()), ops(), buf(NULL), bufcap(0) { }
+
+const char* FqTrimmer::upperSeq(const FqReadView& v) {
+	int i=0;
+	while (i<v.len && !islower(v.seq[i])) i++;
+	if (i==v.len) return v.seq; //used as it is
+	if (v.len>bufcap) {
+		bufcap=GMAX(v.len, 512);
+		GREALLOC(buf, bufcap);
+	}
+	memcpy(buf, v.seq, i);
+	for (;i<v.len;i++) buf[i]=toupper(v.seq[i]);
+	return buf;
+}
+
+void FqTrimmer::trimRead(const FqReadView& v, FqTrimResult& res) {
+	ops.setCount(0); //keeps its capacity
+	STrimRead r(upperSeq(v), v.qual, v.len, ops);
+	res.trashcode=k.process_read(r);
+	if (r.trim5>0) {
+		k.b_trim5+=r.trim5;
+		k.num_trim5++;
+	}
+	if (r.trim3>0) {
+		k.b_trim3+=r.trim3;
+		k.num_trim3++;
+	}
+	res.trim5=r.trim5;
+	res.trim3=r.trim3;
+	res.totalOps=ops.Count();
+	res.numOps=GMIN(res.totalOps, FQLIB_MAX_OPS);
+	for (int i=0;i<res.numOps;i++) res.ops[i]=ops[i];
+}
+
+void FqTrimmer::trim(const FqReadView* reads, int n, FqTrimResult* res) {
+	for (int i=0;i<n;i++) {
+		k.incounter++;
+		trimRead(reads[i], res[i]);
+		k.countTrashed(res[i].trashcode);
+		if (res[i].trashcode<=1) k.outcounter++;
+	}
+}
+
+void FqTrimmer::trimPairs(const FqReadView* reads1, const FqReadView* reads2, int n,
+		FqTrimResult* res1, FqTrimResult* res2) {
+	for (int i=0;i<n;i++) {
+		k.incounter++;
+		trimRead(reads1[i], res1[i]);
+		trimRead(reads2[i], res2[i]);
+		k.countTrashed(res2[i].trashcode);
+		k.countTrashed(res1[i].trashcode);
+		//fqtrim's default pair rescue: the pair is kept if either mate is
+		if (res1[i].trashcode<=1 || res2[i].trashcode<=1) k.outcounter++;
+	}
+}
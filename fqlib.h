@@ -0,0 +1,94 @@
+#ifndef FQ_LIB_H
+#define FQ_LIB_H
+#include "fqkernels.h"
+
+// In-memory trimming API (libfqtrim.a): the per-read trimming of fqtrim,
+// without its file handling, for programs that already have the reads.
+//
+// fqTrimInit() sets the trimming options and the adapters for the whole
+// process (they are the same globals fqtrim's command line sets), so it is
+// called once before any trimming, and again only when no FqTrimmer exists.
+// Each thread then uses its own FqTrimmer, which can trim any number of
+// batches: the reads are given as views of the caller's sequence and
+// quality data, which the trimming kernels scan in place (bases are only
+// copied, into a buffer of the trimmer, when they need upper-casing), and
+// the results go to a caller array. The adapter alignments (-f, -5, -3)
+// still allocate, inside gclib's aligner, for reads with adapter seeds.
+
+#define FQLIB_MAX_OPS 8
+
+struct FqTrimSetup { //the trimming options, as those of fqtrim
+	int minReadLen; //-l
+	int qmin; //-q, quality trimming (0: none)
+	int qwin; //-w
+	int qmax3; //-t
+	int phred; //-P, Phred type of the qualities: 33 or 64 (no guessing)
+	double maxPercN; //-m
+	int nDist; //--ntrimdist, N trimming distance from the ends (bp)
+	double nPercDist; //same as a percentage of the read length (if nDist is 0)
+	bool polyTrim; //not -A
+	bool polyBothEnds; //-B
+	int polyMin; //-y
+	bool dust; //-D
+	int dustCutoff; //-d
+	bool revCompl; //-R
+	bool showAdapterIdx; //--aidx
+	const char* adaptersFile; //-f
+	const char* adapter5; //-5
+	const char* adapter3; //-3
+	int matchReward, mismatchPenalty, xdrop;
+	int minEndAdapter;
+	double minPid5, minPid3;
+	const char* simd; //--simd, level of the byte scanning kernels (NULL: the best)
+	FqTrimSetup():minReadLen(16), qmin(0), qwin(6), qmax3(0), phred(33),
+			maxPercN(5.0), nDist(0), nPercDist(12.0), polyTrim(true),
+			polyBothEnds(false), polyMin(6), dust(false), dustCutoff(16),
+			revCompl(false), showAdapterIdx(false), adaptersFile(NULL),
+			adapter5(NULL), adapter3(NULL), matchReward(1), mismatchPenalty(3),
+			xdrop(8), minEndAdapter(6), minPid5(96.0), minPid3(94.0), simd(NULL) { }
+};
+
+//set up the trimming for the process; false (and the reason in err) for
+//invalid options or an unreadable adapter file
+bool fqTrimInit(const FqTrimSetup& setup, GStr* err=NULL);
+void fqTrimDone(); //frees the adapters
+
+struct FqReadView {
+	const char* seq; //bases, either case (need not be 0-terminated)
+	const char* qual; //len quality chars, NULL for FASTA reads
+	int len;
+};
+
+struct FqTrimResult {
+	int trim5; //bases trimmed from the 5' end
+	int trim3; //bases trimmed from the 3' end
+	//0: untouched, 1: trimmed, otherwise the read was trashed and this is
+	//the reason: 's' (too short), 'N', 'Q', 'A', 'T', 'D' (dust), 'V' or the
+	//adapter code ('a'+adapter index with --aidx)
+	char trashcode;
+	int totalOps; //trimming operations done to the read
+	int numOps; //those in ops, in order: the first FQLIB_MAX_OPS of them
+	STrimOp ops[FQLIB_MAX_OPS];
+};
+
+//the trimming state of a thread; its counts add up the reads it trimmed
+class FqTrimmer {
+	CTrimKernels k;
+	GVec<STrimOp> ops; //trimming operations of the current read
+	char* buf; //upper-cased bases of the current read, if needed
+	int bufcap;
+	const char* upperSeq(const FqReadView& v);
+	void trimRead(const FqReadView& v, FqTrimResult& res);
+ public:
+	FqTrimmer();
+	~FqTrimmer() { GFREE(buf); }
+	//trim n reads
+	void trim(const FqReadView* reads, int n, FqTrimResult* res);
+	//trim n pairs; the counts are per pair, as those of fqtrim
+	void trimPairs(const FqReadView* reads1, const FqReadView* reads2, int n,
+			FqTrimResult* res1, FqTrimResult* res2);
+	STrimCounts& counts() { return k; }
+	void clearCounts() { k.clearCounts(); }
+};
+
+#endif
@@ -0,0 +1,317 @@
+#include "fqlive.h"
+#include "fqjson.h"
+#include "fqprof.h"
+#ifndef NOTHREADS
+#include "GThreads.h"
+#endif
+#include <time.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+bool fqLiveOn=false;
+FqLiveSlot* fqLiveSlots=NULL;
+int fqLiveNumSlots=0;
+
+static GStr statsFile;
+static GStr sockPath;
+static uint64 everyNs=0;
+static uint64 startNs=0;
+static uint64 nextNs=0; //time of the next periodic snapshot
+static uint64 rateNs=0; //reads/s measured since this time..
+static uint64 rateReads=0; //..and reads count
+static double curRate=0;
+static uint64 filesDone=0;
+static uint64 collapsedOut=0; //-C: reads written at the end of each file
+static FqLiveQueuesFunc* queuesFunc=NULL;
+static void* queuesData=NULL;
+#ifndef NOTHREADS
+static GFastMutex liveMutex; //for the queues callback and the snapshot state
+static GThread* liveThread=NULL;
+#endif
+#ifndef _WIN32
+static int sockFd=-1;
+static int wakeFds[2]={-1, -1}; //SIGUSR1 and stop requests to the live thread
+static volatile sig_atomic_t dumpRequest=0;
+#endif
+
+static void writeSnapshot(FILE* f, bool final) {
+	uint64 now=fqNanoTime();
+	uint64 c[FQL_NUM];
+	memset(c, 0, sizeof(c));
+	for (int s=0;s<fqLiveNumSlots;s++)
+		for (int i=0;i<FQL_NUM;i++) c[i]+=fqLiveSlots[s].get(i);
+	c[FQL_READS_OUT]+=__atomic_load_n(&collapsedOut, __ATOMIC_RELAXED);
+	double elapsed=(now-startNs)/1e9;
+	if (now-rateNs>=everyNs/2) { //current rate, over the last period at least
+		curRate=(double)(c[FQL_READS_IN]-rateReads)*1e9/(now-rateNs);
+		rateNs=now;
+		rateReads=c[FQL_READS_IN];
+	}
+	FqJson js(f);
+	js.beginObject();
+	js.addInt("time", (uint64)time(NULL));
+	js.addNum("elapsed_s", elapsed);
+	js.addBool("done", final);
+	js.addInt("files_done", __atomic_load_n(&filesDone, __ATOMIC_RELAXED));
+	js.addInt("reads_in", c[FQL_READS_IN]); //read pairs for paired input
+	js.addInt("reads_out", c[FQL_READS_OUT]);
+	js.addInt("bases_in", c[FQL_BASES_IN]);
+	js.addNum("reads_per_s", curRate);
+	js.addNum("avg_reads_per_s", elapsed>0 ? c[FQL_READS_IN]/elapsed : 0);
+	js.beginObject("trashed");
+	js.addInt("short", c[FQL_TRASH_S]);
+	js.addInt("poly_AT", c[FQL_TRASH_POLY]);
+	js.addInt("quality", c[FQL_TRASH_Q]);
+	js.addInt("N", c[FQL_TRASH_N]);
+	js.addInt("dust", c[FQL_TRASH_D]);
+	js.addInt("adapter", c[FQL_TRASH_V]);
+	js.addInt("other", c[FQL_TRASH_X]);
+	js.endObject();
+	js.beginObject("trimmed_reads");
+	js.addInt("5p", c[FQL_TRIM5]);
+	js.addInt("3p", c[FQL_TRIM3]);
+	js.endObject();
+	if (queuesFunc) {
+		int64 q[FQLQ_NUM];
+		queuesFunc(queuesData, q);
+		js.beginObject("queues");
+		js.addInt("free_batches", q[FQLQ_FREE]);
+		js.addInt("work_batches", q[FQLQ_WORK]);
+		js.addInt("tasks", q[FQLQ_TASKS]);
+		js.addInt("done_batches", q[FQLQ_DONE]);
+		js.endObject();
+	}
+	js.endObject();
+}
+
+//replace the stats file with a new snapshot; progress line on stderr if asked
+static void publish(bool final, bool progress) {
+#ifndef NOTHREADS
+	GLockGuard<GFastMutex> guard(liveMutex);
+#endif
+	if (!statsFile.is_empty()) {
+		GStr tmp(statsFile);
+		tmp.append(".tmp");
+		FILE* f=fopen(tmp.chars(), "w");
+		if (f!=NULL) {
+			writeSnapshot(f, final);
+			bool ok=(fclose(f)==0);
+			if (ok) rename(tmp.chars(), statsFile.chars());
+		}
+	}
+	if (progress) {
+		uint64 rin=0, rout=0;
+		for (int s=0;s<fqLiveNumSlots;s++) {
+			rin+=fqLiveSlots[s].get(FQL_READS_IN);
+			rout+=fqLiveSlots[s].get(FQL_READS_OUT);
+		}
+		rout+=__atomic_load_n(&collapsedOut, __ATOMIC_RELAXED);
+		double elapsed=(fqNanoTime()-startNs)/1e9;
+		GMessage("fqtrim progress: %llu reads in, %llu out, %llu files done, %.1f s (%.0f reads/s)\n",
+		    rin, rout, __atomic_load_n(&filesDone, __ATOMIC_RELAXED), elapsed,
+		    elapsed>0 ? rin/elapsed : 0.0);
+	}
+}
+
+#ifndef _WIN32
+static void sendSnapshot(int fd) {
+	char* buf=NULL;
+	size_t len=0;
+	FILE* f=open_memstream(&buf, &len);
+	if (f==NULL) return;
+	{
+#ifndef NOTHREADS
+	GLockGuard<GFastMutex> guard(liveMutex);
+#endif
+	writeSnapshot(f, false);
+	}
+	fclose(f);
+	int flags=0;
+#ifdef MSG_NOSIGNAL
+	flags=MSG_NOSIGNAL; //a client going away must not kill fqtrim
+#endif
+	for (size_t sent=0;sent<len;) {
+		ssize_t n=send(fd, buf+sent, len-sent, flags);
+		if (n<=0) break;
+		sent+=n;
+	}
+	free(buf);
+}
+
+static void acceptClients() {
+	if (sockFd<0) return;
+	int fd;
+	while ((fd=accept(sockFd, NULL, NULL))>=0) {
+		sendSnapshot(fd);
+		close(fd);
+	}
+}
+
+static void onSigUsr1(int) {
+	dumpRequest=1;
+	if (wakeFds[1]>=0) {
+		ssize_t r=write(wakeFds[1], "u", 1);
+		(void)r;
+	}
+}
+
+static bool openSocket(const char* path) {
+	struct sockaddr_un sa;
+	if (strlen(path)>=sizeof(sa.sun_path)) {
+		GMessage("Warning: --stats-sock path too long: %s\n", path);
+		return false;
+	}
+	sockFd=socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sockFd<0) return false;
+	memset(&sa, 0, sizeof(sa));
+	sa.sun_family=AF_UNIX;
+	strcpy(sa.sun_path, path);
+	struct stat st;
+	if (lstat(path, &st)==0 && S_ISSOCK(st.st_mode))
+		unlink(path); //left by a previous run (never remove anything else)
+	if (bind(sockFd, (struct sockaddr*)&sa, sizeof(sa))!=0 || listen(sockFd, 8)!=0) {
+		GMessage("Warning: cannot listen on socket %s (%s)\n", path, strerror(errno));
+		close(sockFd);
+		sockFd=-1;
+		return false;
+	}
+	fcntl(sockFd, F_SETFL, fcntl(sockFd, F_GETFL)|O_NONBLOCK);
+	return true;
+}
+
+#ifndef NOTHREADS
+static void liveLoop(void*) {
+	struct pollfd pfd[2];
+	pfd[0].fd=wakeFds[0];
+	pfd[0].events=POLLIN;
+	pfd[1].fd=sockFd;
+	pfd[1].events=POLLIN;
+	int nfds=(sockFd>=0) ? 2 : 1;
+	bool stop=false;
+	while (!stop) {
+		uint64 now=fqNanoTime();
+		int waitms=(nextNs>now) ? (int)((nextNs-now)/1000000)+1 : 0;
+		pfd[0].revents=0;
+		pfd[1].revents=0;
+		if (poll(pfd, nfds, waitms)>0) {
+			if (pfd[0].revents & POLLIN) {
+				char cmd[16];
+				ssize_t n=read(wakeFds[0], cmd, sizeof(cmd));
+				for (ssize_t i=0;i<n;i++)
+					if (cmd[i]=='q') stop=true;
+			}
+			if (nfds>1 && (pfd[1].revents & POLLIN)) acceptClients();
+		}
+		if (dumpRequest) {
+			dumpRequest=0;
+			publish(false, true);
+		}
+		now=fqNanoTime();
+		if (now>=nextNs) {
+			publish(false, false);
+			nextNs=now+everyNs;
+		}
+	}
+}
+#endif
+#endif //!_WIN32
+
+void fqLiveStart(const char* statsfile, const char* sockpath, int every, int nslots) {
+#ifdef _WIN32
+	GMessage("Warning: --stats-file/--stats-sock are not supported on this system\n");
+	return;
+#else
+	if (statsfile) statsFile=statsfile;
+	if (sockpath && !openSocket(sockpath)) sockpath=NULL;
+	if (sockpath) sockPath=sockpath;
+	if (statsFile.is_empty() && sockPath.is_empty()) return;
+	everyNs=(uint64)GMAX(1, every)*1000000000ULL;
+	fqLiveNumSlots=nslots;
+	fqLiveSlots=new FqLiveSlot[nslots];
+	startNs=fqNanoTime();
+	rateNs=startNs;
+	nextNs=startNs+everyNs;
+	fqLiveOn=true;
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler=onSigUsr1;
+	sa.sa_flags=SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+#ifndef NOTHREADS
+	if (pipe(wakeFds)!=0) GError("Error: pipe() failed\n");
+	fcntl(wakeFds[1], F_SETFL, fcntl(wakeFds[1], F_GETFL)|O_NONBLOCK);
+	sigaction(SIGUSR1, &sa, NULL);
+	liveThread=new GThread();
+	liveThread->kickStart(liveLoop, NULL);
+#else
+	sigaction(SIGUSR1, &sa, NULL);
+#endif
+	publish(false, false);
+#endif
+}
+
+void fqLiveStop() {
+	if (!fqLiveOn) return;
+#ifndef _WIN32
+	signal(SIGUSR1, SIG_IGN); //a late signal must not kill the process
+#ifndef NOTHREADS
+	ssize_t r=write(wakeFds[1], "q", 1);
+	(void)r;
+	liveThread->join();
+	delete liveThread;
+	liveThread=NULL;
+	close(wakeFds[0]);
+	close(wakeFds[1]);
+	wakeFds[0]=wakeFds[1]=-1;
+#endif
+	publish(true, false);
+	if (sockFd>=0) {
+		close(sockFd);
+		sockFd=-1;
+		unlink(sockPath.chars());
+	}
+#endif
+	fqLiveOn=false;
+	delete[] fqLiveSlots;
+	fqLiveSlots=NULL;
+	fqLiveNumSlots=0;
+}
+
+void fqLiveFileDone(uint64 collapsed) {
+	if (!fqLiveOn) return;
+	__atomic_add_fetch(&filesDone, 1, __ATOMIC_RELAXED);
+	if (collapsed) __atomic_add_fetch(&collapsedOut, collapsed, __ATOMIC_RELAXED);
+}
+
+void fqLiveSetQueues(FqLiveQueuesFunc* fn, void* data) {
+	if (!fqLiveOn) return;
+#ifndef NOTHREADS
+	GLockGuard<GFastMutex> guard(liveMutex);
+#endif
+	queuesFunc=fn;
+	queuesData=data;
+}
+
+void fqLiveTick() {
+#if defined(NOTHREADS) && !defined(_WIN32)
+	if (!fqLiveOn) return;
+	acceptClients();
+	if (dumpRequest) {
+		dumpRequest=0;
+		publish(false, true);
+	}
+	uint64 now=fqNanoTime();
+	if (now>=nextNs) {
+		publish(false, false);
+		nextNs=now+everyNs;
+	}
+#endif
+}
@@ -0,0 +1,83 @@
+#ifndef FQ_LIVE_H
+#define FQ_LIVE_H
+#include "GBase.h"
+#include "GStr.h"
+#include "fqkernels.h"
+
+// Live progress of a run (--stats-file, --stats-sock): the read counters and
+// the pipeline queue depths are published every --stats-every seconds, as a
+// JSON snapshot atomically replacing the stats file (written to <file>.tmp,
+// then renamed), and to every client connecting to the Unix-domain socket.
+// SIGUSR1 publishes a snapshot right away, also printing a progress line to
+// stderr. The publishing is done by a background thread (or between batches
+// in a NOTHREADS build), so the trimming threads only add their counts to
+// their own cache line aligned slot (fqLiveUpdate()), without any locking.
+
+#define FQLIVE_EVERY 10 //default seconds between snapshots
+
+enum {
+	FQL_READS_IN=0,
+	FQL_READS_OUT,
+	FQL_BASES_IN,
+	FQL_TRASH_S, //trashed reads, by cause
+	FQL_TRASH_POLY,
+	FQL_TRASH_Q,
+	FQL_TRASH_N,
+	FQL_TRASH_D,
+	FQL_TRASH_V,
+	FQL_TRASH_X,
+	FQL_TRIM5, //trimmed reads
+	FQL_TRIM3,
+	FQL_NUM
+};
+
+//counters of one thread, only ever updated by that thread
+struct FqLiveSlot {
+	uint64 v[FQL_NUM];
+	FqLiveSlot() { memset(v, 0, sizeof(v)); }
+	void add(int i, uint64 d) { __atomic_store_n(&v[i], v[i]+d, __ATOMIC_RELAXED); }
+	uint64 get(int i) { return __atomic_load_n(&v[i], __ATOMIC_RELAXED); }
+} __attribute__((aligned(64)));
+
+//queue depths, filled in by the pipeline when asked (fqLiveSetQueues())
+enum {
+	FQLQ_FREE=0, //batches free to be loaded
+	FQLQ_WORK, //loaded batches waiting for a worker
+	FQLQ_TASKS, //tasks queued or running
+	FQLQ_DONE, //trimmed batches waiting for the writer
+	FQLQ_NUM
+};
+typedef void FqLiveQueuesFunc(void* data, int64* depths);
+
+extern bool fqLiveOn;
+
+//start publishing, with a counters slot for each of nslots threads
+void fqLiveStart(const char* statsfile, const char* sockpath, int every, int nslots);
+void fqLiveStop(); //publish the final snapshot, remove the socket
+void fqLiveFileDone(uint64 collapsed); //an input file (pair) was finished; -C: reads written
+void fqLiveSetQueues(FqLiveQueuesFunc* fn, void* data); //NULL when the pipeline ends
+void fqLiveTick(); //NOTHREADS: publish if it's time, called between batches
+
+extern FqLiveSlot* fqLiveSlots;
+extern int fqLiveNumSlots;
+
+//add the counts of a thread since the last update (prev), then prev=cur
+static inline void fqLiveUpdate(int slot, STrimCounts& cur, STrimCounts& prev) {
+	if (slot>=fqLiveNumSlots) return;
+	FqLiveSlot& s=fqLiveSlots[slot];
+	s.add(FQL_READS_IN, cur.incounter-prev.incounter);
+	s.add(FQL_READS_OUT, cur.outcounter-prev.outcounter);
+	s.add(FQL_BASES_IN, cur.b_totalIn-prev.b_totalIn);
+	s.add(FQL_TRASH_S, cur.trash_s-prev.trash_s);
+	s.add(FQL_TRASH_POLY, cur.trash_poly-prev.trash_poly);
+	s.add(FQL_TRASH_Q, cur.trash_Q-prev.trash_Q);
+	s.add(FQL_TRASH_N, cur.trash_N-prev.trash_N);
+	s.add(FQL_TRASH_D, cur.trash_D-prev.trash_D);
+	s.add(FQL_TRASH_V, cur.trash_V-prev.trash_V);
+	s.add(FQL_TRASH_X, cur.trash_X-prev.trash_X);
+	s.add(FQL_TRIM5, cur.num_trim5-prev.num_trim5);
+	s.add(FQL_TRIM3, cur.num_trim3-prev.num_trim3);
+	prev=cur;
+}
+
+#endif
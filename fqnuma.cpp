@@ -0,0 +1,78 @@
+#include "fqnuma.h"
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0
+#define MPOL_PREFERRED 1
+#endif
+
+bool FqTopology::load() {
+	cpus.Clear();
+	nodes.Clear();
+	numNodes=0;
+	cpu_set_t saved;
+	CPU_ZERO(&saved);
+	if (sched_getaffinity(0, sizeof(saved), &saved)!=0) return false;
+	GVec<int> cpunode[FQNUMA_MAX_NODES];
+	for (int c=0;c<CPU_SETSIZE;c++) {
+		if (!CPU_ISSET(c, &saved)) continue;
+		unsigned int gc=0, gn=0;
+		if (!fqPinThread(c) || syscall(SYS_getcpu, &gc, &gn, NULL)!=0) {
+			sched_setaffinity(0, sizeof(saved), &saved);
+			return false;
+		}
+		if (gn>=FQNUMA_MAX_NODES) gn=0;
+		cpunode[gn].Add(c);
+		if ((int)gn>=numNodes) numNodes=gn+1;
+	}
+	sched_setaffinity(0, sizeof(saved), &saved);
+	for (int n=0;n<numNodes;n++)
+		for (int i=0;i<cpunode[n].Count();i++) {
+			cpus.Add(cpunode[n][i]);
+			nodes.Add(n);
+		}
+	return cpus.Count()>0;
+}
+
+bool fqPinThread(int cpu) {
+	cpu_set_t cs;
+	CPU_ZERO(&cs);
+	CPU_SET(cpu, &cs);
+	return (sched_setaffinity(0, sizeof(cs), &cs)==0);
+}
+
+bool fqPreferNode(int node) {
+	if (node<0)
+		return (syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0)==0);
+	unsigned long mask[FQNUMA_MAX_NODES/(8*sizeof(unsigned long))+1];
+	memset(mask, 0, sizeof(mask));
+	mask[node/(8*sizeof(unsigned long))]|=1UL<<(node%(8*sizeof(unsigned long)));
+	return (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask)*8)==0);
+}
+
+#else
+
+bool FqTopology::load() { return false; }
+bool fqPinThread(int) { return false; }
+bool fqPreferNode(int) { return false; }
+
+#endif
+
+GStr fqCpuList(GVec<int>& cpus) {
+	GStr s;
+	int i=0;
+	while (i<cpus.Count()) {
+		int j=i;
+		while (j+1<cpus.Count() && cpus[j+1]==cpus[j]+1) j++;
+		char buf[32];
+		if (j>i) sprintf(buf, "%d-%d", cpus[i], cpus[j]);
+		else sprintf(buf, "%d", cpus[i]);
+		if (!s.is_empty()) s.append(',');
+		s.append(buf);
+		i=j+1;
+	}
+	return s;
+}
@@ -0,0 +1,37 @@
+#ifndef FQ_NUMA_H
+#define FQ_NUMA_H
+#include "GBase.h"
+#include "GStr.h"
+#include "GVec.hh"
+
+// CPU pinning and NUMA placement of the -p worker threads (--pin), using
+// plain Linux system calls (no libnuma): the node of each CPU the process
+// may run on is found by briefly moving the calling thread there and asking
+// getcpu(); a pinned thread then sets its own memory policy (set_mempolicy)
+// so that the memory it allocates comes from its local node.
+// On other systems (or if the calls fail) load() returns false.
+
+#define FQNUMA_MAX_NODES 64
+
+class FqTopology {
+ protected:
+	GVec<int> cpus; //CPUs allowed for the process, grouped by node
+	GVec<int> nodes; //node of each CPU in cpus
+	int numNodes; //1 + the highest node number seen
+ public:
+	FqTopology():cpus(), nodes(), numNodes(0) { }
+	bool load();
+	int Count() { return cpus.Count(); }
+	int getNumNodes() { return numNodes; }
+	//placement of the i-th thread: consecutive threads fill a node first
+	int cpu(int i) { return cpus[i % cpus.Count()]; }
+	int node(int i) { return nodes[i % nodes.Count()]; }
+};
+
+bool fqPinThread(int cpu); //restrict the calling thread to one CPU
+//allocate the calling thread's memory on this node when possible (-1: default policy)
+bool fqPreferNode(int node);
+//compact CPU list like 0-11,24-35
+GStr fqCpuList(GVec<int>& cpus);
+
+#endif
@@ -0,0 +1,176 @@
+#ifndef FQ_PIPE_H
+#define FQ_PIPE_H
+#include "GBase.h"
+#include "fqtrace.h"
+#include <sched.h>
+#include <unistd.h>
+
+// Lock-free building blocks for the multi-threaded trimming pipeline (-p)
+
+#define FQ_CACHE_LINE 64
+
+// Bounded multi-producer/multi-consumer queue of pointers (D. Vyukov's
+// algorithm): each cell carries a sequence number telling whether it's ready
+// to be written or read for the current lap, so producers and consumers only
+// contend on their own position counter (kept on separate cache lines).
+template <class T> class FqQueue {
+ protected:
+	struct Cell {
+		uint64 seq;
+		T* data;
+	};
+	Cell* cells;
+	uint64 mask;
+	char pad0[FQ_CACHE_LINE];
+	uint64 enqPos;
+	char pad1[FQ_CACHE_LINE-sizeof(uint64)];
+	uint64 deqPos;
+	char pad2[FQ_CACHE_LINE-sizeof(uint64)];
+ public:
+	FqQueue(int minsize=16):cells(NULL), mask(0), enqPos(0), deqPos(0) {
+		uint64 size=16;
+		while (size<(uint64)minsize) size<<=1;
+		GMALLOC(cells, size*sizeof(Cell));
+		for (uint64 i=0;i<size;i++) {
+			cells[i].seq=i;
+			cells[i].data=NULL;
+		}
+		mask=size-1;
+	}
+	~FqQueue() { GFREE(cells); }
+	uint64 capacity() { return mask+1; }
+	//returns false if the queue is full
+	bool push(T* v) {
+		Cell* c=NULL;
+		uint64 pos=__atomic_load_n(&enqPos, __ATOMIC_RELAXED);
+		while (true) {
+			c=&cells[pos & mask];
+			uint64 seq=__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+			int64 dif=(int64)seq-(int64)pos;
+			if (dif==0) {
+				if (__atomic_compare_exchange_n(&enqPos, &pos, pos+1, true,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+			}
+			else if (dif<0) return false;
+			else pos=__atomic_load_n(&enqPos, __ATOMIC_RELAXED);
+		}
+		c->data=v;
+		__atomic_store_n(&c->seq, pos+1, __ATOMIC_RELEASE);
+		return true;
+	}
+	//returns false if the queue is empty
+	bool pop(T* & v) {
+		Cell* c=NULL;
+		uint64 pos=__atomic_load_n(&deqPos, __ATOMIC_RELAXED);
+		while (true) {
+			c=&cells[pos & mask];
+			uint64 seq=__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+			int64 dif=(int64)seq-(int64)(pos+1);
+			if (dif==0) {
+				if (__atomic_compare_exchange_n(&deqPos, &pos, pos+1, true,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+			}
+			else if (dif<0) return false;
+			else pos=__atomic_load_n(&deqPos, __ATOMIC_RELAXED);
+		}
+		v=c->data;
+		__atomic_store_n(&c->seq, pos+mask+1, __ATOMIC_RELEASE);
+		return true;
+	}
+	//approximate number of items in the queue
+	uint64 Count() {
+		uint64 d=__atomic_load_n(&deqPos, __ATOMIC_RELAXED);
+		uint64 e=__atomic_load_n(&enqPos, __ATOMIC_RELAXED);
+		return (e>d) ? e-d : 0;
+	}
+};
+
+// Work-stealing deque (Chase-Lev, with the C11 memory orderings of Le et al.):
+// the owner thread pushes and pops tasks at the bottom (LIFO), other threads
+// steal from the top. Fixed capacity: push() fails when it's full.
+template <class T> class FqDeque {
+ protected:
+	T** buf;
+	int64 mask;
+	char pad0[FQ_CACHE_LINE];
+	int64 top;
+	char pad1[FQ_CACHE_LINE-sizeof(int64)];
+	int64 bottom;
+	char pad2[FQ_CACHE_LINE-sizeof(int64)];
+ public:
+	FqDeque(int minsize=16):buf(NULL), mask(0), top(0), bottom(0) {
+		int64 size=16;
+		while (size<minsize) size<<=1;
+		GCALLOC(buf, size*sizeof(T*));
+		mask=size-1;
+	}
+	~FqDeque() { GFREE(buf); }
+	bool push(T* v) { //owner only
+		int64 b=__atomic_load_n(&bottom, __ATOMIC_RELAXED);
+		int64 t=__atomic_load_n(&top, __ATOMIC_ACQUIRE);
+		if (b-t>mask) return false;
+		__atomic_store_n(&buf[b & mask], v, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		__atomic_store_n(&bottom, b+1, __ATOMIC_RELAXED);
+		return true;
+	}
+	bool pop(T* & v) { //owner only
+		int64 b=__atomic_load_n(&bottom, __ATOMIC_RELAXED)-1;
+		__atomic_store_n(&bottom, b, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		int64 t=__atomic_load_n(&top, __ATOMIC_RELAXED);
+		if (t>b) { //empty
+			__atomic_store_n(&bottom, b+1, __ATOMIC_RELAXED);
+			return false;
+		}
+		v=__atomic_load_n(&buf[b & mask], __ATOMIC_RELAXED);
+		if (t==b) { //last item, race against the thieves
+			bool won=__atomic_compare_exchange_n(&top, &t, t+1, false,
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+			__atomic_store_n(&bottom, b+1, __ATOMIC_RELAXED);
+			return won;
+		}
+		return true;
+	}
+	bool steal(T* & v) { //any thread
+		int64 t=__atomic_load_n(&top, __ATOMIC_ACQUIRE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		int64 b=__atomic_load_n(&bottom, __ATOMIC_ACQUIRE);
+		if (t>=b) return false;
+		v=__atomic_load_n(&buf[t & mask], __ATOMIC_RELAXED);
+		return __atomic_compare_exchange_n(&top, &t, t+1, false,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	}
+};
+
+// Waiting on a queue: spin briefly, then yield the CPU, then sleep, so idle
+// threads do not burn a core when a stage is blocked for long; the time
+// from the first pause() to reset() is profiled (and traced) as the given wait stage
+class FqBackoff {
+	int n;
+	int stage;
+	uint64 t0;
+	uint64 tt0; //for the trace
+ public:
+	FqBackoff(int st):n(0), stage(st), t0(0), tt0(0) { }
+	~FqBackoff() { reset(); }
+	void reset() {
+		if (n>0) {
+			FQ_PROF_ADD(stage, t0);
+			FQ_TRACE_ADD(fqProfStageName(stage), tt0, -1);
+		}
+		n=0;
+	}
+	void pause() {
+		if (n==0) {
+			t0=FQ_PROF_MARK();
+			tt0=FQ_TRACE_MARK();
+		}
+		++n;
+		if (n<32) return;
+		if (n<256) sched_yield();
+		else usleep(50);
+	}
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "fqprof.h"
+#include "GVec.hh"
+#ifndef NOTHREADS
+#include "GThreads.h"
+#endif
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+__thread FqProfile* fqProf=NULL;
+
+static bool profEnabled=false;
+static bool perfEnabled=false; //--perf, and the counters could be opened
+static bool profReport=false; //print the report at the end
+static uint64 profStartNs=0;
+static uint64 profStartCycles=0;
+static GPVec<FqProfile> profiles(true); //all the threads' profiles, freed at exit
+#ifndef NOTHREADS
+static GFastMutex profMutex;
+#endif
+
+static const char* stageNames[FQP_NUM_STAGES]={
+	"input (read+parse)",
+	"UMI extraction",
+	"trimming (other)",
+	"qtrim",
+	"ntrim",
+	"trim_poly*",
+	"trim_adapter*",
+	"dust",
+	"dupstat sketch",
+	"QC metrics (--qc)",
+	"output (write)",
+	"collapse (-C)",
+	"wait: free batch",
+	"wait: work (idle)",
+	"wait: next batch",
+	"wait: output lock"
+};
+
+static const char* stageKeys[FQP_NUM_STAGES]={ "input", "umi", "trim_other", "qtrim",
+	"ntrim", "trim_poly", "trim_adapter", "dust", "dupstat", "qc", "output", "collapse",
+	"wait_free", "wait_work", "wait_next", "wait_lock" };
+
+//--------------- hardware counters (--perf) ----------------
+
+FqPerfGroup::FqPerfGroup():numOpen(0) {
+	for (int i=0;i<FQHW_NUM;i++) {
+		fds[i]=-1;
+		pos[i]=-1;
+	}
+}
+
+FqPerfGroup::~FqPerfGroup() {
+	for (int i=FQHW_NUM-1;i>=0;i--)
+		if (fds[i]>=0) close(fds[i]);
+}
+
+#ifdef __linux__
+static const uint64 hwEvents[FQHW_NUM]={ PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+//the cycles counter leads the group; other events the CPU lacks are skipped
+bool FqPerfGroup::open(GStr* err) {
+	for (int i=0;i<FQHW_NUM;i++) {
+		struct perf_event_attr pa;
+		memset(&pa, 0, sizeof(pa));
+		pa.type=PERF_TYPE_HARDWARE;
+		pa.size=sizeof(pa);
+		pa.config=hwEvents[i];
+		pa.read_format=PERF_FORMAT_GROUP;
+		pa.disabled=(i==0);
+		pa.exclude_kernel=1;
+		pa.exclude_hv=1;
+		int fd=syscall(SYS_perf_event_open, &pa, 0, -1, (i==0) ? -1 : fds[0], 0);
+		if (fd<0) {
+			if (i>0) continue;
+			if (err) {
+				*err=strerror(errno);
+				if (errno==EACCES || errno==EPERM)
+					err->append(", see /proc/sys/kernel/perf_event_paranoid");
+			}
+			return false;
+		}
+		fds[i]=fd;
+		pos[i]=numOpen++;
+	}
+	ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+}
+
+void FqPerfGroup::read(uint64* v) {
+	uint64 buf[FQHW_NUM+1]; //number of events, then their values
+	if (::read(fds[0], buf, sizeof(buf))<(ssize_t)((numOpen+1)*sizeof(uint64))) {
+		memset(v, 0, FQHW_NUM*sizeof(uint64));
+		return;
+	}
+	for (int i=0;i<FQHW_NUM;i++)
+		v[i]=(pos[i]<0) ? 0 : buf[pos[i]+1];
+}
+#else
+bool FqPerfGroup::open(GStr* err) {
+	if (err) *err="not supported on this system";
+	return false;
+}
+void FqPerfGroup::read(uint64* v) { memset(v, 0, FQHW_NUM*sizeof(uint64)); }
+#endif
+
+//-------------------------------------------------------------
+
+void fqProfInit(bool hwcounters, bool report) {
+	if (report) profReport=true;
+	if (profEnabled) return;
+	profEnabled=true;
+	profStartNs=fqNanoTime();
+	profStartCycles=fqCycles();
+	if (hwcounters) {
+		FqPerfGroup* pg=new FqPerfGroup();
+		GStr err;
+		if (pg->open(&err)) perfEnabled=true;
+		else GMessage("Warning: hardware performance counters not available (%s),"
+		    " only times will be reported\n", err.chars());
+		delete pg;
+	}
+	fqProfThread();
+}
+
+bool fqProfEnabled() { return profEnabled; }
+
+const char* fqProfStageName(int stage) { return stageNames[stage]; }
+
+const char* fqProfStageKey(int stage) { return stageKeys[stage]; }
+
+//cycle counter rate, measured since fqProfInit()
+static double cyclesPerSec() {
+	uint64 wallns=fqNanoTime()-profStartNs;
+	double cps=(wallns>0) ? (double)(fqCycles()-profStartCycles)/wallns*1e9 : 1e9;
+	return (cps>0) ? cps : 1e9;
+}
+
+bool fqProfTimes(double* secs) {
+	if (!profEnabled) return false;
+	double cps=cyclesPerSec();
+	for (int s=0;s<FQP_NUM_STAGES;s++) {
+		uint64 c=0;
+		for (int i=0;i<profiles.Count();i++) c+=profiles[i]->cycles[s];
+		secs[s]=c/cps;
+	}
+	return true;
+}
+
+void fqProfThread() {
+	if (!profEnabled || fqProf!=NULL) return;
+	FqProfile* p=new FqProfile();
+	if (perfEnabled) {
+		p->perf=new FqPerfGroup();
+		if (!p->perf->open()) { //this thread won't have counters
+			delete p->perf;
+			p->perf=NULL;
+		}
+	}
+	{
+#ifndef NOTHREADS
+	GLockGuard<GFastMutex> guard(profMutex);
+#endif
+	profiles.Add(p);
+	}
+	fqProf=p;
+}
+
+void fqProfReport(uint64 nreads, uint64 nbases) {
+	if (!profEnabled || !profReport) return;
+	uint64 wallns=fqNanoTime()-profStartNs;
+	double cps=cyclesPerSec();
+	uint64 tot[FQP_NUM_STAGES];
+	memset(tot, 0, sizeof(tot));
+	uint64 sum=0;
+	for (int i=0;i<profiles.Count();i++)
+		for (int s=0;s<FQP_NUM_STAGES;s++) tot[s]+=profiles[i]->cycles[s];
+	for (int s=0;s<FQP_NUM_STAGES;s++) sum+=tot[s];
+	GMessage("\n------------------- Profile (--profile): -------------------\n");
+	GMessage(" wall time: %.3f s, %d threads, %.3f thread-seconds timed\n",
+	    wallns/1e9, profiles.Count(), sum/cps);
+	GMessage("               stage     time(s)   share    Mreads/s   Mbases/s\n");
+	for (int s=0;s<FQP_NUM_STAGES;s++) {
+		if (tot[s]==0) continue;
+		double t=tot[s]/cps;
+		GMessage("%20s %11.3f %6.1f%%", stageNames[s], t, sum ? 100.0*tot[s]/sum : 0.0);
+		if (s<FQP_WAIT_FREE && t>0)
+			GMessage(" %11.3f %10.2f\n", nreads/t/1e6, nbases/t/1e6);
+		else GMessage("           -          -\n");
+	}
+	if (!perfEnabled) return;
+	//hardware counters of the processing stages (waits are not counted)
+	int64 hw[FQP_NUM_STAGES][FQHW_NUM];
+	memset(hw, 0, sizeof(hw));
+	bool has[FQHW_NUM];
+	for (int e=0;e<FQHW_NUM;e++) has[e]=false;
+	int nthreads=0;
+	for (int i=0;i<profiles.Count();i++) {
+		FqProfile& p=*profiles[i];
+		if (p.perf==NULL) continue;
+		nthreads++;
+		for (int e=0;e<FQHW_NUM;e++)
+			if (p.perf->has(e)) has[e]=true;
+		for (int s=0;s<FQP_WAIT_FREE;s++)
+			for (int e=0;e<FQHW_NUM;e++) hw[s][e]+=p.hw[s][e];
+	}
+	GMessage(" hardware counters (user mode, %d threads):\n", nthreads);
+	GMessage("               stage      Minstr    IPC  instr/read  LLC-MPKI  br-MPKI\n");
+	for (int s=0;s<FQP_WAIT_FREE;s++) {
+		int64* h=hw[s];
+		if (tot[s]==0 || h[FQHW_INSTR]<=0) continue;
+		double ki=h[FQHW_INSTR]/1000.0;
+		GMessage("%20s %11.1f", stageNames[s], h[FQHW_INSTR]/1e6);
+		if (has[FQHW_CYCLES] && h[FQHW_CYCLES]>0)
+			GMessage(" %6.2f", (double)h[FQHW_INSTR]/h[FQHW_CYCLES]);
+		else GMessage("      -");
+		GMessage(" %11.0f", nreads ? (double)h[FQHW_INSTR]/nreads : 0.0);
+		if (has[FQHW_CMISS]) GMessage(" %9.3f", h[FQHW_CMISS]/ki);
+		else GMessage("         -");
+		if (has[FQHW_BMISS]) GMessage(" %8.3f\n", h[FQHW_BMISS]/ki);
+		else GMessage("        -\n");
+	}
+}
@@ -0,0 +1,165 @@
+#ifndef FQ_PROF_H
+#define FQ_PROF_H
+#include "GBase.h"
+#include "GStr.h"
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Per-stage time accounting (--profile)
+//
+// Each thread taking part gets its own FqProfile (fqProfThread()), reachable
+// through a thread local pointer, so the counters are never shared. A stage
+// is timed with the cycle counter (rdtsc, or cntvct on ARM) by a FQ_PROF()
+// scope, or between FQ_PROF_MARK() and FQ_PROF_ADD() for waits; time spent
+// in a nested stage is taken out of the enclosing one, so all stages add up
+// to the instrumented time. With --profile off, a scope costs one test of
+// the thread local pointer; building with NOPROFILE (make noprofile) removes
+// the instrumentation altogether.
+// With --perf, each thread also opens a group of hardware counters (Linux
+// perf_event_open: cycles, instructions, cache and branch misses, user mode
+// only) that is read at the same stage boundaries, for per-stage IPC and
+// miss rates; reading the group is a system call, so timings are inflated
+// in that mode. If the counters cannot be opened (not permitted, no PMU in
+// a VM..) only the times are reported.
+
+//monotonic clock, in nanoseconds
+static inline uint64 fqNanoTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+static inline uint64 fqCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64 v;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+	return v;
+#else
+	return fqNanoTime();
+#endif
+}
+
+enum {
+	FQP_INPUT=0, //reading and parsing the input (including decompression waits)
+	FQP_UMI,
+	FQP_TRIM, //read processing not covered by the stages below
+	FQP_QTRIM,
+	FQP_NTRIM,
+	FQP_POLY,
+	FQP_ADAPTER,
+	FQP_DUST,
+	FQP_SKETCH,
+	FQP_QC,
+	FQP_OUTPUT,
+	FQP_COLLAPSE,
+	FQP_WAIT_FREE, //reader waiting for a free batch
+	FQP_WAIT_WORK, //idle worker
+	FQP_WAIT_DONE, //writer waiting for the next trimmed batch
+	FQP_WAIT_LOCK, //waiting for the collapsed output lock
+	FQP_NUM_STAGES
+};
+
+enum { //hardware counters (--perf)
+	FQHW_CYCLES=0,
+	FQHW_INSTR,
+	FQHW_CMISS, //last level cache misses
+	FQHW_BMISS, //mispredicted branches
+	FQHW_NUM
+};
+
+//group of hardware counters of the calling thread
+class FqPerfGroup {
+	int fds[FQHW_NUM]; //-1 for events not available
+	int pos[FQHW_NUM]; //position of each event in the group read
+	int numOpen;
+ public:
+	FqPerfGroup();
+	~FqPerfGroup();
+	bool open(GStr* err=NULL);
+	bool has(int ev) { return fds[ev]>=0; }
+	void read(uint64* v); //current counts (FQHW_NUM values)
+};
+
+struct FqProfile {
+	uint64 cycles[FQP_NUM_STAGES];
+	uint64 calls[FQP_NUM_STAGES];
+	int64 hw[FQP_NUM_STAGES][FQHW_NUM];
+	FqPerfGroup* perf; //hardware counters, if --perf
+	int cur; //stage being timed, -1 if none
+	FqProfile():perf(NULL), cur(-1) {
+		memset(cycles, 0, sizeof(cycles));
+		memset(calls, 0, sizeof(calls));
+		memset(hw, 0, sizeof(hw));
+	}
+	~FqProfile() { delete perf; }
+	void add(int stage, uint64 c, uint64* dhw=NULL) {
+		cycles[stage]+=c;
+		calls[stage]++;
+		if (cur>=0) cycles[cur]-=c; //will be added back to cur with its own time
+		if (dhw==NULL) return;
+		for (int i=0;i<FQHW_NUM;i++) {
+			hw[stage][i]+=dhw[i];
+			if (cur>=0) hw[cur][i]-=dhw[i];
+		}
+	}
+};
+
+extern __thread FqProfile* fqProf;
+
+//--profile (or --perf, with hwcounters) was given, called from main() before any thread;
+//without report, the times are only collected for fqProfTimes() (--json-stats)
+void fqProfInit(bool hwcounters=false, bool report=true);
+bool fqProfEnabled();
+void fqProfThread(); //the calling thread collects a profile (if enabled)
+const char* fqProfStageName(int stage);
+const char* fqProfStageKey(int stage); //short identifier of a stage
+//thread-seconds spent in each stage so far, by all threads (false if not enabled)
+bool fqProfTimes(double* secs);
+//print the table of all thread profiles, for that many reads and bases
+void fqProfReport(uint64 nreads, uint64 nbases);
+
+class FqProfScope {
+	int stage;
+	int parent;
+	uint64 t0;
+	uint64 hw0[FQHW_NUM];
+ public:
+	FqProfScope(int st):stage(st), parent(-1), t0(0) {
+		if (fqProf==NULL) return;
+		parent=fqProf->cur;
+		fqProf->cur=stage;
+		if (fqProf->perf) fqProf->perf->read(hw0);
+		t0=fqCycles();
+	}
+	~FqProfScope() {
+		if (fqProf==NULL) return;
+		uint64 c=fqCycles()-t0;
+		fqProf->cur=parent;
+		if (fqProf->perf==NULL) {
+			fqProf->add(stage, c);
+			return;
+		}
+		uint64 hw[FQHW_NUM];
+		fqProf->perf->read(hw);
+		for (int i=0;i<FQHW_NUM;i++) hw[i]-=hw0[i];
+		fqProf->add(stage, c, hw);
+	}
+};
+
+#ifndef NOPROFILE
+#define FQ_PROF_CAT_(a, b) a##b
+#define FQ_PROF_CAT(a, b) FQ_PROF_CAT_(a, b)
+#define FQ_PROF(stage) FqProfScope FQ_PROF_CAT(fqprof_scope_, __LINE__)(stage)
+#define FQ_PROF_MARK() (fqProf ? fqCycles() : 0)
+#define FQ_PROF_ADD(stage, t0) if (fqProf) fqProf->add(stage, fqCycles()-(t0))
+#else
+#define FQ_PROF(stage)
+#define FQ_PROF_MARK() 0
+#define FQ_PROF_ADD(stage, t0) ((void)(t0))
+#endif
+
+#endif
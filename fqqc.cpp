@@ -0,0 +1,168 @@
+#include "fqqc.h"
+
+static const char* stageNames[FQQC_NUM_STAGES]={ "raw", "trimmed" };
+
+FqQcStats::FqQcStats():cap(0), maxLen(0), pending(0), q32(NULL), qsum(NULL),
+		lens(NULL), hasQv(false), numReads(0), numBases(0) {
+	for (int b=0;b<4;b++) {
+		b32[b]=NULL;
+		bsum[b]=NULL;
+	}
+}
+
+FqQcStats::~FqQcStats() {
+	GFREE(q32);
+	GFREE(qsum);
+	for (int b=0;b<4;b++) {
+		GFREE(b32[b]);
+		GFREE(bsum[b]);
+	}
+	GFREE(lens);
+}
+
+void FqQcStats::Clear() {
+	if (cap>0) {
+		memset(q32, 0, cap*sizeof(uint32));
+		memset(qsum, 0, cap*sizeof(uint64));
+		for (int b=0;b<4;b++) {
+			memset(b32[b], 0, cap*sizeof(uint32));
+			memset(bsum[b], 0, cap*sizeof(uint64));
+		}
+		memset(lens, 0, (cap+1)*sizeof(uint64));
+	}
+	maxLen=0;
+	pending=0;
+	hasQv=false;
+	numReads=0;
+	numBases=0;
+}
+
+//the per-position loops, vectorized when built with -O3 (see the Makefile)
+static void addBases(const byte* __restrict s, uint32* __restrict a, uint32* __restrict c,
+		uint32* __restrict g, uint32* __restrict t, int len) {
+	for (int i=0;i<len;i++) {
+		byte u=s[i] & 0xDF; //upper case
+		a[i]+=(u=='A');
+		c[i]+=(u=='C');
+		g[i]+=(u=='G');
+		t[i]+=(u=='T');
+	}
+}
+
+static void addQuals(const byte* __restrict q, uint32* __restrict qs, int len) {
+	for (int i=0;i<len;i++) qs[i]+=q[i];
+}
+
+//make room for reads of length len
+void FqQcStats::grow(int len) {
+	int newcap=(len/64+1)*64;
+	GREALLOC(q32, newcap*sizeof(uint32));
+	GREALLOC(qsum, newcap*sizeof(uint64));
+	memset(q32+cap, 0, (newcap-cap)*sizeof(uint32));
+	memset(qsum+cap, 0, (newcap-cap)*sizeof(uint64));
+	for (int b=0;b<4;b++) {
+		GREALLOC(b32[b], newcap*sizeof(uint32));
+		GREALLOC(bsum[b], newcap*sizeof(uint64));
+		memset(b32[b]+cap, 0, (newcap-cap)*sizeof(uint32));
+		memset(bsum[b]+cap, 0, (newcap-cap)*sizeof(uint64));
+	}
+	GREALLOC(lens, (newcap+1)*sizeof(uint64));
+	memset(lens+cap+(cap>0), 0, (newcap+1-cap-(cap>0))*sizeof(uint64));
+	cap=newcap;
+}
+
+void FqQcStats::flush() {
+	for (int i=0;i<maxLen;i++) {
+		qsum[i]+=q32[i];
+		q32[i]=0;
+	}
+	for (int b=0;b<4;b++) {
+		uint64* bs=bsum[b];
+		uint32* bp=b32[b];
+		for (int i=0;i<maxLen;i++) {
+			bs[i]+=bp[i];
+			bp[i]=0;
+		}
+	}
+	pending=0;
+}
+
+void FqQcStats::add(const char* seq, const char* qv, int len) {
+	if (len>=cap) grow(len);
+	if (len>maxLen) maxLen=len;
+	numReads++;
+	numBases+=len;
+	lens[len]++;
+	addBases((const byte*)seq, b32[0], b32[1], b32[2], b32[3], len);
+	if (qv!=NULL) {
+		hasQv=true;
+		addQuals((const byte*)qv, q32, len);
+	}
+	if (++pending==FQQC_FLUSH) flush();
+}
+
+void FqQcStats::merge(FqQcStats& s) {
+	if (s.numReads==0) return;
+	s.flush();
+	flush();
+	if (s.maxLen>=cap) grow(s.maxLen);
+	if (s.maxLen>maxLen) maxLen=s.maxLen;
+	for (int i=0;i<s.maxLen;i++) qsum[i]+=s.qsum[i];
+	for (int b=0;b<4;b++)
+		for (int i=0;i<s.maxLen;i++) bsum[b][i]+=s.bsum[b][i];
+	for (int i=0;i<=s.maxLen;i++) lens[i]+=s.lens[i];
+	numReads+=s.numReads;
+	numBases+=s.numBases;
+	hasQv|=s.hasQv;
+}
+
+void FqQcStats::write(FILE* f, const char* stage, int mate, int qvoffset) {
+	if (numReads==0) return;
+	flush();
+	uint64 tq=0, tb[4]={0, 0, 0, 0};
+	for (int i=0;i<maxLen;i++) {
+		tq+=qsum[i];
+		for (int b=0;b<4;b++) tb[b]+=bsum[b][i];
+	}
+	uint64 tn=numBases-tb[0]-tb[1]-tb[2]-tb[3];
+	double nb=numBases ? (double)numBases : 1.0;
+	fprintf(f, "SUM\t%s\t%d\t%llu\t%llu\t%.2f\t", stage, mate, numReads, numBases,
+	    (double)numBases/numReads);
+	if (hasQv) fprintf(f, "%.2f", tq/nb-qvoffset);
+	else fprintf(f, "-");
+	fprintf(f, "\t%.2f\t%.3f\n", 100.0*(tb[1]+tb[2])/nb, 100.0*tn/nb);
+	uint64 cov=numReads-lens[0]; //reads covering position i
+	for (int i=0;i<maxLen;i++) {
+		if (cov==0) break;
+		uint64 n=cov-bsum[0][i]-bsum[1][i]-bsum[2][i]-bsum[3][i];
+		double dc=(double)cov;
+		fprintf(f, "POS\t%s\t%d\t%d\t%llu\t", stage, mate, i+1, cov);
+		if (hasQv) fprintf(f, "%.2f", qsum[i]/dc-qvoffset);
+		else fprintf(f, "-");
+		fprintf(f, "\t%.2f\t%.2f\t%.2f\t%.2f\t%.3f\n", 100.0*bsum[0][i]/dc, 100.0*bsum[1][i]/dc,
+		    100.0*bsum[2][i]/dc, 100.0*bsum[3][i]/dc, 100.0*n/dc);
+		cov-=lens[i+1];
+	}
+	for (int l=0;l<=maxLen;l++)
+		if (lens[l]) fprintf(f, "LEN\t%s\t%d\t%d\t%llu\n", stage, mate, l, lens[l]);
+}
+
+void FqQc::Clear() {
+	for (int s=0;s<FQQC_NUM_STAGES;s++)
+		for (int m=0;m<2;m++) stats[s][m].Clear();
+}
+
+void FqQc::merge(FqQc& qc) {
+	for (int s=0;s<FQQC_NUM_STAGES;s++)
+		for (int m=0;m<2;m++) stats[s][m].merge(qc.stats[s][m]);
+}
+
+void FqQc::write(FILE* f, const char* fname, bool paired, int qvoffset) {
+	fprintf(f, "#file\t%s\n", fname);
+	fprintf(f, "#SUM\tstage\tmate\treads\tbases\tmean_len\tmean_q\tGC%%\tN%%\n");
+	fprintf(f, "#POS\tstage\tmate\tpos\treads\tmean_q\tA%%\tC%%\tG%%\tT%%\tN%%\n");
+	fprintf(f, "#LEN\tstage\tmate\tlength\treads\n");
+	for (int s=0;s<FQQC_NUM_STAGES;s++)
+		for (int m=0;m<(paired ? 2 : 1);m++)
+			stats[s][m].write(f, stageNames[s], m+1, qvoffset);
+}
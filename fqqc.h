@@ -0,0 +1,61 @@
+#ifndef FQ_QC_H
+#define FQ_QC_H
+#include "GBase.h"
+#include "GStr.h"
+
+// In-flight QC metrics (--qc): per-position mean quality and base composition,
+// read length distribution and N rate, for the reads as they are loaded and for
+// the reads written after trimming, separately for each mate. With -C the
+// trimmed stage has every read kept by trimming, before the duplicates are
+// collapsed (so its read count is not the number of records written).
+//
+// Each trimming thread accumulates into its own FqQc, merged when the file is
+// finished. The per-position accumulation is a branch-free loop over the read
+// into 32 bit counters (so the compiler can vectorize it), which are flushed
+// into the 64 bit totals every FQQC_FLUSH reads, before they could overflow.
+// The number of reads covering a position comes from the length distribution,
+// so the non-ACGT (N) count of a position is what's left after A,C,G,T.
+
+#define FQQC_FLUSH 0x800000 //255*FQQC_FLUSH fits in 32 bits
+
+enum {
+	FQQC_RAW=0, //reads as loaded
+	FQQC_TRIMMED, //reads kept after trimming (before -C collapsing)
+	FQQC_NUM_STAGES
+};
+
+class FqQcStats { //one stage, one mate
+ protected:
+	int cap; //positions allocated
+	int maxLen;
+	uint32 pending; //reads added to the 32 bit counters
+	uint32* q32; //sum of the quality characters at each position
+	uint32* b32[4]; //A,C,G,T counts at each position
+	uint64* qsum;
+	uint64* bsum[4];
+	uint64* lens; //reads by length, 0..cap
+	bool hasQv; //quality values were added
+	void grow(int len);
+	void flush();
+ public:
+	uint64 numReads;
+	uint64 numBases;
+	FqQcStats();
+	~FqQcStats();
+	void Clear();
+	//add a read (qv can be NULL, for FASTA)
+	void add(const char* seq, const char* qv, int len);
+	void merge(FqQcStats& s);
+	//write the summary, per-position and length lines of this stage/mate
+	void write(FILE* f, const char* stage, int mate, int qvoffset);
+};
+
+struct FqQc { //the stats of one thread, or merged
+	FqQcStats stats[FQQC_NUM_STAGES][2];
+	void Clear();
+	void merge(FqQc& qc);
+	//write the report of an input file; single reads if !paired
+	void write(FILE* f, const char* fname, bool paired, int qvoffset);
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "GArgs.h"
+#include "GStr.h"
+#include "fqrep.h"
+
+// Converts a binary trim report (fqtrim -r <file> --rbin) to the text report
+
+#define USAGE "fqrep: convert a binary fqtrim trim report (--rbin) to text. Usage:\n\
+fqrep [-o <report.txt>] <report.bin>\n\
+\n\
+Options:\n\
+-o output file (default: stdout)\n\
+The input can be compressed (.gz or .bz2), '-' reads it from stdin.\n\
+"
+
+int main(int argc, char* argv[]) {
+	GArgs args(argc, argv, "ho:");
+	int e;
+	if ((e=args.isError())>0 || args.getOpt('h')!=NULL) {
+		GMessage("%s\n", USAGE);
+		if (e>0) GMessage("Invalid argument: %s\n", argv[e]);
+		exit(1);
+	}
+	if (args.startNonOpt()!=1) {
+		GMessage("%s\n", USAGE);
+		exit(1);
+	}
+	GStr fname(args.nextNonOpt());
+	FILE* fin=stdin;
+	bool piped=false;
+	if (fname!="-") {
+		GStr zcmd;
+		if (fname.endsWith(".gz") || fname.endsWith(".gzip")) zcmd="gzip -cd ";
+		else if (fname.endsWith(".bz2") || fname.endsWith(".bzip2")) zcmd="bzip2 -cd ";
+		if (zcmd.is_empty()) fin=fopen(fname.chars(), "rb");
+		else {
+			if (fileExists(fname.chars())<2) GError("Error: cannot find file %s\n", fname.chars());
+			zcmd.append(fname);
+			fin=popen(zcmd.chars(), "r");
+			piped=true;
+		}
+		if (fin==NULL) GError("Error opening file %s\n", fname.chars());
+	}
+	char magic[FQREP_MAGIC_LEN];
+	if (fread(magic, 1, FQREP_MAGIC_LEN, fin)!=FQREP_MAGIC_LEN ||
+	    memcmp(magic, FQREP_MAGIC, FQREP_MAGIC_LEN)!=0)
+		GError("Error: %s is not a binary fqtrim report (--rbin)\n", fname.chars());
+	FILE* fout=stdout;
+	GStr s=args.getOpt('o');
+	if (!s.is_empty() && s!="-") {
+		fout=fopen(s.chars(), "w");
+		if (fout==NULL) GError("Error creating file %s\n", s.chars());
+	}
+	FqRepRecord r;
+	FqRepBuf name;
+	FqRepBuf out;
+	uint64 n=0;
+	int res;
+	while ((res=fqRepReadBin(fin, r, name))>0) {
+		fqRepAddText(out, r);
+		n++;
+		if (out.len>=(1<<16)) out.write(fout);
+	}
+	out.write(fout);
+	if (piped) pclose(fin);
+	else if (fin!=stdin) fclose(fin);
+	if (fout!=stdout) fclose(fout);
+	if (res<0) GError("Error: truncated record in %s (after %llu records)\n", fname.chars(), n);
+	return 0;
+}
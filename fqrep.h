@@ -0,0 +1,175 @@
+#ifndef FQ_REP_H
+#define FQ_REP_H
+#include "GBase.h"
+
+// Trim report records (-r), shared by fqtrim and the fqrep converter.
+//
+// The text report has a line for each trimmed or trashed read:
+//   <read_name>\t<tend><tcode><tlen>[,...]\t<trash_code>
+// (paired reads get a /1 or /2 suffix), and "<read_name>_x<count>\tD" for
+// the duplicates trashed by dust after collapsing (-C -D).
+// With --rbin the same records are written in a compact binary form: the
+// FQREP_MAGIC header, then for each record a flags byte (FQREP_*), the name
+// length (varint) and the name, the trash code, the number of trimming
+// operations, and for each of them tend, tcode and tlen (varint).
+// Records are formatted into an FqRepBuf by the trimming threads, and the
+// buffers are written in the batch order by the output thread.
+
+#define FQREP_MAGIC "FQTREP1\n"
+#define FQREP_MAGIC_LEN 8
+#define FQREP_MAX_OPS 255
+
+enum {
+	FQREP_MATE1=1, //paired reads: the name gets a /1 suffix (if missing)
+	FQREP_MATE2=2,
+	FQREP_DUP=4 //collapsed duplicates trashed by dust (<name>_x<count>)
+};
+
+struct FqRepOp {
+	byte tend; //5 or 3
+	char tcode;
+	int tlen;
+};
+
+struct FqRepRecord {
+	const char* name;
+	int nameLen;
+	byte flags;
+	char trashcode;
+	int numOps;
+	FqRepOp ops[FQREP_MAX_OPS];
+	FqRepRecord():name(NULL), nameLen(0), flags(0), trashcode(0), numOps(0) { }
+};
+
+class FqRepBuf { //growing buffer of report records
+ public:
+	char* data;
+	int len;
+	int cap;
+	FqRepBuf():data(NULL), len(0), cap(0) { }
+	~FqRepBuf() { GFREE(data); }
+	void clear() { len=0; }
+	void reserve(int n) {
+		if (len+n<=cap) return;
+		cap=GMAX(len+n, cap*2);
+		if (cap<256) cap=256;
+		GREALLOC(data, cap);
+	}
+	void add(char c) {
+		reserve(1);
+		data[len++]=c;
+	}
+	void add(const char* s, int n) {
+		reserve(n);
+		memcpy(data+len, s, n);
+		len+=n;
+	}
+	void addInt(int v) { //as decimal text
+		char s[16];
+		int n=0;
+		unsigned int u=(v<0) ? -(unsigned int)v : v;
+		do { s[n++]='0'+u%10; u/=10; } while (u);
+		reserve(n+1);
+		if (v<0) data[len++]='-';
+		while (n>0) data[len++]=s[--n];
+	}
+	void addVarint(uint64 v) {
+		reserve(10);
+		while (v>=0x80) {
+			data[len++]=(char)(v|0x80);
+			v>>=7;
+		}
+		data[len++]=(char)v;
+	}
+	void write(FILE* f) {
+		if (len>0) fwrite(data, 1, len, f);
+		len=0;
+	}
+};
+
+//a record as a line of the text report
+static inline void fqRepAddText(FqRepBuf& b, FqRepRecord& r) {
+	b.add(r.name, r.nameLen);
+	if (r.flags & (FQREP_MATE1|FQREP_MATE2)) {
+		const char* sfx=(r.flags & FQREP_MATE2) ? "/2" : "/1";
+		if (r.nameLen<2 || memcmp(r.name+r.nameLen-2, sfx, 2)!=0) b.add(sfx, 2);
+	}
+	b.add('\t');
+	if (r.flags & FQREP_DUP) {
+		b.add(r.trashcode);
+		b.add('\n');
+		return;
+	}
+	if (r.numOps==0) {
+		b.add(r.trashcode);
+		b.add('\t');
+		b.add(r.trashcode);
+		b.add('\n');
+		return;
+	}
+	for (int i=0;i<r.numOps;i++) {
+		if (i) b.add(',');
+		b.addInt(r.ops[i].tend);
+		b.add(r.ops[i].tcode);
+		b.addInt(r.ops[i].tlen);
+	}
+	b.add('\t');
+	if (r.trashcode>' ') b.add(r.trashcode);
+	b.add('\n');
+}
+
+static inline void fqRepAddBin(FqRepBuf& b, FqRepRecord& r) {
+	b.add((char)r.flags);
+	b.addVarint(r.nameLen);
+	b.add(r.name, r.nameLen);
+	b.add(r.trashcode);
+	b.add((char)r.numOps);
+	for (int i=0;i<r.numOps;i++) {
+		b.add((char)r.ops[i].tend);
+		b.add(r.ops[i].tcode);
+		b.addVarint((uint16)r.ops[i].tlen);
+	}
+}
+
+static inline bool fqRepGetVarint(FILE* f, uint64& v) {
+	v=0;
+	for (int shift=0;shift<64;shift+=7) {
+		int c=getc(f);
+		if (c==EOF) return false;
+		v|=(uint64)(c & 0x7F)<<shift;
+		if ((c & 0x80)==0) return true;
+	}
+	return false;
+}
+
+//read the next binary record, its name is kept in nbuf;
+//returns 1, 0 at the end of the file or -1 for a truncated record
+static inline int fqRepReadBin(FILE* f, FqRepRecord& r, FqRepBuf& nbuf) {
+	int c=getc(f);
+	if (c==EOF) return 0;
+	r.flags=(byte)c;
+	uint64 nlen=0;
+	if (!fqRepGetVarint(f, nlen) || nlen>0x7FFFFFFF) return -1;
+	nbuf.clear();
+	nbuf.reserve((int)nlen+1);
+	if (fread(nbuf.data, 1, nlen, f)!=nlen) return -1;
+	nbuf.len=(int)nlen;
+	r.name=nbuf.data;
+	r.nameLen=nbuf.len;
+	if ((c=getc(f))==EOF) return -1;
+	r.trashcode=(char)c;
+	if ((c=getc(f))==EOF) return -1;
+	r.numOps=c;
+	for (int i=0;i<r.numOps;i++) {
+		int e=getc(f);
+		int tc=getc(f);
+		uint64 tl=0;
+		if (e==EOF || tc==EOF || !fqRepGetVarint(f, tl)) return -1;
+		r.ops[i].tend=(byte)e;
+		r.ops[i].tcode=(char)tc;
+		r.ops[i].tlen=(short)(uint16)tl;
+	}
+	return 1;
+}
+
+#endif
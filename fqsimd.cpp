@@ -0,0 +1,359 @@
+#include "fqsimd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+ #define FQSIMD_X86 1
+ #include <immintrin.h>
+ #define FQ_SSE42 __attribute__((target("sse4.2,popcnt")))
+ #define FQ_AVX2 __attribute__((target("avx2,popcnt")))
+ #define FQ_AVX512 __attribute__((target("avx512f,avx512bw,popcnt")))
+#endif
+
+static const char* levelNames[FQSIMD_NUM_LEVELS]={ "scalar", "sse4.2", "avx2", "avx512" };
+
+//--------------- scalar versions (also used for the tails) ----------------
+
+static inline bool isACGTchr(char c) {
+	char l=c|0x20;
+	return (l=='a' || l=='c' || l=='g' || l=='t');
+}
+
+static inline int countNonACGT_tail(const char* s, int i, int len) {
+	int n=0;
+	for (;i<len;i++)
+		if (!isACGTchr(s[i])) n++;
+	return n;
+}
+
+static int countNonACGT_scalar(const char* s, int len) {
+	return countNonACGT_tail(s, 0, len);
+}
+
+static inline void qualRange_tail(const char* q, int i, int len, int& qmin, int& qmax) {
+	for (;i<len;i++) {
+		if (qmin>q[i]) qmin=q[i];
+		if (qmax<q[i]) qmax=q[i];
+	}
+}
+
+static void qualRange_scalar(const char* q, int len, int& qmin, int& qmax) {
+	qmin=256;
+	qmax=0;
+	qualRange_tail(q, 0, len, qmin, qmax);
+}
+
+static inline bool polyAt(const char* s, int i, uint32 seed) { //seed: c,c,c,c
+	uint32 v;
+	memcpy(&v, s+i, 4);
+	return v==seed;
+}
+
+static int polySeed3_scalar(const char* s, int len, char c) {
+	uint32 seed=0x01010101u*(byte)c;
+	int lmin=GMAX(len-16, 0);
+	for (int i=len-4;i>lmin;i--)
+		if (polyAt(s, i, seed)) return i;
+	return -1;
+}
+
+static int polySeed5_scalar(const char* s, int len, char c) {
+	uint32 seed=0x01010101u*(byte)c;
+	int lmax=GMIN(12, len-4);
+	for (int i=0;i<=lmax;i++)
+		if (polyAt(s, i, seed)) return i;
+	return -1;
+}
+
+static inline void addQual_tail(char* q, int i, int len, int v) {
+	for (;i<len;i++) q[i]+=v;
+}
+
+static void addQual_scalar(char* q, int len, int v) {
+	addQual_tail(q, 0, len, v);
+}
+
+#ifdef FQSIMD_X86
+//--------------- SSE4.2 ----------------
+
+FQ_SSE42 static inline __m128i nonACGT16(__m128i v) { //0xFF where not A,C,G,T
+	__m128i l=_mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i m=_mm_or_si128(
+	    _mm_or_si128(_mm_cmpeq_epi8(l, _mm_set1_epi8('a')), _mm_cmpeq_epi8(l, _mm_set1_epi8('c'))),
+	    _mm_or_si128(_mm_cmpeq_epi8(l, _mm_set1_epi8('g')), _mm_cmpeq_epi8(l, _mm_set1_epi8('t'))));
+	return _mm_xor_si128(m, _mm_set1_epi8(-1));
+}
+
+FQ_SSE42 static int countNonACGT_sse42(const char* s, int len) {
+	int n=0, i=0;
+	for (;i+16<=len;i+=16) {
+		__m128i v=_mm_loadu_si128((const __m128i*)(s+i));
+		n+=_mm_popcnt_u32(_mm_movemask_epi8(nonACGT16(v)));
+	}
+	return n+countNonACGT_tail(s, i, len);
+}
+
+FQ_SSE42 static inline void qualRange16(__m128i vmin, __m128i vmax, int& qmin, int& qmax) {
+	vmin=_mm_min_epi8(vmin, _mm_srli_si128(vmin, 8));
+	vmin=_mm_min_epi8(vmin, _mm_srli_si128(vmin, 4));
+	vmin=_mm_min_epi8(vmin, _mm_srli_si128(vmin, 2));
+	vmin=_mm_min_epi8(vmin, _mm_srli_si128(vmin, 1));
+	vmax=_mm_max_epi8(vmax, _mm_srli_si128(vmax, 8));
+	vmax=_mm_max_epi8(vmax, _mm_srli_si128(vmax, 4));
+	vmax=_mm_max_epi8(vmax, _mm_srli_si128(vmax, 2));
+	vmax=_mm_max_epi8(vmax, _mm_srli_si128(vmax, 1));
+	int vn=(signed char)_mm_extract_epi8(vmin, 0);
+	int vx=(signed char)_mm_extract_epi8(vmax, 0);
+	if (qmin>vn) qmin=vn;
+	if (qmax<vx) qmax=vx;
+}
+
+FQ_SSE42 static void qualRange_sse42(const char* q, int len, int& qmin, int& qmax) {
+	qmin=256;
+	qmax=0;
+	int i=0;
+	if (len>=16) {
+		__m128i vmin=_mm_loadu_si128((const __m128i*)q);
+		__m128i vmax=vmin;
+		for (i=16;i+16<=len;i+=16) {
+			__m128i v=_mm_loadu_si128((const __m128i*)(q+i));
+			vmin=_mm_min_epi8(vmin, v);
+			vmax=_mm_max_epi8(vmax, v);
+		}
+		qualRange16(vmin, vmax, qmin, qmax);
+	}
+	qualRange_tail(q, i, len, qmin, qmax);
+}
+
+//bit i set if s[i..i+3] is a run of c, for the 16 bytes at s
+FQ_SSE42 static inline unsigned int polyRuns16(const char* s, char c) {
+	__m128i v=_mm_loadu_si128((const __m128i*)s);
+	unsigned int m=_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+	return m & (m>>1) & (m>>2) & (m>>3);
+}
+
+FQ_SSE42 static int polySeed3_sse42(const char* s, int len, char c) {
+	if (len<16) return polySeed3_scalar(s, len, c);
+	unsigned int r=polyRuns16(s+len-16, c) & ~1u; //start must be > len-16
+	if (r==0) return -1;
+	return len-16+(31-__builtin_clz(r));
+}
+
+FQ_SSE42 static int polySeed5_sse42(const char* s, int len, char c) {
+	if (len<16) return polySeed5_scalar(s, len, c);
+	unsigned int r=polyRuns16(s, c); //only bits 0..12 can be set
+	if (r==0) return -1;
+	return __builtin_ctz(r);
+}
+
+FQ_SSE42 static void addQual_sse42(char* q, int len, int v) {
+	__m128i vv=_mm_set1_epi8((char)v);
+	int i=0;
+	for (;i+16<=len;i+=16) {
+		__m128i x=_mm_loadu_si128((const __m128i*)(q+i));
+		_mm_storeu_si128((__m128i*)(q+i), _mm_add_epi8(x, vv));
+	}
+	addQual_tail(q, i, len, v);
+}
+
+//--------------- AVX2 ----------------
+
+FQ_AVX2 static int countNonACGT_avx2(const char* s, int len) {
+	const __m256i lc=_mm256_set1_epi8(0x20);
+	int n=0, i=0;
+	for (;i+32<=len;i+=32) {
+		__m256i l=_mm256_or_si256(_mm256_loadu_si256((const __m256i*)(s+i)), lc);
+		__m256i m=_mm256_or_si256(
+		    _mm256_or_si256(_mm256_cmpeq_epi8(l, _mm256_set1_epi8('a')), _mm256_cmpeq_epi8(l, _mm256_set1_epi8('c'))),
+		    _mm256_or_si256(_mm256_cmpeq_epi8(l, _mm256_set1_epi8('g')), _mm256_cmpeq_epi8(l, _mm256_set1_epi8('t'))));
+		n+=32-_mm_popcnt_u32((unsigned int)_mm256_movemask_epi8(m));
+	}
+	if (i+16<=len) {
+		n+=_mm_popcnt_u32(_mm_movemask_epi8(nonACGT16(_mm_loadu_si128((const __m128i*)(s+i)))));
+		i+=16;
+	}
+	return n+countNonACGT_tail(s, i, len);
+}
+
+FQ_AVX2 static void qualRange_avx2(const char* q, int len, int& qmin, int& qmax) {
+	qmin=256;
+	qmax=0;
+	int i=0;
+	if (len>=32) {
+		__m256i vmin=_mm256_loadu_si256((const __m256i*)q);
+		__m256i vmax=vmin;
+		for (i=32;i+32<=len;i+=32) {
+			__m256i v=_mm256_loadu_si256((const __m256i*)(q+i));
+			vmin=_mm256_min_epi8(vmin, v);
+			vmax=_mm256_max_epi8(vmax, v);
+		}
+		qualRange16(_mm_min_epi8(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1)),
+		    _mm_max_epi8(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1)), qmin, qmax);
+	}
+	if (i+16<=len) {
+		__m128i v=_mm_loadu_si128((const __m128i*)(q+i));
+		qualRange16(v, v, qmin, qmax);
+		i+=16;
+	}
+	qualRange_tail(q, i, len, qmin, qmax);
+}
+
+FQ_AVX2 static void addQual_avx2(char* q, int len, int v) {
+	__m256i vv=_mm256_set1_epi8((char)v);
+	int i=0;
+	for (;i+32<=len;i+=32) {
+		__m256i x=_mm256_loadu_si256((const __m256i*)(q+i));
+		_mm256_storeu_si256((__m256i*)(q+i), _mm256_add_epi8(x, vv));
+	}
+	addQual_tail(q, i, len, v);
+}
+
+//--------------- AVX-512 (BW): masked loads and stores, no scalar tails ----------------
+
+FQ_AVX512 static inline __mmask64 tailMask(int n) { //the first n (<64) lanes
+	return (n>=64) ? ~(__mmask64)0 : (((__mmask64)1<<n)-1);
+}
+
+FQ_AVX512 static int countNonACGT_avx512(const char* s, int len) {
+	const __m512i lc=_mm512_set1_epi8(0x20);
+	int n=0;
+	for (int i=0;i<len;i+=64) {
+		__mmask64 k=tailMask(len-i);
+		__m512i l=_mm512_or_si512(_mm512_maskz_loadu_epi8(k, s+i), lc);
+		__mmask64 m=_mm512_cmpeq_epi8_mask(l, _mm512_set1_epi8('a')) |
+		    _mm512_cmpeq_epi8_mask(l, _mm512_set1_epi8('c')) |
+		    _mm512_cmpeq_epi8_mask(l, _mm512_set1_epi8('g')) |
+		    _mm512_cmpeq_epi8_mask(l, _mm512_set1_epi8('t'));
+		n+=__builtin_popcountll(k & ~m);
+	}
+	return n;
+}
+
+FQ_AVX512 static void qualRange_avx512(const char* q, int len, int& qmin, int& qmax) {
+	qmin=256;
+	qmax=0;
+	if (len<=0) return;
+	//lanes past the end are loaded as q[0]
+	const __m512i fill=_mm512_set1_epi8(q[0]);
+	__m512i vmin=fill, vmax=fill;
+	for (int i=0;i<len;i+=64) {
+		__m512i v=_mm512_mask_loadu_epi8(fill, tailMask(len-i), q+i);
+		vmin=_mm512_min_epi8(vmin, v);
+		vmax=_mm512_max_epi8(vmax, v);
+	}
+	//(through memory: GCC 12 warns about the 512-bit extracts)
+	char bmin[64], bmax[64];
+	_mm512_storeu_si512(bmin, vmin);
+	_mm512_storeu_si512(bmax, vmax);
+	__m128i n=_mm_loadu_si128((const __m128i*)bmin);
+	__m128i x=_mm_loadu_si128((const __m128i*)bmax);
+	for (int j=16;j<64;j+=16) {
+		n=_mm_min_epi8(n, _mm_loadu_si128((const __m128i*)(bmin+j)));
+		x=_mm_max_epi8(x, _mm_loadu_si128((const __m128i*)(bmax+j)));
+	}
+	qualRange16(n, x, qmin, qmax);
+}
+
+FQ_AVX512 static void addQual_avx512(char* q, int len, int v) {
+	__m512i vv=_mm512_set1_epi8((char)v);
+	for (int i=0;i<len;i+=64) {
+		__mmask64 k=tailMask(len-i);
+		__m512i x=_mm512_maskz_loadu_epi8(k, q+i);
+		_mm512_mask_storeu_epi8(q+i, k, _mm512_add_epi8(x, vv));
+	}
+}
+#endif //FQSIMD_X86
+
+FqSimd fqsimd={ FQSIMD_SCALAR, countNonACGT_scalar, qualRange_scalar,
+		polySeed3_scalar, polySeed5_scalar, addQual_scalar };
+
+bool fqSimdSupported(int level) {
+	if (level==FQSIMD_SCALAR) return true;
+#ifdef FQSIMD_X86
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("popcnt"))
+		return false;
+	switch (level) {
+		case FQSIMD_SSE42: return true;
+		case FQSIMD_AVX2: return __builtin_cpu_supports("avx2");
+		case FQSIMD_AVX512: return __builtin_cpu_supports("avx2") &&
+		    __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+	}
+#endif
+	return false;
+}
+
+const char* fqSimdLevelName(int level) {
+	if (level<0 || level>=FQSIMD_NUM_LEVELS) return "?";
+	return levelNames[level];
+}
+
+void fqSimdGet(int level, FqSimd& k) {
+	k.level=FQSIMD_SCALAR;
+	k.countNonACGT=countNonACGT_scalar;
+	k.qualRange=qualRange_scalar;
+	k.polySeed3=polySeed3_scalar;
+	k.polySeed5=polySeed5_scalar;
+	k.addQual=addQual_scalar;
+	if (!fqSimdSupported(level)) return;
+#ifdef FQSIMD_X86
+	k.level=level;
+	//the 16 byte windows of the poly seeds do not gain from wider vectors
+	switch (level) {
+		case FQSIMD_SSE42:
+			k.countNonACGT=countNonACGT_sse42;
+			k.qualRange=qualRange_sse42;
+			k.polySeed3=polySeed3_sse42;
+			k.polySeed5=polySeed5_sse42;
+			k.addQual=addQual_sse42;
+			break;
+		case FQSIMD_AVX2:
+			k.countNonACGT=countNonACGT_avx2;
+			k.qualRange=qualRange_avx2;
+			k.polySeed3=polySeed3_sse42;
+			k.polySeed5=polySeed5_sse42;
+			k.addQual=addQual_avx2;
+			break;
+		case FQSIMD_AVX512:
+			k.countNonACGT=countNonACGT_avx512;
+			k.qualRange=qualRange_avx512;
+			k.polySeed3=polySeed3_sse42;
+			k.polySeed5=polySeed5_sse42;
+			k.addQual=addQual_avx512;
+			break;
+	}
+#endif
+}
+
+bool fqSimdInit(const char* level) {
+	int l=FQSIMD_NUM_LEVELS-1;
+	if (level!=NULL && level[0]!=0) {
+		for (l=0;l<FQSIMD_NUM_LEVELS;l++)
+			if (strcmp(level, levelNames[l])==0) break;
+		if (l==FQSIMD_NUM_LEVELS || !fqSimdSupported(l)) return false;
+	}
+	else while (l>0 && !fqSimdSupported(l)) l--;
+	fqSimdGet(l, fqsimd);
+	return true;
+}
+
+GStr fqSimdCpuFeatures() {
+	GStr s;
+#ifdef FQSIMD_X86
+	static const char* features[]={ "sse4.2", "popcnt", "avx2", "avx512f", "avx512bw", NULL };
+	__builtin_cpu_init();
+	for (int i=0;features[i]!=NULL;i++) {
+		bool has=false;
+		switch (i) { //__builtin_cpu_supports() needs a string literal
+			case 0: has=__builtin_cpu_supports("sse4.2"); break;
+			case 1: has=__builtin_cpu_supports("popcnt"); break;
+			case 2: has=__builtin_cpu_supports("avx2"); break;
+			case 3: has=__builtin_cpu_supports("avx512f"); break;
+			case 4: has=__builtin_cpu_supports("avx512bw"); break;
+		}
+		if (!has) continue;
+		if (!s.is_empty()) s.append(' ');
+		s.append(features[i]);
+	}
+#endif
+	if (s.is_empty()) s="none";
+	return s;
+}
@@ -0,0 +1,40 @@
+#ifndef FQ_SIMD_H
+#define FQ_SIMD_H
+#include "GBase.h"
+#include "GStr.h"
+
+// Runtime CPU dispatch of the byte scanning kernels: each has a scalar
+// version and, on x86, SSE4.2, AVX2 and AVX-512 (BW) versions compiled with
+// function target attributes, so a generic build (no -march) still uses the
+// vector instructions of the CPU it runs on. fqSimdInit() picks the variants
+// once at startup; until then (and on other CPUs) the scalar ones are used.
+// All variants give the same results as the scalar loops they replace.
+
+enum { FQSIMD_SCALAR=0, FQSIMD_SSE42, FQSIMD_AVX2, FQSIMD_AVX512, FQSIMD_NUM_LEVELS };
+
+struct FqSimd {
+	int level;
+	//base scan: number of bytes in s that are not A,C,G,T (either case)
+	int (*countNonACGT)(const char* s, int len);
+	//quality scan: lowest and highest quality char
+	void (*qualRange)(const char* q, int len, int& qmin, int& qmax);
+	//poly-A/T seed: start of the last 4 x c run in s[len-16+1..len-1],
+	//or of the first one in s[0..15] (-1 if none)
+	int (*polySeed3)(const char* s, int len, char c);
+	int (*polySeed5)(const char* s, int len, char c);
+	//output: add v to each quality char (Phred type conversion)
+	void (*addQual)(char* q, int len, int v);
+};
+
+extern FqSimd fqsimd; //the variants in use
+
+//select the best variants the CPU supports, or those of the level named
+//(scalar, sse4.2, avx2, avx512); false if that level is not available here
+bool fqSimdInit(const char* level=NULL);
+bool fqSimdSupported(int level);
+const char* fqSimdLevelName(int level);
+//the variants of a level (the scalar ones if not supported)
+void fqSimdGet(int level, FqSimd& k);
+GStr fqSimdCpuFeatures(); //vector extensions of this CPU, e.g. "sse4.2 avx2"
+
+#endif
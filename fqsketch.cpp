@@ -0,0 +1,184 @@
+#include "fqsketch.h"
+#include <math.h>
+
+#define FQSK_HLL_SIZE (1<<FQSK_HLL_BITS)
+#define FQSK_CM_WIDTH (1<<FQSK_CM_BITS)
+
+static inline uint64 skMix(uint64 h) {
+	h^=h>>33;
+	h*=0xff51afd7ed558ccdULL;
+	h^=h>>33;
+	h*=0xc4ceb9fe1a85ec53ULL;
+	h^=h>>33;
+	return h;
+}
+
+uint64 fqSeqHash(const char* seq, int len, uint64 seed) {
+	uint64 h=skMix(seed^((len+1)*0x9E3779B97F4A7C15ULL));
+	int i=0;
+	uint64 w;
+	for (;i+8<=len;i+=8) {
+		memcpy(&w, seq+i, 8);
+		h=skMix(h^w)+i;
+	}
+	if (i<len) {
+		w=0;
+		memcpy(&w, seq+i, len-i);
+		h=skMix(h^w);
+	}
+	return h;
+}
+
+FqDupSketch::FqDupSketch():hll(NULL), cms(NULL), numReads(0), heapCount(0) {
+	GCALLOC(hll, FQSK_HLL_SIZE);
+	GCALLOC(cms, FQSK_CM_DEPTH*FQSK_CM_WIDTH*sizeof(uint32));
+}
+
+FqDupSketch::~FqDupSketch() {
+	GFREE(hll);
+	GFREE(cms);
+}
+
+void FqDupSketch::Clear() {
+	memset(hll, 0, FQSK_HLL_SIZE);
+	memset(cms, 0, FQSK_CM_DEPTH*FQSK_CM_WIDTH*sizeof(uint32));
+	numReads=0;
+	for (int i=0;i<heapCount;i++) heap[i].seq="";
+	heapCount=0;
+}
+
+void FqDupSketch::hllAdd(uint64 h) {
+	uint32 idx=(uint32)(h>>(64-FQSK_HLL_BITS));
+	//rank of the first 1 bit in the remaining bits (capped)
+	uint64 w=(h<<FQSK_HLL_BITS) | (1ULL<<(FQSK_HLL_BITS-1));
+	byte rank=(byte)(__builtin_clzll(w)+1);
+	if (rank>hll[idx]) hll[idx]=rank;
+}
+
+//row r uses the bucket h1+r*h2 (double hashing)
+#define FQSK_CM_BUCKET(h1, h2, r) ((r)*FQSK_CM_WIDTH+(((h1)+(r)*(h2)) & (FQSK_CM_WIDTH-1)))
+
+uint32 FqDupSketch::cmEstimate(uint64 h) {
+	uint64 h2=skMix(h)|1;
+	uint32 est=cms[FQSK_CM_BUCKET(h, h2, 0)];
+	for (int r=1;r<FQSK_CM_DEPTH;r++) {
+		uint32 c=cms[FQSK_CM_BUCKET(h, h2, r)];
+		if (c<est) est=c;
+	}
+	return est;
+}
+
+uint32 FqDupSketch::cmAdd(uint64 h) {
+	uint64 h2=skMix(h)|1;
+	uint32* c[FQSK_CM_DEPTH];
+	uint32 est=0xFFFFFFFF;
+	for (int r=0;r<FQSK_CM_DEPTH;r++) {
+		c[r]=cms+FQSK_CM_BUCKET(h, h2, r);
+		if (*c[r]<est) est=*c[r];
+	}
+	est++;
+	//conservative update: only raise the counters below the new estimate
+	for (int r=0;r<FQSK_CM_DEPTH;r++)
+		if (*c[r]<est) *c[r]=est;
+	return est;
+}
+
+void FqDupSketch::siftUp(int i) {
+	while (i>0) {
+		int p=(i-1)>>1;
+		if (heap[p].count<=heap[i].count) break;
+		Gswap(heap[p], heap[i]);
+		i=p;
+	}
+}
+
+void FqDupSketch::siftDown(int i) {
+	while (true) {
+		int m=i;
+		int l=2*i+1;
+		if (l<heapCount && heap[l].count<heap[m].count) m=l;
+		if (l+1<heapCount && heap[l+1].count<heap[m].count) m=l+1;
+		if (m==i) break;
+		Gswap(heap[m], heap[i]);
+		i=m;
+	}
+}
+
+int FqDupSketch::findItem(uint64 h) {
+	for (int i=0;i<heapCount;i++)
+		if (heap[i].h==h) return i;
+	return -1;
+}
+
+void FqDupSketch::offer(uint64 h, uint32 est, const char* s1, const char* s2) {
+	if (heapCount==FQSK_HEAP && est<=heap[0].count) return;
+	int i=findItem(h);
+	if (i>=0) { //already a candidate, counts only grow
+		heap[i].count=est;
+		siftDown(i);
+		return;
+	}
+	if (heapCount<FQSK_HEAP) i=heapCount++;
+	else i=0; //replace the smallest candidate
+	heap[i].h=h;
+	heap[i].count=est;
+	heap[i].seq=s1;
+	if (s2!=NULL) {
+		heap[i].seq.append(',');
+		heap[i].seq.append(s2);
+	}
+	if (i==0) siftDown(0);
+	else siftUp(i);
+}
+
+void FqDupSketch::add(const char* s1, int l1, const char* s2, int l2) {
+	uint64 h=fqSeqHash(s1, l1);
+	if (s2!=NULL) h=fqSeqHash(s2, l2, h);
+	numReads++;
+	hllAdd(h);
+	offer(h, cmAdd(h), s1, s2);
+}
+
+void FqDupSketch::merge(FqDupSketch& s) {
+	numReads+=s.numReads;
+	for (int i=0;i<FQSK_HLL_SIZE;i++)
+		if (s.hll[i]>hll[i]) hll[i]=s.hll[i];
+	for (int i=0;i<FQSK_CM_DEPTH*FQSK_CM_WIDTH;i++)
+		cms[i]+=s.cms[i];
+	//re-estimate all the candidates with the merged counters
+	for (int i=0;i<heapCount;i++)
+		heap[i].count=cmEstimate(heap[i].h);
+	for (int i=(heapCount>>1)-1;i>=0;i--)
+		siftDown(i);
+	for (int i=0;i<s.heapCount;i++) {
+		FqSkItem& it=s.heap[i];
+		offer(it.h, cmEstimate(it.h), it.seq.chars(), NULL);
+	}
+}
+
+double FqDupSketch::distinct() {
+	double m=FQSK_HLL_SIZE;
+	double sum=0;
+	int zeros=0;
+	for (int i=0;i<FQSK_HLL_SIZE;i++) {
+		sum+=ldexp(1.0, -hll[i]);
+		if (hll[i]==0) zeros++;
+	}
+	double e=(0.7213/(1.0+1.079/m))*m*m/sum;
+	if (e<=2.5*m && zeros>0) //small range correction
+		e=m*log(m/zeros);
+	if (e>numReads) e=numReads;
+	return e;
+}
+
+uint32 FqDupSketch::noiseLevel() {
+	return (uint32)ceil(M_E*numReads/FQSK_CM_WIDTH);
+}
+
+int FqDupSketch::sortTop() {
+	for (int i=1;i<heapCount;i++) { //insertion sort, by decreasing count
+		for (int j=i;j>0 && heap[j].count>heap[j-1].count;j--)
+			Gswap(heap[j], heap[j-1]);
+	}
+	return GMIN(heapCount, FQSK_TOP);
+}
@@ -0,0 +1,64 @@
+#ifndef FQ_SKETCH_H
+#define FQ_SKETCH_H
+#include "GBase.h"
+#include "GStr.h"
+
+// Constant memory estimation of read duplication levels (--dupstat)
+//
+// Every read (pair) sequence is hashed once (64 bit) and the hash is fed to:
+//  - a HyperLogLog sketch (2^FQSK_HLL_BITS one byte registers), estimating
+//    the number of distinct sequences
+//  - a count-min sketch (FQSK_CM_DEPTH rows of 2^FQSK_CM_BITS counters, with
+//    conservative update) estimating the count of any given sequence
+//  - a min-heap of the FQSK_HEAP sequences with the highest count-min
+//    estimates seen so far (heavy hitters)
+// Each trimming thread fills its own sketch; they are merged at the end
+// (registers max'ed, counters added, heavy hitter candidates re-estimated).
+
+#define FQSK_HLL_BITS 14
+#define FQSK_CM_DEPTH 4
+#define FQSK_CM_BITS 16
+#define FQSK_HEAP 32 //heavy hitter candidates kept
+#define FQSK_TOP 10 //over-represented sequences reported
+
+uint64 fqSeqHash(const char* seq, int len, uint64 seed=0);
+
+struct FqSkItem {
+	uint64 h; //sequence hash
+	uint32 count; //count-min estimate
+	GStr seq; //the sequence (mates separated by ',')
+	FqSkItem():h(0), count(0), seq() { }
+};
+
+class FqDupSketch {
+ protected:
+	byte* hll;
+	uint32* cms;
+	uint64 numReads;
+	FqSkItem heap[FQSK_HEAP]; //min-heap on count
+	int heapCount;
+	void siftDown(int i);
+	void siftUp(int i);
+	int findItem(uint64 h);
+	uint32 cmEstimate(uint64 h);
+	uint32 cmAdd(uint64 h); //conservative update, returns the new estimate
+	void hllAdd(uint64 h);
+	void offer(uint64 h, uint32 est, const char* s1, const char* s2);
+ public:
+	FqDupSketch();
+	~FqDupSketch();
+	void Clear();
+	//add a read, or a read pair if s2 is not NULL (0-terminated sequences)
+	void add(const char* s1, int l1, const char* s2=NULL, int l2=0);
+	void merge(FqDupSketch& s);
+	uint64 Count() { return numReads; }
+	double distinct(); //estimated number of distinct sequences
+	//expected count-min over-estimation (e*N/width), counts below this are noise
+	uint32 noiseLevel();
+	//sort the heavy hitters by decreasing count (breaks the heap!)
+	//and return how many there are (at most FQSK_TOP)
+	int sortTop();
+	FqSkItem& topItem(int i) { return heap[i]; }
+};
+
+#endif
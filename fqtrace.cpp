@@ -0,0 +1,72 @@
+#include "fqtrace.h"
+#include "GStr.h"
+#include "GVec.hh"
+#ifndef NOTHREADS
+#include "GThreads.h"
+#endif
+
+__thread FqTraceBuf* fqTrace=NULL;
+
+static GStr traceFile;
+static uint64 traceStartNs=0;
+static GPVec<FqTraceBuf> traceBufs(true);
+#ifndef NOTHREADS
+static GFastMutex traceMutex;
+#endif
+
+FqTraceBuf::FqTraceBuf(int id, const char* tname, int idx):events(NULL), count(0), tid(id) {
+	GMALLOC(events, FQTRACE_EVENTS*sizeof(FqTraceEvent));
+	if (idx>=0) snprintf(name, sizeof(name), "%s %d", tname, idx);
+	else snprintf(name, sizeof(name), "%s", tname);
+}
+
+void fqTraceInit(const char* fname) {
+	traceFile=fname;
+	traceStartNs=fqNanoTime();
+}
+
+void fqTraceThread(const char* tname, int idx) {
+	if (traceFile.is_empty() || fqTrace!=NULL) return;
+#ifndef NOTHREADS
+	GLockGuard<GFastMutex> guard(traceMutex);
+#endif
+	fqTrace=new FqTraceBuf(traceBufs.Count()+1, tname, idx);
+	traceBufs.Add(fqTrace);
+}
+
+void fqTraceWrite() {
+	if (traceFile.is_empty()) return;
+	FILE* f=fopen(traceFile.chars(), "w");
+	if (f==NULL) {
+		GMessage("Warning: cannot create trace file %s\n", traceFile.chars());
+		return;
+	}
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"fqtrim\"}}");
+	uint64 ndropped=0;
+	for (int i=0;i<traceBufs.Count();i++) {
+		FqTraceBuf& t=*traceBufs[i];
+		fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		    t.tid, t.name);
+		fprintf(f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+		    t.tid, t.tid);
+		uint64 first=0;
+		if (t.count>FQTRACE_EVENTS) {
+			first=t.count-FQTRACE_EVENTS;
+			ndropped+=first;
+		}
+		for (uint64 e=first;e<t.count;e++) {
+			FqTraceEvent& ev=t.events[e & (FQTRACE_EVENTS-1)];
+			//timestamps in microseconds
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+			    ev.name, t.tid, (ev.ts-traceStartNs)/1000.0, ev.dur/1000.0);
+			if (ev.arg>=0) fprintf(f, ",\"args\":{\"batch\":%lld}", (long long)ev.arg);
+			fputc('}', f);
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	if (ndropped)
+		GMessage("Warning: the oldest %llu events were dropped from the trace (more than %d per thread)\n",
+		    ndropped, FQTRACE_EVENTS);
+}
@@ -0,0 +1,73 @@
+#ifndef FQ_TRACE_H
+#define FQ_TRACE_H
+#include "GBase.h"
+#include "fqprof.h"
+
+// Event timeline of the threads (--trace <file.json>)
+//
+// Each thread registered with fqTraceThread() records the spans of its work
+// (reading a batch, trimming a task, writing a batch, waiting..) in its own
+// ring buffer, so recording takes no lock and the newest FQTRACE_EVENTS
+// spans of every thread are kept. fqTraceWrite() saves them at the end of
+// the run in the Chrome trace event format (JSON), which can be loaded in
+// chrome://tracing or https://ui.perfetto.dev to see where the pipeline
+// threads are busy or stalled. Like --profile, this is compiled out with
+// NOPROFILE.
+
+#define FQTRACE_EVENTS 65536 //per thread, must be a power of 2
+
+struct FqTraceEvent {
+	const char* name; //static string
+	uint64 ts; //start (fqNanoTime())
+	uint64 dur;
+	int64 arg; //batch id (or -1)
+};
+
+struct FqTraceBuf {
+	FqTraceEvent* events;
+	uint64 count; //all the spans recorded (only the last FQTRACE_EVENTS are kept)
+	int tid;
+	char name[32];
+	FqTraceBuf(int id, const char* tname, int idx);
+	~FqTraceBuf() { GFREE(events); }
+	void add(const char* ename, uint64 t0, uint64 t1, int64 a) {
+		FqTraceEvent& e=events[count & (FQTRACE_EVENTS-1)];
+		e.name=ename;
+		e.ts=t0;
+		e.dur=t1-t0;
+		e.arg=a;
+		count++;
+	}
+};
+
+extern __thread FqTraceBuf* fqTrace;
+
+void fqTraceInit(const char* fname); //--trace was given, called from main() before any thread
+//the calling thread records its spans (if enabled), shown as "<tname> <idx>" (idx>=0) or <tname>
+void fqTraceThread(const char* tname, int idx=-1);
+void fqTraceWrite(); //write the JSON file
+
+class FqTraceScope {
+	const char* name;
+	int64 arg;
+	uint64 t0;
+ public:
+	FqTraceScope(const char* ename, int64 a=-1):name(ename), arg(a), t0(0) {
+		if (fqTrace) t0=fqNanoTime();
+	}
+	~FqTraceScope() {
+		if (fqTrace) fqTrace->add(name, t0, fqNanoTime(), arg);
+	}
+};
+
+#ifndef NOPROFILE
+#define FQ_TRACE(name, arg) FqTraceScope FQ_PROF_CAT(fqtrace_scope_, __LINE__)(name, arg)
+#define FQ_TRACE_MARK() (fqTrace ? fqNanoTime() : 0)
+#define FQ_TRACE_ADD(name, t0, arg) if (fqTrace) fqTrace->add(name, t0, fqNanoTime(), arg)
+#else
+#define FQ_TRACE(name, arg)
+#define FQ_TRACE_MARK() 0
+#define FQ_TRACE_ADD(name, t0, arg) ((void)(t0))
+#endif
+
+#endif
@@ -1,16 +1,32 @@
 #define VERSION "0.9.7"
 #include "GArgs.h"
 #include "GStr.h"
-#include "GHash.hh"
 #include "GList.hh"
 #include <ctype.h>
 #include "GAlnExtend.h"
+#include "fqkernels.h"
+#include "fqdups.h"
+#include "fqsketch.h"
+#include "fqqc.h"
+#include "fqadstats.h"
+#include "fqrep.h"
+#include "fqbinout.h"
+#include "fqsimd.h"
+#include "fqprof.h"
+#include "fqtrace.h"
+#include "fqjson.h"
+#include "fqlive.h"
 #ifndef NOTHREADS
 #include "GThreads.h"
+#include "fqpipe.h"
+#include "fqnuma.h"
 #endif
 
 #include "time.h"
 #include "sys/time.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
 
 //DEBUG ONLY: uncomment this to show trimming progress
 //#define TRIMDEBUG 1
@@ -20,7 +36,11 @@ fqtrim [{-5 <5adapter> -3 <3adapter>|-f <adapters_file>}] [-a <min_match>]\\\n\
    [-R] [-q <minq> [-t <trim_max_len>]] [-p <numcpus>] [-P {64|33}] \\\n\
    [-m <max_percN>] [--ntrimdist=<max_Ntrim_dist>] [-l <minlen>] [-C]\\\n\
    [-o <outsuffix> [--outdir <outdir>]] [-D][-Q][-O] [-n <rename_prefix>]\\\n\
-   [-r <trim_report.txt>] [-y <min_poly>] [-A|-B] <input.fq>[,<input_mates.fq>\\\n\
+   [--umi {<umi_len>|hdr} [--umimerge]] [--dupstat] [--qc <qc.tsv>]\\\n\
+   [--adstats <adstats.tsv>] [--batch <size>] [--pin] [--simd <level>]\\\n\
+   [--profile|--perf] [--trace <trace.json>] [--json-stats <stats.json>]\\\n\
+   [--stats-file <live.json>] [--stats-sock <path>] [--stats-every <sec>]\\\n\
+   [-r <trim_report.txt> [--rbin]] [--obin [--qbin]] [-y <min_poly>] [-A|-B] <input.fq>[,<input_mates.fq>\\\n\
  \n\
  Trim low quality bases at the 3' end and can trim adapter sequence(s), filter\n\
  for low complexity and collapse duplicate reads.\n\
@@ -39,6 +59,12 @@ Options:\n\
     NOTE: if the input file is '-' (stdin) then this is the full name of the\n\
     output file, not just the suffix.\n\
 --outdir for -o option, write the output file(s) to <outdir> directory instead\n\
+--obin write the output reads in a binary format instead of FASTA/FASTQ:\n\
+    blocks of 2-bit packed bases (with the positions of the Ns), qualities,\n\
+    trim coordinates and names, and a block index (see fqbin.h; 'fqbin'\n\
+    converts it back to FASTA/FASTQ); not with -C; without -P the Phred type\n\
+    is detected from the first reads\n\
+--qbin for --obin, bin the quality values to 8 levels (as Illumina does)\n\
 -f  file with adapter sequences to trim, each line having this format:\n\
     [<5_adapter_sequence>][ <3_adapter_sequence>]\n\
 -5  trim the given adapter or primer sequence at the 5' end of each read\n\
@@ -56,7 +82,9 @@ Options:\n\
 -l  minimum read length after trimming (if the remaining sequence is shorter\n\
     than this, the read will be discarded (trashed)(default: 16)\n\
 -r  write a \"trimming report\" file listing the affected reads with a list\n\
-    of trimming operations\n\
+    of trimming operations (compressed if the file name ends in .gz or .bz2)\n\
+--rbin write the -r report in a compact binary format instead, which can be\n\
+    converted to the text report by 'fqrep'\n\
 -s1/-s2:  for paired reads, one of the reads (1 or 2) is not being processed\n\
     (no attempt to trim it) but the pair is discarded if the other read is\n\
     trashed by the trimming process\n\
@@ -70,8 +98,51 @@ Options:\n\
 --dmask option is the same with -D but fqtrim will actually mask the low \n\
     complexity regions with Ns in the output sequence\n\
 -C  collapse duplicate reads and append a _x<N>count suffix to the read\n\
-    name (where <N> is the duplication count)\n\
+    name (where <N> is the duplication count); read pairs are collapsed\n\
+    only when both mates are identical after trimming\n\
+--mem for -C, limit the memory used for collapsing to about <size> (e.g.\n\
+    800M, 16G); duplicates are collapsed through temporary files (created\n\
+    in $TMPDIR or /tmp) when needed; -p can be used for these\n\
+--umi reads have a UMI: either the first <umi_len> bases of each read (of\n\
+    mate 1 for pairs), which are removed before trimming and appended to the\n\
+    read name as _<UMI> (a read not longer than <umi_len> is trashed, with\n\
+    its mate), or (--umi hdr) in the read header, as the last field of the\n\
+    read name after ':' or '_', or as a RX:Z:<UMI> tag; with -C only reads\n\
+    (pairs) having the same UMI are collapsed\n\
+--umimerge for -C --umi, also merge a UMI into a more abundant one (at least\n\
+    2n-1 reads, where n is its own count) which is 1 mismatch away\n\
+--dupstat estimate the duplication rate and the most over-represented\n\
+    sequences of the trimmed reads (in constant memory, without -C)\n\
+--qc write QC metrics of the input reads and of the trimmed reads written to\n\
+    this file (TSV, for each input file and mate): per-position mean quality\n\
+    and base composition, length distribution, mean quality, GC and N rates;\n\
+    with -C the trimmed reads are counted before collapsing\n\
+--adstats write the hits of each adapter (by end and strand, with -R) to this\n\
+    file, with the number of alignments tried and a trim position histogram;\n\
+    a summary of the adapters used (or never matching) is also shown\n\
 -p  use <numcpus> CPUs (threads) on the local machine\n\
+--batch size of the batches of reads loaded at once (e.g. 256K, default\n\
+    128K); with -p the batch size is otherwise adapted to the trimming speed\n\
+--pin for -p, pin each worker thread to a CPU (filling a NUMA node first) and\n\
+    keep its read batches and buffers in the memory of that node\n\
+--simd use these vector instructions for the base and quality scans: scalar,\n\
+    sse4.2, avx2 or avx512 (default: the best the CPU supports, shown by -V)\n\
+--profile show the time spent in each processing stage (and waiting) by all\n\
+    the threads, with the processing rate of each stage\n\
+--perf like --profile, also reporting hardware counters for each stage (IPC,\n\
+    cache and branch misses, if the system allows perf_event_open)\n\
+--trace write a timeline of the work done by each thread (reading, trimming\n\
+    and writing batches, waits) to this file, in the Chrome trace event\n\
+    format (JSON, can be loaded in chrome://tracing or ui.perfetto.dev)\n\
+--json-stats write the statistics of the run to this file as JSON: all the\n\
+    trimming counters of each input file and their totals, wall and CPU time,\n\
+    reads/s, bases/s, the number of threads and the time of each stage\n\
+--stats-file while running, keep replacing this file with a JSON snapshot of\n\
+    the progress: reads in/out, trashed reads by cause, the current reads/s\n\
+    and the pipeline queue depths (SIGUSR1 also prints a progress line)\n\
+--stats-sock send the same JSON snapshot to each client connecting to this\n\
+    Unix-domain socket\n\
+--stats-every seconds between two snapshots of --stats-file (default: 10)\n\
 -P  input is phred64/phred33 (use -P64 or -P33)\n\
 -Q  convert quality values to the other Phred qv type\n\
 -M  disable read name consistency check for paired reads\n\
@@ -102,61 +173,61 @@ Advanced adapter/primer match options (for -f or -5 , -3 options):\n\
 //FILE* f_in2=NULL; //for paired reads
 
 FILE* freport=NULL;
+bool reportPiped=false; //-r <file>.gz: written through gzip
+bool reportBin=false; //--rbin, binary trim report records
+bool binOutput=false; //--obin, reads written in the binary format of fqbin.h
+bool binQuals=false; //--qbin, binned qualities in the binary output
 
 bool debug=false;
-bool verbose=false;
-bool doCollapse=false;
-bool doDust=false;
-bool doPolyTrim=true;
-bool fastaOutput=false;
+bool doUMI=false; //--umi option
+bool doDupStat=false; //--dupstat, sketch based duplication estimate
+bool umiFromHeader=false; //--umi hdr
+bool umiMerge=false; //--umimerge
 bool trimReport=false; //create a trim/trash report file
-bool showAdapterIdx=false;
-bool trimInfo=false; //trim info added to the output reads
-bool polyBothEnds=false; //attempt poly-A/T trimming at both ends
 bool onlyTrimmed=false; //report only trimmed reads
 bool show_Trim=false;
-bool dustMask=false;
 bool pairedOutput=false;
-bool revCompl=false; //also reverse complement adapter sequences
 bool disableMateNameCheck=false;
-int adapter_idx=0;
-int min_read_len=16;
+#define FQ_BATCH_SIZE (128ULL<<10) //initial read batch size (bytes of sequence, qv and names)
+#define FQ_BATCH_MIN (16ULL<<10)
+#define FQ_BATCH_MAX (4ULL<<20)
 int num_cpus=1; // -p option
-int readBufSize=200; //how many reads to fetch at a time (useful for multi-threading)
+uint64 batch_size=FQ_BATCH_SIZE; //--batch: bytes of reads loaded at a time (one batch)
+bool batch_fixed=false; //--batch was given, -p does not adapt the batch size
+bool pinThreads=false; //--pin, CPU and NUMA node placement of the -p workers
+uint64 collapse_mem=0; //--mem option, memory limit for -C (0 = no limit)
+int collapse_cpus=1; //threads collapsing the --mem partitions
 int shieldMate=0; //-s option, shield a mate from trimming but discard the pair
                    //if the other mate gets trashed
-double max_perc_N=5.0;
-double perc_lenN=12.0; // incremental distance from ends, in percentage of read length
-          // where N-trimming is allowed (default:12 %) (autolimited to 20)
-int dist_lenN=0; // incremental distance from either end (in bp) 
-          // where N-trimming is allowed (default: none, perc_lenN controls it)
 
-int dust_cutoff=16;
 bool isfasta=false;
-bool convert_phred=false;
 GStr outdir(".");
 GStr outsuffix; // -o
-GStr prefix;
 GStr zcmd;
-char isACGT[256];
-
-uint inCounter=0;
-uint outCounter=0;
-
-int gtrash_s=0;
-int gtrash_poly=0;
-int gtrash_Q=0;
-int gtrash_N=0;
-int gtrash_D=0;
-int gtrash_V=0;
-int gtrash_X=0;
-uint gnum_trimN=0; //reads trimmed by N%
-uint gnum_trimQ=0; //reads trimmed by qv threshold
-uint gnum_trimV=0; //reads trimmed by adapter match
-uint gnum_trimA=0; //reads trimmed by polyA
-uint gnum_trimT=0; //reads trimmed by polyT
-uint gnum_trim5=0; //number of reads trimmed at 5' end
-uint gnum_trim3=0; //number of reads trimmed at 3' end
+
+uint64 inCounter=0;
+uint64 outCounter=0;
+uint64 total_reads=0; //all input files, for --profile
+uint64 total_bases=0;
+FqJson* jstats=NULL; //--json-stats
+FILE* f_jstats=NULL;
+uint64 run_start_ns=0;
+STrimCounts run_counts; //all input files, for --json-stats
+
+uint64 gtrash_s=0;
+uint64 gtrash_poly=0;
+uint64 gtrash_Q=0;
+uint64 gtrash_N=0;
+uint64 gtrash_D=0;
+uint64 gtrash_V=0;
+uint64 gtrash_X=0;
+uint64 gnum_trimN=0; //reads trimmed by N%
+uint64 gnum_trimQ=0; //reads trimmed by qv threshold
+uint64 gnum_trimV=0; //reads trimmed by adapter match
+uint64 gnum_trimA=0; //reads trimmed by polyA
+uint64 gnum_trimT=0; //reads trimmed by polyT
+uint64 gnum_trim5=0; //number of reads trimmed at 5' end
+uint64 gnum_trim3=0; //number of reads trimmed at 3' end
 
 uint64 gb_totalIn=0; //total number of input bases
 uint64 gb_totalN=0;  //total number of undetermined bases found in input bases
@@ -171,298 +242,188 @@ uint64 gb_trim3=0; //total bases trimmed on the 3' side
 //int min_trimmed5=INT_MAX;
 //int min_trimmed3=INT_MAX;
 
-int qvtrim_qmin=0;
-int qvtrim_max=0;  //(-t) for -q, do not trim the 3'-end more than this number of bases
-int qvtrim_win=6;  //(-w) for -q, sliding window length for avg qual calculation
-int qv_phredtype=0; // could be 64 or 33 (0 means undetermined yet)
-int qv_cvtadd=0; //could be -31 or +31
 
 // adapter matching metrics -- for X-drop ungapped extension
 //const int match_reward=2;
 //const int mismatch_penalty=3;
-int match_reward=1;
-int mismatch_penalty=3;
-int Xdrop=8;
-int minEndAdapter=6;
 //adapter matching percent identiy thresholds:
-double min_pid3=94.0; //min % identity for primer/adapter match at 3' end
-double min_pid5=96.0; //min % identity for primer/adapter match at 5' end
 
 
-const int poly_m_score=2; //match score for poly-A/T extension
-const int poly_mis_score=-3; //mismatch for poly-A/T extension
-const int poly_dropoff_score=7;
-int poly_minScore=12; //i.e. an exact match of 6 bases at the proper ends WILL be trimmed
 
-const char *polyA_seed="AAAA";
-const char *polyT_seed="TTTT";
 
 
 #ifndef NOTHREADS
 
-GFastMutex readMutex; //reading input
-GFastMutex writeMutex; //writing the output reads
-GFastMutex reportMutex; //trim report writing
-GFastMutex statsMutex; //for updating global stats
-void workerThread(GThreadData& td); // Thread function
+GFastMutex writeMutex; //writing collapsed reads (-C)
+#define FQ_BATCHES_PER_CPU 4 //read batches in flight in the pipeline, per worker
+#define FQ_BATCH_MS 4 //target trimming time of a batch, for the adaptive batch size
+#define FQ_PIPE_MAXMEM (256ULL<<20) //limits the batch size when many are in flight
 
 #endif
 
 
 
-struct STrimOp {
-	byte tend; //5 or 3
-	char tcode; //'N','A','T','V' or 'a'..'z'
-	short tlen; //trim length
-	STrimOp(byte e=0, char c=0, short l=0) {
-		assign(e,c,l);
-	}
-	void assign(byte e,char c, short l) {
-		tend=e;
-		tcode=c;
-		tlen=l;
-	}
-};
-
-struct RData {
-	GStr seq;
-	GStr qv;
-	GStr rid;
-	GStr rinfo;
-	GVec<STrimOp> trimhist;
-	int trim5;
-	int trim3;
-	char trashcode;
-	int l3() { return seq.length()-trim3-1; }
-	RData():seq(),qv(),rid(),rinfo(), trimhist(), trim5(0), trim3(0), trashcode(0) {}
-	GStr getTrimSeq() {
-		if (trim5 || trim3)
-			return seq.substr(trim5, seq.length()-trim5-trim3);
-			else return seq;
-	}
-	GStr getTrimQv() {
-		if (trim5 || trim3)
-			return qv.substr(trim5, qv.length()-trim5-trim3);
-		else return qv;
-	}
-
-	void clear() { seq="";qv="";rid="";rinfo=""; trimhist.Clear();
-	               trim5=0; trim3=0; trashcode=0; }
-};
-
+// An input file (or pair) with its outputs. With -p several of them can be
+// in the pipeline at the same time (the end of a file overlapping the start
+// of the next one), so the stats are kept per file, in a slot for each
+// thread, and only added up by finishFile() once all its reads were written.
 struct RInfo {
+	FILE* f_in;
+	FILE* f_in2;
 	GLineReader* fq;
 	GLineReader* fq2;
 	FILE* f_out;
 	FILE* f_out2;
+	FqBinWriter* bout; //--obin writers of f_out and f_out2
+	FqBinWriter* bout2;
 	GStr infname;
 	GStr infname2;
-
-	RInfo(FILE* fo=NULL, FILE* fo2=NULL, GLineReader* fl=NULL,
-			GLineReader* fl2=NULL): fq(fl), fq2(fl2),
-			f_out(fo), f_out2(fo2), infname(), infname2() { }
+	bool paired;
+	bool isfasta; //input format, found by the reader
+	int numSlots; //threads updating the stats
+	uint64 startNs; //opened at, for --json-stats
+	STrimCounts* counts;
+	FqDupSketch** sketches; //--dupstat, created when a thread first needs one
+	FqQc** qcs; //--qc, same
+	FqAdStats** adstats; //--adstats, same
+
+	RInfo(int nslots=1):f_in(NULL), f_in2(NULL), fq(NULL), fq2(NULL),
+			f_out(NULL), f_out2(NULL), bout(NULL), bout2(NULL), infname(), infname2(), paired(false),
+			isfasta(false), numSlots(nslots), startNs(fqNanoTime()), counts(NULL), sketches(NULL),
+			qcs(NULL), adstats(NULL) {
+		counts=new STrimCounts[numSlots];
+		GCALLOC(sketches, numSlots*sizeof(FqDupSketch*));
+		GCALLOC(qcs, numSlots*sizeof(FqQc*));
+		GCALLOC(adstats, numSlots*sizeof(FqAdStats*));
+	}
+	~RInfo() {
+		delete bout;
+		delete bout2;
+		delete[] counts;
+		for (int i=0;i<numSlots;i++) delete sketches[i];
+		GFREE(sketches);
+		for (int i=0;i<numSlots;i++) delete qcs[i];
+		GFREE(qcs);
+		for (int i=0;i<numSlots;i++) delete adstats[i];
+		GFREE(adstats);
+	}
+	FqDupSketch* sketch(int tid) {
+		if (sketches[tid]==NULL) sketches[tid]=new FqDupSketch();
+		return sketches[tid];
+	}
+	FqQc* qc(int tid) {
+		if (qcs[tid]==NULL) qcs[tid]=new FqQc();
+		return qcs[tid];
+	}
+	FqAdStats* adStats(int tid) {
+		if (adstats[tid]==NULL) adstats[tid]=new FqAdStats(adapter_idx);
+		return adstats[tid];
+	}
 };
 
+RInfo* openInput(GStr& s); //setupFiles() for an input file (pair)
+void closeInput(RInfo& ri); //done reading, the outputs are still open
+void finishFile(RInfo& ri); //collapse, print the stats and close the outputs
+void jsonStart(GStr& fname, int argc, char* argv[]); //--json-stats
+void jsonFileStats(RInfo& ri);
+void jsonFinish();
 
+#define FQ_TASK_READS 32 //batches are split in tasks of this many reads
+#define FQ_MAX_TASKS 64 //capacity of a worker's task deque
 
-struct CASeqData {
-	//positional data for every possible hexamer in an adapter
-	GVec<uint16>* pz[4096]; //0-based coordinates of all possible hexamers in the adapter sequence
-	GVec<uint16>* pzr[4096]; //0-based coordinates of all possible hexamers for the reverse complement of the adapter sequence
-	GStr seq; //actual adapter sequence data
-	GStr seqr; //reverse complement sequence
-	int fidx; //index of adapter in the file (order they are given)
-	int amlen; //fraction of adapter length matching that's enough to consider the alignment
-	GAlnTrimType trim_type;
-	bool use_reverse;
-	CASeqData(bool rev=false, int aidx=0):seq(),seqr(),
-			fidx(aidx), amlen(0), use_reverse(rev) {
-		trim_type=galn_None; //should be updated later!
-		for (int i=0;i<4096;i++) {
-			pz[i]=NULL;
-			pzr[i]=NULL;
-		}
-	}
-
-	void update(const char* s) {
-		seq=s;
-		table6mers(seq.chars(), seq.length(), pz);
-		amlen=calc_safelen(seq.length());
-		if (!use_reverse) return;
-		//reverse complement
-		seqr=s;
-		int slen=seq.length();
-		for (int i=0;i<slen;i++)
-			seqr[i]=ntComplement(seq[slen-i-1]);
-		table6mers(seqr.chars(), seqr.length(), pzr);
-	}
+struct SReadBatch;
 
-	void freePosData() {
-		for (int i=0;i<4096;i++) {
-			delete pz[i];
-			delete pzr[i];
-		}
-	}
-	~CASeqData() { freePosData(); }
+struct STrimTask { //a range of reads in a batch, trimmed by one worker
+	SReadBatch* batch;
+	int start;
+	int end;
+	FqRepBuf report; //-r records of these reads, written with the batch
 };
 
-GPVec<CASeqData> adapters5(false);
-GPVec<CASeqData> adapters3(false);
-GPVec<CASeqData> all_adapters(true);
-
-// element in dhash:
-class FqDupRec {
- public:
-   int count; //how many of these reads are the same
-   int len; //length of qv
-   char* firstname; //optional, only if we want to keep the original read names
-   char* qv;
-   FqDupRec(GStr* qstr=NULL, const char* rname=NULL) {
-     len=0;
-     qv=NULL;
-     firstname=NULL;
-     count=0;
-     if (qstr!=NULL) {
-       qv=Gstrdup(qstr->chars());
-       len=qstr->length();
-       count++;
-       }
-     if (rname!=NULL) firstname=Gstrdup(rname);
-     }
-   ~FqDupRec() {
-     GFREE(qv);
-     GFREE(firstname);
-     }
-   void add(GStr& d) { //collapse another record into this one
-     if (d.length()!=len)
-       GError("Error at FqDupRec::add(): cannot collapse reads with different length!\n");
-     count++;
-     for (int i=0;i<len;i++)
-       qv[i]+=(d[i]-qv[i])/count; //the mean is calculated incrementally
-     }
- };
-
-struct CTrimHandler {
-	CGreedyAlignData* gxmem_l;
-	CGreedyAlignData* gxmem_r;
-	GVec<RData> rbuf;   //read buffer
-	int rbuf_p; //index of next read unprocessed from the reading buffer
-	GVec<RData> rbuf2;  //mate read buffer
-	int rbuf2_p;
-	RInfo* rinfo;
-	int incounter;
-	int outcounter;
-	int trash_s;
-	int trash_poly;
-	int trash_Q;
-	int trash_N;
-	int trash_D;
-	int trash_V;
-	int trash_X;
-	uint num_trimN, num_trimQ, num_trimV,
-	  num_trimA, num_trimT, num_trim5, num_trim3;
-
-	uint64 b_totalIn, b_totalN, b_trimN, b_trimQ,
-	  b_trimV, b_trimA, b_trimT, b_trim5, b_trim3;
-
-	CTrimHandler(RInfo* ri=NULL): gxmem_l(NULL), gxmem_r(NULL), rbuf(readBufSize), rbuf_p(-1),
-			rbuf2(0),rbuf2_p(-1), rinfo(ri), incounter(0), outcounter(0),trash_s(0), trash_poly(0),
-			trash_Q(0), trash_N(0), trash_D(0), trash_V(0),
-			trash_X(0),
-			num_trimN(0), num_trimQ(0), num_trimV(0), num_trimA(0), num_trimT(0), num_trim5(0), num_trim3(0),
-			b_totalIn(0), b_totalN(0), b_trimN(0), b_trimQ(0), b_trimV(0),
-			b_trimA(0), b_trimT(0), b_trim5(0), b_trim3(0) {
-      if (adapters5.Count()>0)
-        gxmem_l=new CGreedyAlignData(match_reward, mismatch_penalty, Xdrop);
-      if (adapters3.Count()>0)
-        gxmem_r=new CGreedyAlignData(match_reward, mismatch_penalty, Xdrop);
-      if (ri && ri->fq2) {
-    	  rbuf2.setCapacity(readBufSize);
-      }
-	}
-	void updateTrashCounts(RData& rd);
-
-	void Clear() {
-		 rbuf_p=0; rbuf2_p=0;
-		 incounter=0; outcounter=0;
-		 rbuf.Clear(); rbuf2.Clear();
-		 trash_s=0; trash_poly=0;
-		 trash_Q=0; trash_N=0;
-		 trash_X=0;
-		 trash_D=0; num_trimV=0;
-		 num_trimN=0;num_trimQ=0;
-		 num_trimA=0;num_trimT=0;
-		 num_trim5=0;num_trim3=0;
-		 b_totalIn=0;b_totalN=0;
-		 b_trimN=0;b_trimQ=0;
-		 b_trimV=0;b_trimA=0;b_trimT=0;
-		 b_trim5=0;b_trim3=0;
-	}
+struct SReadBatch { //a batch of reads (and their mates), reused for the next ones
+	uint64 id; //batch number in the input (output order)
+	int count; //number of reads loaded
+	uint64 bytes; //size of the reads loaded (and mates)
+	RInfo* rinfo; //input file the reads come from
+	bool last; //empty batch marking the end of an input file
+	GVec<RData> reads; //the RData slots are kept (and reused) after a batch is done
+	GVec<RData> mates; //for paired reads
+	STrimTask tasks[FQ_MAX_TASKS];
+	int numTasks;
+	int pending; //tasks not done yet, the batch is trimmed when it drops to 0
+	int queue; //work queue (NUMA node) the batch is loaded for
+	SReadBatch():id(0), count(0), bytes(0), rinfo(NULL), last(false), reads(), mates(),
+	    numTasks(0), pending(0), queue(0) { }
+};
 
-	void updateCounts() {
+//load the next batch of reads (and mates) from the input files,
+//up to about maxbytes of read data (at least one read)
+bool readBatch(RInfo& ri, SReadBatch& b, uint64 maxbytes);
+bool phredNeeded();
+//set the Phred type from the first reads of the batch telling it apart
+void detectPhred(SReadBatch& b);
+void reportBatches(uint64 nbatches, uint64 nreads, uint64 minsize, uint64 maxsize, int nchanges);
 #ifndef NOTHREADS
- GLockGuard<GFastMutex> guard(statsMutex);
+void runPipeline(GArgs& args); //-p: trim all the input files using num_cpus workers
 #endif
-	  inCounter+=incounter;
-	  outCounter+=outcounter;
-	  gtrash_s+=trash_s;
-	  gtrash_poly+=trash_poly;
-	  gtrash_Q+=trash_Q;
-	  gtrash_N+=trash_N;
-	  gtrash_D+=trash_D;
-	  gtrash_V+=trash_V;
-	  gtrash_X+=trash_X;
-
-	  gnum_trimN+=num_trimN;
-	  gnum_trimQ+=num_trimQ;
-	  gnum_trimV+=num_trimV;
-	  gnum_trimA+=num_trimA;
-	  gnum_trimT+=num_trimT;
-	  gnum_trim5+=num_trim5;
-	  gnum_trim3+=num_trim3;
-	  gb_totalIn+=b_totalIn;
-	  gb_totalN+=b_totalN;
-	  gb_trimN+=b_trimN;
-	  gb_trimQ+=b_trimQ;
-	  gb_trimV+=b_trimV;
-	  gb_trimA+=b_trimA;
-	  gb_trimT+=b_trimT;
-	  gb_trim5+=b_trim5;
-	  gb_trim3+=b_trim3;
+
+
+
+const FqTrimOptions* trimOpts=NULL; //set once the options are parsed
+
+//the per-read work of processReads() besides the trimming, each
+//specialization of it is compiled for one combination of these
+enum { FQH_QC=1, FQH_SKETCH=2, FQH_REPORT=4 };
+
+struct CTrimHandler: public CTrimKernels {
+	SReadBatch rbatch; //read buffer, when not running in the pipeline
+	int tid; //stats slot of this thread in RInfo
+	RInfo* rinfo; //file of the batch being processed
+	FqDupSketch* dupsketch; //--dupstat, this thread's sketch for rinfo
+	FqQc* qc; //--qc, this thread's metrics for rinfo
+	STrimCounts livePrev; //counts already published by fqLiveUpdate()
+
+	//no alignment buffers if !trimmer (output only, the pipeline writer)
+	CTrimHandler(int id=0, bool trimmer=true): CTrimKernels(*trimOpts, trimmer),
+			rbatch(), tid(id), rinfo(NULL), dupsketch(NULL), qc(NULL),
+			livePrev() { }
+	void updateTrashCounts(RData& rd);
+	//move the counts so far to this thread's slot in rinfo
+	void moveCounts() {
+	  if (fqLiveOn) {
+	    fqLiveUpdate(tid, *this, livePrev);
+	    livePrev.clearCounts();
+	  }
+	  rinfo->counts[tid].addCounts(*this);
+	  clearCounts();
 	}
 
-	~CTrimHandler() {
-		delete gxmem_l;
-		delete gxmem_r;
+	void processAll(RInfo& ri); //trim and write all the reads of a file, sequentially
+	void processBatch(SReadBatch& b) { //trim a batch of reads
+		b.numTasks=1;
+		processReads(b, 0, b.count, b.tasks[0].report);
 	}
-	void processAll();
-    bool fetchReads();
-	void flushReads();
+	void processReads(SReadBatch& b, int start, int end, FqRepBuf& rep);
+	template<int H> void processReads_t(SReadBatch& b, int start, int end, FqRepBuf& rep);
+	void flushBatch(SReadBatch& b); //write (or collapse) a trimmed batch
 
     void writeRead(RData& rd, RData* rd2);
        //writes the output read/pair after processing
        //also implements pair survival decision logic
+	void sketchRead(RData& rd, RData* rd2); //--dupstat
+	void qcRaw(RData& rd, RData* rd2); //--qc, before trimming
+	void qcTrimmed(RData& rd, RData* rd2); //--qc, the reads to be written
 
-	bool nextRead(RData* & rdata, RData* & rdata2);
-	bool processRead();
+	void processRead(RData* rd, RData* rd2); //trim a read, or a pair (rd2!=NULL)
 
-	char process_read(RData& r);
-	//returns 0 if the read was untouched, 1 if it was trimmed and a trash code if it was trashed
 	//void trim_report(char trashcode, GStr& rname, GVec<STrimOp>& t_hist, FILE* freport);
-	void trim_report(RData& rd, int mate=0);
-
-	bool ntrim(GStr& rseq, int &l5, int &l3, double& pN); //returns true if any trimming occured
-	bool qtrim(GStr& qvs, int &l5, int &l3); //return true if any trimming occured
-	bool trim_poly5(GStr &seq, int &l5, int &l3, const char* poly_seed); //returns true if any trimming occured
-	bool trim_poly3(GStr &seq, int &l5, int &l3, const char* poly_seed);
-	bool trim_adapter5(GStr& seq, int &l5, int &l3, int &aidx); //returns true if any trimming occured
-	bool trim_adapter3(GStr& seq, int &l5, int &l3, int &aidx);
+	void trim_report(FqRepBuf& rep, RData& rd, int mate=0);
 };
 
-//bool getBufRead(GVec<RData>& rbuf, int& rbuf_p, GLineReader* fq, GStr& infname, RData& rdata);
 
-
-int dust(GStr& seq);
+void collapseRead(RData& rd, RData* rd2); //-C: add the read/pair to the duplicates table
+void extractUMI(RData& rd); //--umi: set rd.umi, moving it out of the read if needed
+void writeBinRead(FqBinWriter& w, RData& rd, uint64 counter); //--obin
 
 void openfw(FILE* &f, GArgs& args, char opt) {
   GStr s=args.getOpt(opt);
@@ -478,20 +439,39 @@ void openfw(FILE* &f, GArgs& args, char opt) {
 #define FWCLOSE(fh) if (fh!=NULL && fh!=stdout) fclose(fh)
 #define FRCLOSE(fh) if (fh!=NULL && fh!=stdin) fclose(fh)
 
-GHash<FqDupRec> dhash; //hash to keep track of duplicates
+FqDupTable dhash; //table of unique reads, to keep track of duplicates
+FqDupSpill dspill(dhash); //moves dhash to temporary files when over --mem
+FqDupSketch* gdupsketch=NULL; //--dupstat, merged from all the threads
+FILE* f_qc=NULL; //--qc
+FqQc* gqc=NULL; //--qc, merged from all the threads
+GStr adstatsFile; //--adstats
+FqAdStats* gadstats=NULL; //--adstats, merged from all the threads and files
+void printDupStats(FqDupSketch& sketch);
+void openReport(GStr& fname); //-r, piped through gzip/bzip2 if needed
+void reportDusted(GStr& rname, int count); //-r, a collapsed duplicate trashed by -D
+
+struct SDupOutput { //output state shared by the threads writing collapsed reads
+	FILE* f_out;
+	int maxdup_count;
+	GStr maxdup_seq;
+	uint64 num_unique;
+	uint64 num_umi_merged; //--umimerge
+	FILE* f_out2; //mates output, for read pairs
+	SDupOutput(FILE* f=NULL, FILE* f2=NULL):f_out(f), maxdup_count(1), maxdup_seq(),
+	    num_unique(0), num_umi_merged(0), f_out2(f2) { }
+};
 
-void addAdapter(GPVec<CASeqData>& adapters, GStr& seq, GAlnTrimType trim_type);
-int loadAdapters(const char* fname);
+void writeCollapsed(FqDupTable& dtable, SDupOutput& dout);
+#ifndef NOTHREADS
+void collapseThread(GThreadData& td);
+#endif
 
 void setupFiles(FILE*& f_in, FILE*& f_in2, FILE*& f_out, FILE*& f_out2,
                        GStr& s, GStr& infname, GStr& infname2);
 // uses outsuffix to generate output file names and open file handles as needed
 
-void convertPhred(char* q, int len);
-void convertPhred(GStr& q);
-
 int main(int argc, char* argv[]) {
-  GArgs args(argc, argv, "pid5=pid3=mism=ntrimdist=match=XDROP=outdir=dmask;aidx;showtrim;YQDCRVABOTMl:d:3:5:m:n:r:p:s:P:q:f:w:t:o:z:a:y:");
+  GArgs args(argc, argv, "pid5=pid3=mism=ntrimdist=match=XDROP=outdir=mem=umi=batch=dmask;aidx;showtrim;umimerge;dupstat;rbin;obin;qbin;simd=;qc=;adstats=;pin;profile;perf;trace=;json-stats=;stats-file=;stats-sock=;stats-every=;YQDCRVABOTMl:d:3:5:m:n:r:p:s:P:q:f:w:t:o:z:a:y:");
   int e;
   if ((e=args.isError())>0) {
       GMessage("%s\nInvalid argument: %s\n", USAGE, argv[e]);
@@ -574,17 +554,59 @@ int main(int argc, char* argv[]) {
   s=args.getOpt("XDROP");
   if (!s.is_empty())
 	    Xdrop=s.asInt();
+  s=args.getOpt("mem");
+  if (!s.is_empty()) {
+     if (!doCollapse) GError("Error: --mem option requires -C\n");
+     collapse_mem=parseMemSize(s.chars());
+     if (collapse_mem==0) GError("Error: invalid --mem value (%s)\n", s.chars());
+     if (collapse_mem<FQDUP_MIN_MEM) {
+        GMessage("Warning: --mem value too low, using %dM\n", (int)(FQDUP_MIN_MEM>>20));
+        collapse_mem=FQDUP_MIN_MEM;
+     }
+     dspill.setMemLimit(collapse_mem, getenv("TMPDIR"));
+  }
+  s=args.getOpt("umi");
+  if (!s.is_empty()) {
+     doUMI=true;
+     if (s=="hdr") umiFromHeader=true;
+     else {
+       umi_len=s.asInt();
+       if (umi_len<=0 || umi_len>255)
+         GError("Error: invalid --umi value (%s)\n", s.chars());
+     }
+  }
+  umiMerge=(args.getOpt("umimerge")!=NULL);
+  doDupStat=(args.getOpt("dupstat")!=NULL);
+  if (doDupStat) gdupsketch=new FqDupSketch();
+  s=args.getOpt("qc");
+  if (!s.is_empty()) {
+    if (s=="-") f_qc=stdout;
+    else if ((f_qc=fopen(s.chars(), "w"))==NULL)
+      GError("Error creating file: %s\n", s.chars());
+    gqc=new FqQc();
+  }
+  if (umiMerge && (!doUMI || !doCollapse))
+     GError("Error: --umimerge option requires -C and --umi\n");
   s=args.getOpt('p');
   if (!s.is_empty()) {
   	num_cpus=s.asInt();
-  	if (doCollapse) {
-  		GMessage("Warning: -p option ignored (not supported with -C).\n");
-  		num_cpus=1;
-  	} else
   	if (num_cpus<1) {
   		GMessage("Warning: invalid number of threads specified (-p option).\n");
   		num_cpus=1;
   	}
+  	pinThreads=(args.getOpt("pin")!=NULL && num_cpus>1);
+  	//with -C the reads are collapsed by the pipeline writer, in input
+  	//order, and the partitions created by --mem are collapsed in parallel
+  	if (doCollapse && collapse_mem) collapse_cpus=num_cpus;
+  }
+  s=args.getOpt("batch");
+  if (!s.is_empty()) {
+     batch_size=parseMemSize(s.chars());
+     if (batch_size==0) GError("Error: invalid --batch value (%s)\n", s.chars());
+     if (batch_size<FQ_BATCH_MIN || batch_size>FQ_BATCH_MAX)
+        GError("Error: --batch value must be between %lluK and %lluM\n",
+            FQ_BATCH_MIN>>10, FQ_BATCH_MAX>>20);
+     batch_fixed=true;
   }
   s=args.getOpt('P');
   if (!s.is_empty()) {
@@ -600,9 +622,7 @@ int main(int argc, char* argv[]) {
        else
          GMessage("%s\nInvalid value for -P option (can only be 64 or 33)!\n",USAGE);
      }
-  memset((void*)isACGT, 0, 256);
-  isACGT['A']=isACGT['a']=isACGT['C']=isACGT['c']=1;
-  isACGT['G']=isACGT['g']=isACGT['T']=isACGT['t']=1;
+  initACGT();
   s=args.getOpt('f');
   if (!s.is_empty()) {
    loadAdapters(s.chars());
@@ -648,1074 +668,673 @@ int main(int argc, char* argv[]) {
   
   trimReport =  (args.getOpt('r')!=NULL);
   trimInfo = (args.getOpt('T')!=NULL);
+  adstatsFile=args.getOpt("adstats");
+  if (!adstatsFile.is_empty()) {
+    if (adapter_idx==0) GMessage("Warning: no adapters given, --adstats ignored\n");
+    else gadstats=new FqAdStats(adapter_idx);
+  }
   if (args.getOpt("aidx")!=NULL) {
 	  if (!trimReport || !fileAdapters)
 		  GError("Error: option --aidx requires -f and -r options.\n");
 	  showAdapterIdx=true;
   }
+  trimOpts=new FqTrimOptions(); //the trimming options are final now
 
   int fcount=args.startNonOpt();
   if (fcount==0) {
     GMessage(USAGE);
     exit(224);
     }
-   if (fcount>1 && doCollapse) {
-    GError("%s Sorry, the -C option only works with a single input file.\n", USAGE);
-    }
-  if (verbose) args.printCmdLine(stderr);
-  if (trimReport)
-    openfw(freport, args, 'r');
-  char* infile=NULL;
-
-  while ((infile=args.nextNonOpt())!=NULL) {
-    //for each input file
-    inCounter=0; //counter for input reads
-    outCounter=0; //counter for output reads
-    gtrash_s=0; //too short from the get go
-    gtrash_Q=0;
-    gtrash_N=0;
-    gtrash_D=0;
-    gtrash_poly=0;
-    gtrash_V=0;
-    gtrash_X=0;
-
-    gnum_trimN=0;
-    gnum_trimQ=0;
-    gnum_trimV=0;
-    gnum_trimA=0;
-    gnum_trimT=0;
-    gnum_trim5=0;
-    gnum_trim3=0;
-
-    gb_totalIn=0;
-    gb_totalN=0;
-    gb_trimN=0;
-    gb_trimQ=0;
-    gb_trimV=0;
-    gb_trimA=0;
-    gb_trimT=0;
-    gb_trim5=0;
-    gb_trim3=0;
-
-    s=infile;
-    GStr infname;
-    GStr infname2;
-    FILE* f_in=NULL;
-    FILE* f_in2=NULL;
-    FILE* f_out=NULL;
-    FILE* f_out2=NULL;
-    bool paired_reads=false;
-    setupFiles(f_in, f_in2, f_out, f_out2, s, infname, infname2);
-    GLineReader fq(f_in);
-    GLineReader* fq2=NULL;
-    if (f_in2!=NULL) {
-       fq2=new GLineReader(f_in2);
-       paired_reads=true;
-    }
-
-    RInfo rinfo(f_out, f_out2, &fq, fq2);
-    rinfo.infname=infname;
-    rinfo.infname2=infname2;
-#ifndef NOTHREADS
-    GThread *threads=new GThread[num_cpus];
-    for (int t=0;t<num_cpus;t++) {
-    	threads[t].kickStart(workerThread, &rinfo);
-    }
+  s=args.getOpt("simd");
+  if (!fqSimdInit(s.chars()))
+    GError("Error: --simd %s is not available here (CPU: %s)\n", s.chars(),
+        fqSimdCpuFeatures().chars());
+  if (verbose) {
+    args.printCmdLine(stderr);
+    GMessage("SIMD kernels: %s (CPU: %s)\n", fqSimdLevelName(fqsimd.level),
+        fqSimdCpuFeatures().chars());
+  }
+  s=args.getOpt("json-stats");
+  if (!s.is_empty()) jsonStart(s, argc, argv);
+  if (args.getOpt("profile")!=NULL || args.getOpt("perf")!=NULL) {
+#ifdef NOPROFILE
+    GMessage("Warning: --profile is not available in this build (NOPROFILE)\n");
 #else
-    CTrimHandler* trimmer=new CTrimHandler(&rinfo);
-    trimmer->processAll();
-    delete trimmer;
+    fqProfInit(args.getOpt("perf")!=NULL);
 #endif
-
+  }
+#ifndef NOPROFILE
+  else if (jstats) fqProfInit(false, false); //only the stage times, for the JSON stats
+#endif
+  s=args.getOpt("trace");
+  if (!s.is_empty()) {
+#ifdef NOPROFILE
+    GMessage("Warning: --trace is not available in this build (NOPROFILE)\n");
+#else
+    fqTraceInit(s.chars());
+    fqTraceThread(num_cpus>1 ? "reader" : "main");
+#endif
+  }
+  GStr livefile=args.getOpt("stats-file");
+  GStr livesock=args.getOpt("stats-sock");
+  if (!livefile.is_empty() || !livesock.is_empty()) {
+    int every=FQLIVE_EVERY;
+    s=args.getOpt("stats-every");
+    if (!s.is_empty()) every=s.asInt();
+    if (every<1) GError("Error: invalid --stats-every value (%s)\n", s.chars());
+    fqLiveStart(livefile.is_empty() ? NULL : livefile.chars(),
+        livesock.is_empty() ? NULL : livesock.chars(), every, num_cpus+1);
+  }
+  //read names are only needed for the output (or the report) when not renaming
+  dhash.setKeepNames(prefix.is_empty() || trimReport);
+  binOutput=(args.getOpt("obin")!=NULL);
+  binQuals=(args.getOpt("qbin")!=NULL);
+  if (binQuals && !binOutput) GError("Error: option --qbin requires --obin\n");
+  if (binOutput && doCollapse) GError("Error: options --obin and -C cannot be used together!\n");
+  if (trimReport) {
+    reportBin=(args.getOpt("rbin")!=NULL);
+    GStr rfile=args.getOpt('r');
+    openReport(rfile);
+  }
 #ifndef NOTHREADS
-    for (int i=0;i<num_cpus;i++)
-    	threads[i].join();
-    delete[] threads;
+  if (num_cpus>1) runPipeline(args);
+  else
 #endif
-
-    delete fq2;
-    FRCLOSE(f_in);
-    FRCLOSE(f_in2);
-    if (doCollapse) {
-       outCounter=0;
-       int maxdup_count=1;
-       char* maxdup_seq=NULL;
-       dhash.startIterate();
-       FqDupRec* qd=NULL;
-       char* seq=NULL;
-       while ((qd=dhash.NextData(seq))!=NULL) {
-         GStr rseq(seq);
-         //do the dusting here
-         if (doDust) {
-            int dustbases=dust(rseq);
-            if (dustbases>(rseq.length()>>1)) {
-               if (trimReport && qd->firstname!=NULL) {
-                 fprintf(freport, "%s_x%d\tD\n",qd->firstname, qd->count);
-                 }
-               gtrash_D+=qd->count;
-               continue;
-               }
-            }
-         outCounter++;
-         if (qd->count>maxdup_count) {
-            maxdup_count=qd->count;
-            maxdup_seq=seq;
-            }
-         if (isfasta) {
-           if (prefix.is_empty()) {
-             fprintf(f_out, ">%s_x%d\n%s\n", qd->firstname, qd->count,
-                           rseq.chars());
-             }
-           else { //use custom read name
-             fprintf(f_out, ">%s%08d_x%d\n%s\n", prefix.chars(), outCounter,
-                        qd->count, rseq.chars());
-             }
-           }
-         else { //fastq format
-          if (convert_phred) convertPhred(qd->qv, qd->len);
-          if (prefix.is_empty()) {
-            fprintf(f_out, "@%s_x%d\n%s\n+\n%s\n", qd->firstname, qd->count,
-                           rseq.chars(), qd->qv);
-            }
-          else { //use custom read name
-            fprintf(f_out, "@%s%08d_x%d\n%s\n+\n%s\n", prefix.chars(), outCounter,
-                        qd->count, rseq.chars(), qd->qv);
-            }
-           }
-         }//for each element of dhash
-       if (maxdup_count>1) {
-         GMessage("Maximum read multiplicity: x %d (read: %s)\n",maxdup_count, maxdup_seq);
-         }
-       } //collapse entries
-    if (verbose) {
-       if (paired_reads) {
-           GMessage(">Input files : %s , %s\n", infname.chars(), infname2.chars());
-           GMessage("Number of input pairs :%9u\n", inCounter);
-           if (onlyTrimmed)
-               GMessage("         Output pairs :%9u\t(trimmed only)\n", outCounter);
-           else
-        	   GMessage("         Output pairs :%9u\t(%u discarded)\n", outCounter, inCounter-outCounter);
-           }
-         else {
-           GMessage(">Input file : %s\n", infname.chars());
-           GMessage("Number of input reads :%9d\n", inCounter);
-           GMessage("         Output reads :%9d  (%u discarded)\n", outCounter, inCounter-outCounter);
-           }
-       GMessage("\n-------------- Read trimming: --------------\n");
-       if (gnum_trim5)
-          GMessage("           5' trimmed :%9u\n", gnum_trim5);
-       if (gnum_trim3)
-          GMessage("           3' trimmed :%9u\n", gnum_trim3);
-       if (gnum_trimQ)
-          GMessage("         q.v. trimmed :%9u\n", gnum_trimQ);
-       if (gnum_trimN)
-          GMessage("            N trimmed :%9u\n", gnum_trimN);
-       if (gnum_trimT)
-          GMessage("       poly-T trimmed :%9u\n", gnum_trimT);
-       if (gnum_trimA)
-          GMessage("       poly-A trimmed :%9u\n", gnum_trimA);
-       if (gnum_trimV)
-          GMessage("      Adapter trimmed :%9u\n", gnum_trimV);
-       GMessage("--------------------------------------------\n");
-       if (gtrash_s>0)
-         GMessage("Trashed by initial len:%9d\n", gtrash_s);
-       if (gtrash_N>0)
-         GMessage("         Trashed by N%%:%9d\n", gtrash_N);
-       if (gtrash_Q>0)
-         GMessage("Trashed by low quality:%9d\n", gtrash_Q);
-       if (gtrash_poly>0)
-         GMessage("   Trashed by poly-A/T:%9d\n", gtrash_poly);
-       if (gtrash_V>0)
-         GMessage("    Trashed by adapter:%9d\n", gtrash_V);
-       if (gtrash_X>0)
-         GMessage("    Trashed by X      :%9d\n", gtrash_X);
-     GMessage("\n-------------- Base counts: ----------------\n");
-       GMessage("      Input bases :%12llu\n", gb_totalIn);
-       double percN=100.0* ((double)gb_totalN/(double)gb_totalIn);
-       GMessage("          N bases :%12llu (%4.2f%%)\n", gb_totalN, percN);
-       GMessage("   trimmed from 5':%12llu\n", gb_trim5);
-       GMessage("   trimmed from 3':%12llu\n", gb_trim3);
-       GMessage("\n");
-       if (gb_trimQ)
-       GMessage("     q.v. trimmed :%12llu\n", gb_trimQ);
-       if (gb_trimN)
-       GMessage("        N trimmed :%12llu\n", gb_trimN);
-       if (gb_trimT)
-       GMessage("   poly-T trimmed :%12llu\n", gb_trimT);
-       if (gb_trimA)
-       GMessage("   poly-A trimmed :%12llu\n", gb_trimA);
-       if (gb_trimV)
-       GMessage("  Adapter trimmed :%12llu\n", gb_trimV);
-
-       }
-    FWCLOSE(f_out);
-    FWCLOSE(f_out2);
-   } //while each input file
+  {
+    char* infile=NULL;
+    while ((infile=args.nextNonOpt())!=NULL) {
+      //for each input file
+      s=infile;
+      RInfo* ri=openInput(s);
+      CTrimHandler trimmer;
+      trimmer.processAll(*ri);
+      closeInput(*ri);
+      finishFile(*ri);
+      delete ri;
+    }
+  }
   if (trimReport) {
-          FWCLOSE(freport);
-          }
+    if (reportPiped) pclose(freport);
+    else FWCLOSE(freport);
+  }
+  fqLiveStop();
+  fqProfReport(total_reads, total_bases);
+  fqTraceWrite();
+  if (jstats) jsonFinish();
+  delete gdupsketch;
+  delete trimOpts;
+  if (gadstats) {
+    gadstats->printSummary();
+    FILE* f=stdout;
+    if (adstatsFile!="-" && (f=fopen(adstatsFile.chars(), "w"))==NULL)
+      GError("Error creating file: %s\n", adstatsFile.chars());
+    gadstats->write(f);
+    FWCLOSE(f);
+    delete gadstats;
+  }
+  if (f_qc) {
+    FWCLOSE(f_qc);
+    delete gqc;
+  }
   //getc(stdin);
 }
 
-class NData {
- public:
-   GVec<int> NPos; //there should be no reads longer than 1K ?
-   //int NCount;
-   int end5;
-   int end3;
-   int n5; //left side N position (index in NPos)
-   int n3; //right side N position (index in NPos)
-   int seqlen;
-   double perc_N; //percentage of Ns in end5..end3 range only!
-   const char* seq;
-   bool valid;
-   NData():NPos(),end5(0),end3(0),n5(0),n3(-1),seqlen(0),
-         perc_N(0),seq(NULL),valid(true) {  }
-   NData(GStr& rseq):NPos(rseq.length()), end5(0),end3(rseq.length()-1),n5(0),n3(-1),
-       seqlen(rseq.length()), perc_N(0),seq(rseq.chars()),valid(true) {
-     //init(rseq);
-     for (int i=0;i<seqlen;i++)
-        if (seq[i]=='N') {// if (!ichrInStr(rseq[i], "ACGT")
-           NPos.Add(i);
-           }
-     n3=NPos.Count()-1; // -1 if no Ns
-     N_calc();
-   }
-  void N_trim(); //former N_analyze();
-  double N_calc() { //only in the end5-end3 region
-     if (n5<=n3) {
-       perc_N=((n3-n5+1)*100.0)/(end3-end5+1);
-       }
-      else perc_N=0; 
-    return perc_N;
+RInfo* openInput(GStr& s) {
+  RInfo* ri=new RInfo(num_cpus+1); //one more slot for the pipeline writer
+  setupFiles(ri->f_in, ri->f_in2, ri->f_out, ri->f_out2, s, ri->infname, ri->infname2);
+  if (binOutput) {
+    if (ri->f_out) ri->bout=new FqBinWriter(ri->f_out, binQuals);
+    if (ri->f_out2) ri->bout2=new FqBinWriter(ri->f_out2, binQuals);
   }
- };
-
-
-void NData::N_trim() { //N_analyze(NData& feat, int l5, int l3, int p5, int p3) {
-/* assumes feat was filled properly */
- int old_dif, t5,t3,v;
- int l3=end3;
- int l5=end5;
- while (l3>=l5+2 && n5<=n3) {
-   t5=NPos[n5]-l5; //left side possible trimming
-   t3=l3-NPos[n3]; //right side potential trimming
-   old_dif=n3-n5;
-   if (dist_lenN) { 
-      v=dist_lenN;
-   }
-   else {
-     v=iround(perc_lenN*(l3-l5+1)/100);
-     if (v>20) v=20; // enforce N-search limit for very long reads
-        else if (v<1) v=1;
-   }   
-   if (t5 <= v ) {
-     l5=NPos[n5]+1;
-     n5++; //we can trim at 5' end up to after leftmost N
-   }
-   if (t3 <= v) {
-     l3=NPos[n3]-1;
-     n3--; //we can trim at 3' before leftmost N;
-   }
-   // restNs=p3-p5; number of Ns in the new CLR 
-   if (n3-n5==old_dif) { // no change, return
-     break;
-   }
- }
- end5=l5;
- end3=l3;
- N_calc();
- return;
- /*
- if (l3<l5+2 || p5>p3 ) {
-   feat.end5=l5+1;
-   feat.end3=l3+1;
-   return;
-   }
-
- t5=feat.NPos[p5]-l5; //left side possible trimming
- t3=l3-feat.NPos[p3]; //right side potential trimming
- old_dif=p3-p5;
- v=(int)((((double)(l3-l5))*perc_lenN)/100);
- if (v>20) v=20; // enforce N-search limit for very long reads
-    else if (v<1) v=1;
- if (t5 < v ) {
-   l5=feat.NPos[p5]+1;
-   p5++; //we can trim at 5' end up to after leftmost N
-   }
- if (t3 < v) {
-   l3=feat.NPos[p3]-1;
-   p3--; //we can trim at 3' before leftmost N;
-   }
- // restNs=p3-p5; number of Ns in the new CLR 
- if (p3-p5==old_dif) { // no change, return
-           feat.end5=l5+1;
-           feat.end3=l3+1;
-           return;
-           }
-    else
-      N_analyze(feat, l5,l3, p5,p3);
- */
+  ri->fq=new GLineReader(ri->f_in);
+  if (ri->f_in2!=NULL) {
+    ri->fq2=new GLineReader(ri->f_in2);
+    ri->paired=true;
+  }
+  return ri;
 }
 
-
-bool CTrimHandler::qtrim(GStr& qvs, int &l5, int &l3) {
-if (qvtrim_qmin==0 || qvs.is_empty()) return false;
-l5=0;
-l3=qvs.length()-1;
-if (qv_phredtype==0) {
-  //try to guess the Phred type
-  int vmin=256, vmax=0;
-  for (int i=0;i<qvs.length();i++) {
-     if (vmin>qvs[i]) vmin=qvs[i];
-     if (vmax<qvs[i]) vmax=qvs[i];
-     }
-  if (vmin<64) { qv_phredtype=33; qv_cvtadd=31; }
-  if (vmax>95) { qv_phredtype=64; qv_cvtadd=-31; }
-  if (qv_phredtype==0) {
-    GError("Error: couldn't determine Phred type, please use the -p33 or -p64 !\n");
-    }
-  if (verbose)
-    GMessage("Input reads have Phred-%d quality values.\n", (qv_phredtype==33 ? 33 : 64));
-} //guessing Phred type
-int winlen=GMIN(qvtrim_win, qvs.length()/4);
-if (winlen<3) {
- //no sliding window
- //scan from the ends and look for two consecutive bases above the threshold
- for (;l3>2;l3--) {
-    if (qvs[l3]-qv_phredtype>=qvtrim_qmin && qvs[l3-1]-qv_phredtype>=qvtrim_qmin) break;
- }
-// qtrim 5' end
- for (l5=0;l5<qvs.length()-3;l5++) {
-    if (qvs[l5]-qv_phredtype>=qvtrim_qmin && qvs[l5+1]-qv_phredtype>=qvtrim_qmin) break;
- }
+void closeInput(RInfo& ri) {
+  delete ri.fq;
+  delete ri.fq2;
+  ri.fq=NULL;
+  ri.fq2=NULL;
+  FRCLOSE(ri.f_in);
+  FRCLOSE(ri.f_in2);
+  ri.f_in=NULL;
+  ri.f_in2=NULL;
 }
-else {
- // trim 3'
- //sliding window from the 5' end until avg qual drops below the threshold
- //init sum
-
- int qsum=0;
- /*
- int qilow=-1; //first base index where qv drops below qmin
- for (int q=0;q<winlen;q++) {
-   int qvq=qvs[q]-qv_phredtype;
-   qsum+=qvq;
-   if (qilow<0 && qvq<qvtrim_qmin) qilow=q;
-   }
- double qavg=((double)qsum)/winlen;
- if (qavg<qvtrim_qmin) { //first window fail
-   l3=qilow-1;
- }
- else {
-   for (int i=1;i<=qvs.length()-qvtrim_win;i++) {
-     qsum -= qvs[i-1]-qv_phredtype;
-     int inew=i+qvtrim_win-1;
-     int qvnew=qvs[inew]-qv_phredtype;
-     qsum += qvnew;
-     //if (qilow<i && qvnew<qvtrim_qmin) qilow=inew;
-     qavg=((double)qsum)/qvtrim_win;
-     //GMessage("i=%d (%c), inew=%d (%c), qilow=%d, qavg=%4.2f\n", i, qvs[i], inew, qvs[inew], qilow, qavg);
-     if (qavg<qvtrim_qmin) {
-       for (int qlo=i;qlo<i+qvtrim_win;qlo++) {
-          if (qvs[qlo]-qv_phredtype<qvtrim_qmin) {
-            l3=qlo-1;
-            break;
-          }
-       }
-       //l3=qilow-1;
-       break;
-       }
-   } //for each sliding window
- }
- */
- int qi5=l5; //suggested qv trim 5' base index
- int qi3=l3; //suggested qv trim 3' base index
- double qavg; //avg. qv for the current window
- int i5bw=-1; //index of first base below threshold in current window
- int i3bw=-1; //index of last base below threshold in current window
- bool okfound=false; //found a window above threshold
- for (int i=0;i<winlen;++i) {
-   int cq=qvs[i]-qv_phredtype;
-   qsum+=cq;
-   if (cq<qvtrim_qmin) {
-	   i3bw=i;
-	   if (i5bw<0) i5bw=i;
-   }
- }
- qavg=((double)qsum)/winlen;
- if (iround(qavg)<qvtrim_qmin) {
-	 //propose 5' trimming by qv
-	 qi5=i3bw+1;
- }
- else { okfound=true; }
- //now scan the rest of the read
- if (okfound) i5bw=-1;
- for (int i=1;i<=qvs.length()-winlen;i++) {
-   if (i5bw<i) i5bw=-1;
-   qsum -= qvs[i-1]-qv_phredtype;
-   int inew=i+winlen-1;
-   int qvnew=qvs[inew]-qv_phredtype;
-   if (qvnew<qvtrim_qmin) {
-      if (i5bw<0) i5bw=inew;
-      i3bw=inew;
-   }
-   qsum += qvnew;
-   //if (qilow<i && qvnew<qvtrim_qmin) qilow=inew;
-   qavg=((double)qsum)/winlen;
-   if (qavg<qvtrim_qmin) { //bad qv window
-	 if (okfound) {
-		 //trimming 3' now
-		 qi3=i5bw-1;
-	     break;
-	 } else {
-		 //still trimming 5', shame
-		 qi5=i3bw+1;
-		 if (qvs.length()-qi5<min_read_len)
-			 break;
-	 }
-   }
-   else okfound=true;
- } //for each sliding window
- if (!okfound) {
-	 //fatal trimming at 5' end
-	 l5=qi5;
-	 return true;
- }
- l5=qi5;
- l3=qi3;
+
+void resetCounts() {
+  inCounter=0; //counter for input reads
+  outCounter=0; //counter for output reads
+  gtrash_s=0; //too short from the get go
+  gtrash_Q=0;
+  gtrash_N=0;
+  gtrash_D=0;
+  gtrash_poly=0;
+  gtrash_V=0;
+  gtrash_X=0;
+
+  gnum_trimN=0;
+  gnum_trimQ=0;
+  gnum_trimV=0;
+  gnum_trimA=0;
+  gnum_trimT=0;
+  gnum_trim5=0;
+  gnum_trim3=0;
+
+  gb_totalIn=0;
+  gb_totalN=0;
+  gb_trimN=0;
+  gb_trimQ=0;
+  gb_trimV=0;
+  gb_trimA=0;
+  gb_trimT=0;
+  gb_trim5=0;
+  gb_trim3=0;
 }
 
-if (qvtrim_max>0) {
-  if (qvs.length()-1-l3>qvtrim_max) l3=qvs.length()-1-qvtrim_max;
-  if (l5>qvtrim_max) l5=qvtrim_max;
-  }
-return (l5>0 || l3<qvs.length()-1);
+void addGlobalCounts(STrimCounts& c) {
+  inCounter+=c.incounter;
+  outCounter+=c.outcounter;
+  gtrash_s+=c.trash_s;
+  gtrash_poly+=c.trash_poly;
+  gtrash_Q+=c.trash_Q;
+  gtrash_N+=c.trash_N;
+  gtrash_D+=c.trash_D;
+  gtrash_V+=c.trash_V;
+  gtrash_X+=c.trash_X;
+
+  gnum_trimN+=c.num_trimN;
+  gnum_trimQ+=c.num_trimQ;
+  gnum_trimV+=c.num_trimV;
+  gnum_trimA+=c.num_trimA;
+  gnum_trimT+=c.num_trimT;
+  gnum_trim5+=c.num_trim5;
+  gnum_trim3+=c.num_trim3;
+  gb_totalIn+=c.b_totalIn;
+  gb_totalN+=c.b_totalN;
+  gb_trimN+=c.b_trimN;
+  gb_trimQ+=c.b_trimQ;
+  gb_trimV+=c.b_trimV;
+  gb_trimA+=c.b_trimA;
+  gb_trimT+=c.b_trimT;
+  gb_trim5+=c.b_trim5;
+  gb_trim3+=c.b_trim3;
 }
 
-bool CTrimHandler::ntrim(GStr& rseq, int &l5, int &l3, double& pN) {
- //count Ns in the sequence, trim N-rich ends
- NData feat(rseq);
- l5=feat.end5;
- l3=feat.end3;
- pN=0.0;
- if (feat.NPos.Count()==0) return false;
- //int clrNcount = N_analyze(feat, feat.end5-1, feat.end3-1, 0, feat.NPos.Count()-1); //feat.NCount-1);
- feat.N_trim(); //tries to trim terminal Ns, recalculates perc_N
- pN=feat.perc_N;
- if (l5==feat.end5 && l3==feat.end3) {
-    if (feat.perc_N>max_perc_N) {
-           #ifdef TRIMDEBUG
-           GMessage(" ### : N_trim() did nothing but remaining range %d-%d has internal %N = %4.2f\n", 
-               feat.end5, feat.end3, feat.perc_N);
-           #endif
-           feat.valid=false;
-           return true;
-           }
-      else {
-       return false; //no trimming
+void finishFile(RInfo& ri) {
+  //all the reads of this file were written (or collapsed) at this point
+  resetCounts();
+  for (int i=0;i<ri.numSlots;i++)
+    addGlobalCounts(ri.counts[i]);
+  total_reads+=inCounter;
+  total_bases+=gb_totalIn;
+  if (gdupsketch) {
+    gdupsketch->Clear();
+    for (int i=0;i<ri.numSlots;i++)
+      if (ri.sketches[i]) gdupsketch->merge(*ri.sketches[i]);
+  }
+  isfasta=ri.isfasta;
+  if (doCollapse) {
+     outCounter=0;
+     SDupOutput dout(ri.f_out, ri.f_out2);
+     if (dspill.spilled()) {
+       dspill.finish();
+       if (verbose)
+         GMessage("Collapsing %llu records from %d temporary files (memory limit: %.1f MB)\n",
+             dspill.spilledRecords(), dspill.numRunFiles(), collapse_mem/1048576.0);
+#ifndef NOTHREADS
+       GThread *cthreads=new GThread[collapse_cpus];
+       for (int t=0;t<collapse_cpus;t++)
+         cthreads[t].kickStart(collapseThread, &dout);
+       for (int t=0;t<collapse_cpus;t++)
+         cthreads[t].join();
+       delete[] cthreads;
+#else
+       FqDupTable dtable(dhash.namesKept());
+       while (dspill.loadNext(dtable, collapse_mem))
+         writeCollapsed(dtable, dout);
+#endif
        }
-    }
- l5=feat.end5;
- l3=feat.end3;
- //feat.N_calc(); feat.N_trim() did this already
- #ifdef TRIMDEBUG
-     GStr r=rseq.substr(feat.end5, feat.end3-feat.end5+1);
-     GMessage(" ### : after N_trim() clear range %d-%d has %N = %4.2f :\n%s\n", 
-          feat.end5, feat.end3, feat.perc_N, r.chars());
- #endif
- /*
-  if (l3-l5+1<min_read_len) {
-   feat.valid=false;
-   return true;
-   }
- if (feat.perc_N>max_perc_N) {
-      feat.valid=false;
-      return true;
-      }
- */
- return true;
- }
+     else writeCollapsed(dhash, dout);
+     if (dout.maxdup_count>1) {
+       GMessage("Maximum read multiplicity: x %d (read: %s)\n",dout.maxdup_count,
+           dout.maxdup_seq.chars());
+       }
+     if (verbose) {
+       if (umiMerge)
+         GMessage("UMIs merged (1 mismatch): %llu\n", dout.num_umi_merged);
+       if (dspill.spilled())
+         GMessage("Unique reads: %llu\n", dout.num_unique);
+       else
+         GMessage("Unique reads: %llu (collapse table size: %.1f MB)\n", dout.num_unique,
+             dhash.memUsed()/1048576.0);
+       }
+     dhash.Clear(true); //get ready for the next input file
+     dspill.reset();
+     } //collapse entries
+  if (verbose) {
+     if (ri.paired) {
+         GMessage(">Input files : %s , %s\n", ri.infname.chars(), ri.infname2.chars());
+         GMessage("Number of input pairs :%9llu\n", inCounter);
+         if (onlyTrimmed)
+             GMessage("         Output pairs :%9llu\t(trimmed only)\n", outCounter);
+         else
+      	   GMessage("         Output pairs :%9llu\t(%llu discarded)\n", outCounter, inCounter-outCounter);
+         }
+       else {
+         GMessage(">Input file : %s\n", ri.infname.chars());
+         GMessage("Number of input reads :%9llu\n", inCounter);
+         GMessage("         Output reads :%9llu  (%llu discarded)\n", outCounter, inCounter-outCounter);
+         }
+     GMessage("\n-------------- Read trimming: --------------\n");
+     if (gnum_trim5)
+        GMessage("           5' trimmed :%9llu\n", gnum_trim5);
+     if (gnum_trim3)
+        GMessage("           3' trimmed :%9llu\n", gnum_trim3);
+     if (gnum_trimQ)
+        GMessage("         q.v. trimmed :%9llu\n", gnum_trimQ);
+     if (gnum_trimN)
+        GMessage("            N trimmed :%9llu\n", gnum_trimN);
+     if (gnum_trimT)
+        GMessage("       poly-T trimmed :%9llu\n", gnum_trimT);
+     if (gnum_trimA)
+        GMessage("       poly-A trimmed :%9llu\n", gnum_trimA);
+     if (gnum_trimV)
+        GMessage("      Adapter trimmed :%9llu\n", gnum_trimV);
+     GMessage("--------------------------------------------\n");
+     if (gtrash_s>0)
+       GMessage("Trashed by initial len:%9llu\n", gtrash_s);
+     if (gtrash_N>0)
+       GMessage("         Trashed by N%%:%9llu\n", gtrash_N);
+     if (gtrash_Q>0)
+       GMessage("Trashed by low quality:%9llu\n", gtrash_Q);
+     if (gtrash_poly>0)
+       GMessage("   Trashed by poly-A/T:%9llu\n", gtrash_poly);
+     if (gtrash_V>0)
+       GMessage("    Trashed by adapter:%9llu\n", gtrash_V);
+     if (gtrash_X>0)
+       GMessage("    Trashed by X      :%9llu\n", gtrash_X);
+   GMessage("\n-------------- Base counts: ----------------\n");
+     GMessage("      Input bases :%12llu\n", gb_totalIn);
+     double percN=100.0* ((double)gb_totalN/(double)gb_totalIn);
+     GMessage("          N bases :%12llu (%4.2f%%)\n", gb_totalN, percN);
+     GMessage("   trimmed from 5':%12llu\n", gb_trim5);
+     GMessage("   trimmed from 3':%12llu\n", gb_trim3);
+     GMessage("\n");
+     if (gb_trimQ)
+     GMessage("     q.v. trimmed :%12llu\n", gb_trimQ);
+     if (gb_trimN)
+     GMessage("        N trimmed :%12llu\n", gb_trimN);
+     if (gb_trimT)
+     GMessage("   poly-T trimmed :%12llu\n", gb_trimT);
+     if (gb_trimA)
+     GMessage("   poly-A trimmed :%12llu\n", gb_trimA);
+     if (gb_trimV)
+     GMessage("  Adapter trimmed :%12llu\n", gb_trimV);
 
-//--------------- dust functions ----------------
-class DNADuster {
- public:
-  int dustword;
-  int dustwindow;
-  int dustwindow2;
-  int dustcutoff;
-  int mv, iv, jv;
-  int counts[32*32*32];
-  int iis[32*32*32];
-  DNADuster(int cutoff=16, int winsize=32, int wordsize=3) {
-    dustword=wordsize;
-    dustwindow=winsize;
-    dustwindow2 = (winsize>>1);
-    dustcutoff=cutoff;
-    mv=0;
-    iv=0;
-    jv=0;
-    }
-  void setWindowSize(int value) {
-    dustwindow = value;
-    dustwindow2 = (dustwindow >> 1);
-    }
-  void setWordSize(int value) {
-    dustword=value;
-    }
-void wo1(int len, const char* s, int ivv) {
-  int i, ii, j, v, t, n, n1, sum;
-  int js, nis;
-  n = 32 * 32 * 32;
-  n1 = n - 1;
-  nis = 0;
-  i = 0;
-  ii = 0;
-  sum = 0;
-  v = 0;
-  for (j=0; j < len; j++, s++) {
-        ii <<= 5;
-        if (*s<=32) {
-           i=0;
-           continue;
-           }
-        ii |= *s - 'A'; //assume uppercase!
-        ii &= n1;
-        i++;
-        if (i >= dustword) {
-              for (js=0; js < nis && iis[js] != ii; js++) ;
-              if (js == nis) {
-                    iis[nis] = ii;
-                    counts[ii] = 0;
-                    nis++;
-              }
-              if ((t = counts[ii]) > 0) {
-                    sum += t;
-                    v = 10 * sum / j;
-                    if (mv < v) {
-                          mv = v;
-                          iv = ivv;
-                          jv = j;
-                    }
-              }
-              counts[ii]++;
-        }
+     }
+  if (gdupsketch) printDupStats(*gdupsketch);
+  if (gqc) {
+    gqc->Clear();
+    for (int i=0;i<ri.numSlots;i++)
+      if (ri.qcs[i]) gqc->merge(*ri.qcs[i]);
+    GStr fname(ri.infname);
+    if (ri.paired) fname.append(',').append(ri.infname2);
+    gqc->write(f_qc, fname.chars(), ri.paired, qv_phredtype); //0 only for FASTA
   }
+  if (gadstats)
+    for (int i=0;i<ri.numSlots;i++)
+      if (ri.adstats[i]) gadstats->merge(*ri.adstats[i]);
+  if (jstats) jsonFileStats(ri);
+  fqLiveFileDone(doCollapse ? outCounter : 0);
+  if (ri.bout) ri.bout->finish();
+  if (ri.bout2) ri.bout2->finish();
+  FWCLOSE(ri.f_out);
+  FWCLOSE(ri.f_out2);
 }
 
-int wo(int len, const char* s, int* beg, int* end) {
-      int i, l1;
-      l1 = len - dustword + 1;
-      if (l1 < 0) {
-            *beg = 0;
-            *end = len - 1;
-            return 0;
-            }
-      mv = 0;
-      iv = 0;
-      jv = 0;
-      for (i=0; i < l1; i++) {
-            wo1(len-i, s+i, i);
-            }
-      *beg = iv;
-      *end = iv + jv;
-      return mv;
- }
-
-void dust(const char* seq, char* seqmsk, int seqlen, int cutoff=0) { //, maskFunc maskfn) {
-  int i, j, l, a, b, v;
-  if (cutoff==0) cutoff=dustcutoff;
-  a=0;b=0;
-  //GMessage("Dust cutoff=%d\n", cutoff);
-  for (i=0; i < seqlen; i += dustwindow2) {
-        l = (seqlen > i+dustwindow) ? dustwindow : seqlen-i;
-        v = wo(l, seq+i, &a, &b);
-        if (v > cutoff) {
-           //for (j = a; j <= b && j < dustwindow2; j++) {
-           for (j = a; j <= b; j++) {
-                    seqmsk[i+j]='N';//could be made lowercase instead
-                    }
-           }
-         }
-//return first;
- }
-};
+//--------------- --json-stats ----------------
+
+void getGlobalCounts(STrimCounts& c) {
+  c.incounter=inCounter;
+  c.outcounter=outCounter;
+  c.trash_s=gtrash_s;
+  c.trash_poly=gtrash_poly;
+  c.trash_Q=gtrash_Q;
+  c.trash_N=gtrash_N;
+  c.trash_D=gtrash_D;
+  c.trash_V=gtrash_V;
+  c.trash_X=gtrash_X;
+  c.num_trimN=gnum_trimN;
+  c.num_trimQ=gnum_trimQ;
+  c.num_trimV=gnum_trimV;
+  c.num_trimA=gnum_trimA;
+  c.num_trimT=gnum_trimT;
+  c.num_trim5=gnum_trim5;
+  c.num_trim3=gnum_trim3;
+  c.b_totalIn=gb_totalIn;
+  c.b_totalN=gb_totalN;
+  c.b_trimN=gb_trimN;
+  c.b_trimQ=gb_trimQ;
+  c.b_trimV=gb_trimV;
+  c.b_trimA=gb_trimA;
+  c.b_trimT=gb_trimT;
+  c.b_trim5=gb_trim5;
+  c.b_trim3=gb_trim3;
+}
 
-//static DNADuster duster;
+void jsonCounts(FqJson& js, STrimCounts& c) {
+  js.addInt("reads_in", c.incounter); //read pairs for paired input
+  js.addInt("reads_out", c.outcounter);
+  js.beginObject("trashed");
+  js.addInt("short", c.trash_s);
+  js.addInt("poly_AT", c.trash_poly);
+  js.addInt("quality", c.trash_Q);
+  js.addInt("N", c.trash_N);
+  js.addInt("dust", c.trash_D);
+  js.addInt("adapter", c.trash_V);
+  js.addInt("other", c.trash_X);
+  js.endObject();
+  js.beginObject("trimmed_reads");
+  js.addInt("5p", c.num_trim5);
+  js.addInt("3p", c.num_trim3);
+  js.addInt("quality", c.num_trimQ);
+  js.addInt("N", c.num_trimN);
+  js.addInt("poly_A", c.num_trimA);
+  js.addInt("poly_T", c.num_trimT);
+  js.addInt("adapter", c.num_trimV);
+  js.endObject();
+  js.beginObject("bases");
+  js.addInt("input", c.b_totalIn);
+  js.addInt("N", c.b_totalN);
+  js.addInt("trimmed_5p", c.b_trim5);
+  js.addInt("trimmed_3p", c.b_trim3);
+  js.addInt("trimmed_quality", c.b_trimQ);
+  js.addInt("trimmed_N", c.b_trimN);
+  js.addInt("trimmed_poly_A", c.b_trimA);
+  js.addInt("trimmed_poly_T", c.b_trimT);
+  js.addInt("trimmed_adapter", c.b_trimV);
+  js.endObject();
+}
 
-int dust(GStr& rseq) {
- DNADuster duster;
- char* seq=Gstrdup(rseq.chars());
- duster.dust(rseq.chars(), seq, rseq.length(), dust_cutoff);
- //check the number of Ns:
- int ncount=0;
- for (int i=0;i<rseq.length();i++) {
-   if (seq[i]=='N') ncount++;
-   }
- if (dustMask) rseq=seq; //hard masking requested
- GFREE(seq);
- return ncount;
- }
+void jsonStart(GStr& fname, int argc, char* argv[]) {
+  f_jstats=fopen(fname.chars(), "w");
+  if (f_jstats==NULL) GError("Error creating file: %s\n", fname.chars());
+  run_start_ns=fqNanoTime();
+  jstats=new FqJson(f_jstats);
+  GStr cmd;
+  for (int i=0;i<argc;i++) {
+    if (i) cmd.append(' ');
+    cmd.append(argv[i]);
+  }
+  jstats->beginObject();
+  jstats->addStr("program", "fqtrim");
+  jstats->addStr("version", VERSION);
+  jstats->addStr("command", cmd.chars());
+  jstats->addInt("threads", num_cpus);
+  jstats->addStr("simd", fqSimdLevelName(fqsimd.level));
+  jstats->beginArray("files");
+}
 
-struct SLocScore {
-  int pos;
-  int score;
-  SLocScore(int p=0,int s=0) {
-    pos=p;
-    score=s;
-    }
-  void set(int p, int s) {
-    pos=p;
-    score=s;
-    }
-  void add(int p, int add) {
-    pos=p;
-    score+=add;
-    }
-};
+void jsonFileStats(RInfo& ri) {
+  STrimCounts c;
+  getGlobalCounts(c);
+  run_counts.addCounts(c);
+  double wall=(fqNanoTime()-ri.startNs)/1e9;
+  jstats->beginObject();
+  jstats->addStr("input", ri.infname.chars());
+  if (ri.paired) jstats->addStr("input2", ri.infname2.chars());
+  jstats->addBool("paired", ri.paired);
+  jstats->addStr("format", ri.isfasta ? "fasta" : "fastq");
+  jstats->addNum("wall_s", wall);
+  jstats->addNum("reads_per_s", wall>0 ? c.incounter/wall : 0);
+  jstats->addNum("bases_per_s", wall>0 ? c.b_totalIn/wall : 0);
+  jsonCounts(*jstats, c);
+  jstats->endObject();
+}
 
-bool CTrimHandler::trim_poly3(GStr &seq, int &l5, int &l3, const char* poly_seed) {
- if (!doPolyTrim) return false;
- int rlen=seq.length();
- l5=0;
- l3=rlen-1;
- int32 seedVal=*(int32*)poly_seed;
- char polyChar=poly_seed[0];
- //assumes N trimming was already done
- //so a poly match should be very close to the end of the read
- // -- find the initial match (seed)
- int lmin=GMAX((rlen-16), 0);
- int li;
- for (li=rlen-4;li>lmin;li--) {
-   if (seedVal==*(int*)&(seq[li])) {
-      break;
-      }
-   }
- if (li<=lmin) return false;
- //seed found, try to extend it both ways
- //extend right
- int ri=li+3;
- SLocScore loc(ri, poly_m_score<<2);
- SLocScore maxloc(loc);
- //extend right
- while (ri<rlen-1) {
-   ri++;
-   if (seq[ri]==polyChar) {
-                loc.add(ri,poly_m_score);
-                }
-   else if (seq[ri]=='N') {
-                loc.add(ri,0);
-                }
-   else { //mismatch
-        loc.add(ri,poly_mis_score);
-        if (maxloc.score-loc.score>poly_dropoff_score) break;
-        }
-   if (maxloc.score<=loc.score) {
-      maxloc=loc;
-      }
-   }
- ri=maxloc.pos;
- if (ri<rlen-6) return false; //no trimming wanted, too far from 3' end
- //ri = right boundary for the poly match
- //extend left
- loc.set(li, maxloc.score);
- maxloc.pos=li;
- while (li>0) {
-    li--;
-    if (seq[li]==polyChar) {
-                 loc.add(li,poly_m_score);
-                 }
-    else if (seq[li]=='N') {
-                 loc.add(li,0);
-                 }
-    else { //mismatch
-         loc.add(li,poly_mis_score);
-         if (maxloc.score-loc.score>poly_dropoff_score) break;
-         }
-    if (maxloc.score<=loc.score) {
-       maxloc=loc;
-       }
-    }
-li=maxloc.pos;
-if ((maxloc.score==poly_minScore && ri==rlen-1) ||
-    (maxloc.score>poly_minScore && ri>=rlen-3) ||
-    (maxloc.score>(poly_minScore*3) && ri>=rlen-8)) {
-  //trimming this li-ri match at 3' end
-    l3=li-1;
-    if (l3<0) l3=0;
-    return true;
-    }
-return false;
+void jsonFinish() {
+  jstats->endArray();
+  double wall=(fqNanoTime()-run_start_ns)/1e9;
+  jstats->beginObject("totals");
+  jsonCounts(*jstats, run_counts);
+  jstats->endObject();
+  jstats->addNum("wall_s", wall);
+#ifndef _WIN32
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru)==0) {
+    jstats->addNum("cpu_user_s", ru.ru_utime.tv_sec+ru.ru_utime.tv_usec/1e6);
+    jstats->addNum("cpu_sys_s", ru.ru_stime.tv_sec+ru.ru_stime.tv_usec/1e6);
+  }
+#endif
+  jstats->addNum("reads_per_s", wall>0 ? run_counts.incounter/wall : 0);
+  jstats->addNum("bases_per_s", wall>0 ? run_counts.b_totalIn/wall : 0);
+  double secs[FQP_NUM_STAGES];
+  if (fqProfTimes(secs)) { //thread-seconds of each stage
+    jstats->beginObject("stages");
+    for (int i=0;i<FQP_NUM_STAGES;i++)
+      jstats->addNum(fqProfStageKey(i), secs[i]);
+    jstats->endObject();
+  }
+  jstats->endObject();
+  fclose(f_jstats);
+  delete jstats;
+  jstats=NULL;
 }
 
-bool CTrimHandler::trim_poly5(GStr &seq, int &l5, int &l3, const char* poly_seed) {
- if (!doPolyTrim) return false;
- int rlen=seq.length();
- l5=0;
- l3=rlen-1;
- int32 seedVal=*(int32*)poly_seed;
- char polyChar=poly_seed[0];
- //assumes N trimming was already done
- //so a poly match should be very close to the end of the read
- // -- find the initial match (seed)
- int lmax=GMIN(12, rlen-4);//how far from 5' end to look for 4-mer seeds
- int li;
- for (li=0;li<=lmax;li++) {
-   if (seedVal==*(int*)&(seq[li])) {
-      break;
-      }
-   }
- if (li>lmax) return false;
- //seed found, try to extend it both ways
- //extend left
- int ri=li+3; //save rightmost base of the seed
- SLocScore loc(li, poly_m_score<<2);
- SLocScore maxloc(loc);
- while (li>0) {
-    li--;
-    if (seq[li]==polyChar) {
-                 loc.add(li,poly_m_score);
-                 }
-    else if (seq[li]=='N') {
-                 loc.add(li,0);
-                 }
-    else { //mismatch
-         loc.add(li,poly_mis_score);
-         if (maxloc.score-loc.score>poly_dropoff_score) break;
-         }
-    if (maxloc.score<=loc.score) {
-       maxloc=loc;
+void writeDupRead(FILE* f_out, GStr& rname, GStr& umisfx, int count, GStr& rseq,
+		char* qv, int qlen) {
+   if (isfasta) {
+     if (prefix.is_empty()) {
+       fprintf(f_out, ">%s%s_x%d\n%s\n", rname.chars(), umisfx.chars(), count,
+                     rseq.chars());
        }
-    }
- li=maxloc.pos;
- if (li>5) return false; //no trimming wanted, too far from 5' end
- //li = right boundary for the poly match
-
- //extend right
- loc.set(ri, maxloc.score);
- maxloc.pos=ri;
- while (ri<rlen-1) {
-   ri++;
-   if (seq[ri]==polyChar) {
-                loc.add(ri,poly_m_score);
-                }
-   else if (seq[ri]=='N') {
-                loc.add(ri,0);
-                }
-   else { //mismatch
-        loc.add(ri,poly_mis_score);
-        if (maxloc.score-loc.score>poly_dropoff_score) break;
-        }
-   if (maxloc.score<=loc.score) {
-      maxloc=loc;
+     else { //use custom read name
+       fprintf(f_out, ">%s%08llu%s_x%d\n%s\n", prefix.chars(), outCounter,
+                  umisfx.chars(), count, rseq.chars());
+       }
+     }
+   else { //fastq format
+    if (convert_phred) convertPhred(qv, qlen);
+    if (prefix.is_empty()) {
+      fprintf(f_out, "@%s%s_x%d\n%s\n+\n%.*s\n", rname.chars(), umisfx.chars(), count,
+                     rseq.chars(), qlen, qv);
       }
-   }
-ri=maxloc.pos;
-if ((maxloc.score==poly_minScore && li==0) ||
-     (maxloc.score>poly_minScore && li<2)
-     || (maxloc.score>(poly_minScore*3) && li<8)) {
-    //adjust l5 to reflect this trimming of 5' end
-    l5=ri+1;
-    if (l5>rlen-1) l5=rlen-1;
-    return true;
-    }
-return false;
+    else { //use custom read name
+      fprintf(f_out, "@%s%08llu%s_x%d\n%s\n+\n%.*s\n", prefix.chars(), outCounter,
+                  umisfx.chars(), count, rseq.chars(), qlen, qv);
+      }
+     }
 }
 
-bool CTrimHandler::trim_adapter3(GStr& seq, int&l5, int &l3, int& aidx) {
- if (adapters3.Count()==0) return false;
- //GMessage("Trimming adapter 3!\n");
- int rlen=seq.length();
- l5=0;
- l3=rlen-1;
- bool trimmed=false;
- GStr wseq(seq);
- int wlen=rlen;
- GXSeqData seqdata;
- int numruns=revCompl ? 2 : 1;
- GList<GXAlnInfo> bestalns(true, true, false);
- aidx=-1;
- for (int ai=0;ai<adapters3.Count();ai++) {
-   for (int r=0;r<numruns;r++) {
-     if (r) {
-  	  seqdata.update(adapters3[ai]->seqr.chars(), adapters3[ai]->seqr.length(),
-  		 adapters3[ai]->pzr, wseq.chars(), wlen, adapters3[ai]->amlen);
-        }
-     else {
-  	    seqdata.update(adapters3[ai]->seq.chars(), adapters3[ai]->seq.length(),
-  		 adapters3[ai]->pz, wseq.chars(), wlen, adapters3[ai]->amlen);
-        }
-     //GXAlnInfo* aln=match_adapter(seqdata, adapters3[ai]->trim_type, minEndAdapter, gxmem_r, min_pid3);
-     GXAlnInfo* aln=match_adapter(seqdata, galn_TrimRight, minEndAdapter, gxmem_r, min_pid3);
-	 if (aln) {
-	   aln->udata=adapters3[ai]->fidx;
-	   if (aln->strong) {
-		   trimmed=true;
-		   bestalns.Add(aln);
-		   break; //will check the rest next time
-		   }
-	    else bestalns.Add(aln);
-	   }
-   }//forward and reverse adapters
-   if (trimmed) break; //will check the rest in the next cycle
-  }//for each 3' adapter
- if (bestalns.Count()>0) {
-	   GXAlnInfo* aln=bestalns[0];
-	   if (aln->sl-1 > wlen-aln->sr) {
-		   //keep left side
-		   l3-=(wlen-aln->sl+1);
-		   if (l3<0) l3=0;
-		   }
-	   else { //keep right side
-		   l5+=aln->sr;
-		   if (l5>=rlen) l5=rlen-1;
-		   }
-	   //delete aln;
-	   //if (l3-l5+1<min_read_len) return true;
-	   wseq=seq.substr(l5,l3-l5+1);
-	   wlen=wseq.length();
-	   aidx=aln->udata;
-	   return true; //break the loops here to report a good find
+void writeCollapsed(FqDupTable& dtable, SDupOutput& dout) {
+ FQ_PROF(FQP_COLLAPSE);
+ uint64 umi_merged=0;
+ if (umiMerge) umi_merged=dtable.mergeUMIs();
+#ifndef NOTHREADS
+ uint64 lt=FQ_PROF_MARK(), ltt=FQ_TRACE_MARK();
+ GLockGuard<GFastMutex> guard(writeMutex);
+ FQ_PROF_ADD(FQP_WAIT_LOCK, lt);
+ FQ_TRACE_ADD("wait: output lock", ltt, -1);
+#endif
+ dout.num_umi_merged+=umi_merged;
+ FqDupView qd;
+ dtable.startIterate();
+ while (dtable.nextRecord(qd)) {
+   dout.num_unique++;
+   GStr rseq(qd.seq);
+   GStr rseq2;
+   GStr rname;
+   GStr rname2;
+   GStr umisfx;
+   if (qd.name!=NULL) rname=qd.name;
+   if (qd.ulen>0) { //the key starts with the UMI
+     if (umiInName()) {
+       umisfx='_';
+       umisfx.append(rseq.substr(0, qd.ulen));
+       }
+     rseq.cut(0, qd.ulen);
      }
-  aidx=-1;
-  return false;
- }
-
-bool CTrimHandler::trim_adapter5(GStr& seq, int&l5, int &l3, int& aidx) {
- if (adapters5.Count()==0) return false;
- int rlen=seq.length();
- l5=0;
- l3=rlen-1;
- bool trimmed=false;
- GStr wseq(seq);
- int wlen=rlen;
- GXSeqData seqdata;
- int numruns=revCompl ? 2 : 1;
- GList<GXAlnInfo> bestalns(true, true, false);
- aidx=-1;
- for (int ai=0;ai<adapters5.Count();ai++) {
-   for (int r=0;r<numruns;r++) {
-     if (r) {
-  	  seqdata.update(adapters5[ai]->seqr.chars(), adapters5[ai]->seqr.length(),
-  		 adapters5[ai]->pzr, wseq.chars(), wlen, adapters5[ai]->amlen);
-        }
-     else {
-  	    seqdata.update(adapters5[ai]->seq.chars(), adapters5[ai]->seq.length(),
-  		 adapters5[ai]->pz, wseq.chars(), wlen, adapters5[ai]->amlen);
+   if (qd.mlen>0) { //read pair, split the mates
+     rseq2=rseq.substr(qd.mlen);
+     rseq.cut(qd.mlen);
+     int p=rname.index(' ');
+     if (p>=0) {
+       rname2=rname.substr(p+1);
+       rname.cut(p);
+       }
+     }
+   //do the dusting here
+   if (doDust) {
+      bool dusted=(dust(rseq)>(rseq.length()>>1));
+      if (qd.mlen>0) { //same pair survival rules as in pairSurvival()
+         bool dusted2=(dust(rseq2)>(rseq2.length()>>1));
+         if (shieldMate==1) dusted=dusted2;
+         else if (shieldMate!=2) dusted=(dusted && dusted2);
+         }
+      if (dusted) {
+         if (trimReport && qd.name!=NULL) {
+           reportDusted(rname, qd.count);
+           if (qd.mlen>0) reportDusted(rname2, qd.count);
+           }
+         gtrash_D+=qd.count;
+         continue;
+         }
+      }
+   outCounter++;
+   if (qd.count>dout.maxdup_count) {
+      dout.maxdup_count=qd.count;
+      dout.maxdup_seq=rseq;
+      if (qd.mlen>0) {
+        dout.maxdup_seq.append(',');
+        dout.maxdup_seq.append(rseq2);
         }
-	 //GXAlnInfo* aln=match_adapter(seqdata, adapters5[ai]->trim_type,
-     GXAlnInfo* aln=match_adapter(seqdata, galn_TrimLeft,
-		                                       minEndAdapter, gxmem_l, min_pid5);
-	 if (aln) {
-	   aln->udata=adapters5[ai]->fidx;
-	   if (aln->strong) {
-		   trimmed=true;
-		   bestalns.Add(aln);
-		   break; //will check the rest next time
-		   }
-	    else bestalns.Add(aln);
-	   }
-	 } //forward and reverse?
-   if (trimmed) break; //will check the rest in the next cycle
-  }//for each 5' adapter
-  if (bestalns.Count()>0) {
-	   GXAlnInfo* aln=bestalns[0];
-	   if (aln->sl-1 > wlen-aln->sr) {
-		   //keep left side
-		   l3-=(wlen-aln->sl+1);
-		   if (l3<0) l3=0;
-		   }
-	   else { //keep right side
-		   l5+=aln->sr;
-		   if (l5>=rlen) l5=rlen-1;
-		   }
-	   //delete aln;
-	   //if (l3-l5+1<min_read_len) return true;
-	   wseq=seq.substr(l5,l3-l5+1);
-	   wlen=wseq.length();
-	   aidx=aln->udata;
-	   return true; //break the loops here to report a good find
+      }
+   if (qd.mlen==0) {
+     writeDupRead(dout.f_out, rname, umisfx, qd.count, rseq, qd.qv, qd.qlen);
+     continue;
      }
-  aidx=-1;
-  return false;
+   writeDupRead(dout.f_out, rname, umisfx, qd.count, rseq, qd.qv, qd.qlen ? qd.mlen : 0);
+   writeDupRead(dout.f_out2, rname2, umisfx, qd.count, rseq2, qd.qlen ? qd.qv+qd.mlen : NULL,
+        qd.qlen ? qd.qlen-qd.mlen : 0);
+   }//for each record in dtable
 }
 
-//convert qvs to/from phred64 from/to phread33
-void convertPhred(GStr& q) {
- for (int i=0;i<q.length();i++) q[i]+=qv_cvtadd;
-}
-
-void convertPhred(char* q, int len) {
- for (int i=0;i<len;i++) q[i]+=qv_cvtadd;
+#ifndef NOTHREADS
+void collapseThread(GThreadData& td) {
+  fqProfThread();
+  fqTraceThread("collapse");
+  FQ_PROF(FQP_COLLAPSE);
+  SDupOutput* dout=(SDupOutput*)td.udata;
+  FqDupTable dtable(dhash.namesKept());
+  uint64 maxmem=GMAX(collapse_mem/collapse_cpus, (FQDUP_MIN_MEM>>2));
+  while (true) {
+    uint64 t0=FQ_TRACE_MARK();
+    if (!dspill.loadNext(dtable, maxmem)) break;
+    FQ_TRACE_ADD("load spilled reads", t0, -1);
+    FQ_TRACE("collapse", -1);
+    writeCollapsed(dtable, *dout);
+    }
 }
+#endif
 
-bool getFastxRead(GLineReader& fq, RData& rd, GStr& infname) {
-	 if (fq.eof()) return false;
-	 char* l=fq.getLine();
-	 while (l!=NULL && (l[0]==0 || isspace(l[0]))) l=fq.getLine(); //ignore empty lines
-	 if (l==NULL) return false;
-	 /* if (rawFormat) {
-	      //TODO: implement raw qseq parsing here?
-	      //if (raw type=N) then continue; //skip invalid/bad records
-	      } //raw qseq format
-	 else { // FASTQ or FASTA */
-	 isfasta=(l[0]=='>');
-	 if (!isfasta && l[0]!='@') GError("Error: fasta/fastq record marker not found(%s)\n%s\n",
-	      infname.chars(), l);
-	 GStr s(l);
-	 rd.rid=&(l[1]);
-	 for (int i=0;i<rd.rid.length();i++)
-	    if (rd.rid[i]<=' ') {
-	       if (i<rd.rid.length()-2) rd.rinfo=rd.rid.substr(i+1);
-	       rd.rid.cut(i);
-	       break;
-	       }
-	  //now get the sequence
-	 if ((l=fq.getLine())==NULL)
-	      GError("Error: unexpected EOF after header for read %s (%s)\n",
-	      		rd.rid.chars(), infname.chars());
-	 rd.seq=l; //this must be the DNA line
-	 while ((l=fq.getLine())!=NULL) {
-	      //seq can span multiple lines
-	      if (l[0]=='>' || l[0]=='+') {
-	           fq.pushBack();
-	           break; //
-	           }
-	      rd.seq+=l;
-	      } //check for multi-line seq
-	 if (!isfasta) { //reading fastq quality values, which can also be multi-line
-	    if ((l=fq.getLine())==NULL)
-	        GError("Error: unexpected EOF after sequence for %s\n", rd.rid.chars());
-	    if (l[0]!='+') GError("Error: fastq qv header marker not detected!\n");
-	    if ((l=fq.getLine())==NULL)
-	        GError("Error: unexpected EOF after qv header for %s\n", rd.rid.chars());
-	    rd.qv=l;
-	    //if (rqv.length()!=rseq.length())
-	    //  GError("Error: qv len != seq len for %s\n", rname.chars());
-	    while (rd.qv.length()<rd.seq.length() && ((l=fq.getLine())!=NULL)) {
-	      rd.qv+=l; //append to qv string
-	      }
-	    }// fastq
-	 if (rd.seq.is_empty()) {
-		 rd.seq="A";
-		 rd.qv="B";
-	 }
-	 // } //<-- FASTA or FASTQ
-	 rd.seq.upper();
-	 return true;
+static inline uint64 readBytes(RData& rd) {
+	return rd.seq.length()+rd.qv.length()+rd.rid.length()+rd.rinfo.length();
 }
 
-bool getBufRead(GVec<RData>& rbuf, int& rbuf_p, GLineReader* fq, GStr& infname, RData& rdata) {
-	rdata.clear();
-	if (rbuf_p<=0) { //load next chunk of reads
-		rbuf_p=0;
-		if (fq->isEof()) return false;
-		{
-#ifndef NOTHREADS
-			GLockGuard<GFastMutex> guard(readMutex);
-#endif
-			while(!fq->isEof() && rbuf_p<readBufSize) {
-				if (!getFastxRead(*(fq), rdata, infname)) break;
-				rbuf.Add(&rdata);
-				//rbuf[rbuf_p]=rdata;
-				++rbuf_p;
-			}
+bool readBatch(RInfo& ri, SReadBatch& b, uint64 maxbytes) {
+	FQ_PROF(FQP_INPUT);
+	b.rinfo=&ri;
+	b.count=0;
+	b.bytes=0;
+	if (ri.fq2) maxbytes>>=1; //the mates take about as much
+	while (b.bytes<maxbytes && !ri.fq->isEof()) {
+		if (b.count==b.reads.Count()) {
+			RData rd0;
+			b.reads.Add(rd0);
 		}
-		if (rbuf_p==0) return false;
-		//if (rbuf_p<rbuf.Count()) rbuf.setCount(rbuf_p);
-		GASSERT( rbuf_p==rbuf.Count() );
-	} //read next chunk of reads
-	//next unprocessed read from read buffer
-	rdata=rbuf[rbuf.Count()-rbuf_p];
-	rbuf_p--;
-	return true;
-}
-
-bool CTrimHandler::fetchReads() {
-	// do NOT call this unless rbuf_p<=0, it'll clobber the buffer!
-	GASSERT(rbuf_p<=0);
-	//refill read buffer
-	rbuf_p=0;
-	rbuf2_p=0;
-	if (rinfo->fq->isEof()) return false;
-	{ //file reading block
-#ifndef NOTHREADS
-		GLockGuard<GFastMutex> guard(readMutex);
-#endif
-		while(!rinfo->fq->isEof() && rbuf_p<readBufSize) {
+		RData& rd=b.reads[b.count];
+		rd.clear();
+		if (!getFastxRead(*(ri.fq), rd, ri.infname, ri.isfasta)) break;
+		b.bytes+=readBytes(rd);
+		++b.count;
+	}
+	if (b.count==0) {
+		if (ri.fq2 && !ri.fq2->isEof()) { //mates left?
 			RData rd;
-			if (!getFastxRead(*(rinfo->fq), rd, rinfo->infname)) break;
-			rbuf.Add(rd);
-			//rbuf[rbuf_p]=rd;
-			++rbuf_p;
-		}
-		if (rbuf_p==0) return false;
-		GASSERT( rbuf_p==rbuf.Count() );
-		//also load from the mates file, if given
-		if (rinfo->fq2) {
-			while(!rinfo->fq2->isEof() && rbuf2_p<readBufSize) {
-				RData rd;
-				if (!getFastxRead(*(rinfo->fq2), rd, rinfo->infname2)) break;
-				rbuf2.Add(rd);
-				//rbuf[rbuf_p]=rd;
-				++rbuf2_p;
-			}
-			if (rbuf_p!=rbuf2_p) {
+			if (getFastxRead(*(ri.fq2), rd, ri.infname2, ri.isfasta))
 				GError("Error: mismatch in the count of reads vs mates!\n");
+		}
+		return false;
+	}
+	if (ri.fq2) { //also load from the mates file
+		int n=0;
+		while (n<b.count && !ri.fq2->isEof()) {
+			if (n==b.mates.Count()) {
+				RData rd0;
+				b.mates.Add(rd0);
 			}
-			GASSERT( rbuf2_p==rbuf2.Count() );
-		} //loaded the mates too
-	} //file reading block
+			RData& rd=b.mates[n];
+			rd.clear();
+			if (!getFastxRead(*(ri.fq2), rd, ri.infname2, ri.isfasta)) break;
+			b.bytes+=readBytes(rd);
+			++n;
+		}
+		if (n!=b.count) {
+			GError("Error: mismatch in the count of reads vs mates!\n");
+		}
+	}
+	if (qv_phredtype==0 && phredNeeded()) detectPhred(b);
 	return true;
 }
 
-bool CTrimHandler::nextRead(RData* & rdata, RData* & rdata2) {
-  /*
-  if (!getBufRead(rbuf, rbuf_p, rinfo->fq, rinfo->infname, rdata)) return false;
-  incounter++;
-  if (rinfo->fq2==NULL) return true;
-  getBufRead(rbuf2, rbuf2_p, rinfo->fq2, rinfo->infname2, rdata2);
-  */
-  //rdata=NULL;
-  //rdata2=NULL;
-  GASSERT(rbuf_p>0); //read buffer should be prepared for use!
-  GASSERT(rbuf.Count()>0);
-  //if (rbuf_p<=0) {
-  //  if (!fetchReads()) return false;
-  //}
-  if (rbuf.Count()==0 || rbuf_p<=0) return false;
-  ++incounter;
-  rdata=&(rbuf[rbuf.Count()-rbuf_p]);
-  --rbuf_p;
-  if (rinfo->fq2 && rbuf2.Count()>0) {
-	rdata2=&(rbuf2[rbuf2.Count()-rbuf2_p]);
-	--rbuf2_p;
-  }
-  return true;
+bool phredNeeded() { //the Phred type must be known before trimming (or --obin)
+	return qvtrim_qmin>0 || convert_phred || gqc!=NULL || binOutput;
 }
 
-void CTrimHandler::flushReads() {
-	 //write reads and update counts
-	 for (int i=0;i<rbuf.Count();++i) {
-		RData& rd=rbuf[i];
+void detectPhred(SReadBatch& b) {
+	//by the reader, before the batch goes to the trimming threads
+	bool hasQv=false;
+	for (int i=0;i<b.count && qv_phredtype==0;i++) {
+		for (int m=0;m<2;m++) {
+			if (m && !b.rinfo->paired) break;
+			GStr& qv=m ? b.mates[i].qv : b.reads[i].qv;
+			if (qv.is_empty()) continue;
+			hasQv=true;
+			setPhredType(guessPhred(qv.chars(), qv.length()));
+			if (qv_phredtype) break;
+		}
+	}
+	if (hasQv && qv_phredtype==0)
+		GError("Error: couldn't determine the Phred type of the quality values, please use -P33 or -P64!\n");
+	if (qv_phredtype && verbose)
+		GMessage("Input reads have Phred-%d quality values.\n", qv_phredtype);
+}
+
+void CTrimHandler::flushBatch(SReadBatch& b) {
+	 FQ_PROF(FQP_OUTPUT);
+	 rinfo=b.rinfo;
+	 isfasta=rinfo->isfasta;
+	 if (trimReport) //formatted by the trimming threads
+		for (int t=0;t<b.numTasks;t++) b.tasks[t].report.write(freport);
+	 //write reads (or collapse them)
+	 for (int i=0;i<b.count;++i) {
+		RData& rd=b.reads[i];
 		bool trimmed=(rd.trashcode>0);
-		if (rd.trashcode>0 && trimReport)
-			trim_report(rd);
 		RData *rd2p=NULL;
-		if (rinfo->fq2 && rbuf2.Count()>i) { //paired reads
-			rd2p = & (rbuf2[i]);
-			if (!rd2p->seq.is_empty() && rd2p->trashcode>0) {
-				if (trimReport) trim_report(*rd2p, 1);
-				trimmed=true;
-			}
+		if (rinfo->paired) { //paired reads
+			rd2p = & (b.mates[i]);
+			if (!rd2p->seq.is_empty() && rd2p->trashcode>0) trimmed=true;
 		}
-		if (!doCollapse) {
+		if (doCollapse) collapseRead(rd, rd2p);
+		else {
 		  if ((onlyTrimmed && trimmed) || !onlyTrimmed )
 		      writeRead(rd, rd2p);
 		}
 	 }
-	 updateCounts();
-	 Clear();
 }
 
 void showTrim(RData& r) {
@@ -1755,366 +1374,235 @@ void showTrim(GStr& rname, GStr& s, int l5, int l3,  GVec<STrimOp>& t_hist) {
 
 
 
-struct STrimState {
- int w5;
- int w3;
- GStr wseq;
- GStr wqv;
- bool w3upd;
- bool w5upd;
- bool wupd;
- STrimState(GStr& rseq, GStr& rqv):w5(0), w3(rseq.length()-1),
-     wseq(rseq.chars()), wqv(rqv.chars()), w3upd(true), w5upd(true), wupd(true) {
- }
-
- char update(char trim_code, int& trim5, int& trim3) {
-   trim5+=w5;
-   trim3+=(wseq.length()-1-w3);
- //#ifdef TRIMDEBUG
- //  GMessage("#### TRIM by '%c' code ( w5-w3 = %d-%d ):\n",trim_code, w5,w3);
- //  showTrim(wseq, wqv, w5, w3);
- //#endif
-   //-- keep only the w5..w3 range
-   wseq=wseq.substr(w5, w3-w5+1);
-   if (!wqv.is_empty())
-      wqv=wqv.substr(w5, w3-w5+1);
-   if (w3-w5+1<min_read_len) {
-       return trim_code; //return last operation code as "trash code"
-   }
-   w5=0;
-   w3=wseq.length()-1;
-   return 0;
- }
- 
-};
-
-char CTrimHandler::process_read (RData &r) {
- //returns 0 if the read was untouched, 1 if it was just trimmed
- // and a trash code if it was trashed
- if (r.seq.length()-r.trim5-r.trim3<min_read_len) {
-   return 's'; //too short already
-   }
-//count Ns
-b_totalIn+=r.seq.length();
-for (int i=0;i<r.seq.length();i++) {
- if (isACGT[(int)r.seq[i]]==0) b_totalN++;
- }
-double percN=0;
-char trim_code=0;
-
-GStr wseq(r.seq.chars());
-GStr wqv(r.qv.chars());
-
-int w5=r.trim5;
-int w3=r.seq.length()-r.trim3-1;
-
-//first do the q-based trimming
-if (qvtrim_qmin!=0 && !wqv.is_empty() && qtrim(wqv, w5, w3)) { // qv-threshold trimming
-   trim_code='Q';
-   int t5=(w5-r.trim5);
-   if (t5>0) {
-      STrimOp trimop(5,trim_code,t5);
-      r.trimhist.Add(trimop);
-   }
-   int t3=(r.l3()-w3);
-   if (t3>0) {
-      STrimOp trimop(3,trim_code,t3);
-      r.trimhist.Add(trimop);
-   }
-   #ifdef TRIMDEBUG
-     GMessage("#DBG# qv trimming: %d from 5'end; %d from 3'end\n",t5,t3);
-   #endif
-   b_trimQ+=t5+t3;
-   num_trimQ++;
-   r.trim5=w5;
-   r.trim3=r.seq.length()-1-w3;
-   if (r.seq.length()-r.trim5-r.trim3<min_read_len) {
-     return trim_code; //invalid read
-     }
-   //-- keep only the w5..w3 range
-   wseq=wseq.substr(r.trim5, r.seq.length()-r.trim3-r.trim5);
-   if (!wqv.is_empty())
-      wqv=wqv.substr(r.trim5, r.seq.length()-r.trim3-r.trim5);
-   } //qv trimming
-// N-trimming on the remaining read seq
-if (ntrim(wseq, w5, w3, percN)) {
-   //Note: ntrim sets w5 to the number of trimmed bases at read start
-   //     and w3 to the new end of read sequence
-#ifdef TRIMDEBUG
-   GMessage("#DBG# N trim: keeping %d-%d range: %s\n",w5+1,w3, wseq.substr(w5, w3-w5+1).chars() );
-#endif
-   int trim3=(wseq.length()-1-w3);
-   trim_code='N';
-   b_trimN+=w5+trim3;
-   num_trimN++;
-   if (w5>0) {
-      STrimOp trimop(5,trim_code,w5);
-      r.trimhist.Add(trimop);
-   }
-   if (trim3>0) {
-      STrimOp trimop(3,trim_code,trim3);
-      r.trimhist.Add(trimop);
-   }
-   r.trim5+=w5;
-   r.trim3+=trim3;
-   if (w3-w5+1<min_read_len) {
-     return trim_code; //to be trashed
-   }
-   if (percN > max_perc_N) {
-     return trim_code;
-   }
-    //-- keep only the w5..w3 range
-   wseq=wseq.substr(w5, w3-w5+1);
-   if (!wqv.is_empty())
-      wqv=wqv.substr(w5, w3-w5+1);
-   //w5=0;
-   //w3=wseq.length()-1;
+bool validUMI(const char* s, int len) {
+  if (len<=0) return false;
+  for (int i=0;i<len;i++) {
+    char c=toupper(s[i]);
+    if (c!='A' && c!='C' && c!='G' && c!='T' && c!='N' && c!='+') return false;
+  }
+  return true;
 }
 
-//clean the more dirty end first - 3'
-bool trimmedA=false;
-bool trimmedT=false;
-bool trimmedV=false;
-STrimState ts(wseq,wqv); //work with this structure from now on
-do {
-  int prev_t3=r.trim3;
-  int prev_t5=r.trim5;
-  trim_code=0;
-  if (ts.w3upd) {
-    if (trim_poly3(ts.wseq, ts.w5, ts.w3, polyA_seed)) {
-      trim_code='A';
-      STrimOp trimop(3, trim_code, (ts.w5+(ts.wseq.length()-1-ts.w3)));
-      #ifdef TRIMDEBUG
-        GMessage("#DBG# 3' polyA trimming %d bases\n",trimop.tlen);
-      #endif
-      r.trimhist.Add(trimop);
-      b_trimA+=trimop.tlen;
-      if (!trimmedA) { num_trimA++; trimmedA=true; }
-    }
-    else
-    if (polyBothEnds && trim_poly3(ts.wseq, ts.w5, ts.w3, polyT_seed)) {
-      trim_code='T';
-      STrimOp trimop(3, trim_code, (ts.w5+(ts.wseq.length()-1-ts.w3)));
-     #ifdef TRIMDEBUG
-       GMessage("#DBG# 3' polyT trimming %d bases\n",trimop.tlen);
-     #endif
-      r.trimhist.Add(trimop);
-      b_trimT+=trimop.tlen;
-      if (!trimmedT) { num_trimT++; trimmedT=true; }
-    }
-    if (trim_code) {
-      ts.wupd=true;
-      if (ts.update(trim_code, r.trim5, r.trim3))
-         return trim_code;
-      trim_code=0;
+void extractUMI(RData& rd) {
+  FQ_PROF(FQP_UMI);
+  if (umi_len>0) { //move the UMI out of the read, before any trimming
+    if (rd.seq.length()>umi_len) {
+      rd.umi=rd.seq.substr(0, umi_len);
+      rd.seq.cut(0, umi_len);
+      if (!rd.qv.is_empty()) rd.qv.cut(0, umi_len);
     }
-   }
-   int tidx=-1;
-   if (ts.wupd && trim_adapter3(ts.wseq, ts.w5, ts.w3, tidx)) {
-       if (showAdapterIdx && tidx>=0) trim_code=('a'+tidx);
-         else trim_code='V';
-       STrimOp trimop(3, trim_code, (ts.w5+(ts.wseq.length()-1-ts.w3)));
-       #ifdef TRIMDEBUG
-          GMessage("#DBG# 3' adapter trimming %d bases\n",trimop.tlen);
-       #endif
-
-       r.trimhist.Add(trimop);
-       b_trimV+=trimop.tlen;
-       if (!trimmedV) { num_trimV++; trimmedV=true; }
-   }
-   if (trim_code) {
-    if (ts.update(trim_code, r.trim5, r.trim3))
-        return trim_code;
-    //wseq, w5, w3 were updated, let this fall through to next check
-    trim_code=0;
-   }
-   if (ts.w5upd) {
-    if (trim_poly5(ts.wseq, ts.w5, ts.w3, polyT_seed)) {
-        trim_code='T';
-        STrimOp trimop(5, trim_code,(ts.w5+(ts.wseq.length()-1-ts.w3)));
-        #ifdef TRIMDEBUG
-          GMessage("#DBG# 5' polyT trimming %d bases\n",trimop.tlen);
-        #endif
-        r.trimhist.Add(trimop);
-        b_trimT+=trimop.tlen;
-        if (!trimmedT) { num_trimT++; trimmedT=true; }
+    else { //no complete UMI, or nothing left after it: trash the read (pair)
+      rd.trashcode='s';
     }
-    else
-    if (polyBothEnds && trim_poly5(ts.wseq, ts.w5, ts.w3, polyA_seed)) {
-        trim_code='A';
-        STrimOp trimop(5, trim_code,(ts.w5+(ts.wseq.length()-1-ts.w3)));
-		#ifdef TRIMDEBUG
-		  GMessage("#DBG# 5' polyA trimming %d bases\n",trimop.tlen);
-		#endif
-        r.trimhist.Add(trimop);
-        b_trimA+=trimop.tlen;
-        if (!trimmedA) { num_trimA++; trimmedA=true; }
-    }
-    if (trim_code) {
-      ts.wupd=true;
-      if (ts.update(trim_code, r.trim5, r.trim3))
-         return trim_code;
-      trim_code=0;
-    }
-   }
-   tidx=-1;
-   if (ts.wupd && trim_adapter5(ts.wseq, ts.w5, ts.w3, tidx)) {
-      if (showAdapterIdx && tidx>=0) trim_code=('a'+tidx);
-   	   else trim_code='V';
-      STrimOp trimop(5, trim_code,(ts.w5+(ts.wseq.length()-1-ts.w3)));
-	  #ifdef TRIMDEBUG
-	    GMessage("#DBG# 5' adapter trimming %d bases\n",trimop.tlen);
-	  #endif
-      r.trimhist.Add(trimop);
-      b_trimV+=trimop.tlen;
-      if (!trimmedV) { num_trimV++; trimmedV=true; }
-      }
-  //checked the 3' end
-  if (trim_code) {
-    if (ts.update(trim_code, r.trim5, r.trim3))
-        return trim_code;
-    //wseq, w5, w3 were updated, let this fall through to next check
-    trim_code=0;
+    return;
   }
-  ts.w3upd=(r.trim3!=prev_t3);
-  ts.w5upd=(r.trim5!=prev_t5);
-  ts.wupd=(ts.w3upd || ts.w5upd);
-} while (ts.wupd);
-if (doCollapse) {
-   //keep read for later
-   FqDupRec* dr=dhash.Find(ts.wseq.chars());
-   if (dr==NULL) { //new entry
-          //if (prefix.is_empty())
-             dhash.Add(ts.wseq.chars(),
-                  new FqDupRec(&ts.wqv, r.rid.chars()));
-          //else dhash.Add(wseq.chars(), new FqDupRec(wqv.chars(),wqv.length()));
-         }
-      else
-         dr->add(ts.wqv);
-   } //collapsing duplicates
- else { //not collapsing duplicates
-   //apply the dust filter now
-   if (doDust) {
-     int dustbases=dust(ts.wseq);
-     if (dustbases>(ts.wseq.length()>>1)) {
-        return 'D';//trash code
-        }
-     }
-   } //not collapsing duplicates
-return (r.trim5>0 || r.trim3>0) ? 1 : 0;
-}
-
-void printHeader(FILE* f_out, char recmarker, RData& rd) { //GStr& rname, GStr& rinfo) {
- //GMessage("printing Header..%c%s\n",recmarker, rname.chars());
- fprintf(f_out, "%c%s",recmarker, rd.rid.chars());
- if (trimInfo) 
-    fprintf(f_out, " %d %d", rd.trim5, rd.trim3);
- if (!rd.rinfo.is_empty())
-    fprintf(f_out, " %s", rd.rinfo.chars());
- fprintf(f_out, "\n");
- }
-
-void write1Read(FILE* fout, RData& rd, int counter) {
-  //GStr& rname, GStr& rinfo, GStr& rseq, GStr& rqv,
-  GStr seq=rd.getTrimSeq();
-  GStr qv=rd.getTrimQv();
-  if (seq.is_empty()) {
-     seq="A";
-     qv="B";
+  //--umi hdr: last field of the read name (ignoring any /1,/2 mate suffix)
+  const char* rid=rd.rid.chars();
+  int e=rd.rid.length();
+  if (e>2 && rid[e-2]=='/') e-=2;
+  int p=e-1;
+  while (p>=0 && rid[p]!=':' && rid[p]!='_') p--;
+  if (p>=0 && validUMI(rid+p+1, e-p-1)) {
+    rd.umi=rd.rid.substr(p+1, e-p-1);
   }
-  bool asFasta=(rd.qv.is_empty() || fastaOutput);
-  if (asFasta) {
-   if (prefix.is_empty()) {
-      printHeader(fout, '>', rd);
-      //fprintf(fout, "%s\n", rd.seq.chars()); //plain one-line fasta for now
-      writeFasta(fout, NULL, NULL, seq.chars(), 100, seq.length());
-      }
-     else {
-      fprintf(fout, ">%s_%08d",prefix.chars(), counter);
-      if (trimInfo) 
-        fprintf(fout," %d %d", rd.trim5, rd.trim3);
-      //fprintf(fout, "\n%s\n", rd.seq.chars());
-      writeFasta(fout, NULL, NULL, seq.chars(), 100, seq.length());
-      }
-    }
-  else {  //fastq
-   if (convert_phred) convertPhred(qv);
-   if (prefix.is_empty()) {
-      printHeader(fout, '@', rd);
-      fprintf(fout, "%s\n+\n%s\n", seq.chars(), qv.chars());
-      }
-     else {
-      fprintf(fout, "@%s_%08d", prefix.chars(), counter);
-      if (trimInfo) 
-        fprintf(fout," %d %d", rd.trim5, rd.trim3);
-      fprintf(fout,"\n%s\n+\n%s\n", seq.chars(), qv.chars() );
-      }
+  else { //or a RX:Z: tag in the read comment
+    int t=rd.rinfo.index("RX:Z:");
+    if (t>=0) {
+      const char* u=rd.rinfo.chars()+t+5;
+      int ul=0;
+      while (u[ul]>' ') ul++;
+      if (validUMI(u, ul)) rd.umi=rd.rinfo.substr(t+5, ul);
     }
+  }
+  if (rd.umi.is_empty())
+    GError("Error: no UMI found in the header of read %s\n", rd.rid.chars());
+  rd.umi.upper();
 }
 
-void CTrimHandler::writeRead(RData& rd, RData* rd2) {
-    //output the read/pair after processing
-    //also implements pair survival decision logic
-#ifndef NOTHREADS
-	GLockGuard<GFastMutex> guard(writeMutex);
-#endif
-
-	if (show_Trim) { outcounter++; return; }
-	bool write1=false;
-	bool write2=false;
+void pairSurvival(RData& rd, RData* rd2, bool& keep1, bool& keep2) {
+	//pair survival decision logic (a pair without a UMI has both mates
+	//trashed, so it is discarded even with -s)
 	if (pairedOutput && rd2!=NULL) {
 		//paired reads output
 		if (shieldMate==1) { //read2 decides
-			write1=write2=(rd2->trashcode<=1);
+			keep1=keep2=(rd2->trashcode<=1);
 		}
 		else if (shieldMate==2) {
-			write1=write2=(rd.trashcode<=1);
+			keep1=keep2=(rd.trashcode<=1);
 		} else { //default pair rescue policy
-			write1=write2=(rd.trashcode<=1 || rd2->trashcode<=1);
+			keep1=keep2=(rd.trashcode<=1 || rd2->trashcode<=1);
 		}
 	}
 	else {
-		write1=(rd.trashcode<=1);
-		write2=(rd2!=NULL && rd2->trashcode<=1);
+		keep1=(rd.trashcode<=1);
+		keep2=(rd2!=NULL && rd2->trashcode<=1);
+	}
+}
+
+void collapseRead(RData& rd, RData* rd2) {
+	FQ_PROF(FQP_COLLAPSE);
+	//keep the read (pair) for later, in the duplicates table
+	bool keep1=false;
+	bool keep2=false;
+	pairSurvival(rd, rd2, keep1, keep2);
+	if (!pairedOutput || rd2==NULL) {
+		if (!keep1) return;
+		GStr seq=rd.getTrimSeq();
+		GStr qv=rd.getTrimQv();
+		if (!rd.umi.is_empty()) { //collapse on (UMI, sequence)
+			GStr useq(rd.umi);
+			useq.append(seq);
+			dspill.add(useq.chars(), useq.length(), qv.chars(), qv.length(), rd.rid.chars(),
+					0, rd.umi.length());
+			return;
+		}
+		dspill.add(seq.chars(), seq.length(), qv.chars(), qv.length(), rd.rid.chars());
+		return;
+	}
+	if (!keep1) return;
+	//collapse pairs on both mates: [UMI+]seq+seq2 with the mate 1 length as the key
+	GStr seq, qv, seq2, qv2;
+	getOutSeq(rd, seq, qv);
+	getOutSeq(*rd2, seq2, qv2);
+	int mlen=seq.length();
+	GStr key(rd.umi);
+	key.append(seq);
+	key.append(seq2);
+	if (qv.is_empty() || qv2.is_empty()) qv.clear();
+	else qv.append(qv2);
+	GStr rname(rd.rid);
+	rname.append(' ');
+	rname.append(rd2->rid);
+	dspill.add(key.chars(), key.length(), qv.chars(), qv.length(), rname.chars(), mlen,
+			rd.umi.length());
+}
+
+void CTrimHandler::sketchRead(RData& rd, RData* rd2) {
+	FQ_PROF(FQP_SKETCH);
+	//same reads (pairs) that would be collapsed by -C
+	bool keep1=false;
+	bool keep2=false;
+	pairSurvival(rd, rd2, keep1, keep2);
+	if (!keep1) return;
+	GStr seq=rd.getTrimSeq();
+	if (pairedOutput && rd2!=NULL) {
+		GStr seq2=rd2->getTrimSeq();
+		dupsketch->add(seq.chars(), seq.length(), seq2.chars(), seq2.length());
+	}
+	else dupsketch->add(seq.chars(), seq.length());
+}
+
+void CTrimHandler::qcRaw(RData& rd, RData* rd2) {
+	FQ_PROF(FQP_QC);
+	qc->stats[FQQC_RAW][0].add(rd.seq.chars(), rd.qv.is_empty() ? NULL : rd.qv.chars(),
+	    rd.seq.length());
+	if (rd2!=NULL)
+		qc->stats[FQQC_RAW][1].add(rd2->seq.chars(), rd2->qv.is_empty() ? NULL : rd2->qv.chars(),
+		    rd2->seq.length());
+}
+
+void CTrimHandler::qcTrimmed(RData& rd, RData* rd2) {
+	FQ_PROF(FQP_QC);
+	bool keep1=false;
+	bool keep2=false;
+	pairSurvival(rd, rd2, keep1, keep2);
+	RData* r[2]={ &rd, rd2 };
+	bool keep[2]={ keep1, keep2 };
+	for (int m=0;m<2;m++) {
+		if (!keep[m]) continue;
+		RData& d=*r[m];
+		int len=GMAX(0, d.seq.length()-d.trim5-d.trim3);
+		qc->stats[FQQC_TRIMMED][m].add(d.seq.chars()+d.trim5,
+		    d.qv.is_empty() ? NULL : d.qv.chars()+d.trim5, len);
 	}
+}
+
+void printDupStats(FqDupSketch& sketch) {
+  uint64 n=sketch.Count();
+  double d=sketch.distinct();
+  GMessage("\n------ Duplication estimate (sketch): ------\n");
+  GMessage("   Reads sketched :%12llu\n", n);
+  GMessage("  Distinct (est.) :%12.0f\n", d);
+  GMessage(" Duplication rate :%11.2f%%\n", n ? 100.0*(1.0-d/n) : 0.0);
+  int ntop=sketch.sortTop();
+  //only report counts clearly above the sketch error
+  uint32 mincount=GMAX(2, 2*sketch.noiseLevel());
+  if (ntop==0 || sketch.topItem(0).count<mincount) return;
+  GMessage("Most over-represented sequences (est. count, %% of reads):\n");
+  for (int i=0;i<ntop;i++) {
+    FqSkItem& it=sketch.topItem(i);
+    if (it.count<mincount) break;
+    GMessage("%10u %6.2f%%  %s\n", it.count, (100.0*it.count)/n, it.seq.chars());
+  }
+}
+
+void CTrimHandler::writeRead(RData& rd, RData* rd2) {
+    //output the read/pair after processing
+    //also implements pair survival decision logic
+	if (show_Trim) { outcounter++; return; }
+	bool write1=false;
+	bool write2=false;
+	pairSurvival(rd, rd2, write1, write2);
 	if (rinfo->f_out && write1) {
 		outcounter++;
-		write1Read(rinfo->f_out, rd, outcounter);
+		if (rinfo->bout) writeBinRead(*rinfo->bout, rd, outcounter);
+		else write1Read(rinfo->f_out, rd, outcounter);
 	}
 	if (rinfo->f_out2 && write2)  {
 		if (!pairedOutput) outcounter++;
-		write1Read(rinfo->f_out2, *rd2, outcounter);
+		if (rinfo->bout2) writeBinRead(*rinfo->bout2, *rd2, outcounter);
+		else write1Read(rinfo->f_out2, *rd2, outcounter);
 	}
 }
 
-//trim_report(char trimcode, GStr& rname, GVec<STrimOp>& t_hist, FILE* frep)
-void CTrimHandler::trim_report(RData& r, int mate) {
-	if (freport && r.trashcode) {
-#ifndef NOTHREADS
-		GLockGuard<GFastMutex> guard(reportMutex);
-#endif
-		GStr rname(r.rid);
-		if (rinfo && rinfo->fq2) {
-			if (mate) {
-				if (!rname.endsWith("/2")) rname+="/2";
-			}
-			else {
-				if (!rname.endsWith("/1")) rname+="/1";
-			}
-		}
-		if (r.trimhist.Count()==0) {
-			if (r.trashcode<=' ') r.trashcode='?';
-			fprintf(freport, "%s\t%c\t%c\n",rname.chars(), r.trashcode, r.trashcode);
-			return;
-		}
-		fprintf(freport, "%s\t", rname.chars());
-		for (int i=0;i<r.trimhist.Count();i++) {
-			fprintf(freport,"%d%c%d",r.trimhist[i].tend, r.trimhist[i].tcode, r.trimhist[i].tlen);
-			if (i<r.trimhist.Count()-1) fprintf(freport,",");
-		}
-		if (r.trashcode>' ') fprintf(freport, "\t%c\n", r.trashcode);
-		else fprintf(freport, "\t\n");
+//--obin: the same read as write1Read() would write
+void writeBinRead(FqBinWriter& w, RData& rd, uint64 counter) {
+	GStr name, seq, qv;
+	getOutName(rd, counter, name);
+	getOutSeq(rd, seq, qv);
+	bool asFasta=(rd.qv.is_empty() || fastaOutput);
+	if (w.phred==0 && !asFasta) { //Phred type of the qualities written
+		if (qv_phredtype==0) GError("Error: the Phred type of the reads is unknown!\n");
+		w.phred=qv_phredtype;
+		if (convert_phred) w.phred=(w.phred==33) ? 64 : 33;
 	}
+	if (!asFasta && convert_phred) convertPhred(qv);
+	w.add(name.chars(), name.length(), seq.chars(), asFasta ? NULL : qv.chars(),
+	    seq.length(), rd.trim5, rd.trim3);
+}
+
+//append the -r record of a trimmed or trashed read
+void CTrimHandler::trim_report(FqRepBuf& rep, RData& r, int mate) {
+	if (r.trimhist.Count()==0 && r.trashcode<=' ') r.trashcode='?';
+	FqRepRecord rr;
+	rr.name=r.rid.chars();
+	rr.nameLen=r.rid.length();
+	if (rinfo && rinfo->paired) rr.flags=mate ? FQREP_MATE2 : FQREP_MATE1;
+	rr.trashcode=r.trashcode;
+	rr.numOps=GMIN(r.trimhist.Count(), FQREP_MAX_OPS);
+	for (int i=0;i<rr.numOps;i++) {
+		rr.ops[i].tend=r.trimhist[i].tend;
+		rr.ops[i].tcode=r.trimhist[i].tcode;
+		rr.ops[i].tlen=r.trimhist[i].tlen;
+	}
+	if (reportBin) fqRepAddBin(rep, rr);
+	else fqRepAddText(rep, rr);
+}
+
+//-r: the report of the duplicates trashed by dust after collapsing
+void reportDusted(GStr& rname, int count) {
+	GStr name(rname);
+	name.append("_x");
+	name+=count;
+	FqRepRecord rr;
+	rr.name=name.chars();
+	rr.nameLen=name.length();
+	rr.flags=FQREP_DUP;
+	rr.trashcode='D';
+	FqRepBuf rep;
+	if (reportBin) fqRepAddBin(rep, rr);
+	else fqRepAddText(rep, rr);
+	rep.write(freport);
 }
 
 GStr getFext(GStr& s, int* xpos=NULL) {
@@ -2187,7 +1675,7 @@ FILE* prepOutFile(GStr& infname, GStr& pocmd) {
                  oname.append('.');
                  oname.append(outsuffix);
                }
-               f_out=fopen(oname.chars(),"w");
+               f_out=fopen(oname.chars(), binOutput ? "wb" : "w");
                if (f_out==NULL) GError("Error: cannot create file '%s'\n",oname.chars());
                }
             else {
@@ -2207,6 +1695,24 @@ FILE* prepOutFile(GStr& infname, GStr& pocmd) {
  return f_out;
 }
 
+void openReport(GStr& fname) {
+	if (fname=="-") freport=stdout;
+	else {
+		GStr zcmd;
+		GStr fext=getFext(fname);
+		if (fext=="gz" || fext=="gzip") zcmd="gzip -c >";
+		else if (fext=="bz2" || fext=="bzip2") zcmd="bzip2 -c >";
+		if (zcmd.is_empty()) freport=fopen(fname.chars(), "w");
+		else {
+			zcmd.append(fname);
+			freport=popen(zcmd.chars(), "w");
+			reportPiped=true;
+		}
+		if (freport==NULL) GError("Error creating file: %s\n", fname.chars());
+	}
+	if (reportBin) fwrite(FQREP_MAGIC, 1, FQREP_MAGIC_LEN, freport);
+}
+
 void guess_unzip(GStr& fname, GStr& picmd) {
  GStr fext=getFext(fname);
  if (fext=="gz" || fext=="gzip" || fext=="z") {
@@ -2217,70 +1723,6 @@ void guess_unzip(GStr& fname, GStr& picmd) {
     }
 }
 
-void addAdapter(GPVec<CASeqData>& adapters, GStr& seq, GAlnTrimType trim_type) {
-  if (seq.is_empty() || seq=="-" ||
-      seq=="N/A" || seq==".") return;
- ++adapter_idx;
- CASeqData* adata = new CASeqData(revCompl, adapter_idx);
- int idx=adapters.Add(adata);
- if (idx<0) GError("Error: failed to add adapter!\n");
- adapters[idx]->trim_type=trim_type;
- adapters[idx]->update(seq.chars());
- if (trim_type==galn_TrimEither) {
-  //special case, can only be used with adapters==adapters5
-  //add to adapters3 automatically
-  adapters3.Add(adata);
- }
- all_adapters.Add(adata);
-}
-
-
-int loadAdapters(const char* fname) {
-  GLineReader lr(fname);
-  char* l;
-  while ((l=lr.nextLine())!=NULL) {
-   if (lr.tlength()<=3 || l[0]=='#') continue;
-   if ( l[0]==' ' || l[0]=='\t' || l[0]==',' ||
-        l[0]==';'|| l[0]==':' ) { //starts with a delimiter
-       //so we're reading 3' adapter here
-      int i=1;
-      while (l[i]!=0 && isspace(l[i])) {
-        i++;
-        }
-      if (l[i]!=0) {
-        GStr s(&(l[i]));
-        addAdapter(adapters3, s, galn_TrimRight);
-        continue;
-        }
-      }
-    else {
-      //5' adapter (at least)
-      GStr s(l);
-      char lastc=s[s.length()-1];
-      s.startTokenize("\t ;,:");
-      GStr a5,a3;
-      if (s.nextToken(a5))
-            s.nextToken(a3);
-      else {
-         //GMessage("No token found on adapter line\n");
-         continue; //nothing on this line
-         }
-      bool nodelim=(lastc>='A');
-      GAlnTrimType ttype5=galn_TrimLeft;
-      //GMessage("tokens found: <%s> , <%s>\n",a5.chars(),a3.chars());
-      a5.upper();
-      a3.upper();
-      if ((a3.is_empty() && nodelim) || a3==a5 || a3=="=") {
-         a3.clear();
-         ttype5=galn_TrimEither;
-         }
-      addAdapter(adapters5, a5, ttype5);
-      addAdapter(adapters3, a3, galn_TrimRight);
-      }
-   }
-   return adapters5.Count()+adapters3.Count();
-}
-
 void setupFiles(FILE*& f_in, FILE*& f_in2, FILE*& f_out, FILE*& f_out2,
                        GStr& s, GStr& infname, GStr& infname2) {
 // uses outsuffix to generate output file names and open file handles as needed
@@ -2332,7 +1774,6 @@ void setupFiles(FILE*& f_in, FILE*& f_in2, FILE*& f_out, FILE*& f_out2,
    }
  f_out=prepOutFile(infname, pocmd);
  if (!paired) return;
- if (doCollapse) GError("Error: -C option cannot be used with paired reads!\n");
 
  // ---- paired reads:-------------
  if (fileExists(infname2.chars())==0)
@@ -2354,77 +1795,505 @@ void setupFiles(FILE*& f_in, FILE*& f_in2, FILE*& f_out, FILE*& f_out2,
 }
 
 #ifndef NOTHREADS
-void workerThread(GThreadData& td) {
-	CTrimHandler trimmer((RInfo*)td.udata);
-	trimmer.processAll();
-}
-#endif
+// Multi-threaded trimming: a pipeline of three stages connected by bounded
+// lock-free queues. The main thread reads batches of reads, num_cpus workers
+// trim them and a single writer thread writes them in input order (so the
+// output is the same as with -p 1). A fixed pool of batches is recycled
+// through the stages: the reader waits for a free batch when the workers or
+// the writer fall behind.
+// A worker taking a batch splits it into tasks of FQ_TASK_READS reads and
+// pushes them on its own deque; idle workers steal tasks from the other
+// deques, so a batch of slow reads does not hold back the end of the input.
+// The same threads are used for all the input files: the reader goes on to
+// the next file right away, after queuing an empty batch marking the end of
+// the current one, and the writer finishes a file (collapsing, stats) when
+// it gets to that batch, so the tail of a file overlaps the next file's start.
+// With --pin each worker is pinned to a CPU and there is a work queue for
+// each NUMA node used: a batch always goes to the same queue, and the reader
+// allocates its reads in the memory of that node, so they are trimmed by
+// workers local to it; a worker only takes batches from another node's
+// queue (and steals tasks from workers on other nodes) when it's idle.
+struct STrimPipeline;
+
+struct SPipeWorker {
+	STrimPipeline* pl;
+	int idx;
+	int cpu; //--pin placement
+	int node;
+	int queue; //work queue of this worker's node
+	bool pinned; //the placement was applied
+	bool memLocal; //..and so was the memory policy
+	FqDeque<STrimTask> tasks;
+	uint64 numTasks; //tasks run by this worker
+	uint64 numStolen; //..of which stolen from other workers
+	SPipeWorker():pl(NULL), idx(0), cpu(-1), node(-1), queue(0), pinned(false),
+	    memLocal(false), tasks(FQ_MAX_TASKS), numTasks(0), numStolen(0) { }
+};
 
-void CTrimHandler::processAll() {
-	if (fetchReads()) {
-		while (processRead()) {
-			if (rbuf_p<=0) {
-				flushReads(); //flush the read buffers
-				if (!fetchReads()) break;
+struct STrimPipeline {
+	int numBatches;
+	SReadBatch* batches;
+	SPipeWorker* workers;
+	int numQueues;
+	int queueNode[FQNUMA_MAX_NODES]; //NUMA node of each work queue (-1: any)
+	FqQueue<SReadBatch> freeQ; //batches ready to be loaded
+	FqQueue<SReadBatch>* workQ[FQNUMA_MAX_NODES]; //loaded batches
+	FqQueue<SReadBatch> doneQ; //trimmed batches, in any order
+	uint64 pendingTasks; //tasks queued or running, in all the workers
+	uint64 trimNs; //time spent trimming by all the workers
+	uint64 trimBytes; //size of the batches trimmed
+	uint64 numLoaded; //total batches loaded, valid once inputDone is set
+	bool inputDone;
+	//topo!=NULL: --pin placement
+	STrimPipeline(int nbatches, FqTopology* topo):numBatches(nbatches), batches(NULL),
+	     workers(NULL), numQueues(1), freeQ(nbatches), doneQ(nbatches),
+	     pendingTasks(0), trimNs(0), trimBytes(0), numLoaded(0), inputDone(false) {
+		queueNode[0]=-1;
+		workers=new SPipeWorker[num_cpus];
+		for (int i=0;i<num_cpus;i++) {
+			SPipeWorker& w=workers[i];
+			w.pl=this;
+			w.idx=i;
+			if (topo==NULL) continue;
+			w.cpu=topo->cpu(i);
+			w.node=topo->node(i);
+			w.queue=-1;
+			for (int q=0;q<numQueues;q++)
+				if (queueNode[q]==w.node) w.queue=q;
+			if (w.queue<0) { //first worker on this node
+				if (queueNode[0]<0) numQueues=0;
+				w.queue=numQueues++;
+				queueNode[w.queue]=w.node;
 			}
 		}
+		for (int q=0;q<numQueues;q++)
+			workQ[q]=new FqQueue<SReadBatch>(nbatches);
+		batches=new SReadBatch[numBatches];
+		for (int i=0;i<numBatches;i++) {
+			//as many batches for each node as it has workers
+			batches[i].queue=workers[i % num_cpus].queue;
+			freeQ.push(&batches[i]);
+		}
+	}
+	~STrimPipeline() {
+		for (int q=0;q<numQueues;q++) delete workQ[q];
+		delete[] workers;
+		delete[] batches;
+	}
+};
+
+//a batch from the worker's own queue, or from another node's
+SReadBatch* takeBatch(SPipeWorker& w) {
+	STrimPipeline* pl=w.pl;
+	SReadBatch* b=NULL;
+	for (int i=0;i<pl->numQueues;i++)
+		if (pl->workQ[(w.queue+i) % pl->numQueues]->pop(b)) return b;
+	return NULL;
+}
+
+//queue all the tasks of a new batch but the first one, which is returned
+STrimTask* splitBatch(SPipeWorker& w, SReadBatch& b) {
+	int tsize=GMAX(FQ_TASK_READS, (b.count+FQ_MAX_TASKS-1)/FQ_MAX_TASKS);
+	int ntasks=GMAX(1, (b.count+tsize-1)/tsize); //an end of file batch is one empty task
+	for (int i=0;i<ntasks;i++) {
+		b.tasks[i].batch=&b;
+		b.tasks[i].start=i*tsize;
+		b.tasks[i].end=GMIN(b.count, (i+1)*tsize);
 	}
+	b.numTasks=ntasks;
+	b.pending=ntasks;
+	__atomic_add_fetch(&w.pl->pendingTasks, ntasks, __ATOMIC_RELEASE);
+	for (int i=ntasks-1;i>0;i--)
+		w.tasks.push(&b.tasks[i]); //the deque is empty here, it cannot fail
+	return &b.tasks[0];
 }
 
-void CTrimHandler::updateTrashCounts(RData& rd) {
-	if (rd.trashcode>1) { //read/pair trashed
-		if (rd.trashcode=='s') trash_s++;
-		else if (rd.trashcode=='A' || rd.trashcode=='T') trash_poly++;
-		else if (rd.trashcode=='Q') trash_Q++;
-		else if (rd.trashcode=='N') trash_N++;
-		else if (rd.trashcode=='D') trash_D++;
-		else if (rd.trashcode=='V') trash_V++;
-		else {
-			trash_X++;
+STrimTask* stealTask(SPipeWorker& w, uint32& rnd) {
+	if (num_cpus<2) return NULL;
+	rnd^=rnd<<13; //xorshift, to pick the first victim
+	rnd^=rnd>>17;
+	rnd^=rnd<<5;
+	//workers on the same node first
+	for (int remote=0;remote<=(w.pl->numQueues>1 ? 1 : 0);remote++) {
+		int v=rnd % num_cpus;
+		for (int i=0;i<num_cpus;i++, v=(v+1) % num_cpus) {
+			SPipeWorker& victim=w.pl->workers[v];
+			bool isRemote=(victim.queue!=w.queue);
+			if (v==w.idx || isRemote!=(remote==1)) continue;
+			STrimTask* t=NULL;
+			if (victim.tasks.steal(t)) {
+				w.numStolen++;
+				return t;
+			}
 		}
 	}
+	return NULL;
+}
 
+void pipeWorker(GThreadData& td) {
+	SPipeWorker* w=(SPipeWorker*)td.udata;
+	STrimPipeline* pl=w->pl;
+	fqProfThread();
+	fqTraceThread("worker", w->idx);
+	if (w->cpu>=0 && (w->pinned=fqPinThread(w->cpu)))
+		w->memLocal=fqPreferNode(w->node);
+	CTrimHandler trimmer(w->idx); //alignment buffers allocated after pinning
+	FqBackoff wait(FQP_WAIT_WORK);
+	uint32 rnd=2654435761U*(w->idx+1);
+	while (true) {
+		STrimTask* t=NULL;
+		bool inputEnd=false;
+		if (!w->tasks.pop(t)) {
+			//seen before looking at the queues: no batch can be added after that
+			inputEnd=__atomic_load_n(&pl->inputDone, __ATOMIC_ACQUIRE);
+			SReadBatch* b=takeBatch(*w);
+			t=(b!=NULL) ? splitBatch(*w, *b) : stealTask(*w, rnd);
+		}
+		if (t==NULL) {
+			if (inputEnd && __atomic_load_n(&pl->pendingTasks, __ATOMIC_ACQUIRE)==0)
+				break;
+			wait.pause();
+			continue;
+		}
+		wait.reset();
+		SReadBatch* b=t->batch;
+		uint64 t0=fqNanoTime();
+		trimmer.processReads(*b, t->start, t->end, t->report);
+		trimmer.moveCounts(); //before the batch can reach the writer
+		uint64 t1=fqNanoTime();
+		__atomic_add_fetch(&pl->trimNs, t1-t0, __ATOMIC_RELAXED);
+		if (fqTrace) fqTrace->add("trim", t0, t1, b->id);
+		w->numTasks++;
+		if (__atomic_sub_fetch(&b->pending, 1, __ATOMIC_ACQ_REL)==0) {
+			__atomic_add_fetch(&pl->trimBytes, b->bytes, __ATOMIC_RELAXED);
+			pl->doneQ.push(b); //never full, it can hold all the batches
+		}
+		__atomic_sub_fetch(&pl->pendingTasks, 1, __ATOMIC_RELEASE);
+	}
 }
 
-bool CTrimHandler::processRead() {
-	RData* rd=NULL;
-	RData* rd2=NULL; //mate data, if any
-	if (nextRead(rd, rd2)) {
-		if (shieldMate!=1) {
-			rd->trashcode=process_read(*rd);
-			//trashcode: 0 if the read was not trimmed at all and it's long enough
-			//       1 if it was just trimmed but survived,
-			//       >1 (=trash code character ) if it was trashed for any reason
-#ifdef TRIMDEBUG
-			if (rd->trim5>0 || rd->trim3<rd->seq.length()-1) {
-				char tc=(rd->trashcode>32)? rd->trashcode : ('0'+rd->trashcode);
-				GMessage("####> Trim code [%c] ( trim5=%d, trim3=%d): \n",tc, rd->trim5,rd->trim3);
-				showTrim(*rd);
+void pipeWriter(GThreadData& td) {
+	STrimPipeline* pl=(STrimPipeline*)td.udata;
+	fqProfThread();
+	fqTraceThread("writer");
+	CTrimHandler writer(num_cpus, false);
+	//at most numBatches are in flight, so a trimmed batch waiting
+	//for its turn can be parked in slot (id % numBatches)
+	SReadBatch** pending=new SReadBatch*[pl->numBatches];
+	for (int i=0;i<pl->numBatches;i++) pending[i]=NULL;
+	uint64 nextId=0;
+	FqBackoff wait(FQP_WAIT_DONE);
+	while (true) {
+		int slot=(int)(nextId % pl->numBatches);
+		SReadBatch* b=pending[slot];
+		if (b!=NULL) {
+			pending[slot]=NULL;
+			{
+			FQ_TRACE("write batch", b->id);
+			writer.flushBatch(*b);
 			}
-			else {
-				GMessage("####> No trimming for this read.\n");
+			if (fqLiveOn) fqLiveUpdate(writer.tid, writer, writer.livePrev);
+			if (b->last) { //all the reads of this file were written
+				RInfo* ri=b->rinfo;
+				writer.moveCounts();
+				FQ_TRACE("finish file", -1);
+				finishFile(*ri);
+				delete ri;
 			}
-#endif
-			if (show_Trim) {
-				showTrim(*rd);
+			pl->freeQ.push(b);
+			nextId++;
+			wait.reset();
+			continue;
+		}
+		if (pl->doneQ.pop(b)) {
+			pending[b->id % pl->numBatches]=b;
+			continue;
+		}
+		if (__atomic_load_n(&pl->inputDone, __ATOMIC_ACQUIRE) && nextId==pl->numLoaded)
+			break;
+		wait.pause();
+	}
+	delete[] pending;
+}
+
+// Adaptive batch size (-p without --batch): every numBatches batches loaded,
+// the reader estimates how long a batch of the current size takes to trim,
+// from the time and bytes reported by the workers since the last check, and
+// halves or doubles the size to keep that around FQ_BATCH_MS: large enough
+// for the queue hand-offs to be negligible, small enough for the tasks to
+// balance well and to bound the memory of the batches in flight.
+// Batches are not made larger while the workers are starved (the work queue
+// is mostly empty when a new batch is queued), that would only delay the
+// work for the idle threads.
+struct SBatchSizer {
+	uint64 size;
+	uint64 minSize; //smallest and largest sizes used
+	uint64 maxSize;
+	uint64 limit; //upper limit for the size
+	int numChanges;
+	uint64 lastNs; //worker totals at the last check
+	uint64 lastBytes;
+	uint64 qsum; //work queue occupancy samples since the last check
+	uint64 qsamples;
+	SBatchSizer(uint64 bsize, int nbatches):size(bsize), minSize(bsize), maxSize(bsize),
+	    limit(0), numChanges(0), lastNs(0), lastBytes(0), qsum(0), qsamples(0) {
+		limit=GMAX(FQ_BATCH_MIN, GMIN(FQ_BATCH_MAX, FQ_PIPE_MAXMEM/nbatches));
+	}
+	void sample(uint64 qcount) { qsum+=qcount; qsamples++; }
+	void adapt(uint64 ns, uint64 bytes) {
+		if (bytes==lastBytes) return; //nothing trimmed since the last check
+		double ms=(double)(ns-lastNs)*size/(bytes-lastBytes)/1e6;
+		bool starved=(qsum*2<qsamples);
+		lastNs=ns;
+		lastBytes=bytes;
+		qsum=0;
+		qsamples=0;
+		uint64 nsize=size;
+		if (ms>2*FQ_BATCH_MS || (starved && ms>FQ_BATCH_MS))
+			nsize=GMAX(size>>1, FQ_BATCH_MIN);
+		else if (ms*2<FQ_BATCH_MS && !starved)
+			nsize=GMIN(size<<1, limit);
+		if (nsize==size) return;
+		size=nsize;
+		numChanges++;
+		if (size<minSize) minSize=size;
+		if (size>maxSize) maxSize=size;
+	}
+};
+
+void reportPlacement(STrimPipeline& pl) {
+	int npinned=0, nlocal=0;
+	for (int t=0;t<num_cpus;t++) {
+		if (pl.workers[t].pinned) npinned++;
+		if (pl.workers[t].memLocal) nlocal++;
+	}
+	GMessage("Pinned %d of %d workers, on %d NUMA node(s)", npinned, num_cpus, pl.numQueues);
+	if (nlocal<npinned)
+		GMessage(" (no NUMA memory policy for %d of them)", npinned-nlocal);
+	GMessage(":\n");
+	for (int q=0;q<pl.numQueues;q++) {
+		GVec<int> cpus;
+		int nw=0;
+		for (int t=0;t<num_cpus;t++) {
+			SPipeWorker& w=pl.workers[t];
+			if (w.queue!=q || !w.pinned) continue;
+			nw++;
+			bool dup=false; //more workers than CPUs
+			for (int i=0;i<cpus.Count();i++)
+				if (cpus[i]==w.cpu) dup=true;
+			if (!dup) cpus.Add(w.cpu);
+		}
+		GMessage("  node %d: %d workers on CPUs %s\n", pl.queueNode[q], nw,
+		    fqCpuList(cpus).chars());
+	}
+}
+
+//--stats-file: queue depths of the pipeline, called by the live stats thread
+void pipeQueueDepths(void* data, int64* depths) {
+	STrimPipeline* pl=(STrimPipeline*)data;
+	depths[FQLQ_FREE]=pl->freeQ.Count();
+	int64 nwork=0;
+	for (int q=0;q<pl->numQueues;q++) nwork+=pl->workQ[q]->Count();
+	depths[FQLQ_WORK]=nwork;
+	depths[FQLQ_TASKS]=__atomic_load_n(&pl->pendingTasks, __ATOMIC_RELAXED);
+	depths[FQLQ_DONE]=pl->doneQ.Count();
+}
+
+void runPipeline(GArgs& args) {
+	FqTopology topo;
+	if (pinThreads && !topo.load()) {
+		GMessage("Warning: cannot get the CPU placement, --pin ignored\n");
+		pinThreads=false;
+	}
+	STrimPipeline pl(num_cpus*FQ_BATCHES_PER_CPU, pinThreads ? &topo : NULL);
+	fqLiveSetQueues(pipeQueueDepths, &pl);
+	SBatchSizer bsizer(batch_size, pl.numBatches);
+	GThread* workers=new GThread[num_cpus];
+	for (int t=0;t<num_cpus;t++)
+		workers[t].kickStart(pipeWorker, &pl.workers[t]);
+	GThread writer;
+	writer.kickStart(pipeWriter, &pl);
+	uint64 nloaded=0;
+	uint64 nreads=0;
+	int nfiles=0;
+	int memq=-1; //node the reader is allocating batches on
+	FqBackoff wait(FQP_WAIT_FREE);
+	char* infile=NULL;
+	while ((infile=args.nextNonOpt())!=NULL) {
+		GStr s(infile);
+		RInfo* ri=openInput(s);
+		nfiles++;
+		bool more=true;
+		while (more) {
+			SReadBatch* b=NULL;
+			if (!pl.freeQ.pop(b)) { //all batches busy
+				wait.pause();
+				continue;
 			}
-			if (rd->trim5>0) {
-				b_trim5+=rd->trim5;
-				num_trim5++;
+			wait.reset();
+			if (pl.numQueues>1 && b->queue!=memq) {
+				memq=b->queue;
+				fqPreferNode(pl.queueNode[memq]);
 			}
-			if (rd->trim3>0) {
-				b_trim3+=rd->trim3;
-				num_trim3++;
+			b->id=nloaded++;
+			{
+			FQ_TRACE("read batch", b->id);
+			more=readBatch(*ri, *b, bsizer.size);
 			}
+			b->last=!more; //the writer finishes the file after this batch
+			nreads+=b->count;
+			bsizer.sample(pl.workQ[b->queue]->Count());
+			pl.workQ[b->queue]->push(b);
+			if (!batch_fixed && nloaded % pl.numBatches==0)
+				bsizer.adapt(__atomic_load_n(&pl.trimNs, __ATOMIC_RELAXED),
+				    __atomic_load_n(&pl.trimBytes, __ATOMIC_RELAXED));
 		}
-		if (rinfo->fq2!=NULL && rd2!=NULL) { //paired
-			if (!disableMateNameCheck && rd->rid.length()>4 && rd2->rid.length()>=rd->rid.length()) {
-				if (rd->rid.substr(0,rd->rid.length()-3)!=rd2->rid.substr(0,rd->rid.length()-3)) {
-					GError("Error: no paired match for read %s vs %s (%s,%s)\n",
-							rd->rid.chars(), rd2->rid.chars(), rinfo->infname.chars(), rinfo->infname2.chars());
-				}
+		closeInput(*ri);
+	}
+	if (memq>=0) fqPreferNode(-1);
+	pl.numLoaded=nloaded;
+	__atomic_store_n(&pl.inputDone, true, __ATOMIC_RELEASE);
+	for (int t=0;t<num_cpus;t++)
+		workers[t].join();
+	writer.join();
+	fqLiveSetQueues(NULL, NULL);
+	delete[] workers;
+	if (verbose) {
+		uint64 ntasks=0, nstolen=0;
+		for (int t=0;t<num_cpus;t++) {
+			ntasks+=pl.workers[t].numTasks;
+			nstolen+=pl.workers[t].numStolen;
+		}
+		GMessage("Trimmed %llu batches of %d input file(s) in %llu tasks (%llu stolen) using %d threads\n",
+				nloaded-nfiles, nfiles, ntasks-nfiles, nstolen, num_cpus);
+		reportBatches(nloaded-nfiles, nreads, bsizer.minSize, bsizer.maxSize, bsizer.numChanges);
+		if (pinThreads) reportPlacement(pl);
+	}
+}
+#endif
+
+void CTrimHandler::processAll(RInfo& ri) {
+	uint64 nbatches=0, nreads=0;
+	rinfo=&ri;
+	while (true) {
+		rbatch.id=nbatches;
+		{
+		FQ_TRACE("read batch", rbatch.id);
+		if (!readBatch(ri, rbatch, batch_size)) break;
+		}
+		nbatches++;
+		nreads+=rbatch.count;
+		{
+		FQ_TRACE("trim", rbatch.id);
+		processBatch(rbatch);
+		}
+		{
+		FQ_TRACE("write batch", rbatch.id);
+		flushBatch(rbatch);
+		}
+		if (fqLiveOn) {
+			fqLiveUpdate(tid, *this, livePrev);
+			fqLiveTick();
+		}
+	}
+	moveCounts();
+	if (verbose) reportBatches(nbatches, nreads, batch_size, batch_size, 0);
+}
+
+void reportBatches(uint64 nbatches, uint64 nreads, uint64 minsize, uint64 maxsize, int nchanges) {
+	if (nbatches==0) return;
+	double rpb=(double)nreads/nbatches;
+	if (nchanges==0)
+		GMessage("Read batches of %lluK (%.0f reads per batch on average)\n", minsize>>10, rpb);
+	else
+		GMessage("Read batches of %lluK to %lluK (size adapted %d times, %.0f reads per batch on average)\n",
+		    minsize>>10, maxsize>>10, nchanges, rpb);
+}
+
+void CTrimHandler::processReads(SReadBatch& b, int start, int end, FqRepBuf& rep) {
+	rinfo=b.rinfo;
+	if (doDupStat) dupsketch=rinfo->sketch(tid);
+	if (gqc) qc=rinfo->qc(tid);
+	if (gadstats) adstats=rinfo->adStats(tid);
+	int h=(qc ? FQH_QC : 0) | (dupsketch ? FQH_SKETCH : 0) | (trimReport ? FQH_REPORT : 0);
+	switch (h) {
+		case 0: processReads_t<0>(b, start, end, rep); break;
+		case 1: processReads_t<1>(b, start, end, rep); break;
+		case 2: processReads_t<2>(b, start, end, rep); break;
+		case 3: processReads_t<3>(b, start, end, rep); break;
+		case 4: processReads_t<4>(b, start, end, rep); break;
+		case 5: processReads_t<5>(b, start, end, rep); break;
+		case 6: processReads_t<6>(b, start, end, rep); break;
+		default: processReads_t<7>(b, start, end, rep);
+	}
+}
+
+template<int H> void CTrimHandler::processReads_t(SReadBatch& b, int start, int end, FqRepBuf& rep) {
+	for (int i=start;i<end;i++) {
+		RData* rd=&(b.reads[i]);
+		RData* rd2=rinfo->paired ? &(b.mates[i]) : NULL;
+		if (H & FQH_QC) qcRaw(*rd, rd2);
+		processRead(rd, rd2);
+		if (H & FQH_SKETCH) sketchRead(*rd, rd2);
+		if (H & FQH_REPORT) {
+			if (rd->trashcode>0) trim_report(rep, *rd);
+			if (rd2!=NULL && !rd2->seq.is_empty() && rd2->trashcode>0)
+				trim_report(rep, *rd2, 1);
+		}
+		if (H & FQH_QC) qcTrimmed(*rd, rd2);
+	}
+}
+
+void CTrimHandler::updateTrashCounts(RData& rd) {
+	countTrashed(rd.trashcode);
+}
+
+void CTrimHandler::processRead(RData* rd, RData* rd2) {
+	FQ_PROF(FQP_TRIM);
+	++incounter;
+	if (doUMI) { //the UMI applies to the whole pair
+		extractUMI(*rd);
+		if (rd2!=NULL) {
+			rd2->umi=rd->umi;
+			rd2->trashcode=rd->trashcode; //'s' for both mates if no UMI
+		}
+	}
+	if (shieldMate!=1 && rd->trashcode==0) {
+		rd->trashcode=process_read(*rd);
+		//trashcode: 0 if the read was not trimmed at all and it's long enough
+		//       1 if it was just trimmed but survived,
+		//       >1 (=trash code character ) if it was trashed for any reason
+#ifdef TRIMDEBUG
+		if (rd->trim5>0 || rd->trim3<rd->seq.length()-1) {
+			char tc=(rd->trashcode>32)? rd->trashcode : ('0'+rd->trashcode);
+			GMessage("####> Trim code [%c] ( trim5=%d, trim3=%d): \n",tc, rd->trim5,rd->trim3);
+			showTrim(*rd);
+		}
+		else {
+			GMessage("####> No trimming for this read.\n");
+		}
+#endif
+		if (show_Trim) {
+			showTrim(*rd);
+		}
+		if (rd->trim5>0) {
+			b_trim5+=rd->trim5;
+			num_trim5++;
+		}
+		if (rd->trim3>0) {
+			b_trim3+=rd->trim3;
+			num_trim3++;
+		}
+	}
+	if (rinfo->paired && rd2!=NULL) { //paired
+		if (!disableMateNameCheck && rd->rid.length()>4 && rd2->rid.length()>=rd->rid.length()) {
+			if (rd->rid.substr(0,rd->rid.length()-3)!=rd2->rid.substr(0,rd->rid.length()-3)) {
+				GError("Error: no paired match for read %s vs %s (%s,%s)\n",
+						rd->rid.chars(), rd2->rid.chars(), rinfo->infname.chars(), rinfo->infname2.chars());
 			}
-			if (shieldMate!=2) {
+		}
+		if (shieldMate!=2) {
+			if (rd2->trashcode==0) {
 				rd2->trashcode=process_read(*rd2);
 				if (rd2->trim5>0) {
 					b_trim5+=rd2->trim5;
@@ -2434,12 +2303,10 @@ bool CTrimHandler::processRead() {
 					b_trim3+=rd2->trim3;
 					num_trim3++;
 				}
-				updateTrashCounts(*rd2);
 			}
-		} //paired
-		updateTrashCounts(*rd);
-		return true;
-	} //proceed read/pair
-	return false;
+			updateTrashCounts(*rd2);
+		}
+	} //paired
+	updateTrashCounts(*rd);
 }
 
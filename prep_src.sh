@@ -12,7 +12,7 @@ mkdir $pack
 mkdir $pack/gclib
 sed 's|\.\./gclib|./gclib|' Makefile > $pack/Makefile
 libdir=fqtrim-$ver/gclib/
-cp LICENSE README fqtrim.cpp fqtrim-$ver/
+cp LICENSE README fqtrim.cpp fqkernels.{h,cpp} fqsimd.{h,cpp} fqkref.{h,cpp} fqdups.{h,cpp} fqsketch.{h,cpp} fqqc.{h,cpp} fqadstats.{h,cpp} fqpipe.h fqnuma.{h,cpp} fqprof.{h,cpp} fqtrace.{h,cpp} fqjson.{h,cpp} fqlive.{h,cpp} fqrep.{h,cpp} fqbin.{h,cpp} fqbinout.{h,cpp} fqlib.{h,cpp} fqgen.{h,cpp} fqbench.cpp fqkbench.cpp fqcheck.cpp fqtrim-$ver/
 cp ../gclib/{GVec,GList,GHash}.hh $libdir
 cp ../gclib/{GAlnExtend,GArgs,GBase,gdna,GStr,GThreads}.{h,cpp} $libdir
 tar cvfz $pack.tar.gz $pack